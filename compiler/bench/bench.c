@@ -0,0 +1,431 @@
+/* ================
+ * bench/bench.c
+ * VALLEY LANGUAGE COMPILER
+ * Lexer and parser throughput benchmark over synthetic corpora
+ * ================
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <math.h>
+
+#include "../include/valley.h"
+#include "../include/tokens.h"
+
+
+// ---- HEAP COUNTING ---- //
+
+// Linked with --wrap so that every malloc, calloc and realloc made by valley_core lands here too
+static size_t vlHeapAllocations;
+
+#ifdef VL_BENCH_COUNT_HEAP
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+void* __wrap_malloc(size_t size) {
+    ++vlHeapAllocations;
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+    ++vlHeapAllocations;
+    return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+    ++vlHeapAllocations;
+    return __real_realloc(ptr, size);
+}
+#endif
+
+
+// ---- CORPUS ---- //
+
+typedef struct VLCorpus {
+    char* data;
+    size_t len;
+    size_t capacity;
+    uint64_t state;
+} VLCorpus;
+
+
+static void vlCorpusPrintf(VLCorpus* corpus, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(corpus->data + corpus->len, corpus->capacity - corpus->len, format, args);
+    va_end(args);
+    if (len < 0) return;
+
+    if (corpus->len + (size_t) len + 1 > corpus->capacity) {
+        corpus->capacity = (corpus->len + (size_t) len + 1) * 2;
+        corpus->data = realloc(corpus->data, corpus->capacity);
+        if (!corpus->data) {
+            printf("Out of memory.\n");
+            exit(1);
+        }
+        va_start(args, format);
+        vsnprintf(corpus->data + corpus->len, corpus->capacity - corpus->len, format, args);
+        va_end(args);
+    }
+    corpus->len += (size_t) len;
+}
+
+
+// splitmix64, so a seed always yields the same corpus
+static uint64_t vlCorpusRandom(VLCorpus* corpus) {
+    uint64_t z = (corpus->state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+
+static size_t vlCorpusPick(VLCorpus* corpus, size_t count) {
+    return (size_t) (vlCorpusRandom(corpus) % count);
+}
+
+
+// Names always end in a digit, so they can never collide with a keyword
+static void vlCorpusName(VLCorpus* corpus, char* name, size_t maxLen) {
+    static const char letters[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_";
+    size_t len = 2 + vlCorpusPick(corpus, maxLen - 2);
+    for (size_t i = 0; i < len; ++i) name[i] = letters[vlCorpusPick(corpus, sizeof(letters) - 1)];
+    name[len] = (char) ('0' + vlCorpusPick(corpus, 10));
+    name[len + 1] = '\0';
+}
+
+
+// ---- GENERATORS ---- //
+
+static void vlGenIdentifiers(VLCorpus* corpus) {
+    char a[24], b[24], c[24], d[24];
+    vlCorpusName(corpus, a, 20);
+    vlCorpusName(corpus, b, 20);
+    vlCorpusName(corpus, c, 20);
+    vlCorpusName(corpus, d, 20);
+    switch (vlCorpusPick(corpus, 3)) {
+        case 0: vlCorpusPrintf(corpus, "%s %s = %s.%s;\n", a, b, c, d); break;
+        case 1: vlCorpusPrintf(corpus, "%s = %s(%s, %s.%s);\n", a, b, c, d, a); break;
+        default: vlCorpusPrintf(corpus, "%s.%s[%s] = %s;\n", a, b, c, d); break;
+    }
+}
+
+
+static void vlGenLiterals(VLCorpus* corpus) {
+    static const char* strings[] = {"hello, world", "tab\\there", "line\\n", "quote \\\"this\\\"", "valley"};
+    uint64_t r = vlCorpusRandom(corpus);
+    switch (vlCorpusPick(corpus, 5)) {
+        case 0: vlCorpusPrintf(corpus, "int i = %u;\n", (unsigned) (r % 2000000000)); break;
+        case 1: vlCorpusPrintf(corpus, "long l = %llul;\n", (unsigned long long) (r >> 2)); break;
+        case 2: vlCorpusPrintf(corpus, "double d = %.9f;\n", (double) (r >> 11) / 9007199254740992.0 * 1e6); break;
+        case 3: vlCorpusPrintf(corpus, "float f = %.6ff;\n", (double) (r % 100000) / 1000.0); break;
+        default:
+            vlCorpusPrintf(corpus, "str s = \"%s %llu\";\n", strings[r % 5], (unsigned long long) (r >> 40));
+            break;
+    }
+}
+
+
+static void vlGenComments(VLCorpus* corpus) {
+    static const char* words[] = {"the", "parser", "keeps", "every", "token", "in", "a", "packed", "stream", "so"};
+    if (vlCorpusPick(corpus, 2)) {
+        vlCorpusPrintf(corpus, "//");
+        for (size_t i = 4 + vlCorpusPick(corpus, 12); i; --i) {
+            vlCorpusPrintf(corpus, " %s", words[vlCorpusPick(corpus, 10)]);
+        }
+        vlCorpusPrintf(corpus, "\n");
+    } else {
+        vlCorpusPrintf(corpus, "/*");
+        for (size_t i = 8 + vlCorpusPick(corpus, 40); i; --i) {
+            vlCorpusPrintf(corpus, i % 8 ? " %s" : "\n * %s", words[vlCorpusPick(corpus, 10)]);
+        }
+        vlCorpusPrintf(corpus, "\n */\n");
+    }
+    if (!vlCorpusPick(corpus, 4)) {
+        vlCorpusPrintf(corpus, "x%zu = y%zu;\n", vlCorpusPick(corpus, 10), vlCorpusPick(corpus, 10));
+    }
+}
+
+
+static void vlGenOperators(VLCorpus* corpus) {
+    static const char* binary[] = {"+", "-", "*", "/", "%", "**", "&", "|", "^", "<<", ">>", "&&", "||", "==",
+                                   "!=", "<", ">=", "^^"};
+    static const char* assign[] = {"=", "+=", "-=", "*=", "/=", "<<=", "&=", "|="};
+    vlCorpusPrintf(corpus, "v%zu %s ", vlCorpusPick(corpus, 10), assign[vlCorpusPick(corpus, 8)]);
+    for (size_t i = 4 + vlCorpusPick(corpus, 12); i; --i) {
+        switch (vlCorpusPick(corpus, 6)) {
+            case 0: vlCorpusPrintf(corpus, "-"); break;
+            case 1: vlCorpusPrintf(corpus, "~"); break;
+            case 2: vlCorpusPrintf(corpus, "!"); break;
+            default: break;
+        }
+        vlCorpusPrintf(corpus, "v%zu %s ", vlCorpusPick(corpus, 10), binary[vlCorpusPick(corpus, 18)]);
+    }
+    vlCorpusPrintf(corpus, "v%zu;\n", vlCorpusPick(corpus, 10));
+}
+
+
+static void vlGenNestedLevel(VLCorpus* corpus, size_t depth) {
+    if (!depth) {
+        size_t parens = 1 + vlCorpusPick(corpus, 24);
+        vlCorpusPrintf(corpus, "x = ");
+        for (size_t i = 0; i < parens; ++i) vlCorpusPrintf(corpus, "(");
+        vlCorpusPrintf(corpus, "a");
+        for (size_t i = 0; i < parens; ++i) vlCorpusPrintf(corpus, " + %zu)", i);
+        vlCorpusPrintf(corpus, ";\n");
+        return;
+    }
+
+    switch (vlCorpusPick(corpus, 4)) {
+        case 0: vlCorpusPrintf(corpus, "if (a%zu < b) {\n", depth); break;
+        case 1: vlCorpusPrintf(corpus, "while (a%zu > 0) {\n", depth); break;
+        case 2: vlCorpusPrintf(corpus, "for (int i%zu = 0; i%zu < n; i%zu++) {\n", depth, depth, depth); break;
+        default: vlCorpusPrintf(corpus, "{\n"); break;
+    }
+    vlGenNestedLevel(corpus, depth - 1);
+    vlCorpusPrintf(corpus, "}\n");
+}
+
+
+static void vlGenNested(VLCorpus* corpus) {
+    vlGenNestedLevel(corpus, 8 + vlCorpusPick(corpus, 56));
+}
+
+
+// ---- DRIVER ---- //
+
+typedef struct VLBenchCorpus {
+    const char* name;
+    void (*generate)(VLCorpus* corpus);
+} VLBenchCorpus;
+
+typedef enum VLBenchPhase {
+    VL_BENCH_LEX,
+    VL_BENCH_LEX_ALL,
+    VL_BENCH_PARSE,
+    VL_BENCH_PHASE_COUNT
+} VLBenchPhase;
+
+typedef struct VLBenchResult {
+    bool ok;
+    size_t tokens;
+    size_t allocations;
+    double seconds;
+} VLBenchResult;
+
+typedef struct VLBenchOptions {
+    size_t runs;
+    size_t warmup;
+    uint64_t seed;
+    const char* writeDir;
+} VLBenchOptions;
+
+static const char* vlPhaseNames[VL_BENCH_PHASE_COUNT] = {"lex", "lex-all", "parse"};
+
+
+static double vlBenchSeconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) now.tv_sec + (double) now.tv_nsec * 1e-9;
+}
+
+
+static VLBenchResult vlBenchOnce(VLBenchPhase phase, const char* data, size_t len) {
+    VLBenchResult result = {0};
+    VLParser parser;
+    vlInitParser(&parser, data, len);
+
+    // Setup is left out, so allocations and time cover only the phase itself
+    size_t heapBefore = vlHeapAllocations;
+    size_t arenaBefore = parser.arena.stats.allocations;
+    double start = vlBenchSeconds();
+    switch (phase) {
+        case VL_BENCH_LEX:
+            while (vlNextToken(&parser) && parser.token.kind != VL_TOKEN_EOF) ++result.tokens;
+            result.ok = parser.status == VL_STATUS_OK;
+            break;
+        case VL_BENCH_LEX_ALL: {
+            VLTokenStream stream;
+            result.ok = vlLexAll(&parser, &stream);
+            result.tokens = stream.count - 1;
+            vlFreeTokenStream(&stream);
+            break;
+        }
+        default:
+            vlGrabToken(&parser);
+            result.ok = vlParseUnit(&parser) && parser.status == VL_STATUS_OK;
+            break;
+    }
+    result.seconds = vlBenchSeconds() - start;
+    result.allocations = vlHeapAllocations - heapBefore + parser.arena.stats.allocations - arenaBefore;
+
+    if (!result.ok) vlCheckStatus(&parser);
+    vlFreeParser(&parser);
+    return result;
+}
+
+
+static int vlCompareSeconds(const void* a, const void* b) {
+    double left = *(const double*) a, right = *(const double*) b;
+    return left < right ? -1 : left > right ? 1 : 0;
+}
+
+
+// Nearest-rank percentile of sorted samples
+static double vlPercentile(const double* sorted, size_t count, double percent) {
+    size_t rank = (size_t) ceil(percent / 100.0 * (double) count);
+    return sorted[rank ? rank - 1 : 0];
+}
+
+
+static bool vlBenchCorpus(const VLBenchCorpus* bench, size_t size, const VLBenchOptions* options) {
+    VLCorpus corpus = {.capacity = size + 4096, .state = options->seed};
+    corpus.data = malloc(corpus.capacity);
+    if (!corpus.data) {
+        printf("Out of memory.\n");
+        return false;
+    }
+    corpus.data[0] = '\0';
+    while (corpus.len < size) bench->generate(&corpus);
+
+    if (options->writeDir) {
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s-%zu.vl", options->writeDir, bench->name, size);
+        FILE* file = fopen(path, "wb");
+        if (file) {
+            fwrite(corpus.data, 1, corpus.len, file);
+            fclose(file);
+        } else {
+            printf("Unable to write '%s'.\n", path);
+        }
+    }
+
+    double* samples = malloc(options->runs * sizeof(double));
+    if (!samples) {
+        free(corpus.data);
+        return false;
+    }
+
+    // The parser doesn't count tokens, so its tokens/s uses the count from lexing the same corpus
+    bool ok = true;
+    size_t tokens = 0;
+    for (VLBenchPhase phase = 0; phase < VL_BENCH_PHASE_COUNT && ok; ++phase) {
+        VLBenchResult result = {0};
+        for (size_t i = 0; i < options->warmup && ok; ++i) ok = vlBenchOnce(phase, corpus.data, corpus.len).ok;
+        for (size_t i = 0; i < options->runs && ok; ++i) {
+            result = vlBenchOnce(phase, corpus.data, corpus.len);
+            samples[i] = result.seconds;
+            ok = result.ok;
+        }
+        if (!ok) {
+            printf("%-12s %10zu %-8s FAILED\n", bench->name, corpus.len, vlPhaseNames[phase]);
+            break;
+        }
+
+        if (result.tokens) tokens = result.tokens;
+        qsort(samples, options->runs, sizeof(double), vlCompareSeconds);
+        double median = vlPercentile(samples, options->runs, 50);
+        printf("%-12s %10zu %-8s %9.1f %10.2f %12zu %9.3f %9.3f %9.3f %9.3f\n", bench->name, corpus.len,
+               vlPhaseNames[phase], (double) corpus.len / median / 1e6, (double) tokens / median / 1e6,
+               result.allocations, samples[0] * 1e3, median * 1e3, vlPercentile(samples, options->runs, 90) * 1e3,
+               vlPercentile(samples, options->runs, 99) * 1e3);
+        fflush(stdout);
+    }
+
+    free(samples);
+    free(corpus.data);
+    return ok;
+}
+
+
+// Sizes may carry a K, M or G suffix
+static size_t vlParseSize(const char* text) {
+    char* end;
+    size_t size = strtoull(text, &end, 10);
+    switch (*end) {
+        case 'k': case 'K': return size << 10;
+        case 'm': case 'M': return size << 20;
+        case 'g': case 'G': return size << 30;
+        default: return size;
+    }
+}
+
+
+static void vlUsage(const char* program) {
+    printf("Usage: %s [options]\n"
+           "  --corpus <name>  Only run one corpus: identifiers, literals, comments, operators or nested\n"
+           "  --size <bytes>   Corpus size, with an optional K/M/G suffix; may be repeated\n"
+           "  --runs <n>       Timed runs per phase (default 10)\n"
+           "  --warmup <n>     Untimed runs per phase before timing (default 2)\n"
+           "  --seed <n>       Seed for the corpus generator (default 1)\n"
+           "  --write <dir>    Also save each generated corpus to <dir>\n",
+           program);
+}
+
+
+int main(int argc, char** argv) {
+    static const VLBenchCorpus corpora[] = {
+        {"identifiers", vlGenIdentifiers},
+        {"literals", vlGenLiterals},
+        {"comments", vlGenComments},
+        {"operators", vlGenOperators},
+        {"nested", vlGenNested},
+    };
+    const size_t corpusCount = sizeof(corpora) / sizeof(corpora[0]);
+
+    VLBenchOptions options = {.runs = 10, .warmup = 2, .seed = 1};
+    const char* only = NULL;
+    size_t sizes[32];
+    size_t sizeCount = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (!strcmp(arg, "--corpus") && value) {
+            only = value;
+        } else if (!strcmp(arg, "--size") && value && sizeCount < 32) {
+            sizes[sizeCount++] = vlParseSize(value);
+        } else if (!strcmp(arg, "--runs") && value) {
+            options.runs = strtoull(value, NULL, 10);
+        } else if (!strcmp(arg, "--warmup") && value) {
+            options.warmup = strtoull(value, NULL, 10);
+        } else if (!strcmp(arg, "--seed") && value) {
+            options.seed = strtoull(value, NULL, 10);
+        } else if (!strcmp(arg, "--write") && value) {
+            options.writeDir = value;
+        } else {
+            vlUsage(argv[0]);
+            return strcmp(arg, "-h") && strcmp(arg, "--help") ? 2 : 0;
+        }
+        ++i;
+    }
+    if (!options.runs) options.runs = 1;
+
+    bool known = !only;
+    for (size_t i = 0; i < corpusCount && !known; ++i) known = !strcmp(only, corpora[i].name);
+    if (!known) {
+        printf("Unknown corpus '%s'.\n", only);
+        return 2;
+    }
+    if (!sizeCount) {
+        sizes[sizeCount++] = 64 << 10;
+        sizes[sizeCount++] = 1 << 20;
+        sizes[sizeCount++] = 16 << 20;
+    }
+
+#ifndef VL_BENCH_COUNT_HEAP
+    printf("Heap allocations are not counted on this platform; allocs shows arena allocations only.\n");
+#endif
+    printf("%-12s %10s %-8s %9s %10s %12s %9s %9s %9s %9s\n", "corpus", "bytes", "phase", "MB/s", "Mtok/s",
+           "allocs", "min ms", "p50 ms", "p90 ms", "p99 ms");
+
+    bool ok = true;
+    for (size_t i = 0; i < corpusCount; ++i) {
+        if (only && strcmp(only, corpora[i].name)) continue;
+        for (size_t j = 0; j < sizeCount; ++j) ok &= vlBenchCorpus(&corpora[i], sizes[j], &options);
+    }
+    return ok ? 0 : 1;
+}
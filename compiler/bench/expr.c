@@ -0,0 +1,169 @@
+/* ================
+ * bench/expr.c
+ * VALLEY LANGUAGE COMPILER
+ * Expression parser stress benchmark
+ * ================
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../include/ast.h"
+
+
+typedef struct VLBenchBuffer {
+    char* data;
+    size_t len;
+    size_t capacity;
+} VLBenchBuffer;
+
+
+static void vlBenchAppend(VLBenchBuffer* buffer, const char* str) {
+    size_t len = strlen(str);
+    if (buffer->len + len + 1 > buffer->capacity) {
+        buffer->capacity = (buffer->len + len + 1) * 2;
+        buffer->data = realloc(buffer->data, buffer->capacity);
+        if (!buffer->data) {
+            printf("Out of memory.\n");
+            exit(1);
+        }
+    }
+    memcpy(buffer->data + buffer->len, str, len + 1);
+    buffer->len += len;
+}
+
+
+static void vlBenchRepeat(VLBenchBuffer* buffer, const char* str, size_t count) {
+    for (size_t i = 0; i < count; ++i) vlBenchAppend(buffer, str);
+}
+
+
+// ---- GENERATORS ---- //
+
+static void vlGenLongChain(VLBenchBuffer* buffer, size_t n) {
+    static const char* ops[] = {" + ", " * ", " - ", " / ", " == ", " && ", " << ", " % "};
+    char term[32];
+    for (size_t i = 0; i < n; ++i) {
+        snprintf(term, sizeof(term), "%sx%zu", i ? ops[i % 8] : "", i % 64);
+        vlBenchAppend(buffer, term);
+    }
+}
+
+
+static void vlGenLongCall(VLBenchBuffer* buffer, size_t n) {
+    vlBenchAppend(buffer, "f(");
+    for (size_t i = 0; i < n; ++i) vlBenchAppend(buffer, i ? ", a.b[1]" : "a.b[1]");
+    vlBenchAppend(buffer, ")");
+}
+
+
+static void vlGenNestedParens(VLBenchBuffer* buffer, size_t n) {
+    vlBenchRepeat(buffer, "(", n);
+    vlBenchAppend(buffer, "x");
+    vlBenchRepeat(buffer, " + 1)", n);
+}
+
+
+static void vlGenNestedCalls(VLBenchBuffer* buffer, size_t n) {
+    vlBenchRepeat(buffer, "f(a, ", n);
+    vlBenchAppend(buffer, "x");
+    vlBenchRepeat(buffer, ")", n);
+}
+
+
+static void vlGenNestedPrefix(VLBenchBuffer* buffer, size_t n) {
+    vlBenchRepeat(buffer, "~", n);
+    vlBenchAppend(buffer, "x");
+}
+
+
+static void vlGenNestedConditional(VLBenchBuffer* buffer, size_t n) {
+    vlBenchRepeat(buffer, "a ? b : ", n);
+    vlBenchAppend(buffer, "c");
+}
+
+
+static void vlGenNestedArrays(VLBenchBuffer* buffer, size_t n) {
+    vlBenchRepeat(buffer, "[1, ", n);
+    vlBenchAppend(buffer, "0");
+    vlBenchRepeat(buffer, "]", n);
+}
+
+
+static void vlGenAssignChain(VLBenchBuffer* buffer, size_t n) {
+    vlBenchRepeat(buffer, "a = ", n);
+    vlBenchAppend(buffer, "b");
+}
+
+
+// ---- DRIVER ---- //
+
+typedef struct VLBenchCase {
+    const char* name;
+    void (*generate)(VLBenchBuffer* buffer, size_t n);
+} VLBenchCase;
+
+
+static double vlBenchSeconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) now.tv_sec + (double) now.tv_nsec * 1e-9;
+}
+
+
+static bool vlBenchRun(const VLBenchCase* bench, size_t n) {
+    VLBenchBuffer buffer = {0};
+    bench->generate(&buffer, n);
+
+    double start = vlBenchSeconds();
+    VLParser parser;
+    vlInitParser(&parser, buffer.data, buffer.len);
+    VLExpression* expr = NULL;
+    if (vlNextToken(&parser)) expr = vlParseExpr(&parser, VL_TYPE_VOID, false, true, false);
+    bool ok = vlCheckStatus(&parser) && expr && parser.token.kind == VL_TOKEN_EOF;
+    double elapsed = vlBenchSeconds() - start;
+
+    // The flat copy is timed separately and checked node for node against the tree it came from
+    VLFlatAst ast;
+    vlInitFlatAst(&ast);
+    double flatStart = vlBenchSeconds();
+    VLNodeIndex root = ok ? vlFlattenExpr(&ast, expr) : VL_NO_NODE;
+    double flatElapsed = vlBenchSeconds() - flatStart;
+    ok = ok && root != VL_NO_NODE && vlFlatMatchesExpr(&ast, root, expr);
+
+    printf("%-14s %10zu %12zu %10.2f %10.1f %10.1f %12zu %10.2f %12zu%s\n", bench->name, n, buffer.len,
+           elapsed * 1e3, (double) buffer.len / elapsed / 1e6, elapsed * 1e9 / (double) n,
+           parser.arena.stats.bytesReserved, flatElapsed * 1e3, vlFlatAstBytes(&ast), ok ? "" : "  FAILED");
+
+    vlFreeFlatAst(&ast);
+    vlFreeParser(&parser);
+    free(buffer.data);
+    return ok;
+}
+
+
+int main(int argc, char** argv) {
+    // Terms double from minTerms up to maxTerms, so per-term cost should stay flat if parsing is linear
+    size_t minTerms = 1 << 12;
+    size_t maxTerms = argc > 1 ? strtoull(argv[1], NULL, 10) : 1 << 20;
+
+    static const VLBenchCase cases[] = {
+        {"long-chain", vlGenLongChain},
+        {"long-call", vlGenLongCall},
+        {"nest-parens", vlGenNestedParens},
+        {"nest-calls", vlGenNestedCalls},
+        {"nest-prefix", vlGenNestedPrefix},
+        {"nest-cond", vlGenNestedConditional},
+        {"nest-arrays", vlGenNestedArrays},
+        {"assign-chain", vlGenAssignChain},
+    };
+
+    printf("%-14s %10s %12s %10s %10s %10s %12s %10s %12s\n", "case", "terms", "bytes", "ms", "MB/s", "ns/term",
+           "arena", "flat ms", "flat bytes");
+    bool ok = true;
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+        for (size_t n = minTerms; n <= maxTerms; n *= 4) ok &= vlBenchRun(&cases[i], n);
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,53 @@
+#ifndef VALLEY_AST_H
+#define VALLEY_AST_H
+
+#include "valley.h"
+
+// ---- MACROS ---- //
+
+#define VL_NO_NODE UINT32_MAX
+
+// ---- TYPEDEFS ---- //
+
+typedef uint32_t VLNodeIndex;
+
+// Expressions as parallel arrays indexed by node. Children always come before their parent, so a
+// plain forward loop over the nodes is a post-order walk. What the three slots hold depends on kind:
+//   literals and names  first = index into literals
+//   unary               first = child
+//   binary              first, second = children
+//   ternary             first, second, third = children
+//   multi               first = offset into children, second = child count
+// For now only the expression benchmark builds these; parsing, folding and checking all still
+// work on VLExpression trees.
+typedef struct VLFlatAst {
+    uint8_t* kinds;
+    uint8_t* operations;
+    uint32_t* positions;
+    VLNodeIndex* first;
+    VLNodeIndex* second;
+    VLNodeIndex* third;
+    size_t count;
+    size_t capacity;
+    VLNodeIndex* children;
+    size_t childCount;
+    size_t childCapacity;
+    VLLiteral* literals;
+    size_t literalCount;
+    size_t literalCapacity;
+} VLFlatAst;
+
+// ---- FUNCTION PROTOTYPES ---- //
+
+void vlInitFlatAst(VLFlatAst* ast);
+void vlFreeFlatAst(VLFlatAst* ast);
+size_t vlFlatAstBytes(const VLFlatAst* ast);
+
+VLNodeIndex vlFlattenExpr(VLFlatAst* ast, const VLExpression* expr);
+
+size_t vlFlatChildCount(const VLFlatAst* ast, VLNodeIndex node);
+VLNodeIndex vlFlatChild(const VLFlatAst* ast, VLNodeIndex node, size_t index);
+const VLLiteral* vlFlatLiteral(const VLFlatAst* ast, VLNodeIndex node);
+bool vlFlatMatchesExpr(const VLFlatAst* ast, VLNodeIndex node, const VLExpression* expr);
+
+#endif /* VALLEY_AST_H */
@@ -0,0 +1,271 @@
+#ifndef VALLEY_BYTECODE_H
+#define VALLEY_BYTECODE_H
+
+#include "valley.h"
+
+// ---- MACROS ---- //
+
+// Every instruction as X(NAME, format). Arithmetic comes in one opcode per representation, so
+// the interpreter never looks at a value's type: _I covers bool, char, byte, short and int (kept
+// sign-extended in a 64-bit slot and narrowed after each operation that could leave the range),
+// _L is long, _F float and _D double. Array access is typed by element width the same way. Arrays
+// grow in place: AINS opens a slot for an element that an ASET then fills, and SETCAP makes room
+// ahead of time. The arguments packed for a variadic call that can't outlive it go in an array
+// NEWPACK takes from a stack of its own, which DROPPACK pops back to once the call returns.
+// REDUCE folds a whole array of primitives into an accumulator, in place of a for-each loop.
+// MOVE copies the whole slot, but records the VLRep of what it copies in C for backends that keep
+// each representation in a variable of its own.
+#define VL_OPCODES(X) \
+    X(MOVE, AB) \
+    X(LOADK, ABX) \
+    X(LOADI, ASBX) \
+    X(LOADNULL, A) \
+    X(I2F, AB) X(I2D, AB) \
+    X(L2I, AB) X(L2F, AB) X(L2D, AB) \
+    X(F2I, AB) X(F2L, AB) X(F2D, AB) \
+    X(D2I, AB) X(D2L, AB) X(D2F, AB) \
+    X(NARROWB, AB) X(NARROWS, AB) X(NARROWC, AB) \
+    X(ADD_I, ABC) X(ADD_L, ABC) X(ADD_F, ABC) X(ADD_D, ABC) \
+    X(SUB_I, ABC) X(SUB_L, ABC) X(SUB_F, ABC) X(SUB_D, ABC) \
+    X(MUL_I, ABC) X(MUL_L, ABC) X(MUL_F, ABC) X(MUL_D, ABC) \
+    X(DIV_I, ABC) X(DIV_L, ABC) X(DIV_F, ABC) X(DIV_D, ABC) \
+    X(MOD_I, ABC) X(MOD_L, ABC) X(MOD_F, ABC) X(MOD_D, ABC) \
+    X(EXP_I, ABC) X(EXP_L, ABC) X(EXP_F, ABC) X(EXP_D, ABC) \
+    X(ADDI_I, ABSC) X(ADDI_L, ABSC) \
+    X(NEG_I, AB) X(NEG_L, AB) X(NEG_F, AB) X(NEG_D, AB) \
+    X(NOT_I, AB) X(NOT_L, AB) X(LNOT, AB) \
+    X(AND_I, ABC) X(AND_L, ABC) X(OR_I, ABC) X(OR_L, ABC) X(XOR_I, ABC) X(XOR_L, ABC) \
+    X(SHL_I, ABC) X(SHL_L, ABC) X(SHR_I, ABC) X(SHR_L, ABC) \
+    X(EQ_I, ABC) X(EQ_L, ABC) X(EQ_F, ABC) X(EQ_D, ABC) X(EQ_S, ABC) X(EQ_P, ABC) \
+    X(NE_I, ABC) X(NE_L, ABC) X(NE_F, ABC) X(NE_D, ABC) X(NE_S, ABC) X(NE_P, ABC) \
+    X(LT_I, ABC) X(LT_L, ABC) X(LT_F, ABC) X(LT_D, ABC) \
+    X(LE_I, ABC) X(LE_L, ABC) X(LE_F, ABC) X(LE_D, ABC) \
+    X(JMP, SAX) \
+    X(JT, ASBX) \
+    X(JF, ASBX) \
+    X(NEWARR, ABC) \
+    X(NEWPACK, ABC) \
+    X(DROPPACK, A) \
+    X(LEN, AB) \
+    X(CAP, AB) \
+    X(SETCAP, AB) \
+    X(AGET_I8, ABC) X(AGET_U8, ABC) X(AGET_I16, ABC) X(AGET_I32, ABC) \
+    X(AGET_I64, ABC) X(AGET_F32, ABC) X(AGET_F64, ABC) X(AGET_REF, ABC) \
+    X(ASET_I8, ABC) X(ASET_I16, ABC) X(ASET_I32, ABC) \
+    X(ASET_I64, ABC) X(ASET_F32, ABC) X(ASET_F64, ABC) X(ASET_REF, ABC) \
+    X(AINS, ABC) \
+    X(REDUCE, ABC) \
+    X(GETG, ABX) \
+    X(SETG, ABX) \
+    X(CALL, ABX) \
+    X(CALLN, ABX) \
+    X(RET, A) \
+    X(RETV, NONE)
+
+#define VL_BC_ENUM(name, format) VL_BC_##name,
+#define VL_BC_COUNT_ONE(name, format) + 1
+#define VL_OPCODE_COUNT (0 VL_OPCODES(VL_BC_COUNT_ONE))
+
+// Instructions are 32 bits: an 8-bit opcode then operands A, B and C of 8 bits each. Bx joins B
+// and C into 16 bits, sBx is Bx biased to be signed and sAx does the same with all 24 bits.
+#define VL_MAX_REGISTERS 256
+#define VL_MAX_CONSTANTS 65536
+#define VL_SBX_BIAS 32767
+#define VL_SAX_BIAS 8388607
+
+#define VL_INS_OP(ins) ((ins) & 0xFF)
+#define VL_INS_A(ins) (((ins) >> 8) & 0xFF)
+#define VL_INS_B(ins) (((ins) >> 16) & 0xFF)
+#define VL_INS_C(ins) ((ins) >> 24)
+#define VL_INS_SC(ins) ((int8_t) VL_INS_C(ins))
+#define VL_INS_BX(ins) ((ins) >> 16)
+#define VL_INS_SBX(ins) ((int32_t) VL_INS_BX(ins) - VL_SBX_BIAS)
+#define VL_INS_SAX(ins) ((int32_t) ((ins) >> 8) - VL_SAX_BIAS)
+
+#define VL_ENCODE_ABC(op, a, b, c) \
+    ((uint32_t) (op) | (uint32_t) (a) << 8 | (uint32_t) (b) << 16 | (uint32_t) (uint8_t) (c) << 24)
+#define VL_ENCODE_ABX(op, a, bx) ((uint32_t) (op) | (uint32_t) (a) << 8 | (uint32_t) (bx) << 16)
+#define VL_ENCODE_SAX(op, sax) ((uint32_t) (op) | (uint32_t) ((sax) + VL_SAX_BIAS) << 8)
+
+#define VL_NO_NATIVE SIZE_MAX
+
+// REDUCE A B C folds the array in B into A. C holds the array's element kind in its low three bits,
+// the VLReduceOp above them and VL_REDUCE_STRICT on top. Integers are folded as longs. Floats are
+// folded over VL_REDUCE_LANES lanes, element i going to lane i % VL_REDUCE_LANES, lane 0 starting
+// from the accumulator and the others from the operation's identity, and the lanes are then folded
+// into lane 0 in order. That keeps arrays no longer than the lanes to the order a loop would use;
+// VL_REDUCE_STRICT folds every array in that order instead.
+#define VL_REDUCE_LANES 8
+#define VL_REDUCE_STRICT 0x40
+#define VL_REDUCE_MODE(element, op, strict) \
+    ((uint32_t) (element) | (uint32_t) (op) << 3 | ((strict) ? VL_REDUCE_STRICT : 0u))
+#define VL_REDUCE_ELEMENT(mode) ((VLElementKind) ((mode) & 7))
+#define VL_REDUCE_OP(mode) ((VLReduceOp) ((mode) >> 3 & 7))
+
+// ---- TYPEDEFS ---- //
+
+typedef enum VLOpcode {
+    VL_OPCODES(VL_BC_ENUM)
+} VLOpcode;
+
+typedef enum VLOperandFormat {
+    VL_FORMAT_NONE,
+    VL_FORMAT_A,
+    VL_FORMAT_AB,
+    VL_FORMAT_ABC,
+    VL_FORMAT_ABSC,
+    VL_FORMAT_ABX,
+    VL_FORMAT_ASBX,
+    VL_FORMAT_SAX,
+} VLOperandFormat;
+
+// How a value is held in a register. Every integer type short of long shares VL_REP_I, and every
+// reference VL_REP_P.
+typedef enum VLRep {
+    VL_REP_I,
+    VL_REP_L,
+    VL_REP_F,
+    VL_REP_D,
+    VL_REP_P,
+} VLRep;
+
+// How an array stores its elements; bool and char take one unsigned byte each
+typedef enum VLElementKind {
+    VL_ELEM_I8,
+    VL_ELEM_U8,
+    VL_ELEM_I16,
+    VL_ELEM_I32,
+    VL_ELEM_I64,
+    VL_ELEM_F32,
+    VL_ELEM_F64,
+    VL_ELEM_REF,
+} VLElementKind;
+
+typedef enum VLReduceOp {
+    VL_REDUCE_ADD,
+    VL_REDUCE_MUL,
+    VL_REDUCE_AND,
+    VL_REDUCE_OR,
+    VL_REDUCE_XOR,
+    VL_REDUCE_MIN,
+    VL_REDUCE_MAX,
+} VLReduceOp;
+
+typedef union VLValue {
+    VLLong i;
+    VLFloat f;
+    VLDouble d;
+    void* p;
+} VLValue;
+
+// Strings and arrays both start with an object header. Those the program allocates while running
+// are chained through next so the machine can free them all at the end, along with any buffer
+// they own apart from themselves; constants are not.
+typedef struct VLObject {
+    struct VLObject* next;
+    void* buffer;
+} VLObject;
+
+typedef struct VLStringObject {
+    VLObject header;
+    size_t length;
+    char data[];
+} VLStringObject;
+
+// An array keeps its elements in the inline storage it was allocated with, which leaves room for
+// a few more than it starts with when it starts small, until it grows past capacity. From then on
+// data points at a buffer of its own, which doubles each time it fills up.
+typedef struct VLArrayObject {
+    VLObject header;
+    size_t length;
+    size_t capacity;
+    VLElementKind element;
+    char* data;
+    alignas(max_align_t) char storage[];
+} VLArrayObject;
+
+// Parameters occupy the first registers, in order. A variadic function takes its last parameter
+// as an array. native indexes vlNatives for prototypes bound to a built-in function. Each constant
+// records how it is held, a VL_REP_P constant being a string, and registerNames holds the first
+// local given each register, if any, for backends that want to show them. An instance is the copy
+// of a generic function made for one list of type arguments, named for them as in max<double>; it
+// shares the generic function's symbol. packEscapes says whether a variadic function's pack can
+// outlive a call to it, in which case callers have to make it a full array.
+typedef struct VLFunction {
+    VLString name;
+    VLSymbol symbol;
+    bool instance;
+    VLType result;
+    VLType* params;
+    const VLExpression** defaults;
+    size_t paramCount;
+    bool variadic;
+    bool packEscapes;
+    const VLExpression* signature;
+    const VLStatement* body;
+    size_t native;
+    size_t pos;
+    uint32_t* code;
+    size_t* positions;
+    size_t codeCount;
+    size_t codeCapacity;
+    VLValue* constants;
+    VLRep* constantReps;
+    size_t constantCount;
+    size_t constantCapacity;
+    size_t registerCount;
+    VLString* registerNames;
+} VLFunction;
+
+// A top-level variable, kept so the results of a run can be shown. Those that functions refer to
+// live in a global slot; the rest stay in the registers of the top-level code.
+typedef struct VLVariable {
+    VLString name;
+    VLType type;
+    uint32_t slot;
+    bool global;
+} VLVariable;
+
+// The last function is the top-level code. Like the parser, a program records the first error
+// it runs into in status, with what naming the offending thing and pos where it is. genericCount
+// counts the generic functions that were called, and reusedInstances the calls that found the
+// instance they needed already made. strictFloat has every float reduction keep the order of the
+// loop it replaces.
+typedef struct VLProgram {
+    VLFunction* functions;
+    size_t functionCount;
+    size_t functionCapacity;
+    size_t genericCount;
+    size_t reusedInstances;
+    bool strictFloat;
+    VLVariable* variables;
+    size_t variableCount;
+    size_t variableCapacity;
+    size_t globalCount;
+    VLArena arena;
+    VLStatus status;
+    const char* what;
+    size_t pos;
+    char detail[128];
+} VLProgram;
+
+// ---- FUNCTION PROTOTYPES ---- //
+
+void vlInitProgram(VLProgram* program);
+void vlFreeProgram(VLProgram* program);
+bool vlCompileProgram(VLProgram* program, const VLStatement* tree);
+
+const char* vlOpcodeName(VLOpcode op);
+const char* vlReduceName(VLReduceOp op);
+VLOperandFormat vlOpcodeFormat(VLOpcode op);
+VLRep vlRep(VLType type);
+VLElementKind vlElementKind(VLType element);
+size_t vlElementSize(VLElementKind kind);
+// Prints the shortest decimal that reads back as the same value, as a float when single is set
+void vlPrintReal(FILE* out, VLDouble value, bool single);
+void vlPrintQuoted(FILE* out, const VLStringObject* string);
+void vlPrintProgram(FILE* out, const VLProgram* program);
+// Prints the code each instance of a generic function adds, one per line, then the total
+void vlPrintInstances(FILE* out, const VLProgram* program);
+
+#endif /* VALLEY_BYTECODE_H */
@@ -0,0 +1,60 @@
+#ifndef VALLEY_CACHE_H
+#define VALLEY_CACHE_H
+
+#include <threads.h>
+
+#include "valley.h"
+
+// ---- MACROS ---- //
+
+#define VL_NO_MODULE UINT32_MAX
+#define VL_CACHE_DEFAULT_BYTES ((size_t) 512 << 20)
+
+// ---- TYPEDEFS ---- //
+
+// A parsed file, keyed by its contents rather than its path; text is kept so a hash match can be
+// confirmed byte for byte. The parser is kept only because it owns the arena and symbols the tree
+// lives in, and never lexes again. Diagnostics are stored without a path so the same module can be
+// reported under whichever name it was requested by.
+typedef struct VLModule {
+    uint64_t hash;
+    char* text;
+    size_t size;
+    VLParser parser;
+    VLStatement* tree;
+    char* message;
+    size_t line;
+    size_t column;
+    size_t lastUsed;
+} VLModule;
+
+// Thread-safe: workers look modules up and insert them concurrently. Eviction only happens in
+// vlTrimCache, which must not overlap with a build that could still be printing an evicted tree.
+typedef struct VLModuleCache {
+    mtx_t lock;
+    VLModule** modules;
+    size_t count;
+    size_t capacity;
+    uint32_t* slots;
+    size_t slotCount;
+    size_t bytes;
+    size_t maxBytes;
+    size_t generation;
+    size_t hits;
+    size_t misses;
+} VLModuleCache;
+
+// ---- FUNCTION PROTOTYPES ---- //
+
+uint64_t vlHashSource(const char* data, size_t size);
+
+VLModule* vlParseModule(const char* data, size_t size, uint64_t hash);
+void vlFreeModule(VLModule* module);
+
+bool vlInitCache(VLModuleCache* cache, size_t maxBytes);
+void vlFreeCache(VLModuleCache* cache);
+VLModule* vlCacheLookup(VLModuleCache* cache, uint64_t hash, const char* data, size_t size);
+VLModule* vlCacheInsert(VLModuleCache* cache, VLModule* module);
+void vlTrimCache(VLModuleCache* cache);
+
+#endif /* VALLEY_CACHE_H */
@@ -0,0 +1,22 @@
+#ifndef VALLEY_CGEN_H
+#define VALLEY_CGEN_H
+
+#include "bytecode.h"
+
+// ---- MACROS ---- //
+
+// Used to build native executables when CC isn't set
+#define VL_DEFAULT_CC "cc"
+
+// ---- FUNCTION PROTOTYPES ---- //
+
+// Writes a compiled program out as one self-contained C23 translation unit, with #line directives
+// mapping each statement back to where it came from in path, so compiler diagnostics and debuggers
+// point at the Valley source. The program prints its top-level variables on exit, like --run.
+bool vlEmitC(FILE* out, const VLProgram* program, const char* path, const char* source, size_t size);
+
+// Compiles a C file written by vlEmitC into an executable with $CC and $CFLAGS, writing whatever
+// the compiler prints and any failure to out
+bool vlBuildNative(const char* cPath, const char* exePath, FILE* out);
+
+#endif /* VALLEY_CGEN_H */
@@ -0,0 +1,23 @@
+#ifndef VALLEY_CHECK_H
+#define VALLEY_CHECK_H
+
+#include "bytecode.h"
+
+// ---- FUNCTION PROTOTYPES ---- //
+
+// Declares the functions tree defines in program, then type-checks their bodies and the top-level
+// code. The parsed tree is left untouched, as the module cache may share it between threads;
+// instead *checked gets a copy, allocated in program's arena, in which:
+//   - every expression standing for a value has its type set
+//   - each implicit conversion is a VL_OP_CAST whose second is NULL, with the target in type
+//   - literals already have the type their context wants, so int 1 in a double[] is 1.0
+//   - calls pass exactly one argument per parameter, defaults filled in and a variadic function's
+//     extra arguments gathered into a VL_OP_ARR_INIT
+//   - true and false are bool literals
+// Binary operators then see operands of one type, but for the count of a shift. A compound
+// assignment computes in its value's type and converts back to its target's, and a for-each item
+// is converted from the element type. Bodies in program's functions point into the copy too.
+// Errors are recorded in program like those from compiling.
+bool vlCheckProgram(VLProgram* program, const VLStatement* tree, VLStatement** checked);
+
+#endif /* VALLEY_CHECK_H */
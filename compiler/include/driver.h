@@ -0,0 +1,73 @@
+#ifndef VALLEY_DRIVER_H
+#define VALLEY_DRIVER_H
+
+#include <stdatomic.h>
+
+#include "valley.h"
+#include "stats.h"
+
+// ---- MACROS ---- //
+
+#define VL_SOURCE_EXTENSION ".vl"
+
+// ---- TYPEDEFS ---- //
+
+// With stats set, each unit is lexed to a token stream before parsing so the passes can be timed
+// apart; otherwise lexing stays interleaved with parsing and nothing is measured. When cache is
+// set, units are parsed through it and their trees outlive the build. dumpTypes, dumpBytecode, run,
+// emitC and native type-check and compile each unit that parses to bytecode, to print the checked
+// tree, print the bytecode, interpret it, print it lowered to C and build that C into an
+// executable. jit has runs compile what functions they can to machine code first. strictFloat keeps
+// float reductions in the order of the loops they replace.
+typedef struct VLDriverOptions {
+    size_t jobs;
+    bool dumpTokens;
+    bool dumpTree;
+    bool dumpTypes;
+    bool dumpBytecode;
+    bool run;
+    bool jit;
+    bool emitC;
+    bool native;
+    bool strictFloat;
+    bool watch;
+    bool stats;
+    struct VLModuleCache* cache;
+} VLDriverOptions;
+
+// One input file. Workers only ever touch their own unit, and everything a unit prints goes to
+// output, so results can be written out in input order no matter which thread finished first.
+typedef struct VLUnit {
+    char* path;
+    size_t size;
+    char* output;
+    size_t outputSize;
+    size_t statements;
+    size_t folded;
+    VLArenaStats arena;
+    VLUnitStats stats;
+    bool ok;
+} VLUnit;
+
+typedef struct VLBuild {
+    VLDriverOptions options;
+    VLUnit* units;
+    size_t count;
+    size_t capacity;
+    size_t* schedule;
+    atomic_size_t next;
+} VLBuild;
+
+// ---- FUNCTION PROTOTYPES ---- //
+
+size_t vlDefaultJobs(void);
+
+void vlInitBuild(VLBuild* build, VLDriverOptions options);
+void vlFreeBuild(VLBuild* build);
+bool vlAddInput(VLBuild* build, const char* path);
+
+bool vlCompileUnit(VLUnit* unit, const VLDriverOptions* options);
+bool vlRunBuild(VLBuild* build);
+bool vlWriteUnits(const VLBuild* build, FILE* out);
+
+#endif /* VALLEY_DRIVER_H */
@@ -0,0 +1,20 @@
+#ifndef VALLEY_FOLD_H
+#define VALLEY_FOLD_H
+
+#include "valley.h"
+
+// ---- FUNCTION PROTOTYPES ---- //
+
+// The numeric kind two operands are brought to before an arithmetic or comparison operator: the
+// wider of the two in the order byte < short < int < long < float < double. false if either side
+// isn't numeric.
+bool vlPromoteKinds(VLExprKind first, VLExprKind second, VLExprKind* result);
+bool vlIsConstantExpr(const VLExpression* expr);
+
+// Called with an operator's operands just before its node would be built. Returns the expression
+// to push in its place, reusing one of the operands, or NULL if the operation has to stay in the
+// tree. Every node that drops out is added to parser->folded.
+VLExpression* vlFoldOperation(VLParser* parser, VLOperation op, VLExpression** args, size_t pos);
+void vlFoldArrayInit(VLExpression** elements, size_t count);
+
+#endif /* VALLEY_FOLD_H */
@@ -0,0 +1,57 @@
+#ifndef VALLEY_JIT_H
+#define VALLEY_JIT_H
+
+#include "bytecode.h"
+
+// ---- MACROS ---- //
+
+#if defined(__x86_64__) && defined(__linux__)
+#define VL_JIT_SUPPORTED
+#endif
+
+// What compiled code returns: zero, or why it stopped, with the context saying where
+#define VL_JIT_OK 0
+#define VL_JIT_DIVIDE 1
+#define VL_JIT_OVERFLOW 2
+#define VL_JIT_NULL_LENGTH 3
+#define VL_JIT_NULL_INDEX 4
+#define VL_JIT_BOUNDS 5
+
+// ---- TYPEDEFS ---- //
+
+// Shared by all the compiled code running for one call from the interpreter. depth counts the
+// calls left before the frame limit, and function and at locate whatever stopped it; after an
+// out of bounds access, index and length say what it was.
+typedef struct VLJitContext {
+    VLValue* globals;
+    VLValue* stackEnd;
+    int64_t depth;
+    uint32_t function;
+    uint32_t at;
+    int64_t index;
+    uint64_t length;
+} VLJitContext;
+
+// Compiled functions take the same register window the interpreter would give them, arguments
+// first, and leave their result in base[0]
+typedef int (*VLJitEntry)(VLValue* base, VLJitContext* context);
+
+// Machine code for every function in a program that computes with primitives and at most reads
+// arrays. entries is indexed like the program's functions and is NULL for those left to the
+// interpreter.
+typedef struct VLJit {
+    uint8_t* code;
+    size_t size;
+    VLJitEntry* entries;
+    size_t compiled;
+    double seconds;
+} VLJit;
+
+// ---- FUNCTION PROTOTYPES ---- //
+
+// Compiles what it can of program into executable memory and lists it in /tmp/perf-<pid>.map
+// for perf. Only fails when out of memory; on targets without a JIT nothing is compiled.
+bool vlInitJit(VLJit* jit, const VLProgram* program);
+void vlFreeJit(VLJit* jit);
+
+#endif /* VALLEY_JIT_H */
@@ -0,0 +1,33 @@
+#ifndef VALLEY_NUMBER_H
+#define VALLEY_NUMBER_H
+
+#include "valley.h"
+
+// ---- MACROS ---- //
+
+#define VL_MAX_MANTISSA_DIGITS 19
+#define VL_MIN_POWER_OF_TEN (-342)
+#define VL_MAX_POWER_OF_TEN 308
+
+// ---- TYPEDEFS ---- //
+
+// A decimal literal as mantissa * 10^exponent. Only the first VL_MAX_MANTISSA_DIGITS significant
+// digits make it into the mantissa; truncated says whether any of the dropped ones were nonzero.
+typedef struct VLDecimal {
+    uint64_t mantissa;
+    int64_t exponent;
+    bool truncated;
+} VLDecimal;
+
+// ---- GLOBALS ---- //
+
+extern const uint64_t vlPowersOfFive[VL_MAX_POWER_OF_TEN - VL_MIN_POWER_OF_TEN + 1][2];
+
+// ---- FUNCTION PROTOTYPES ---- //
+
+// Correctly rounded conversions; false means the fast paths couldn't decide and the caller has to
+// fall back to an exact parse of the original text
+bool vlDecimalToDouble(VLDecimal decimal, VLDouble* value);
+bool vlDecimalToFloat(VLDecimal decimal, VLFloat* value);
+
+#endif /* VALLEY_NUMBER_H */
@@ -0,0 +1,22 @@
+#ifndef VALLEY_SERVER_H
+#define VALLEY_SERVER_H
+
+#include "valley.h"
+#include "driver.h"
+
+// ---- MACROS ---- //
+
+#define VL_REQUEST_MAGIC "VALLEY 1"
+#define VL_MAX_REQUEST_BYTES ((size_t) 1 << 20)
+
+// ---- FUNCTION PROTOTYPES ---- //
+
+// Requests are lines of text: the magic line, then any of "jobs <n>", "tokens", "tree", "types",
+// "bytecode", "run", "jit", "emit-c", "native", "strict-fp", "shutdown" and "input <path>", after which
+// the client closes its end for writing. The reply is the exit status on a line of its own followed by
+// everything the build printed.
+bool vlServe(const char* socketPath, const VLDriverOptions* defaults, FILE* log);
+int vlRequest(const char* socketPath, const VLDriverOptions* options, const char** inputs, size_t inputCount,
+              bool stop, FILE* out);
+
+#endif /* VALLEY_SERVER_H */
@@ -0,0 +1,56 @@
+#ifndef VALLEY_STATS_H
+#define VALLEY_STATS_H
+
+#include "valley.h"
+#include "tokens.h"
+
+// ---- MACROS ---- //
+
+#define VL_TOKEN_KIND_COUNT (VL_TOKEN_BOOL + 1 + VL_KEYWORD_COUNT VL_SYMBOLS(VL_KW_COUNT))
+#define VL_EXPR_KIND_COUNT (VL_EXPR_MULTI + 1)
+
+// ---- TYPEDEFS ---- //
+
+struct VLBuild;
+
+// Passes are timed in the order they run; later passes slot in before VL_PASS_COUNT
+typedef enum VLPass {
+    VL_PASS_READ,
+    VL_PASS_LEX,
+    VL_PASS_PARSE,
+    VL_PASS_CHECK,
+    VL_PASS_COMPILE,
+    VL_PASS_RUN,
+    VL_PASS_COUNT
+} VLPass;
+
+// Only filled in when statistics were asked for. heapBytes is what the unit held on the heap at its
+// peak: arena blocks, the token stream, and the parser's stacks and symbol table.
+typedef struct VLUnitStats {
+    double seconds[VL_PASS_COUNT];
+    size_t bytes;
+    size_t tokens;
+    size_t tokenKinds[VL_TOKEN_KIND_COUNT];
+    size_t exprs;
+    size_t exprKinds[VL_EXPR_KIND_COUNT];
+    size_t statements;
+    size_t folded;
+    VLArenaStats arena;
+    size_t heapBytes;
+} VLUnitStats;
+
+// ---- FUNCTION PROTOTYPES ---- //
+
+double vlStatsClock(void);
+const char* vlPassName(VLPass pass);
+const char* vlTokenKindName(VLTokenKind kind);
+const char* vlExprKindName(VLExprKind kind);
+
+void vlCountTokens(VLUnitStats* stats, const VLTokenStream* stream);
+bool vlCountStatement(VLUnitStats* stats, const VLStatement* stmt);
+size_t vlParserFootprint(const VLParser* parser, const VLTokenStream* stream);
+void vlAddStats(VLUnitStats* total, const VLUnitStats* unit);
+size_t vlPeakResidentBytes(void);
+void vlWriteStatsJson(FILE* out, const struct VLBuild* build, double seconds);
+
+#endif /* VALLEY_STATS_H */
@@ -0,0 +1,45 @@
+#ifndef VALLEY_TOKENS_H
+#define VALLEY_TOKENS_H
+
+#include "valley.h"
+
+// ---- MACROS ---- //
+
+#define VL_MAX_PAYLOAD 0xFFFFFF
+
+// ---- TYPEDEFS ---- //
+
+// One token in 8 bytes. For VL_TOKEN_NAME the payload is the symbol ID; for literals it indexes
+// the stream's literal table; everything else leaves it zero.
+typedef struct VLPackedToken {
+    uint32_t offset;
+    uint32_t kind : 8;
+    uint32_t payload : 24;
+} VLPackedToken;
+
+// A whole unit's tokens. Names and string literals point into the lexing parser's symbol table and
+// arena, so the stream must not outlive that parser.
+typedef struct VLTokenStream {
+    VLPackedToken* tokens;
+    size_t count;
+    size_t capacity;
+    VLLiteral* literals;
+    size_t literalCount;
+    size_t literalCapacity;
+    uint32_t* lineStarts;
+    size_t lineCount;
+    const VLSymbolTable* symbols;
+} VLTokenStream;
+
+// ---- FUNCTION PROTOTYPES ---- //
+
+bool vlLexAll(VLParser* parser, VLTokenStream* stream);
+void vlFreeTokenStream(VLTokenStream* stream);
+
+VLToken vlUnpackToken(const VLTokenStream* stream, size_t index);
+void vlLineColumn(const VLTokenStream* stream, size_t offset, size_t* line, size_t* column);
+
+void vlAttachTokenStream(VLParser* parser, const VLTokenStream* stream);
+VLToken vlPeekToken(const VLParser* parser, size_t ahead);
+
+#endif /* VALLEY_TOKENS_H */
@@ -2,15 +2,133 @@
 #define VALLEY_H
 
 #include <stdio.h>
+#include <stdalign.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
 // ---- MACROS ---- //
 
-#define VL_READ() getc(parser->stream); ++parser->pos
-#define VL_UNREAD(c) ungetc(c, parser->stream); --parser->pos
-#define VL_EOF() feof(parser->stream)
-#define VL_CHECK_KW(str, value) if (strcmp(name, str) == 0) { VLToken token = {.kind = VL_KW_##value, .pos = pos}; parser->token = token; return; }
+#define VL_PEEK() (parser->cursor < parser->end ? (unsigned char) *parser->cursor : EOF)
+#define VL_PEEK_AT(n) (parser->end - parser->cursor > (n) ? (unsigned char) parser->cursor[n] : EOF)
+#define VL_READ() (parser->cursor < parser->end ? (unsigned char) *parser->cursor++ : EOF)
+#define VL_UNREAD(c) do { if ((c) != EOF) --parser->cursor; } while (0)
+#define VL_SKIP(n) (parser->cursor += (n))
+#define VL_EOF() (parser->cursor >= parser->end)
+#define VL_POS() ((size_t) (parser->cursor - parser->source))
+
+// Locale-independent ctype replacements; EOF maps to 0xFF, which has no class
+#define VL_CC_SPACE 0x01
+#define VL_CC_BLANK 0x02
+#define VL_CC_ALPHA 0x04
+#define VL_CC_DIGIT 0x08
+#define VL_CC_PUNCT 0x10
+#define VL_CC_UNDERSCORE 0x20
+#define VL_CC_IS(c, cls) ((vlCharClass[(unsigned char) (c)] & (cls)) != 0)
+#define VL_IS_SPACE(c) VL_CC_IS(c, VL_CC_SPACE)
+#define VL_IS_BLANK(c) VL_CC_IS(c, VL_CC_BLANK)
+#define VL_IS_ALPHA(c) VL_CC_IS(c, VL_CC_ALPHA)
+#define VL_IS_DIGIT(c) VL_CC_IS(c, VL_CC_DIGIT)
+#define VL_IS_PUNCT(c) VL_CC_IS(c, VL_CC_PUNCT)
+#define VL_IS_NAME_START(c) VL_CC_IS(c, VL_CC_ALPHA | VL_CC_UNDERSCORE)
+#define VL_IS_NAME(c) VL_CC_IS(c, VL_CC_ALPHA | VL_CC_DIGIT | VL_CC_UNDERSCORE)
+
+// Every keyword as X(NAME, spelling), in VLTokenKind order
+#define VL_KEYWORDS(X) \
+    X(IS, "is") \
+    X(IF, "if") \
+    X(ELIF, "elif") \
+    X(ELSE, "else") \
+    X(FOR, "for") \
+    X(WHILE, "while") \
+    X(DO, "do") \
+    X(BREAK, "break") \
+    X(CONTINUE, "continue") \
+    X(SWITCH, "switch") \
+    X(CASE, "case") \
+    X(DEFAULT, "default") \
+    X(WITH, "with") \
+    X(TRY, "try") \
+    X(CATCH, "catch") \
+    X(FINALLY, "finally") \
+    X(THROW, "throw") \
+    X(RETURN, "return") \
+    X(FINAL, "final") \
+    X(PUBLIC, "public") \
+    X(PROTECTED, "protected") \
+    X(PRIVATE, "private") \
+    X(STATIC, "static") \
+    X(IMPORT, "import") \
+    X(CLASS, "class")
+
+#define VL_KW_ENUM(name, spelling) VL_KW_##name,
+#define VL_KW_COUNT(name, spelling) + 1
+#define VL_KEYWORD_COUNT (0 VL_KEYWORDS(VL_KW_COUNT))
+
+// The bool literals are interned right after the keywords, so they too are known by symbol
+#define VL_SYMBOL_TRUE VL_KEYWORD_COUNT
+#define VL_SYMBOL_FALSE (VL_KEYWORD_COUNT + 1)
+
+// Every special symbol as X(NAME, spelling), in VLTokenKind order; spellings may only use ASCII punctuation
+#define VL_SYMBOLS(X) \
+    X(ADD, "+") \
+    X(SUB, "-") \
+    X(MUL, "*") \
+    X(DIV, "/") \
+    X(MOD, "%") \
+    X(EXP, "**") \
+    X(NOT, "~") \
+    X(AND, "&") \
+    X(XOR, "^") \
+    X(OR, "|") \
+    X(LSHIFT, "<<") \
+    X(RSHIFT, ">>") \
+    X(LNOT, "!") \
+    X(LAND, "&&") \
+    X(LXOR, "^^") \
+    X(LOR, "||") \
+    X(EQ, "==") \
+    X(NEQ, "!=") \
+    X(LT, "<") \
+    X(GT, ">") \
+    X(LTEQ, "<=") \
+    X(GTEQ, ">=") \
+    X(SAME, "===") \
+    X(NSAME, "!==") \
+    X(INC, "++") \
+    X(DEC, "--") \
+    X(PUT, "=") \
+    X(ADD_PUT, "+=") \
+    X(SUB_PUT, "-=") \
+    X(MUL_PUT, "*=") \
+    X(DIV_PUT, "/=") \
+    X(MOD_PUT, "%=") \
+    X(EXP_PUT, "**=") \
+    X(AND_PUT, "&=") \
+    X(XOR_PUT, "^=") \
+    X(OR_PUT, "|=") \
+    X(LSHIFT_PUT, "<<=") \
+    X(RSHIFT_PUT, ">>=") \
+    X(COLON, ":") \
+    X(SEMICOLON, ";") \
+    X(COMMA, ",") \
+    X(L_CURLY, "{") \
+    X(R_CURLY, "}") \
+    X(COND, "?") \
+    X(L_PAREN, "(") \
+    X(R_PAREN, ")") \
+    X(L_SQUARE, "[") \
+    X(R_SQUARE, "]") \
+    X(DOT, ".") \
+    X(ARROW, "->") \
+    X(ELLIPSIS, "...")
+
+#define VL_SYM_ENUM(name, spelling) VL_SYM_##name,
+#define VL_SYM_CHARS(name, spelling) + sizeof(spelling) - 1
+
+// Symbol DFA bounds: at most one state per spelling character, one class per punctuation character
+#define VL_SYM_MAX_STATES (2 VL_SYMBOLS(VL_SYM_CHARS))
+#define VL_SYM_CLASSES 33
 
 #define VL_ANSI_RED     "\x1b[31m"
 #define VL_ANSI_GREEN   "\x1b[32m"
@@ -20,8 +138,12 @@
 #define VL_ANSI_CYAN    "\x1b[36m"
 #define VL_ANSI_RESET   "\x1b[0m"
 
-#define VL_MAX_OPERATORS 20
-#define VL_MAX_OPERANDS 100
+#define VL_NO_SYMBOL UINT32_MAX
+#define VL_ARENA_BLOCK_SIZE 65536
+
+#define VL_NO_GROUP SIZE_MAX
+#define VL_NO_POS SIZE_MAX
+#define VL_MAX_STMT_DEPTH 1024
 
 // ---- TYPEDEFS ---- //
 
@@ -30,6 +152,8 @@ typedef struct {
     size_t len;
 } VLString;
 
+typedef uint32_t VLSymbol;
+
 typedef char VLChar;
 typedef int8_t VLByte;
 typedef int16_t VLShort;
@@ -55,83 +179,10 @@ typedef enum VLTokenKind {
     VL_TOKEN_BOOL,
 
     // Keywords
-    VL_KW_IS,
-    VL_KW_IF,
-    VL_KW_ELIF,
-    VL_KW_ELSE,
-    VL_KW_FOR,
-    VL_KW_WHILE,
-    VL_KW_DO,
-    VL_KW_BREAK,
-    VL_KW_CONTINUE,
-    VL_KW_SWITCH,
-    VL_KW_CASE,
-    VL_KW_DEFAULT,
-    VL_KW_WITH,
-    VL_KW_TRY,
-    VL_KW_CATCH,
-    VL_KW_FINALLY,
-    VL_KW_THROW,
-    VL_KW_RETURN,
-    VL_KW_FINAL,
-    VL_KW_PUBLIC,
-    VL_KW_PROTECTED,
-    VL_KW_PRIVATE,
-    VL_KW_STATIC,
-    VL_KW_IMPORT,
+    VL_KEYWORDS(VL_KW_ENUM)
 
     // Special symbols
-    VL_SYM_ADD,
-    VL_SYM_SUB,
-    VL_SYM_MUL,
-    VL_SYM_DIV,
-    VL_SYM_MOD,
-    VL_SYM_EXP,
-    VL_SYM_NOT,
-    VL_SYM_AND,
-    VL_SYM_XOR,
-    VL_SYM_OR,
-    VL_SYM_LSHIFT,
-    VL_SYM_RSHIFT,
-    VL_SYM_LNOT,
-    VL_SYM_LAND,
-    VL_SYM_LXOR,
-    VL_SYM_LOR,
-    VL_SYM_EQ,
-    VL_SYM_NEQ,
-    VL_SYM_LT,
-    VL_SYM_GT,
-    VL_SYM_LTEQ,
-    VL_SYM_GTEQ,
-    VL_SYM_SAME,
-    VL_SYM_NSAME,
-    VL_SYM_INC,
-    VL_SYM_DEC,
-    VL_SYM_PUT,
-    VL_SYM_ADD_PUT,
-    VL_SYM_SUB_PUT,
-    VL_SYM_MUL_PUT,
-    VL_SYM_DIV_PUT,
-    VL_SYM_MOD_PUT,
-    VL_SYM_EXP_PUT,
-    VL_SYM_AND_PUT,
-    VL_SYM_XOR_PUT,
-    VL_SYM_OR_PUT,
-    VL_SYM_LSHIFT_PUT,
-    VL_SYM_RSHIFT_PUT,
-    VL_SYM_COLON,
-    VL_SYM_SEMICOLON,
-    VL_SYM_COMMA,
-    VL_SYM_L_CURLY,
-    VL_SYM_R_CURLY,
-    VL_SYM_COND,
-    VL_SYM_L_PAREN,
-    VL_SYM_R_PAREN,
-    VL_SYM_L_SQUARE,
-    VL_SYM_R_SQUARE,
-    VL_SYM_DOT,
-    VL_SYM_ARROW,
-    VL_SYM_ELLIPSIS,
+    VL_SYMBOLS(VL_SYM_ENUM)
 //    VL_SYM_AT,
 //    VL_SYM_BACKSLASH,
 //    VL_SYM_HASH,
@@ -209,6 +260,7 @@ typedef enum VLOperation {
     VL_OP_DECLARE,
     VL_OP_DECLARE_FINAL,
     VL_OP_EXTEND,
+    VL_OP_GENERIC,
 } VLOperation;
 
 typedef enum VLPrecedence {
@@ -251,20 +303,58 @@ typedef enum VLDataType {
     VL_TYPE_FUNCTION,
 } VLDataType;
 
+// A static type as the compiler sees it. Arrays keep their innermost element type in base and
+// their nesting in rank, so int[][] is {VL_TYPE_INT, 2}. The null literal is {VL_TYPE_OBJECT, 0}.
+typedef struct VLType {
+    VLDataType base;
+    uint8_t rank;
+} VLType;
+
 typedef enum VLStatus {
     VL_STATUS_OK,
     VL_STATUS_OUT_OF_MEM,
     VL_STATUS_UNEXPECTED,
+    VL_STATUS_SYNTAX,
     VL_STATUS_EXPECTED,
     VL_STATUS_UNCLOSED,
     VL_STATUS_NOT_ENOUGH_OPERANDS,
+    VL_STATUS_TOO_DEEP,
+    VL_STATUS_TOO_LARGE,
+    VL_STATUS_OVERFLOW,
+    VL_STATUS_UNDEFINED,
+    VL_STATUS_REDEFINED,
+    VL_STATUS_MISMATCH,
+    VL_STATUS_ARGUMENTS,
+    VL_STATUS_UNSUPPORTED,
+    VL_STATUS_LIMIT,
+    VL_STATUS_RUNTIME,
 } VLStatus;
 
+typedef union VLLiteral {
+    struct {
+        VLString stringValue;
+        VLSymbol symbol;
+        bool hasEscapes;
+    };
+    VLChar charValue;
+    VLByte byteValue;
+    VLShort shortValue;
+    VLInt intValue;
+    VLLong longValue;
+    VLFloat floatValue;
+    VLDouble doubleValue;
+    VLBool boolValue;
+} VLLiteral;
+
 typedef struct VLToken {
     VLTokenKind kind;
     size_t pos;
     union {
-        VLString stringValue;
+        struct {
+            VLString stringValue;
+            VLSymbol symbol;
+            bool hasEscapes;
+        };
         VLChar charValue;
         VLByte byteValue;
         VLShort shortValue;
@@ -276,11 +366,17 @@ typedef struct VLToken {
     };
 } VLToken;
 
+// type is only filled in by the checker, on its own copy of a tree; parsed trees leave it zeroed
 typedef struct VLExpression {
     VLExprKind kind;
     size_t pos;
+    VLType type;
     union {
-        VLString stringValue;
+        struct {
+            VLString stringValue;
+            VLSymbol symbol;
+            bool hasEscapes;
+        };
         VLChar charValue;
         VLByte byteValue;
         VLShort shortValue;
@@ -312,21 +408,204 @@ typedef struct VLExpression {
     };
 } VLExpression;
 
-typedef struct VLParser {
-    FILE* stream;
+typedef enum VLStmtKind {
+    VL_STMT_EXPR,
+    VL_STMT_BLOCK,
+    VL_STMT_IF,
+    VL_STMT_FOR,
+    VL_STMT_FOR_EACH,
+    VL_STMT_WHILE,
+    VL_STMT_DO_WHILE,
+    VL_STMT_WITH,
+    VL_STMT_RETURN,
+    VL_STMT_BREAK,
+    VL_STMT_CONTINUE,
+    VL_STMT_THROW,
+    VL_STMT_FUNCTION,
+    VL_STMT_CLASS,
+    VL_STMT_IMPORT,
+} VLStmtKind;
+
+typedef enum VLModifier {
+    VL_MOD_PUBLIC = 1 << 0,
+    VL_MOD_PROTECTED = 1 << 1,
+    VL_MOD_PRIVATE = 1 << 2,
+    VL_MOD_STATIC = 1 << 3,
+    VL_MOD_GET = 1 << 4,
+    VL_MOD_SET = 1 << 5,
+} VLModifier;
+
+typedef struct VLStatement {
+    VLStmtKind kind;
+    size_t pos;
+    uint32_t modifiers;
+    union {
+        // Expression statements, return and throw; NULL for a bare return
+        VLExpression* expr;
+        struct {
+            struct VLStatement** items;
+            size_t count;
+        } block;
+        // An elif chain nests as another VL_STMT_IF in otherwise
+        struct {
+            VLExpression* condition;
+            struct VLStatement* then;
+            struct VLStatement* otherwise;
+        } ifStmt;
+        // for (init; condition; step), while (condition : step) and do ... while (condition)
+        struct {
+            VLExpression* init;
+            VLExpression* condition;
+            VLExpression* step;
+            struct VLStatement* body;
+        } loop;
+        struct {
+            VLExpression* item;
+            VLExpression* iterable;
+            struct VLStatement* body;
+        } forEach;
+        struct {
+            VLExpression* setup;
+            struct VLStatement* body;
+        } with;
+        // The signature is the VL_OP_CALL the declaration parses as; body is NULL for a prototype.
+        // params is the VL_OP_LIST of type parameters of a generic function, or NULL.
+        struct {
+            VLExpression* signature;
+            struct VLStatement* body;
+            VLExpression* params;
+        } function;
+        // params and supers are VL_OP_LIST expressions, or NULL when absent
+        struct {
+            VLExpression* name;
+            VLExpression* params;
+            VLExpression* supers;
+            struct VLStatement* body;
+        } classDef;
+        struct {
+            VLExpression* module;
+            struct VLStatement* body;
+        } import;
+    };
+} VLStatement;
+
+typedef struct VLArenaBlock {
+    struct VLArenaBlock* next;
+    size_t used;
+    size_t size;
+    alignas(max_align_t) char data[];
+} VLArenaBlock;
+
+typedef struct VLArenaStats {
+    size_t allocations;
+    size_t bytesUsed;
+    size_t bytesReserved;
+    size_t blocks;
+} VLArenaStats;
+
+typedef struct VLArena {
+    VLArenaBlock* blocks;
+    VLArenaStats stats;
+} VLArena;
+
+typedef struct VLSymbolTable {
+    VLString* names;
+    uint32_t* hashes;
+    size_t count;
+    size_t capacity;
+    VLSymbol* slots;
+    size_t slotCount;
+    VLArena* storage;
+} VLSymbolTable;
+
+typedef struct VLScanner {
+    const char* name;
+    const char* (*skipSpace)(const char* p, const char* end);
+    const char* (*skipName)(const char* p, const char* end);
+    const char* (*findLineStop)(const char* p, const char* end);
+    const char* (*findStringStop)(const char* p, const char* end);
+    const char* (*findBlockEnd)(const char* p, const char* end);
+} VLScanner;
+
+typedef struct VLPendingOp {
+    VLOperation operation;
     size_t pos;
+    size_t base;
+    size_t enclosing;
+    bool open;
+} VLPendingOp;
+
+typedef struct VLSource {
+    char* data;
+    size_t size;
+    bool mapped;
+} VLSource;
+
+typedef struct VLParser {
+    const char* source;
+    const char* cursor;
+    const char* end;
+    const VLScanner* scanner;
+    const struct VLTokenStream* tokens;
+    size_t tokenIndex;
     VLToken token;
-    VLOperation operators[VL_MAX_OPERATORS];
+    VLArena arena;
+    VLSymbolTable symbols;
+    VLPendingOp* operators;
     size_t operatorCount;
-    VLExpression* operands[VL_MAX_OPERANDS];
+    size_t operatorCapacity;
+    VLExpression** operands;
     size_t operandCount;
+    size_t operandCapacity;
+    VLStatement** statements;
+    size_t statementCount;
+    size_t statementCapacity;
     VLStatus status;
     const char* what;
+    char unexpected[2];
+    size_t errorPos;
+    bool copyStrings;
+    size_t folded;
 } VLParser;
 
+// ---- GLOBALS ---- //
+
+extern const uint8_t vlCharClass[256];
+
 // ---- FUNCTION PROTOTYPES ---- //
 
-void vlPrintToken(VLToken token);
+const VLScanner* vlGetScanner(void);
+
+bool vlLoadSource(VLSource* source, const char* path);
+void vlFreeSource(VLSource* source);
+void vlInitParser(VLParser* parser, const char* source, size_t size);
+void vlFreeParser(VLParser* parser);
+
+VLExpression* vlNewExpr(VLParser* parser, VLExprKind kind, size_t pos);
+
+void vlInitArena(VLArena* arena);
+void vlFreeArena(VLArena* arena);
+void* vlArenaAlloc(VLArena* arena, size_t size);
+char* vlArenaString(VLArena* arena, const char* str, size_t len);
+
+void vlInitSymbols(VLSymbolTable* table, VLArena* storage);
+void vlFreeSymbols(VLSymbolTable* table);
+VLSymbol vlIntern(VLSymbolTable* table, const char* str, size_t len);
+VLString vlSymbolName(const VLSymbolTable* table, VLSymbol symbol);
+
+VLString vlDecodeString(VLArena* arena, VLString raw);
+void vlPrintString(FILE* out, VLString string, bool hasEscapes);
+void vlPrintToken(FILE* out, VLToken token);
+const char* vlTypeName(VLType type, char* buffer, size_t size);
+void vlPrintExpr(FILE* out, const VLExpression* expr);
+void vlPrintStatement(FILE* out, const VLStatement* stmt, size_t depth);
+const char* vlTokenSpelling(VLTokenKind kind);
+const char* vlOpSpelling(VLOperation op);
+void vlLocate(const char* source, size_t pos, size_t* line, size_t* column);
+bool vlReportError(FILE* out, VLStatus status, const char* what);
+bool vlReportStatus(FILE* out, const VLParser* parser);
+bool vlCheckStatus(VLParser* parser);
+size_t vlErrorPos(const VLParser* parser);
 
 void vlGrabNameToken(VLParser* parser);
 void vlGrabNumberToken(VLParser* parser);
@@ -348,6 +627,14 @@ bool vlEndsExpr(VLTokenKind kind, bool allowComma);
 
 void vlMakeOperand(VLParser* parser);
 
+size_t vlExprChildCount(const VLExpression* expr);
+VLExpression* vlExprChild(const VLExpression* expr, size_t index);
+VLLiteral vlExprLiteral(const VLExpression* expr);
+
 VLExpression* vlParseExpr(VLParser* parser, VLDataType type, bool lvalue, bool allowComma, bool allowEmpty);
 
+VLStatement* vlNewStatement(VLParser* parser, VLStmtKind kind, size_t pos);
+VLStatement* vlParseStatement(VLParser* parser);
+VLStatement* vlParseUnit(VLParser* parser);
+
 #endif /* VALLEY_H */
@@ -0,0 +1,80 @@
+#ifndef VALLEY_VM_H
+#define VALLEY_VM_H
+
+#include "valley.h"
+#include "bytecode.h"
+#include "jit.h"
+
+// ---- MACROS ---- //
+
+#define VL_STACK_VALUES ((size_t) 1 << 20)
+#define VL_MAX_FRAMES ((size_t) 1 << 16)
+// New arrays get inline room for at least this many bytes of elements
+#define VL_ARRAY_INLINE_BYTES 32
+// Room for variadic packs; those that don't fit become ordinary arrays
+#define VL_PACK_BYTES ((size_t) 1 << 20)
+
+// ---- TYPEDEFS ---- //
+
+struct VLMachine;
+
+// Natives see their arguments in args[0] onwards and leave their result in args[0]. They return
+// false after setting the machine's status when they fail.
+typedef bool (*VLNativeCall)(struct VLMachine* machine, VLValue* args);
+
+// A built-in a prototype binds to by name; signature is the prototype's types as vlTypeName
+// spells them, such as "str(str[],str)"
+typedef struct VLNative {
+    const char* name;
+    const char* signature;
+    VLNativeCall call;
+} VLNative;
+
+typedef struct VLFrame {
+    const VLFunction* function;
+    const uint32_t* pc;
+    VLValue* base;
+} VLFrame;
+
+// Registers for every active call live on one stack, each frame's window starting at the register
+// its caller put the first argument in. A runtime error stops the machine with status set the way
+// the compiler reports errors, pos being the source offset of the failing instruction. With jit
+// set, calls to functions it compiled run as machine code instead. Packs are taken from packs
+// below packTop, last in first out.
+typedef struct VLMachine {
+    const VLProgram* program;
+    VLValue* stack;
+    VLFrame* frames;
+    size_t frameCount;
+    VLValue* globals;
+    VLObject* objects;
+    char* packs;
+    size_t packTop;
+    VLJit* jit;
+    VLStatus status;
+    const char* what;
+    size_t pos;
+    char detail[128];
+} VLMachine;
+
+// ---- GLOBALS ---- //
+
+extern const VLNative vlNatives[];
+extern const size_t vlNativeCount;
+
+// ---- FUNCTION PROTOTYPES ---- //
+
+size_t vlFindNative(VLString name);
+
+bool vlInitMachine(VLMachine* machine, const VLProgram* program);
+void vlFreeMachine(VLMachine* machine);
+bool vlEnableJit(VLMachine* machine);
+bool vlRunProgram(VLMachine* machine);
+
+VLStringObject* vlNewString(VLMachine* machine, size_t length);
+VLArrayObject* vlNewArray(VLMachine* machine, VLElementKind element, size_t length);
+VLValue vlReduceArray(const VLArrayObject* array, VLValue acc, uint32_t mode);
+void vlPrintValue(FILE* out, VLValue value, VLType type);
+void vlPrintVariables(FILE* out, const VLMachine* machine);
+
+#endif /* VALLEY_VM_H */
@@ -0,0 +1,54 @@
+#ifndef VALLEY_WATCH_H
+#define VALLEY_WATCH_H
+
+#include <stddef.h>
+
+#include "valley.h"
+#include "driver.h"
+
+// ---- MACROS ---- //
+
+// A unit is reparsed from scratch once its arena holds this many times the bytes of its last full parse
+#define VL_ARENA_WASTE_FACTOR 4
+
+// ---- TYPEDEFS ---- //
+
+// A top-level statement together with the byte range it was parsed from. Statements that survive an
+// edit keep the positions they were parsed with, so shift has to be added to any pos found inside stmt.
+typedef struct VLTopLevel {
+    VLStatement* stmt;
+    size_t start;
+    size_t end;
+    size_t line;
+    ptrdiff_t shift;
+} VLTopLevel;
+
+typedef struct VLReparseStats {
+    size_t relexedBytes;
+    size_t reparsed;
+    size_t reused;
+} VLReparseStats;
+
+// A file kept parsed across edits. text is the last version that parsed cleanly; an edit that fails
+// to parse is reported and then diffed against this again next time, so the damage stays local.
+typedef struct VLIncrementalUnit {
+    char* text;
+    size_t size;
+    VLParser parser;
+    VLTopLevel* entries;
+    size_t count;
+    size_t capacity;
+    size_t liveBytes;
+    bool ok;
+} VLIncrementalUnit;
+
+// ---- FUNCTION PROTOTYPES ---- //
+
+void vlInitIncremental(VLIncrementalUnit* unit);
+void vlFreeIncremental(VLIncrementalUnit* unit);
+bool vlUpdateIncremental(VLIncrementalUnit* unit, char* text, size_t size, const char* path, FILE* out,
+                         VLReparseStats* stats);
+
+bool vlWatch(VLBuild* build, FILE* out);
+
+#endif /* VALLEY_WATCH_H */
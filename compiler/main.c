@@ -1,38 +1,165 @@
+#include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 #include "include/valley.h"
+#include "include/driver.h"
+#include "include/watch.h"
+#include "include/server.h"
+#include "include/stats.h"
 
-int main() {
-    clock_t timer = clock();
+static void usage(void) {
+    printf("Usage: valley [options] [file or directory]...\n"
+           "  -j <count>   Compile on <count> threads (default: one per CPU)\n"
+           "  --tokens     Print each file's tokens instead of parsing it\n"
+           "  --tree       Print each file's statement tree\n"
+           "  --types      Print each file's tree after type checking, with the type of each expression\n"
+           "  --bytecode   Print the bytecode each file compiles to\n"
+           "  --run        Compile each file to bytecode and run it, printing its top-level variables\n"
+           "  --jit        With --run, compile functions over primitives to machine code first\n"
+           "  --emit-c     Print each file lowered to a standalone C program\n"
+           "  --native     Build each file into an executable with $CC (default: cc) and $CFLAGS,\n"
+           "               named after the file minus its .vl extension\n"
+           "  --strict-fp  Keep float reductions in loop order instead of folding them in lanes\n"
+           "  --watch      Keep running and reparse files incrementally as they change\n"
+           "  --stats=json Print per-file and total statistics for each pass as JSON; everything\n"
+           "               else goes to stderr so stdout holds only the JSON document\n"
+           "  --server <socket>  Serve compile requests, keeping parsed modules in memory\n"
+           "  --client <socket>  Have the server at <socket> compile the inputs\n"
+           "  --shutdown   With --client, stop the server after this request\n"
+           "With no inputs, compiles test.vl.\n");
+}
 
-    const char* path = "test.vl";
-    FILE* stream = fopen(path, "r");
-    if (!stream) {
-        printf("Unable to load file '%s'.\n", path);
-        return 0;
-    }
+int main(int argc, char** argv) {
+    struct timespec start, stop;
+    clock_gettime(CLOCK_MONOTONIC, &start);
 
-    VLParser parser = {stream, -1, {.kind = VL_TOKEN_EOF, -1}, .status = VL_STATUS_OK};
+    VLDriverOptions options = {0};
+    const char* serverPath = NULL;
+    const char* clientPath = NULL;
+    bool stopServer = false;
+    const char** inputs = malloc(argc * sizeof(char*));
+    size_t inputCount = 0;
+    if (!inputs) return 1;
 
-    if (!vlNextToken(&parser)) {
-        fclose(stream);
-        return 1;
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        if (!strcmp(arg, "-j") && i + 1 < argc) {
+            options.jobs = strtoul(argv[++i], NULL, 10);
+        } else if (!strncmp(arg, "-j", 2) && arg[2]) {
+            options.jobs = strtoul(arg + 2, NULL, 10);
+        } else if (!strcmp(arg, "--tokens")) {
+            options.dumpTokens = true;
+        } else if (!strcmp(arg, "--tree")) {
+            options.dumpTree = true;
+        } else if (!strcmp(arg, "--types")) {
+            options.dumpTypes = true;
+        } else if (!strcmp(arg, "--bytecode")) {
+            options.dumpBytecode = true;
+        } else if (!strcmp(arg, "--run")) {
+            options.run = true;
+        } else if (!strcmp(arg, "--jit")) {
+            options.jit = true;
+        } else if (!strcmp(arg, "--emit-c")) {
+            options.emitC = true;
+        } else if (!strcmp(arg, "--native")) {
+            options.native = true;
+        } else if (!strcmp(arg, "--strict-fp")) {
+            options.strictFloat = true;
+        } else if (!strcmp(arg, "--watch")) {
+            options.watch = true;
+        } else if (!strcmp(arg, "--stats=json")) {
+            options.stats = true;
+        } else if (!strcmp(arg, "--server") && i + 1 < argc) {
+            serverPath = argv[++i];
+        } else if (!strcmp(arg, "--client") && i + 1 < argc) {
+            clientPath = argv[++i];
+        } else if (!strcmp(arg, "--shutdown")) {
+            stopServer = true;
+        } else if (!strcmp(arg, "-h") || !strcmp(arg, "--help")) {
+            usage();
+            free(inputs);
+            return 0;
+        } else if (arg[0] == '-' && arg[1]) {
+            printf("Unknown option '%s'.\n", arg);
+            usage();
+            free(inputs);
+            return 2;
+        } else {
+            inputs[inputCount++] = arg;
+        }
+    }
+    if (serverPath) {
+        free(inputs);
+        return vlServe(serverPath, &options, stdout) ? 0 : 1;
+    }
+    if (clientPath) {
+        if (!inputCount && !stopServer) inputs[inputCount++] = "test.vl";
+        int status = vlRequest(clientPath, &options, inputs, inputCount, stopServer, stdout);
+        free(inputs);
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+        double elapsed = (double) (stop.tv_sec - start.tv_sec) + (double) (stop.tv_nsec - start.tv_nsec) / 1e9;
+        printf("\n============\nTime taken: %f seconds\n", elapsed);
+        return status;
     }
 
-    printf("------------ TOKENS ------------\n");
-    while (parser.token.kind != VL_TOKEN_EOF) {
-        vlPrintToken(parser.token);
+    if (!inputCount) inputs[inputCount++] = "test.vl";
 
-        if (!vlNextToken(&parser)) {
-            fclose(stream);
+    VLBuild build;
+    vlInitBuild(&build, options);
+    for (size_t i = 0; i < inputCount; ++i) {
+        if (!vlAddInput(&build, inputs[i])) {
+            printf(VL_ANSI_RED "Error: Unable to read '%s'." VL_ANSI_RESET "\n", inputs[i]);
+            vlFreeBuild(&build);
+            free(inputs);
             return 1;
         }
     }
+    free(inputs);
 
-    fclose(stream);
+    if (options.watch) {
+        bool ok = vlWatch(&build, stdout);
+        vlFreeBuild(&build);
+        return ok ? 0 : 1;
+    }
+
+    if (!vlRunBuild(&build)) {
+        fprintf(options.stats ? stderr : stdout, VL_ANSI_RED "Error: Ran out of available memory." VL_ANSI_RESET "\n");
+        vlFreeBuild(&build);
+        return 1;
+    }
+    bool ok = vlWriteUnits(&build, options.stats ? stderr : stdout);
+    if (options.stats) {
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+        double elapsed = (double) (stop.tv_sec - start.tv_sec) + (double) (stop.tv_nsec - start.tv_nsec) / 1e9;
+        vlWriteStatsJson(stdout, &build, elapsed);
+        vlFreeBuild(&build);
+        return ok ? 0 : 1;
+    }
+
+    size_t bytes = 0, statements = 0, folded = 0;
+    VLArenaStats stats = {0};
+    for (size_t i = 0; i < build.count; ++i) {
+        bytes += build.units[i].size;
+        statements += build.units[i].statements;
+        folded += build.units[i].folded;
+        stats.allocations += build.units[i].arena.allocations;
+        stats.bytesUsed += build.units[i].arena.bytesUsed;
+        stats.bytesReserved += build.units[i].arena.bytesReserved;
+        stats.blocks += build.units[i].arena.blocks;
+    }
+    size_t files = build.count;
+    size_t jobs = options.jobs ? options.jobs : vlDefaultJobs();
+    if (jobs > files) jobs = files;
+    vlFreeBuild(&build);
 
-    timer = clock() - timer;
-    printf("\n============\nTime taken: %f seconds\n", ((float) timer) / CLOCKS_PER_SEC);
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    double elapsed = (double) (stop.tv_sec - start.tv_sec) + (double) (stop.tv_nsec - start.tv_nsec) / 1e9;
+    printf("\n============\nTime taken: %f seconds\n", elapsed);
+    printf("Files: %zu (%zu bytes, %zu top-level statements) on %zu thread(s)\n", files, bytes, statements, jobs);
+    printf("Folded: %zu constant expression nodes\n", folded);
+    printf("Arena: %zu allocations, %zu of %zu bytes in %zu blocks\n",
+           stats.allocations, stats.bytesUsed, stats.bytesReserved, stats.blocks);
 
-    return 0;
+    return ok ? 0 : 1;
 }
@@ -0,0 +1,75 @@
+/* ================
+ * src/arena.c
+ * VALLEY LANGUAGE COMPILER
+ * Per-unit bump allocation
+ * ================
+ */
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "../include/valley.h"
+
+
+// ---- FUNCTIONS ---- //
+
+void vlInitArena(VLArena* arena) {
+    VLArena init = {0};
+    *arena = init;
+}
+
+
+void vlFreeArena(VLArena* arena) {
+    VLArenaBlock* block = arena->blocks;
+    while (block) {
+        VLArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    vlInitArena(arena);
+}
+
+
+void* vlArenaAlloc(VLArena* arena, size_t size) {
+    const size_t align = alignof(max_align_t);
+    size = (size + align - 1) & ~(align - 1);
+
+    VLArenaBlock* block = arena->blocks;
+    if (!block || block->size - block->used < size) {
+        size_t blockSize = size > VL_ARENA_BLOCK_SIZE ? size : VL_ARENA_BLOCK_SIZE;
+        VLArenaBlock* fresh = malloc(sizeof(VLArenaBlock) + blockSize);
+        if (!fresh) return NULL;
+        fresh->used = 0;
+        fresh->size = blockSize;
+
+        // An oversized request gets a block of its own, tucked behind the one still being filled
+        if (block && blockSize > VL_ARENA_BLOCK_SIZE) {
+            fresh->next = block->next;
+            block->next = fresh;
+        } else {
+            fresh->next = block;
+            arena->blocks = fresh;
+        }
+        block = fresh;
+
+        ++arena->stats.blocks;
+        arena->stats.bytesReserved += blockSize;
+    }
+
+    void* ptr = block->data + block->used;
+    block->used += size;
+
+    ++arena->stats.allocations;
+    arena->stats.bytesUsed += size;
+    return ptr;
+}
+
+
+char* vlArenaString(VLArena* arena, const char* str, size_t len) {
+    char* copy = vlArenaAlloc(arena, len + 1);
+    if (!copy) return NULL;
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    return copy;
+}
@@ -0,0 +1,297 @@
+/* ================
+ * src/ast.c
+ * VALLEY LANGUAGE COMPILER
+ * Flat expression storage
+ * ================
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/ast.h"
+
+
+// ---- HELPERS ---- //
+
+static bool vlGrowArray(void** array, size_t count, size_t size) {
+    void* grown = realloc(*array, count * size);
+    if (!grown) return false;
+    *array = grown;
+    return true;
+}
+
+
+static VLNodeIndex vlAddNode(VLFlatAst* ast, VLExprKind kind, VLOperation op, size_t pos) {
+    if (ast->count == ast->capacity) {
+        size_t capacity = ast->capacity ? ast->capacity * 2 : 256;
+        if (capacity > VL_NO_NODE) return VL_NO_NODE;
+        if (!vlGrowArray((void**) &ast->kinds, capacity, sizeof(uint8_t))
+                || !vlGrowArray((void**) &ast->operations, capacity, sizeof(uint8_t))
+                || !vlGrowArray((void**) &ast->positions, capacity, sizeof(uint32_t))
+                || !vlGrowArray((void**) &ast->first, capacity, sizeof(VLNodeIndex))
+                || !vlGrowArray((void**) &ast->second, capacity, sizeof(VLNodeIndex))
+                || !vlGrowArray((void**) &ast->third, capacity, sizeof(VLNodeIndex))) {
+            return VL_NO_NODE;
+        }
+        ast->capacity = capacity;
+    }
+
+    VLNodeIndex node = (VLNodeIndex) ast->count++;
+    ast->kinds[node] = (uint8_t) kind;
+    ast->operations[node] = (uint8_t) op;
+    ast->positions[node] = (uint32_t) pos;
+    ast->first[node] = VL_NO_NODE;
+    ast->second[node] = VL_NO_NODE;
+    ast->third[node] = VL_NO_NODE;
+    return node;
+}
+
+
+static bool vlReserveChildren(VLFlatAst* ast, size_t count) {
+    if (ast->childCount + count <= ast->childCapacity) return true;
+    size_t capacity = ast->childCapacity ? ast->childCapacity : 256;
+    while (capacity < ast->childCount + count) capacity *= 2;
+    if (!vlGrowArray((void**) &ast->children, capacity, sizeof(VLNodeIndex))) return false;
+    ast->childCapacity = capacity;
+    return true;
+}
+
+
+static VLNodeIndex vlAddLiteral(VLFlatAst* ast, VLLiteral literal) {
+    if (ast->literalCount == ast->literalCapacity) {
+        size_t capacity = ast->literalCapacity ? ast->literalCapacity * 2 : 64;
+        if (!vlGrowArray((void**) &ast->literals, capacity, sizeof(VLLiteral))) return VL_NO_NODE;
+        ast->literalCapacity = capacity;
+    }
+    ast->literals[ast->literalCount] = literal;
+    return (VLNodeIndex) ast->literalCount++;
+}
+
+
+static VLOperation vlOperationOf(const VLExpression* expr) {
+    switch (expr->kind) {
+        case VL_EXPR_UNARY: return expr->unaryOp.operation;
+        case VL_EXPR_BINARY: return expr->binaryOp.operation;
+        case VL_EXPR_TERNARY: return expr->ternaryOp.operation;
+        case VL_EXPR_MULTI: return expr->multiOp.operation;
+        default: return 0;
+    }
+}
+
+
+// Appends expr itself, once its children's indices are sitting on top of results
+static VLNodeIndex vlEmitNode(VLFlatAst* ast, const VLExpression* expr, VLNodeIndex* results, size_t count) {
+    switch (expr->kind) {
+        case VL_EXPR_UNARY: {
+            VLNodeIndex node = vlAddNode(ast, expr->kind, expr->unaryOp.operation, expr->pos);
+            if (node != VL_NO_NODE) ast->first[node] = results[0];
+            return node;
+        }
+        case VL_EXPR_BINARY: {
+            VLNodeIndex node = vlAddNode(ast, expr->kind, expr->binaryOp.operation, expr->pos);
+            if (node == VL_NO_NODE) return node;
+            ast->first[node] = results[0];
+            ast->second[node] = results[1];
+            return node;
+        }
+        case VL_EXPR_TERNARY: {
+            VLNodeIndex node = vlAddNode(ast, expr->kind, expr->ternaryOp.operation, expr->pos);
+            if (node == VL_NO_NODE) return node;
+            ast->first[node] = results[0];
+            ast->second[node] = results[1];
+            ast->third[node] = results[2];
+            return node;
+        }
+        case VL_EXPR_MULTI: {
+            if (!vlReserveChildren(ast, count)) return VL_NO_NODE;
+            VLNodeIndex node = vlAddNode(ast, expr->kind, expr->multiOp.operation, expr->pos);
+            if (node == VL_NO_NODE) return node;
+            ast->first[node] = (VLNodeIndex) ast->childCount;
+            ast->second[node] = (VLNodeIndex) count;
+            if (count) memcpy(ast->children + ast->childCount, results, count * sizeof(VLNodeIndex));
+            ast->childCount += count;
+            return node;
+        }
+        default: {
+            VLNodeIndex literal = vlAddLiteral(ast, vlExprLiteral(expr));
+            if (literal == VL_NO_NODE) return VL_NO_NODE;
+            VLNodeIndex node = vlAddNode(ast, expr->kind, 0, expr->pos);
+            if (node != VL_NO_NODE) ast->first[node] = literal;
+            return node;
+        }
+    }
+}
+
+
+// ---- FUNCTIONS ---- //
+
+void vlInitFlatAst(VLFlatAst* ast) {
+    VLFlatAst init = {0};
+    *ast = init;
+}
+
+
+void vlFreeFlatAst(VLFlatAst* ast) {
+    free(ast->kinds);
+    free(ast->operations);
+    free(ast->positions);
+    free(ast->first);
+    free(ast->second);
+    free(ast->third);
+    free(ast->children);
+    free(ast->literals);
+    vlInitFlatAst(ast);
+}
+
+
+size_t vlFlatAstBytes(const VLFlatAst* ast) {
+    size_t perNode = 2 * sizeof(uint8_t) + sizeof(uint32_t) + 3 * sizeof(VLNodeIndex);
+    return ast->count * perNode + ast->childCount * sizeof(VLNodeIndex) + ast->literalCount * sizeof(VLLiteral);
+}
+
+
+VLNodeIndex vlFlattenExpr(VLFlatAst* ast, const VLExpression* expr) {
+    // Iterative post-order walk, so arbitrarily deep trees don't touch the C stack
+    typedef struct {
+        const VLExpression* expr;
+        size_t next;
+    } VLFrame;
+
+    VLFrame* frames = NULL;
+    size_t frameCount = 0, frameCapacity = 0;
+    VLNodeIndex* results = NULL;
+    size_t resultCount = 0, resultCapacity = 0;
+    VLNodeIndex root = VL_NO_NODE;
+
+    const VLExpression* pending = expr;
+    while (true) {
+        if (pending) {
+            if (frameCount == frameCapacity) {
+                frameCapacity = frameCapacity ? frameCapacity * 2 : 64;
+                if (!vlGrowArray((void**) &frames, frameCapacity, sizeof(VLFrame))) break;
+            }
+            VLFrame frame = {pending, 0};
+            frames[frameCount++] = frame;
+            pending = NULL;
+        }
+
+        VLFrame* top = &frames[frameCount - 1];
+        size_t childCount = vlExprChildCount(top->expr);
+        if (top->next < childCount) {
+            pending = vlExprChild(top->expr, top->next++);
+            continue;
+        }
+
+        resultCount -= childCount;
+        VLNodeIndex node = vlEmitNode(ast, top->expr, results + resultCount, childCount);
+        if (node == VL_NO_NODE) break;
+        --frameCount;
+
+        if (frameCount == 0) {
+            root = node;
+            break;
+        }
+        if (resultCount == resultCapacity) {
+            resultCapacity = resultCapacity ? resultCapacity * 2 : 64;
+            if (!vlGrowArray((void**) &results, resultCapacity, sizeof(VLNodeIndex))) break;
+        }
+        results[resultCount++] = node;
+    }
+
+    free(frames);
+    free(results);
+    return root;
+}
+
+
+size_t vlFlatChildCount(const VLFlatAst* ast, VLNodeIndex node) {
+    switch (ast->kinds[node]) {
+        case VL_EXPR_UNARY: return 1;
+        case VL_EXPR_BINARY: return 2;
+        case VL_EXPR_TERNARY: return 3;
+        case VL_EXPR_MULTI: return ast->second[node];
+        default: return 0;
+    }
+}
+
+
+VLNodeIndex vlFlatChild(const VLFlatAst* ast, VLNodeIndex node, size_t index) {
+    switch (ast->kinds[node]) {
+        case VL_EXPR_UNARY:
+        case VL_EXPR_BINARY:
+        case VL_EXPR_TERNARY:
+            return index == 0 ? ast->first[node] : index == 1 ? ast->second[node] : ast->third[node];
+        case VL_EXPR_MULTI:
+            return ast->children[ast->first[node] + index];
+        default:
+            return VL_NO_NODE;
+    }
+}
+
+
+const VLLiteral* vlFlatLiteral(const VLFlatAst* ast, VLNodeIndex node) {
+    if (ast->kinds[node] >= VL_EXPR_UNARY) return NULL;
+    return &ast->literals[ast->first[node]];
+}
+
+
+bool vlFlatMatchesExpr(const VLFlatAst* ast, VLNodeIndex node, const VLExpression* expr) {
+    // Walks both trees side by side with an explicit stack of pairs still to compare
+    typedef struct {
+        VLNodeIndex node;
+        const VLExpression* expr;
+    } VLPair;
+
+    VLPair* pairs = NULL;
+    size_t pairCount = 0, pairCapacity = 0;
+    bool matches = true;
+
+    VLPair pending = {node, expr};
+    while (true) {
+        VLNodeIndex flat = pending.node;
+        const VLExpression* tree = pending.expr;
+        if (flat == VL_NO_NODE || flat >= ast->count || ast->kinds[flat] != tree->kind
+                || ast->positions[flat] != (uint32_t) tree->pos) {
+            matches = false;
+            break;
+        }
+
+        size_t childCount = vlFlatChildCount(ast, flat);
+        if (childCount != vlExprChildCount(tree)) {
+            matches = false;
+            break;
+        }
+        if (childCount == 0) {
+            VLLiteral literal = vlExprLiteral(tree);
+            const VLLiteral* stored = vlFlatLiteral(ast, flat);
+            // The string fields overlay every numeric value, so comparing them covers all literal kinds
+            if (stored->stringValue.first != literal.stringValue.first
+                    || stored->stringValue.len != literal.stringValue.len || stored->symbol != literal.symbol
+                    || stored->hasEscapes != literal.hasEscapes) {
+                matches = false;
+                break;
+            }
+        } else if (ast->operations[flat] != vlOperationOf(tree)) {
+            matches = false;
+            break;
+        }
+
+        if (pairCount + childCount > pairCapacity) {
+            while (pairCount + childCount > pairCapacity) pairCapacity = pairCapacity ? pairCapacity * 2 : 64;
+            if (!vlGrowArray((void**) &pairs, pairCapacity, sizeof(VLPair))) {
+                matches = false;
+                break;
+            }
+        }
+        for (size_t i = 0; i < childCount; ++i) {
+            VLPair pair = {vlFlatChild(ast, flat, i), vlExprChild(tree, i)};
+            pairs[pairCount++] = pair;
+        }
+
+        if (pairCount == 0) break;
+        pending = pairs[--pairCount];
+    }
+
+    free(pairs);
+    return matches;
+}
@@ -0,0 +1,252 @@
+/* ================
+ * src/bytecode.c
+ * VALLEY LANGUAGE COMPILER
+ * Bytecode programs and their disassembly
+ * ================
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "../include/bytecode.h"
+
+
+// ---- HELPERS ---- //
+
+static const char* vlOpcodeNames[] = {
+#define VL_BC_NAME(name, format) #name,
+    VL_OPCODES(VL_BC_NAME)
+#undef VL_BC_NAME
+};
+
+static const VLOperandFormat vlOpcodeFormats[] = {
+#define VL_BC_FORMAT(name, format) VL_FORMAT_##format,
+    VL_OPCODES(VL_BC_FORMAT)
+#undef VL_BC_FORMAT
+};
+
+static const char* vlReduceNames[] = {"add", "mul", "and", "or", "xor", "min", "max"};
+
+
+static void vlPrintInstruction(FILE* out, const VLFunction* fn, size_t at) {
+    uint32_t ins = fn->code[at];
+    VLOpcode op = (VLOpcode) VL_INS_OP(ins);
+    fprintf(out, "    %04zu  %-9s", at, vlOpcodeName(op));
+    switch (vlOpcodeFormat(op)) {
+        case VL_FORMAT_NONE:
+            break;
+        case VL_FORMAT_A:
+            fprintf(out, " r%u", VL_INS_A(ins));
+            break;
+        case VL_FORMAT_AB:
+            fprintf(out, " r%u r%u", VL_INS_A(ins), VL_INS_B(ins));
+            break;
+        case VL_FORMAT_ABC:
+            if (op == VL_BC_NEWARR || op == VL_BC_NEWPACK) {
+                fprintf(out, " r%u r%u elem=%u", VL_INS_A(ins), VL_INS_B(ins), VL_INS_C(ins));
+            } else if (op == VL_BC_REDUCE) {
+                uint32_t mode = VL_INS_C(ins);
+                fprintf(out, " r%u r%u %s elem=%u%s", VL_INS_A(ins), VL_INS_B(ins), vlReduceName(VL_REDUCE_OP(mode)),
+                        VL_REDUCE_ELEMENT(mode), mode & VL_REDUCE_STRICT ? " strict" : "");
+            } else {
+                fprintf(out, " r%u r%u r%u", VL_INS_A(ins), VL_INS_B(ins), VL_INS_C(ins));
+            }
+            break;
+        case VL_FORMAT_ABSC:
+            fprintf(out, " r%u r%u %d", VL_INS_A(ins), VL_INS_B(ins), VL_INS_SC(ins));
+            break;
+        case VL_FORMAT_ABX:
+            if (op == VL_BC_LOADK) {
+                fprintf(out, " r%u k%u", VL_INS_A(ins), VL_INS_BX(ins));
+            } else if (op == VL_BC_GETG || op == VL_BC_SETG) {
+                fprintf(out, " r%u g%u", VL_INS_A(ins), VL_INS_BX(ins));
+            } else {
+                fprintf(out, " r%u #%u", VL_INS_A(ins), VL_INS_BX(ins));
+            }
+            break;
+        case VL_FORMAT_ASBX:
+            if (op == VL_BC_LOADI) {
+                fprintf(out, " r%u %d", VL_INS_A(ins), VL_INS_SBX(ins));
+            } else {
+                fprintf(out, " r%u -> %04zu", VL_INS_A(ins), at + 1 + (size_t) (ptrdiff_t) VL_INS_SBX(ins));
+            }
+            break;
+        case VL_FORMAT_SAX:
+            fprintf(out, " -> %04zu", at + 1 + (size_t) (ptrdiff_t) VL_INS_SAX(ins));
+            break;
+    }
+    fputc('\n', out);
+}
+
+
+static void vlPrintConstant(FILE* out, const VLFunction* fn, size_t index) {
+    VLValue value = fn->constants[index];
+    fprintf(out, "    k%-4zu ", index);
+    switch (fn->constantReps[index]) {
+        case VL_REP_I:
+        case VL_REP_L: fprintf(out, "%lld\n", (long long) value.i); break;
+        case VL_REP_F:
+            vlPrintReal(out, value.f, true);
+            fputs("f\n", out);
+            break;
+        case VL_REP_D:
+            vlPrintReal(out, value.d, false);
+            fputc('\n', out);
+            break;
+        default:
+            vlPrintQuoted(out, value.p);
+            fputc('\n', out);
+            break;
+    }
+}
+
+
+// ---- FUNCTIONS ---- //
+
+void vlInitProgram(VLProgram* program) {
+    memset(program, 0, sizeof(VLProgram));
+    vlInitArena(&program->arena);
+    program->status = VL_STATUS_OK;
+}
+
+
+void vlFreeProgram(VLProgram* program) {
+    for (size_t i = 0; i < program->functionCount; ++i) {
+        VLFunction* fn = &program->functions[i];
+        free(fn->params);
+        free(fn->defaults);
+        free(fn->code);
+        free(fn->positions);
+        free(fn->constants);
+        free(fn->constantReps);
+        free(fn->registerNames);
+    }
+    free(program->functions);
+    free(program->variables);
+    vlFreeArena(&program->arena);
+    memset(program, 0, sizeof(VLProgram));
+}
+
+
+const char* vlOpcodeName(VLOpcode op) {
+    return (size_t) op < VL_OPCODE_COUNT ? vlOpcodeNames[op] : "?";
+}
+
+
+const char* vlReduceName(VLReduceOp op) {
+    return (size_t) op < sizeof(vlReduceNames) / sizeof(vlReduceNames[0]) ? vlReduceNames[op] : "?";
+}
+
+
+VLOperandFormat vlOpcodeFormat(VLOpcode op) {
+    return (size_t) op < VL_OPCODE_COUNT ? vlOpcodeFormats[op] : VL_FORMAT_NONE;
+}
+
+
+VLRep vlRep(VLType type) {
+    if (type.rank || type.base == VL_TYPE_STR || type.base == VL_TYPE_OBJECT) return VL_REP_P;
+    switch (type.base) {
+        case VL_TYPE_LONG: return VL_REP_L;
+        case VL_TYPE_FLOAT: return VL_REP_F;
+        case VL_TYPE_DOUBLE: return VL_REP_D;
+        default: return VL_REP_I;
+    }
+}
+
+
+VLElementKind vlElementKind(VLType element) {
+    if (element.rank) return VL_ELEM_REF;
+    switch (element.base) {
+        case VL_TYPE_BYTE: return VL_ELEM_I8;
+        case VL_TYPE_BOOL:
+        case VL_TYPE_CHAR: return VL_ELEM_U8;
+        case VL_TYPE_SHORT: return VL_ELEM_I16;
+        case VL_TYPE_INT: return VL_ELEM_I32;
+        case VL_TYPE_LONG: return VL_ELEM_I64;
+        case VL_TYPE_FLOAT: return VL_ELEM_F32;
+        case VL_TYPE_DOUBLE: return VL_ELEM_F64;
+        default: return VL_ELEM_REF;
+    }
+}
+
+
+size_t vlElementSize(VLElementKind kind) {
+    static const size_t sizes[] = {1, 1, 2, 4, 8, 4, 8, sizeof(void*)};
+    return sizes[kind];
+}
+
+
+void vlPrintReal(FILE* out, VLDouble value, bool single) {
+    if (!isfinite(value)) {
+        fputs(isnan(value) ? "nan" : value < 0 ? "-inf" : "inf", out);
+        return;
+    }
+    char buffer[40];
+    for (int precision = 1; precision <= 17; ++precision) {
+        snprintf(buffer, sizeof(buffer), "%.*g", precision, value);
+        VLDouble back = strtod(buffer, NULL);
+        if (single ? (VLFloat) back == (VLFloat) value : back == value) break;
+    }
+    fputs(buffer, out);
+    if (!strpbrk(buffer, ".e")) fputs(".0", out);
+}
+
+
+void vlPrintQuoted(FILE* out, const VLStringObject* string) {
+    fputc('"', out);
+    for (size_t i = 0; i < string->length; ++i) {
+        unsigned char ch = (unsigned char) string->data[i];
+        switch (ch) {
+            case '\n': fputs("\\n", out); break;
+            case '\t': fputs("\\t", out); break;
+            case '\r': fputs("\\r", out); break;
+            case '"': fputs("\\\"", out); break;
+            case '\\': fputs("\\\\", out); break;
+            default:
+                if (ch < 0x20 || ch == 0x7F) fprintf(out, "\\x%02X", ch);
+                else fputc(ch, out);
+                break;
+        }
+    }
+    fputc('"', out);
+}
+
+
+void vlPrintProgram(FILE* out, const VLProgram* program) {
+    char type[64];
+    for (size_t i = 0; i < program->functionCount; ++i) {
+        const VLFunction* fn = &program->functions[i];
+        if (!fn->code) continue;
+        if (fn->name.len) {
+            fprintf(out, "function %.*s(", (int) fn->name.len, fn->name.first);
+            for (size_t p = 0; p < fn->paramCount; ++p) {
+                fprintf(out, "%s%s", p ? ", " : "", vlTypeName(fn->params[p], type, sizeof(type)));
+            }
+            fprintf(out, ") -> %s", vlTypeName(fn->result, type, sizeof(type)));
+        } else {
+            fputs("main", out);
+        }
+        fprintf(out, "  [%zu registers, %zu constants, %zu instructions]\n", fn->registerCount, fn->constantCount,
+                fn->codeCount);
+        for (size_t k = 0; k < fn->constantCount; ++k) vlPrintConstant(out, fn, k);
+        for (size_t at = 0; at < fn->codeCount; ++at) vlPrintInstruction(out, fn, at);
+        if (i + 1 < program->functionCount) fputc('\n', out);
+    }
+}
+
+
+void vlPrintInstances(FILE* out, const VLProgram* program) {
+    size_t instances = 0, instanceCode = 0, totalCode = 0;
+    for (size_t i = 0; i < program->functionCount; ++i) {
+        const VLFunction* fn = &program->functions[i];
+        totalCode += fn->codeCount;
+        if (!fn->instance) continue;
+        fprintf(out, "%.*s: %zu instructions\n", (int) fn->name.len, fn->name.first, fn->codeCount);
+        ++instances;
+        instanceCode += fn->codeCount;
+    }
+    fprintf(out, "%zu instances of %zu generic functions, %zu of %zu instructions (%.1f%%), %zu calls reused one\n",
+            instances, program->genericCount, instanceCode, totalCode,
+            totalCode ? 100.0 * (double) instanceCode / (double) totalCode : 0.0, program->reusedInstances);
+}
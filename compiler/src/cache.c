@@ -0,0 +1,205 @@
+/* ================
+ * src/cache.c
+ * VALLEY LANGUAGE COMPILER
+ * Content-addressed cache of parsed modules
+ * ================
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/cache.h"
+
+
+// ---- HELPERS ---- //
+
+static size_t vlModuleBytes(const VLModule* module) {
+    return module->size + module->parser.arena.stats.bytesReserved + sizeof(VLModule);
+}
+
+
+static bool vlRebuildSlots(VLModuleCache* cache, size_t slotCount) {
+    uint32_t* slots = malloc(slotCount * sizeof(uint32_t));
+    if (!slots) return false;
+    memset(slots, 0xFF, slotCount * sizeof(uint32_t));
+
+    for (size_t i = 0; i < cache->count; ++i) {
+        size_t slot = cache->modules[i]->hash & (slotCount - 1);
+        while (slots[slot] != VL_NO_MODULE) slot = (slot + 1) & (slotCount - 1);
+        slots[slot] = (uint32_t) i;
+    }
+
+    free(cache->slots);
+    cache->slots = slots;
+    cache->slotCount = slotCount;
+    return true;
+}
+
+
+// Must be called with the lock held
+static VLModule* vlFindModule(VLModuleCache* cache, uint64_t hash, const char* data, size_t size) {
+    if (!cache->slotCount) return NULL;
+    size_t mask = cache->slotCount - 1;
+    for (size_t slot = hash & mask; cache->slots[slot] != VL_NO_MODULE; slot = (slot + 1) & mask) {
+        VLModule* module = cache->modules[cache->slots[slot]];
+        if (module->hash == hash && module->size == size && !memcmp(module->text, data, size)) return module;
+    }
+    return NULL;
+}
+
+
+static int vlCompareRecency(const void* a, const void* b) {
+    size_t left = (*(VLModule* const*) a)->lastUsed;
+    size_t right = (*(VLModule* const*) b)->lastUsed;
+    return left < right ? 1 : left > right ? -1 : 0;
+}
+
+
+// ---- FUNCTIONS ---- //
+
+uint64_t vlHashSource(const char* data, size_t size) {
+    // Eight bytes per step with a multiply-xorshift mix; hits are confirmed with memcmp anyway
+    uint64_t hash = 0x9E3779B97F4A7C15ull ^ size;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * 0xFF51AFD7ED558CCDull;
+        hash ^= hash >> 32;
+    }
+    uint64_t last = 0;
+    memcpy(&last, data + i, size - i);
+    hash = (hash ^ last) * 0xC4CEB9FE1A85EC53ull;
+    return hash ^ (hash >> 29);
+}
+
+
+VLModule* vlParseModule(const char* data, size_t size, uint64_t hash) {
+    VLModule* module = calloc(1, sizeof(VLModule));
+    if (!module) return NULL;
+    module->hash = hash;
+    module->size = size;
+    module->text = malloc(size ? size : 1);
+    if (!module->text) {
+        free(module);
+        return NULL;
+    }
+    memcpy(module->text, data, size);
+
+    // Initialized in place, since the symbol table keeps a pointer to the parser's own arena
+    VLParser* parser = &module->parser;
+    vlInitParser(parser, module->text, size);
+    vlGrabToken(parser);
+    module->tree = vlParseUnit(parser);
+
+    if (parser->status != VL_STATUS_OK) {
+        size_t messageSize;
+        FILE* out = open_memstream(&module->message, &messageSize);
+        if (out) {
+            vlReportStatus(out, parser);
+            fclose(out);
+        }
+        vlLocate(module->text, vlErrorPos(parser), &module->line, &module->column);
+        module->tree = NULL;
+    }
+    parser->cursor = parser->end;
+    return module;
+}
+
+
+void vlFreeModule(VLModule* module) {
+    vlFreeParser(&module->parser);
+    free(module->message);
+    free(module->text);
+    free(module);
+}
+
+
+bool vlInitCache(VLModuleCache* cache, size_t maxBytes) {
+    VLModuleCache init = {.maxBytes = maxBytes};
+    *cache = init;
+    return mtx_init(&cache->lock, mtx_plain) == thrd_success;
+}
+
+
+void vlFreeCache(VLModuleCache* cache) {
+    for (size_t i = 0; i < cache->count; ++i) vlFreeModule(cache->modules[i]);
+    free(cache->modules);
+    free(cache->slots);
+    mtx_destroy(&cache->lock);
+}
+
+
+VLModule* vlCacheLookup(VLModuleCache* cache, uint64_t hash, const char* data, size_t size) {
+    mtx_lock(&cache->lock);
+    VLModule* module = vlFindModule(cache, hash, data, size);
+    if (module) {
+        module->lastUsed = cache->generation;
+        ++cache->hits;
+    } else {
+        ++cache->misses;
+    }
+    mtx_unlock(&cache->lock);
+    return module;
+}
+
+
+VLModule* vlCacheInsert(VLModuleCache* cache, VLModule* module) {
+    // Two workers can parse the same contents at once; whoever inserts first wins
+    mtx_lock(&cache->lock);
+    VLModule* resident = vlFindModule(cache, module->hash, module->text, module->size);
+    if (resident) {
+        mtx_unlock(&cache->lock);
+        vlFreeModule(module);
+        return resident;
+    }
+
+    bool ok = true;
+    if (cache->count == cache->capacity) {
+        size_t capacity = cache->capacity ? cache->capacity * 2 : 64;
+        VLModule** modules = realloc(cache->modules, capacity * sizeof(VLModule*));
+        if (modules) {
+            cache->modules = modules;
+            cache->capacity = capacity;
+        } else {
+            ok = false;
+        }
+    }
+    if (ok && (cache->count + 1) * 4 > cache->slotCount * 3) {
+        ok = vlRebuildSlots(cache, cache->slotCount ? cache->slotCount * 2 : 128);
+    }
+
+    if (ok) {
+        module->lastUsed = cache->generation;
+        cache->modules[cache->count] = module;
+        size_t mask = cache->slotCount - 1;
+        size_t slot = module->hash & mask;
+        while (cache->slots[slot] != VL_NO_MODULE) slot = (slot + 1) & mask;
+        cache->slots[slot] = (uint32_t) cache->count++;
+        cache->bytes += vlModuleBytes(module);
+    }
+    mtx_unlock(&cache->lock);
+
+    if (!ok) {
+        vlFreeModule(module);
+        return NULL;
+    }
+    return module;
+}
+
+
+void vlTrimCache(VLModuleCache* cache) {
+    mtx_lock(&cache->lock);
+    ++cache->generation;
+    if (cache->bytes > cache->maxBytes) {
+        // Evict least recently used modules down to three quarters of the budget, to avoid trimming every time
+        qsort(cache->modules, cache->count, sizeof(VLModule*), vlCompareRecency);
+        while (cache->count && cache->bytes > cache->maxBytes / 4 * 3) {
+            VLModule* module = cache->modules[--cache->count];
+            cache->bytes -= vlModuleBytes(module);
+            vlFreeModule(module);
+        }
+        vlRebuildSlots(cache, cache->slotCount);
+    }
+    mtx_unlock(&cache->lock);
+}
@@ -0,0 +1,1153 @@
+/* ================
+ * src/cgen.c
+ * VALLEY LANGUAGE COMPILER
+ * C backend lowering bytecode to a standalone C23 program
+ * ================
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "../include/cgen.h"
+#include "../include/vm.h"
+
+extern char** environ;
+
+
+// ---- HELPERS ---- //
+
+// Each register becomes one C local per kind of value it is used for. Ints and longs share a kind,
+// since ints are kept sign-extended in 64 bits exactly as the interpreter holds them.
+typedef enum VLCKind {
+    VL_CK_I,
+    VL_CK_F,
+    VL_CK_D,
+    VL_CK_P,
+    VL_CK_COUNT,
+} VLCKind;
+
+typedef struct VLEmitter {
+    FILE* out;
+    const VLProgram* program;
+    const VLFunction* fn;
+    const char* path;
+    const size_t* lines;
+    size_t lineCount;
+    size_t nextLine;
+    size_t* strings;
+    bool* targets;
+    uint8_t kinds[VL_MAX_REGISTERS];
+} VLEmitter;
+
+static const VLCKind vlRepKinds[] = {VL_CK_I, VL_CK_I, VL_CK_F, VL_CK_D, VL_CK_P};
+static const char vlKindSuffixes[] = "ifdp";
+static const char* vlKindTypes[] = {"int64_t", "float", "double", "void*"};
+static const char* vlKindZeros[] = {"0", "0", "0", "NULL"};
+static const char* vlKindFields[] = {"i", "f", "d", "p"};
+
+static const char* vlElementNames[] = {
+    "VL_ELEM_I8", "VL_ELEM_U8", "VL_ELEM_I16", "VL_ELEM_I32", "VL_ELEM_I64", "VL_ELEM_F32", "VL_ELEM_F64",
+    "VL_ELEM_REF",
+};
+
+static const char* vlElementSuffixes[] = {"i8", "u8", "i16", "i32", "i64", "f32", "f64", "ref"};
+
+static const char* vlTypeEnums[] = {
+    "VL_TYPE_VOID", "VL_TYPE_STR", "VL_TYPE_CHAR", "VL_TYPE_BYTE", "VL_TYPE_SHORT", "VL_TYPE_INT", "VL_TYPE_LONG",
+    "VL_TYPE_FLOAT", "VL_TYPE_DOUBLE", "VL_TYPE_BOOL", "VL_TYPE_OBJECT",
+};
+
+// How most instructions read in C. %A, %B and %C followed by a kind letter name a register's local
+// of that kind; %X is sBx, %S is sC, %J the jump target's label, %E the element kind in C and %W
+// the instruction's "path:line:column" for runtime errors. Instructions left out are written by hand.
+static const char* vlTemplates[VL_OPCODE_COUNT] = {
+    [VL_BC_LOADI] = "%Ai = %X;",
+    [VL_BC_LOADNULL] = "%Ap = NULL;",
+    [VL_BC_I2F] = "%Af = (float) %Bi;",
+    [VL_BC_I2D] = "%Ad = (double) %Bi;",
+    [VL_BC_L2I] = "%Ai = vl_wrap_i((uint64_t) %Bi);",
+    [VL_BC_L2F] = "%Af = (float) %Bi;",
+    [VL_BC_L2D] = "%Ad = (double) %Bi;",
+    [VL_BC_F2I] = "%Ai = vl_trunc(%Bf, INT32_MIN, INT32_MAX);",
+    [VL_BC_F2L] = "%Ai = vl_trunc(%Bf, INT64_MIN, INT64_MAX);",
+    [VL_BC_F2D] = "%Ad = %Bf;",
+    [VL_BC_D2I] = "%Ai = vl_trunc(%Bd, INT32_MIN, INT32_MAX);",
+    [VL_BC_D2L] = "%Ai = vl_trunc(%Bd, INT64_MIN, INT64_MAX);",
+    [VL_BC_D2F] = "%Af = (float) %Bd;",
+    [VL_BC_NARROWB] = "%Ai = (int8_t) %Bi;",
+    [VL_BC_NARROWS] = "%Ai = (int16_t) %Bi;",
+    [VL_BC_NARROWC] = "%Ai = (uint8_t) %Bi;",
+    [VL_BC_ADD_I] = "%Ai = vl_add_i(%Bi, %Ci);",
+    [VL_BC_ADD_L] = "%Ai = vl_add_l(%Bi, %Ci);",
+    [VL_BC_ADD_F] = "%Af = %Bf + %Cf;",
+    [VL_BC_ADD_D] = "%Ad = %Bd + %Cd;",
+    [VL_BC_SUB_I] = "%Ai = vl_sub_i(%Bi, %Ci);",
+    [VL_BC_SUB_L] = "%Ai = vl_sub_l(%Bi, %Ci);",
+    [VL_BC_SUB_F] = "%Af = %Bf - %Cf;",
+    [VL_BC_SUB_D] = "%Ad = %Bd - %Cd;",
+    [VL_BC_MUL_I] = "%Ai = vl_mul_i(%Bi, %Ci);",
+    [VL_BC_MUL_L] = "%Ai = vl_mul_l(%Bi, %Ci);",
+    [VL_BC_MUL_F] = "%Af = %Bf * %Cf;",
+    [VL_BC_MUL_D] = "%Ad = %Bd * %Cd;",
+    [VL_BC_DIV_I] = "%Ai = vl_div_i(%Bi, %Ci, %W);",
+    [VL_BC_DIV_L] = "%Ai = vl_div_l(%Bi, %Ci, %W);",
+    [VL_BC_DIV_F] = "%Af = %Bf / %Cf;",
+    [VL_BC_DIV_D] = "%Ad = %Bd / %Cd;",
+    [VL_BC_MOD_I] = "%Ai = vl_mod_i(%Bi, %Ci, %W);",
+    [VL_BC_MOD_L] = "%Ai = vl_mod_l(%Bi, %Ci, %W);",
+    [VL_BC_MOD_F] = "%Af = (float) fmod(%Bf, %Cf);",
+    [VL_BC_MOD_D] = "%Ad = fmod(%Bd, %Cd);",
+    [VL_BC_EXP_I] = "%Ai = vl_pow_i(%Bi, %Ci, %W);",
+    [VL_BC_EXP_L] = "%Ai = vl_pow_l(%Bi, %Ci, %W);",
+    [VL_BC_EXP_F] = "%Af = (float) pow(%Bf, %Cf);",
+    [VL_BC_EXP_D] = "%Ad = pow(%Bd, %Cd);",
+    [VL_BC_ADDI_I] = "%Ai = vl_add_i(%Bi, %S);",
+    [VL_BC_ADDI_L] = "%Ai = vl_add_l(%Bi, %S);",
+    [VL_BC_NEG_I] = "%Ai = vl_sub_i(0, %Bi);",
+    [VL_BC_NEG_L] = "%Ai = vl_sub_l(0, %Bi);",
+    [VL_BC_NEG_F] = "%Af = -%Bf;",
+    [VL_BC_NEG_D] = "%Ad = -%Bd;",
+    [VL_BC_NOT_I] = "%Ai = ~%Bi;",
+    [VL_BC_NOT_L] = "%Ai = ~%Bi;",
+    [VL_BC_LNOT] = "%Ai = !%Bi;",
+    [VL_BC_AND_I] = "%Ai = %Bi & %Ci;",
+    [VL_BC_AND_L] = "%Ai = %Bi & %Ci;",
+    [VL_BC_OR_I] = "%Ai = %Bi | %Ci;",
+    [VL_BC_OR_L] = "%Ai = %Bi | %Ci;",
+    [VL_BC_XOR_I] = "%Ai = %Bi ^ %Ci;",
+    [VL_BC_XOR_L] = "%Ai = %Bi ^ %Ci;",
+    [VL_BC_SHL_I] = "%Ai = vl_shl_i(%Bi, %Ci);",
+    [VL_BC_SHL_L] = "%Ai = vl_shl_l(%Bi, %Ci);",
+    [VL_BC_SHR_I] = "%Ai = %Bi >> (%Ci & 31);",
+    [VL_BC_SHR_L] = "%Ai = %Bi >> (%Ci & 63);",
+    [VL_BC_EQ_I] = "%Ai = %Bi == %Ci;",
+    [VL_BC_EQ_L] = "%Ai = %Bi == %Ci;",
+    [VL_BC_EQ_F] = "%Ai = %Bf == %Cf;",
+    [VL_BC_EQ_D] = "%Ai = %Bd == %Cd;",
+    [VL_BC_EQ_S] = "%Ai = vl_str_eq(%Bp, %Cp);",
+    [VL_BC_EQ_P] = "%Ai = %Bp == %Cp;",
+    [VL_BC_NE_I] = "%Ai = %Bi != %Ci;",
+    [VL_BC_NE_L] = "%Ai = %Bi != %Ci;",
+    [VL_BC_NE_F] = "%Ai = %Bf != %Cf;",
+    [VL_BC_NE_D] = "%Ai = %Bd != %Cd;",
+    [VL_BC_NE_S] = "%Ai = !vl_str_eq(%Bp, %Cp);",
+    [VL_BC_NE_P] = "%Ai = %Bp != %Cp;",
+    [VL_BC_LT_I] = "%Ai = %Bi < %Ci;",
+    [VL_BC_LT_L] = "%Ai = %Bi < %Ci;",
+    [VL_BC_LT_F] = "%Ai = %Bf < %Cf;",
+    [VL_BC_LT_D] = "%Ai = %Bd < %Cd;",
+    [VL_BC_LE_I] = "%Ai = %Bi <= %Ci;",
+    [VL_BC_LE_L] = "%Ai = %Bi <= %Ci;",
+    [VL_BC_LE_F] = "%Ai = %Bf <= %Cf;",
+    [VL_BC_LE_D] = "%Ai = %Bd <= %Cd;",
+    [VL_BC_JMP] = "goto %J;",
+    [VL_BC_JT] = "if (%Ai) goto %J;",
+    [VL_BC_JF] = "if (!%Ai) goto %J;",
+    [VL_BC_NEWARR] = "%Ap = vl_new_array(%E, %Bi, %W);",
+    [VL_BC_NEWPACK] = "%Ap = vl_new_pack(%E, %Bi, %W);",
+    [VL_BC_DROPPACK] = "vl_drop_pack(%Ap);",
+    [VL_BC_LEN] = "%Ai = vl_length(%Bp, %W);",
+    [VL_BC_CAP] = "%Ai = vl_capacity(%Bp, %W);",
+    [VL_BC_SETCAP] = "vl_set_capacity(%Ap, %Bi, %W);",
+    [VL_BC_AGET_I8] = "%Ai = vl_aget_i8(%Bp, %Ci, %W);",
+    [VL_BC_AGET_U8] = "%Ai = vl_aget_u8(%Bp, %Ci, %W);",
+    [VL_BC_AGET_I16] = "%Ai = vl_aget_i16(%Bp, %Ci, %W);",
+    [VL_BC_AGET_I32] = "%Ai = vl_aget_i32(%Bp, %Ci, %W);",
+    [VL_BC_AGET_I64] = "%Ai = vl_aget_i64(%Bp, %Ci, %W);",
+    [VL_BC_AGET_F32] = "%Af = vl_aget_f32(%Bp, %Ci, %W);",
+    [VL_BC_AGET_F64] = "%Ad = vl_aget_f64(%Bp, %Ci, %W);",
+    [VL_BC_AGET_REF] = "%Ap = vl_aget_ref(%Bp, %Ci, %W);",
+    [VL_BC_ASET_I8] = "vl_aset_u8(%Ap, %Bi, %Ci, %W);",
+    [VL_BC_ASET_I16] = "vl_aset_i16(%Ap, %Bi, %Ci, %W);",
+    [VL_BC_ASET_I32] = "vl_aset_i32(%Ap, %Bi, %Ci, %W);",
+    [VL_BC_ASET_I64] = "vl_aset_i64(%Ap, %Bi, %Ci, %W);",
+    [VL_BC_ASET_F32] = "vl_aset_f32(%Ap, %Bi, %Cf, %W);",
+    [VL_BC_ASET_F64] = "vl_aset_f64(%Ap, %Bi, %Cd, %W);",
+    [VL_BC_ASET_REF] = "vl_aset_ref(%Ap, %Bi, %Cp, %W);",
+    [VL_BC_AINS] = "%Ai = vl_open_slot(%Bp, %Ci, %W);",
+};
+
+// Everything the generated code calls, in step with the interpreter in src/vm.c. Natives are
+// vl_native_<name>, taking their arguments then the caller's location. Most programs use only a
+// few of the helpers, so those that aren't inline are [[maybe_unused]].
+static const char vlPrelude[] =
+    "#include <stdarg.h>\n"
+    "#include <stdalign.h>\n"
+    "#include <stdbool.h>\n"
+    "#include <stddef.h>\n"
+    "#include <stdint.h>\n"
+    "#include <stdio.h>\n"
+    "#include <stdlib.h>\n"
+    "#include <string.h>\n"
+    "#include <math.h>\n"
+    "\n"
+    "// Runtime support, kept in step with the interpreter in src/vm.c\n"
+    "typedef struct vl_object {\n"
+    "    struct vl_object* next;\n"
+    "    void* buffer;\n"
+    "} vl_object;\n"
+    "\n"
+    "typedef struct vl_string {\n"
+    "    vl_object header;\n"
+    "    size_t length;\n"
+    "    char data[];\n"
+    "} vl_string;\n"
+    "\n"
+    "typedef struct vl_array {\n"
+    "    vl_object header;\n"
+    "    size_t length;\n"
+    "    size_t capacity;\n"
+    "    int element;\n"
+    "    char* data;\n"
+    "    alignas(max_align_t) char storage[];\n"
+    "} vl_array;\n"
+    "\n"
+    "typedef union vl_value {\n"
+    "    int64_t i;\n"
+    "    float f;\n"
+    "    double d;\n"
+    "    void* p;\n"
+    "} vl_value;\n"
+    "\n"
+    "enum { VL_ELEM_I8, VL_ELEM_U8, VL_ELEM_I16, VL_ELEM_I32, VL_ELEM_I64, VL_ELEM_F32, VL_ELEM_F64, VL_ELEM_REF };\n"
+    "enum { VL_TYPE_VOID, VL_TYPE_STR, VL_TYPE_CHAR, VL_TYPE_BYTE, VL_TYPE_SHORT, VL_TYPE_INT, VL_TYPE_LONG,\n"
+    "       VL_TYPE_FLOAT, VL_TYPE_DOUBLE, VL_TYPE_BOOL, VL_TYPE_OBJECT };\n"
+    "\n"
+    "enum { VL_ARRAY_INLINE_BYTES = 32 };\n"
+    "[[maybe_unused]] static const size_t vl_element_sizes[] = {1, 1, 2, 4, 8, 4, 8, sizeof(void*)};\n"
+    "[[maybe_unused]] static vl_object* vl_objects;\n"
+    "\n"
+    "[[maybe_unused]] static _Noreturn void vl_fail(const char* where, const char* format, ...) {\n"
+    "    va_list args;\n"
+    "    va_start(args, format);\n"
+    "    fflush(stdout);\n"
+    "    fprintf(stderr, \"%s: Error: \", where);\n"
+    "    vfprintf(stderr, format, args);\n"
+    "    fputs(\".\\n\", stderr);\n"
+    "    va_end(args);\n"
+    "    exit(1);\n"
+    "}\n"
+    "\n"
+    "[[maybe_unused]] static void* vl_alloc(size_t header, size_t count, size_t size, const char* where) {\n"
+    "    if (size && count > (SIZE_MAX - header) / size) vl_fail(where, \"ran out of memory\");\n"
+    "    vl_object* object = calloc(1, header + count * size);\n"
+    "    if (!object) vl_fail(where, \"ran out of memory\");\n"
+    "    object->next = vl_objects;\n"
+    "    vl_objects = object;\n"
+    "    return object;\n"
+    "}\n"
+    "\n"
+    "[[maybe_unused]] static vl_string* vl_new_string(size_t length, const char* where) {\n"
+    "    vl_string* string = vl_alloc(sizeof(vl_string), length + 1, 1, where);\n"
+    "    string->length = length;\n"
+    "    return string;\n"
+    "}\n"
+    "\n"
+    "[[maybe_unused]] static vl_string* vl_string_constant(const char* data, size_t length) {\n"
+    "    vl_string* string = vl_new_string(length, \"string constant\");\n"
+    "    memcpy(string->data, data, length);\n"
+    "    return string;\n"
+    "}\n"
+    "\n"
+    "[[maybe_unused]] static void* vl_new_array(int element, int64_t length, const char* where) {\n"
+    "    if (length < 0) vl_fail(where, \"negative array length %lld\", (long long) length);\n"
+    "    size_t size = vl_element_sizes[element];\n"
+    "    size_t capacity = VL_ARRAY_INLINE_BYTES / size;\n"
+    "    if ((size_t) length > capacity) capacity = (size_t) length;\n"
+    "    vl_array* array = vl_alloc(sizeof(vl_array), capacity, size, where);\n"
+    "    array->length = (size_t) length;\n"
+    "    array->capacity = capacity;\n"
+    "    array->element = element;\n"
+    "    array->data = array->storage;\n"
+    "    return array;\n"
+    "}\n"
+    "\n"
+    "[[maybe_unused]] static void vl_resize_array(vl_array* array, size_t capacity, const char* where) {\n"
+    "    size_t size = vl_element_sizes[array->element];\n"
+    "    if (capacity > SIZE_MAX / size) vl_fail(where, \"ran out of memory\");\n"
+    "    char* data = realloc(array->header.buffer, (capacity ? capacity : 1) * size);\n"
+    "    if (!data) vl_fail(where, \"ran out of memory\");\n"
+    "    if (!array->header.buffer) memcpy(data, array->storage, array->length * size);\n"
+    "    array->header.buffer = data;\n"
+    "    array->data = data;\n"
+    "    array->capacity = capacity;\n"
+    "}\n"
+    "\n"
+    "[[maybe_unused]] static int64_t vl_open_slot(void* object, int64_t index, const char* where) {\n"
+    "    vl_array* array = object;\n"
+    "    if (!array) vl_fail(where, \"adding to a null array\");\n"
+    "    int64_t at = index < 0 ? index + (int64_t) array->length + 1 : index;\n"
+    "    if (at < 0 || (uint64_t) at > array->length) {\n"
+    "        vl_fail(where, \"index %lld is out of bounds for adding to length %zu\", (long long) index,\n"
+    "                array->length);\n"
+    "    }\n"
+    "    if (array->length == array->capacity) {\n"
+    "        vl_resize_array(array, array->capacity ? array->capacity * 2 : 1, where);\n"
+    "    }\n"
+    "    size_t size = vl_element_sizes[array->element];\n"
+    "    char* from = array->data + (size_t) at * size;\n"
+    "    memmove(from + size, from, (array->length - (size_t) at) * size);\n"
+    "    ++array->length;\n"
+    "    return at;\n"
+    "}\n"
+    "\n"
+    "[[maybe_unused]] static void vl_set_capacity(void* object, int64_t capacity, const char* where) {\n"
+    "    vl_array* array = object;\n"
+    "    if (!array) vl_fail(where, \"setting the capacity of null\");\n"
+    "    if (capacity < 0) vl_fail(where, \"negative array capacity %lld\", (long long) capacity);\n"
+    "    if ((uint64_t) capacity < array->length) array->length = (size_t) capacity;\n"
+    "    if (array->header.buffer || (uint64_t) capacity > array->capacity) {\n"
+    "        vl_resize_array(array, (size_t) capacity, where);\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "enum { VL_PACK_BYTES = 1 << 20 };\n"
+    "[[maybe_unused]] static alignas(max_align_t) char vl_packs[VL_PACK_BYTES];\n"
+    "[[maybe_unused]] static size_t vl_pack_top;\n"
+    "\n"
+    "[[maybe_unused]] static void* vl_new_pack(int element, int64_t length, const char* where) {\n"
+    "    size_t size = vl_element_sizes[element];\n"
+    "    size_t align = alignof(max_align_t);\n"
+    "    size_t room = VL_PACK_BYTES - vl_pack_top;\n"
+    "    if (room < sizeof(vl_array) || (size_t) length > (room - sizeof(vl_array)) / size) {\n"
+    "        return vl_new_array(element, length, where);\n"
+    "    }\n"
+    "    vl_array* array = (vl_array*) (void*) (vl_packs + vl_pack_top);\n"
+    "    vl_pack_top += (sizeof(vl_array) + (size_t) length * size + align - 1) & ~(align - 1);\n"
+    "    *array = (vl_array) {.length = (size_t) length, .capacity = (size_t) length, .element = element,\n"
+    "                         .data = array->storage};\n"
+    "    memset(array->storage, 0, (size_t) length * size);\n"
+    "    return array;\n"
+    "}\n"
+    "\n"
+    "[[maybe_unused]] static void vl_drop_pack(void* pack) {\n"
+    "    uintptr_t at = (uintptr_t) pack - (uintptr_t) vl_packs;\n"
+    "    if (at < VL_PACK_BYTES) vl_pack_top = (size_t) at;\n"
+    "}\n"
+    "\n"
+    "[[maybe_unused]] static void vl_free_objects(void) {\n"
+    "    while (vl_objects) {\n"
+    "        vl_object* next = vl_objects->next;\n"
+    "        free(vl_objects->buffer);\n"
+    "        free(vl_objects);\n"
+    "        vl_objects = next;\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "// Ints live in 64 bits, sign-extended, and wrap at 32\n"
+    "static inline int64_t vl_wrap_i(uint64_t value) { return (int32_t) (uint32_t) value; }\n"
+    "static inline int64_t vl_add_i(int64_t a, int64_t b) { return vl_wrap_i((uint64_t) a + (uint64_t) b); }\n"
+    "static inline int64_t vl_sub_i(int64_t a, int64_t b) { return vl_wrap_i((uint64_t) a - (uint64_t) b); }\n"
+    "static inline int64_t vl_mul_i(int64_t a, int64_t b) { return vl_wrap_i((uint64_t) a * (uint64_t) b); }\n"
+    "static inline int64_t vl_shl_i(int64_t a, int64_t b) { return vl_wrap_i((uint64_t) a << (b & 31)); }\n"
+    "static inline int64_t vl_add_l(int64_t a, int64_t b) { return (int64_t) ((uint64_t) a + (uint64_t) b); }\n"
+    "static inline int64_t vl_sub_l(int64_t a, int64_t b) { return (int64_t) ((uint64_t) a - (uint64_t) b); }\n"
+    "static inline int64_t vl_mul_l(int64_t a, int64_t b) { return (int64_t) ((uint64_t) a * (uint64_t) b); }\n"
+    "static inline int64_t vl_shl_l(int64_t a, int64_t b) { return (int64_t) ((uint64_t) a << (b & 63)); }\n"
+    "\n"
+    "static inline int64_t vl_div_i(int64_t a, int64_t b, const char* where) {\n"
+    "    if (!b) vl_fail(where, \"division by zero\");\n"
+    "    return vl_wrap_i((uint64_t) (a / b));\n"
+    "}\n"
+    "\n"
+    "static inline int64_t vl_mod_i(int64_t a, int64_t b, const char* where) {\n"
+    "    if (!b) vl_fail(where, \"division by zero\");\n"
+    "    return a % b;\n"
+    "}\n"
+    "\n"
+    "static inline int64_t vl_div_l(int64_t a, int64_t b, const char* where) {\n"
+    "    if (!b) vl_fail(where, \"division by zero\");\n"
+    "    return b == -1 ? (int64_t) (0 - (uint64_t) a) : a / b;\n"
+    "}\n"
+    "\n"
+    "static inline int64_t vl_mod_l(int64_t a, int64_t b, const char* where) {\n"
+    "    if (!b) vl_fail(where, \"division by zero\");\n"
+    "    return b == -1 ? 0 : a % b;\n"
+    "}\n"
+    "\n"
+    "[[maybe_unused]] static int64_t vl_pow_l(int64_t x, int64_t y, const char* where) {\n"
+    "    if (y < 0) {\n"
+    "        if (x == 0) vl_fail(where, \"division by zero\");\n"
+    "        return x == 1 ? 1 : x == -1 ? (y & 1 ? -1 : 1) : 0;\n"
+    "    }\n"
+    "    uint64_t a = (uint64_t) x, b = (uint64_t) y, value = 1;\n"
+    "    for (; b; b >>= 1, a *= a) {\n"
+    "        if (b & 1) value *= a;\n"
+    "    }\n"
+    "    return (int64_t) value;\n"
+    "}\n"
+    "\n"
+    "static inline int64_t vl_pow_i(int64_t x, int64_t y, const char* where) {\n"
+    "    return vl_wrap_i((uint64_t) vl_pow_l(x, y, where));\n"
+    "}\n"
+    "\n"
+    "static inline int64_t vl_trunc(double value, int64_t min, int64_t max) {\n"
+    "    if (isnan(value)) return 0;\n"
+    "    if (value <= (double) min) return min;\n"
+    "    if (value >= (double) max) return max;\n"
+    "    return (int64_t) value;\n"
+    "}\n"
+    "\n"
+    "[[maybe_unused]] static bool vl_str_eq(const vl_string* first, const vl_string* second) {\n"
+    "    if (first == second) return true;\n"
+    "    if (!first || !second || first->length != second->length) return false;\n"
+    "    return !memcmp(first->data, second->data, first->length);\n"
+    "}\n"
+    "\n"
+    "static inline int64_t vl_length(const void* object, const char* where) {\n"
+    "    if (!object) vl_fail(where, \"taking the length of null\");\n"
+    "    return (int64_t) ((const vl_array*) object)->length;\n"
+    "}\n"
+    "\n"
+    "static inline int64_t vl_capacity(const void* object, const char* where) {\n"
+    "    if (!object) vl_fail(where, \"taking the capacity of null\");\n"
+    "    return (int64_t) ((const vl_array*) object)->capacity;\n"
+    "}\n"
+    "\n"
+    "static inline void vl_check(const vl_array* array, int64_t index, const char* where) {\n"
+    "    if (!array) vl_fail(where, \"indexing a null array\");\n"
+    "    if (index < 0 || (uint64_t) index >= array->length) {\n"
+    "        vl_fail(where, \"index %lld is out of bounds for length %zu\", (long long) index, array->length);\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "#define VL_ACCESSORS(name, type, value_type) \\\n"
+    "    static inline value_type vl_aget_##name(const void* array, int64_t index, const char* where) { \\\n"
+    "        vl_check(array, index, where); \\\n"
+    "        return ((type const*) (const void*) ((const vl_array*) array)->data)[index]; \\\n"
+    "    } \\\n"
+    "    static inline void vl_aset_##name(void* array, int64_t index, value_type value, const char* where) { \\\n"
+    "        vl_check(array, index, where); \\\n"
+    "        ((type*) (void*) ((vl_array*) array)->data)[index] = (type) value; \\\n"
+    "    }\n"
+    "\n"
+    "VL_ACCESSORS(i8, int8_t, int64_t)\n"
+    "VL_ACCESSORS(u8, uint8_t, int64_t)\n"
+    "VL_ACCESSORS(i16, int16_t, int64_t)\n"
+    "VL_ACCESSORS(i32, int32_t, int64_t)\n"
+    "VL_ACCESSORS(i64, int64_t, int64_t)\n"
+    "VL_ACCESSORS(f32, float, float)\n"
+    "VL_ACCESSORS(f64, double, double)\n"
+    "VL_ACCESSORS(ref, void*, void*)\n"
+    "\n"
+    "// Reductions fold over VL_REDUCE_LANES independent lanes, which the C compiler can keep in\n"
+    "// vector registers. Whole blocks are counted and the tail is bounded by the lane count, so it\n"
+    "// can see every lanes[j] stays in range. The strict ones fold one element after another.\n"
+    "enum { VL_REDUCE_LANES = 8 };\n"
+    "#define VL_STEP_ADD(a, b) ((a) + (b))\n"
+    "#define VL_STEP_MUL(a, b) ((a) * (b))\n"
+    "#define VL_STEP_AND(a, b) ((a) & (b))\n"
+    "#define VL_STEP_OR(a, b) ((a) | (b))\n"
+    "#define VL_STEP_XOR(a, b) ((a) ^ (b))\n"
+    "#define VL_STEP_MIN(a, b) ((b) < (a) ? (b) : (a))\n"
+    "#define VL_STEP_MAX(a, b) ((b) > (a) ? (b) : (a))\n"
+    "\n"
+    "#define VL_REDUCTION(name, type, value_type, lane, identity, step) \\\n"
+    "    static inline value_type vl_reduce_##name(const void* object, value_type acc, const char* where) { \\\n"
+    "        if (!object) vl_fail(where, \"taking the length of null\"); \\\n"
+    "        const vl_array* array = object; \\\n"
+    "        const type* items = (const type*) (const void*) array->data; \\\n"
+    "        size_t blocks = array->length / VL_REDUCE_LANES, rest = array->length % VL_REDUCE_LANES; \\\n"
+    "        lane lanes[VL_REDUCE_LANES]; \\\n"
+    "        for (size_t j = 0; j < VL_REDUCE_LANES; ++j) lanes[j] = (identity); \\\n"
+    "        lanes[0] = (lane) acc; \\\n"
+    "        for (size_t b = 0; b < blocks; ++b, items += VL_REDUCE_LANES) { \\\n"
+    "            for (size_t j = 0; j < VL_REDUCE_LANES; ++j) lanes[j] = step(lanes[j], (lane) items[j]); \\\n"
+    "        } \\\n"
+    "        for (size_t j = 0; j < rest; ++j) lanes[j] = step(lanes[j], (lane) items[j]); \\\n"
+    "        for (size_t j = 1; j < VL_REDUCE_LANES; ++j) lanes[0] = step(lanes[0], lanes[j]); \\\n"
+    "        return (value_type) lanes[0]; \\\n"
+    "    }\n"
+    "#define VL_STRICT_REDUCTION(name, type, step) \\\n"
+    "    static inline type vl_reduce_strict_##name(const void* object, type acc, const char* where) { \\\n"
+    "        if (!object) vl_fail(where, \"taking the length of null\"); \\\n"
+    "        const vl_array* array = object; \\\n"
+    "        const type* items = (const type*) (const void*) array->data; \\\n"
+    "        for (size_t i = 0; i < array->length; ++i) acc = step(acc, items[i]); \\\n"
+    "        return acc; \\\n"
+    "    }\n"
+    "#define VL_INT_REDUCTIONS(name, type) \\\n"
+    "    VL_REDUCTION(add_##name, type, int64_t, uint64_t, 0, VL_STEP_ADD) \\\n"
+    "    VL_REDUCTION(mul_##name, type, int64_t, uint64_t, 1, VL_STEP_MUL) \\\n"
+    "    VL_REDUCTION(and_##name, type, int64_t, uint64_t, UINT64_MAX, VL_STEP_AND) \\\n"
+    "    VL_REDUCTION(or_##name, type, int64_t, uint64_t, 0, VL_STEP_OR) \\\n"
+    "    VL_REDUCTION(xor_##name, type, int64_t, uint64_t, 0, VL_STEP_XOR) \\\n"
+    "    VL_REDUCTION(min_##name, type, int64_t, int64_t, INT64_MAX, VL_STEP_MIN) \\\n"
+    "    VL_REDUCTION(max_##name, type, int64_t, int64_t, INT64_MIN, VL_STEP_MAX)\n"
+    "#define VL_REAL_REDUCTIONS(name, type) \\\n"
+    "    VL_REDUCTION(add_##name, type, type, type, (type) -0.0, VL_STEP_ADD) \\\n"
+    "    VL_REDUCTION(mul_##name, type, type, type, 1, VL_STEP_MUL) \\\n"
+    "    VL_REDUCTION(min_##name, type, type, type, INFINITY, VL_STEP_MIN) \\\n"
+    "    VL_REDUCTION(max_##name, type, type, type, -INFINITY, VL_STEP_MAX) \\\n"
+    "    VL_STRICT_REDUCTION(add_##name, type, VL_STEP_ADD) \\\n"
+    "    VL_STRICT_REDUCTION(mul_##name, type, VL_STEP_MUL) \\\n"
+    "    VL_STRICT_REDUCTION(min_##name, type, VL_STEP_MIN) \\\n"
+    "    VL_STRICT_REDUCTION(max_##name, type, VL_STEP_MAX)\n"
+    "\n"
+    "VL_INT_REDUCTIONS(i8, int8_t)\n"
+    "VL_INT_REDUCTIONS(u8, uint8_t)\n"
+    "VL_INT_REDUCTIONS(i16, int16_t)\n"
+    "VL_INT_REDUCTIONS(i32, int32_t)\n"
+    "VL_INT_REDUCTIONS(i64, int64_t)\n"
+    "VL_REAL_REDUCTIONS(f32, float)\n"
+    "VL_REAL_REDUCTIONS(f64, double)\n"
+    "\n"
+    "[[maybe_unused]] static void* vl_native_concat(void* list, void* separator, const char* where) {\n"
+    "    const vl_array* strings = list;\n"
+    "    const vl_string* sep = separator;\n"
+    "    if (!strings || !sep) vl_fail(where, \"null passed to 'concat'\");\n"
+    "    vl_string* const* items = (vl_string* const*) (const void*) strings->data;\n"
+    "    size_t length = strings->length ? (strings->length - 1) * sep->length : 0;\n"
+    "    for (size_t i = 0; i < strings->length; ++i) {\n"
+    "        if (!items[i]) vl_fail(where, \"null passed to 'concat'\");\n"
+    "        length += items[i]->length;\n"
+    "    }\n"
+    "    vl_string* result = vl_new_string(length, where);\n"
+    "    char* at = result->data;\n"
+    "    for (size_t i = 0; i < strings->length; ++i) {\n"
+    "        if (i) {\n"
+    "            memcpy(at, sep->data, sep->length);\n"
+    "            at += sep->length;\n"
+    "        }\n"
+    "        memcpy(at, items[i]->data, items[i]->length);\n"
+    "        at += items[i]->length;\n"
+    "    }\n"
+    "    return result;\n"
+    "}\n"
+    "\n"
+    "[[maybe_unused]] static void vl_print_real(double value, bool single) {\n"
+    "    if (!isfinite(value)) {\n"
+    "        fputs(isnan(value) ? \"nan\" : value < 0 ? \"-inf\" : \"inf\", stdout);\n"
+    "        return;\n"
+    "    }\n"
+    "    char buffer[40];\n"
+    "    for (int precision = 1; precision <= 17; ++precision) {\n"
+    "        snprintf(buffer, sizeof(buffer), \"%.*g\", precision, value);\n"
+    "        double back = strtod(buffer, NULL);\n"
+    "        if (single ? (float) back == (float) value : back == value) break;\n"
+    "    }\n"
+    "    fputs(buffer, stdout);\n"
+    "    if (!strpbrk(buffer, \".e\")) fputs(\".0\", stdout);\n"
+    "}\n"
+    "\n"
+    "[[maybe_unused]] static void vl_print_quoted(const vl_string* string) {\n"
+    "    putchar('\"');\n"
+    "    for (size_t i = 0; i < string->length; ++i) {\n"
+    "        unsigned char ch = (unsigned char) string->data[i];\n"
+    "        switch (ch) {\n"
+    "            case '\\n': fputs(\"\\\\n\", stdout); break;\n"
+    "            case '\\t': fputs(\"\\\\t\", stdout); break;\n"
+    "            case '\\r': fputs(\"\\\\r\", stdout); break;\n"
+    "            case '\"': fputs(\"\\\\\\\"\", stdout); break;\n"
+    "            case '\\\\': fputs(\"\\\\\\\\\", stdout); break;\n"
+    "            default:\n"
+    "                if (ch < 0x20 || ch == 0x7F) printf(\"\\\\x%02X\", ch);\n"
+    "                else putchar(ch);\n"
+    "                break;\n"
+    "        }\n"
+    "    }\n"
+    "    putchar('\"');\n"
+    "}\n"
+    "\n"
+    "[[maybe_unused]] static vl_value vl_load(const vl_array* array, size_t index) {\n"
+    "    vl_value value;\n"
+    "    const char* at = array->data + index * vl_element_sizes[array->element];\n"
+    "    switch (array->element) {\n"
+    "        case VL_ELEM_I8: value.i = *(const int8_t*) at; break;\n"
+    "        case VL_ELEM_U8: value.i = *(const uint8_t*) at; break;\n"
+    "        case VL_ELEM_I16: value.i = *(const int16_t*) at; break;\n"
+    "        case VL_ELEM_I32: value.i = *(const int32_t*) at; break;\n"
+    "        case VL_ELEM_I64: value.i = *(const int64_t*) at; break;\n"
+    "        case VL_ELEM_F32: value.f = *(const float*) at; break;\n"
+    "        case VL_ELEM_F64: value.d = *(const double*) at; break;\n"
+    "        default: value.p = *(void* const*) at; break;\n"
+    "    }\n"
+    "    return value;\n"
+    "}\n"
+    "\n"
+    "[[maybe_unused]] static void vl_print(vl_value value, int base, int rank) {\n"
+    "    if (rank) {\n"
+    "        const vl_array* array = value.p;\n"
+    "        if (!array) {\n"
+    "            fputs(\"null\", stdout);\n"
+    "            return;\n"
+    "        }\n"
+    "        putchar('[');\n"
+    "        for (size_t i = 0; i < array->length; ++i) {\n"
+    "            if (i) fputs(\", \", stdout);\n"
+    "            vl_print(vl_load(array, i), base, rank - 1);\n"
+    "        }\n"
+    "        putchar(']');\n"
+    "        return;\n"
+    "    }\n"
+    "    switch (base) {\n"
+    "        case VL_TYPE_STR:\n"
+    "            if (value.p) vl_print_quoted(value.p);\n"
+    "            else fputs(\"null\", stdout);\n"
+    "            break;\n"
+    "        case VL_TYPE_CHAR: printf(\"%u\", (unsigned) value.i); break;\n"
+    "        case VL_TYPE_BOOL: fputs(value.i ? \"true\" : \"false\", stdout); break;\n"
+    "        case VL_TYPE_FLOAT: vl_print_real(value.f, true); break;\n"
+    "        case VL_TYPE_DOUBLE: vl_print_real(value.d, false); break;\n"
+    "        case VL_TYPE_BYTE:\n"
+    "        case VL_TYPE_SHORT:\n"
+    "        case VL_TYPE_INT:\n"
+    "        case VL_TYPE_LONG: printf(\"%lld\", (long long) value.i); break;\n"
+    "        default: fputs(value.p ? \"<object>\" : \"null\", stdout); break;\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "[[maybe_unused]] static void vl_print_variable(const char* type, const char* name, vl_value value, int base,\n"
+    "                                                int rank) {\n"
+    "    printf(\"%s %s = \", type, name);\n"
+    "    vl_print(value, base, rank);\n"
+    "    putchar('\\n');\n"
+    "}\n";
+
+static bool vlIsVoid(VLType type) {
+    return !type.rank && type.base == VL_TYPE_VOID;
+}
+
+
+static VLCKind vlKind(VLType type) {
+    return vlRepKinds[vlRep(type)];
+}
+
+
+static VLType vlGlobalType(const VLProgram* program, size_t slot) {
+    for (size_t i = 0; i < program->variableCount; ++i) {
+        const VLVariable* variable = &program->variables[i];
+        if (variable->global && variable->slot == slot) return variable->type;
+    }
+    return (VLType) {VL_TYPE_OBJECT, 0};
+}
+
+
+// The prototype a native was bound through, which gives the types of its arguments and result
+static const VLFunction* vlNativePrototype(const VLProgram* program, size_t native) {
+    for (size_t i = 0; i < program->functionCount; ++i) {
+        if (program->functions[i].native == native) return &program->functions[i];
+    }
+    return NULL;
+}
+
+
+static void vlWriteString(FILE* out, const char* data, size_t length) {
+    fputc('"', out);
+    for (size_t i = 0; i < length; ++i) {
+        unsigned char ch = (unsigned char) data[i];
+        if (ch == '"' || ch == '\\') {
+            fprintf(out, "\\%c", ch);
+        } else if (ch < 0x20 || ch >= 0x7F) {
+            fprintf(out, "\\%03o", ch);
+        } else {
+            fputc(ch, out);
+        }
+    }
+    fputc('"', out);
+}
+
+
+static void vlWriteReal(FILE* out, VLDouble value, bool single) {
+    if (isnan(value)) {
+        fputs("NAN", out);
+    } else if (isinf(value)) {
+        fputs(value < 0 ? "-INFINITY" : "INFINITY", out);
+    } else {
+        vlPrintReal(out, value, single);
+        if (single) fputc('f', out);
+    }
+}
+
+
+// Finds the line and column of pos from the table of line starts
+static void vlFindLine(const VLEmitter* e, size_t pos, size_t* line, size_t* column) {
+    size_t low = 0, high = e->lineCount;
+    while (high - low > 1) {
+        size_t mid = low + (high - low) / 2;
+        if (e->lines[mid] <= pos) low = mid;
+        else high = mid;
+    }
+    *line = low + 1;
+    *column = pos - e->lines[low] + 1;
+}
+
+
+static void vlWriteWhere(const VLEmitter* e, size_t at) {
+    size_t line, column;
+    vlFindLine(e, e->fn->positions[at], &line, &column);
+    fprintf(e->out, "\"");
+    for (const char* ch = e->path; *ch; ++ch) {
+        if (*ch == '"' || *ch == '\\') fputc('\\', e->out);
+        fputc(*ch, e->out);
+    }
+    fprintf(e->out, ":%zu:%zu\"", line, column);
+}
+
+
+static void vlWriteLineDirective(VLEmitter* e, size_t line) {
+    fprintf(e->out, "#line %zu ", line);
+    vlWriteString(e->out, e->path, strlen(e->path));
+    fputc('\n', e->out);
+    e->nextLine = line;
+}
+
+
+// Instances of generic functions are named for their type arguments, as in max<int[]>, which
+// becomes vg_max_int___ so as not to clash with any other function
+static void vlWriteFunctionName(FILE* out, const VLProgram* program, const VLFunction* fn) {
+    if (fn == &program->functions[program->functionCount - 1]) {
+        fputs("vl_top", out);
+    } else if (fn->instance) {
+        fputs("vg_", out);
+        for (size_t i = 0; i < fn->name.len; ++i) fputc(VL_IS_NAME(fn->name.first[i]) ? fn->name.first[i] : '_', out);
+    } else {
+        fprintf(out, "v_%.*s", (int) fn->name.len, fn->name.first);
+    }
+}
+
+
+static void vlWriteSignature(FILE* out, const VLProgram* program, const VLFunction* fn) {
+    fprintf(out, "[[maybe_unused]] static %s ", vlIsVoid(fn->result) ? "void" : vlKindTypes[vlKind(fn->result)]);
+    vlWriteFunctionName(out, program, fn);
+    fputc('(', out);
+    for (size_t i = 0; i < fn->paramCount; ++i) {
+        VLCKind kind = vlKind(fn->params[i]);
+        fprintf(out, "%s%s r%zu_%c", i ? ", " : "", vlKindTypes[kind], i, vlKindSuffixes[kind]);
+    }
+    fputs(fn->paramCount ? ")" : "void)", out);
+}
+
+
+// The kind of value a REDUCE folds into, which integers share whatever their width
+static VLCKind vlReduceKind(uint32_t mode) {
+    switch (VL_REDUCE_ELEMENT(mode)) {
+        case VL_ELEM_F32: return VL_CK_F;
+        case VL_ELEM_F64: return VL_CK_D;
+        default: return VL_CK_I;
+    }
+}
+
+
+static void vlMark(VLEmitter* e, size_t reg, VLCKind kind) {
+    if (reg < VL_MAX_REGISTERS) e->kinds[reg] |= (uint8_t) (1u << kind);
+}
+
+
+static void vlMarkCall(VLEmitter* e, const VLFunction* callee, size_t base) {
+    for (size_t i = 0; i < callee->paramCount; ++i) vlMark(e, base + i, vlKind(callee->params[i]));
+    if (!vlIsVoid(callee->result)) vlMark(e, base, vlKind(callee->result));
+}
+
+
+// Works out which kinds of value each register holds, from what reads and writes it. A move
+// carries the representation it copies, so it only touches that kind on either side.
+static void vlFindKinds(VLEmitter* e) {
+    const VLFunction* fn = e->fn;
+    const VLProgram* program = e->program;
+    memset(e->kinds, 0, sizeof(e->kinds));
+    for (size_t i = 0; i < fn->paramCount; ++i) vlMark(e, i, vlKind(fn->params[i]));
+    if (fn == &program->functions[program->functionCount - 1]) {
+        for (size_t i = 0; i < program->variableCount; ++i) {
+            const VLVariable* variable = &program->variables[i];
+            if (!variable->global) vlMark(e, variable->slot, vlKind(variable->type));
+        }
+    }
+
+    for (size_t at = 0; at < fn->codeCount; ++at) {
+        uint32_t ins = fn->code[at];
+        uint32_t regs[] = {VL_INS_A(ins), VL_INS_B(ins), VL_INS_C(ins)};
+        switch ((VLOpcode) VL_INS_OP(ins)) {
+            case VL_BC_LOADK: vlMark(e, regs[0], vlRepKinds[fn->constantReps[VL_INS_BX(ins)]]); break;
+            case VL_BC_GETG:
+            case VL_BC_SETG: vlMark(e, regs[0], vlKind(vlGlobalType(program, VL_INS_BX(ins)))); break;
+            case VL_BC_CALL: vlMarkCall(e, &program->functions[VL_INS_BX(ins)], regs[0]); break;
+            case VL_BC_CALLN: vlMarkCall(e, vlNativePrototype(program, VL_INS_BX(ins)), regs[0]); break;
+            case VL_BC_MOVE:
+                vlMark(e, regs[0], vlRepKinds[regs[2]]);
+                vlMark(e, regs[1], vlRepKinds[regs[2]]);
+                break;
+            case VL_BC_RET: vlMark(e, regs[0], vlKind(fn->result)); break;
+            case VL_BC_REDUCE:
+                vlMark(e, regs[0], vlReduceKind(regs[2]));
+                vlMark(e, regs[1], VL_CK_P);
+                break;
+            default:
+                for (const char* t = vlTemplates[VL_INS_OP(ins)]; t && *t; ++t) {
+                    if (t[0] != '%' || t[1] < 'A' || t[1] > 'C') continue;
+                    vlMark(e, regs[t[1] - 'A'], (VLCKind) (strchr(vlKindSuffixes, t[2]) - vlKindSuffixes));
+                }
+                break;
+        }
+    }
+}
+
+
+static void vlWriteRegister(FILE* out, uint32_t reg, VLCKind kind) {
+    fprintf(out, "r%u_%c", reg, vlKindSuffixes[kind]);
+}
+
+
+static void vlWriteTemplate(const VLEmitter* e, const char* t, size_t at) {
+    uint32_t ins = e->fn->code[at];
+    for (; *t; ++t) {
+        if (*t != '%') {
+            fputc(*t, e->out);
+            continue;
+        }
+        switch (*++t) {
+            case 'A':
+            case 'B':
+            case 'C': {
+                uint32_t reg = *t == 'A' ? VL_INS_A(ins) : *t == 'B' ? VL_INS_B(ins) : VL_INS_C(ins);
+                ++t;
+                vlWriteRegister(e->out, reg, (VLCKind) (strchr(vlKindSuffixes, *t) - vlKindSuffixes));
+                break;
+            }
+            case 'X': fprintf(e->out, "%d", (int) VL_INS_SBX(ins)); break;
+            case 'S': fprintf(e->out, "%d", (int) VL_INS_SC(ins)); break;
+            case 'E': fputs(vlElementNames[VL_INS_C(ins)], e->out); break;
+            case 'W': vlWriteWhere(e, at); break;
+            case 'J': {
+                int32_t offset = VL_INS_OP(ins) == VL_BC_JMP ? VL_INS_SAX(ins) : VL_INS_SBX(ins);
+                fprintf(e->out, "L%zu", at + 1 + (size_t) (ptrdiff_t) offset);
+                break;
+            }
+        }
+    }
+}
+
+
+static void vlWriteCall(const VLEmitter* e, const VLFunction* callee, size_t at) {
+    FILE* out = e->out;
+    uint32_t base = VL_INS_A(e->fn->code[at]);
+    if (!vlIsVoid(callee->result)) {
+        vlWriteRegister(out, base, vlKind(callee->result));
+        fputs(" = ", out);
+    }
+    if (callee->native == VL_NO_NATIVE) vlWriteFunctionName(out, e->program, callee);
+    else fprintf(out, "vl_native_%s", vlNatives[callee->native].name);
+    fputc('(', out);
+    for (size_t i = 0; i < callee->paramCount; ++i) {
+        if (i) fputs(", ", out);
+        vlWriteRegister(out, base + (uint32_t) i, vlKind(callee->params[i]));
+    }
+    if (callee->native != VL_NO_NATIVE) {
+        fputs(callee->paramCount ? ", " : "", out);
+        vlWriteWhere(e, at);
+    }
+    fputs(");", out);
+}
+
+
+static void vlWriteInstruction(const VLEmitter* e, size_t at) {
+    FILE* out = e->out;
+    const VLFunction* fn = e->fn;
+    const VLProgram* program = e->program;
+    bool top = fn == &program->functions[program->functionCount - 1];
+    uint32_t ins = fn->code[at];
+    uint32_t a = VL_INS_A(ins);
+    switch ((VLOpcode) VL_INS_OP(ins)) {
+        case VL_BC_MOVE: {
+            VLCKind kind = vlRepKinds[VL_INS_C(ins)];
+            if (a != VL_INS_B(ins)) {
+                vlWriteRegister(out, a, kind);
+                fputs(" = ", out);
+                vlWriteRegister(out, VL_INS_B(ins), kind);
+            }
+            fputc(';', out);
+            break;
+        }
+        case VL_BC_LOADK: {
+            size_t index = VL_INS_BX(ins);
+            VLValue value = fn->constants[index];
+            VLCKind kind = vlRepKinds[fn->constantReps[index]];
+            vlWriteRegister(out, a, kind);
+            fputs(" = ", out);
+            switch (kind) {
+                case VL_CK_I:
+                    if (value.i == INT64_MIN) fputs("INT64_MIN", out);
+                    else fprintf(out, "%lld", (long long) value.i);
+                    break;
+                case VL_CK_F: vlWriteReal(out, value.f, true); break;
+                case VL_CK_D: vlWriteReal(out, value.d, false); break;
+                default: fprintf(out, "vl_strings[%zu]", e->strings[index]); break;
+            }
+            fputc(';', out);
+            break;
+        }
+        case VL_BC_GETG:
+            vlWriteRegister(out, a, vlKind(vlGlobalType(program, VL_INS_BX(ins))));
+            fprintf(out, " = g%u;", VL_INS_BX(ins));
+            break;
+        case VL_BC_SETG:
+            fprintf(out, "g%u = ", VL_INS_BX(ins));
+            vlWriteRegister(out, a, vlKind(vlGlobalType(program, VL_INS_BX(ins))));
+            fputc(';', out);
+            break;
+        case VL_BC_CALL: vlWriteCall(e, &program->functions[VL_INS_BX(ins)], at); break;
+        case VL_BC_CALLN: vlWriteCall(e, vlNativePrototype(program, VL_INS_BX(ins)), at); break;
+        case VL_BC_RET:
+            if (top) {
+                fputs("goto vl_done;", out);
+                break;
+            }
+            fputs("return ", out);
+            vlWriteRegister(out, a, vlKind(fn->result));
+            fputc(';', out);
+            break;
+        case VL_BC_RETV: fputs(top ? "goto vl_done;" : "return;", out); break;
+        case VL_BC_REDUCE: {
+            uint32_t mode = VL_INS_C(ins);
+            VLCKind kind = vlReduceKind(mode);
+            vlWriteRegister(out, a, kind);
+            fprintf(out, " = vl_reduce_%s%s_%s(", mode & VL_REDUCE_STRICT ? "strict_" : "",
+                    vlReduceName(VL_REDUCE_OP(mode)), vlElementSuffixes[VL_REDUCE_ELEMENT(mode)]);
+            vlWriteRegister(out, VL_INS_B(ins), VL_CK_P);
+            fputs(", ", out);
+            vlWriteRegister(out, a, kind);
+            fputs(", ", out);
+            vlWriteWhere(e, at);
+            fputs(");", out);
+            break;
+        }
+        default: vlWriteTemplate(e, vlTemplates[VL_INS_OP(ins)], at); break;
+    }
+}
+
+
+// Writes one function, putting all the instructions from a line of source on one line of C so
+// a single #line directive covers them, and only writing a new one when lines don't follow on
+static bool vlWriteFunction(VLEmitter* e, size_t firstString) {
+    FILE* out = e->out;
+    const VLFunction* fn = e->fn;
+    const VLProgram* program = e->program;
+    e->targets = calloc(fn->codeCount + 1, sizeof(bool));
+    e->strings = calloc(fn->constantCount ? fn->constantCount : 1, sizeof(size_t));
+    if (!e->targets || !e->strings) {
+        free(e->targets);
+        free(e->strings);
+        return false;
+    }
+    for (size_t k = 0; k < fn->constantCount; ++k) {
+        if (fn->constantReps[k] == VL_REP_P) e->strings[k] = firstString++;
+    }
+    for (size_t at = 0; at < fn->codeCount; ++at) {
+        uint32_t ins = fn->code[at];
+        VLOpcode op = (VLOpcode) VL_INS_OP(ins);
+        if (op != VL_BC_JMP && op != VL_BC_JT && op != VL_BC_JF) continue;
+        int32_t offset = op == VL_BC_JMP ? VL_INS_SAX(ins) : VL_INS_SBX(ins);
+        e->targets[at + 1 + (size_t) (ptrdiff_t) offset] = true;
+    }
+    vlFindKinds(e);
+
+    size_t line, column;
+    vlFindLine(e, fn->pos, &line, &column);
+    vlWriteLineDirective(e, line);
+    vlWriteSignature(out, program, fn);
+    fputs(" {\n", out);
+    for (size_t reg = 0; reg < fn->registerCount && reg < VL_MAX_REGISTERS; ++reg) {
+        for (VLCKind kind = 0; kind < VL_CK_COUNT; ++kind) {
+            if (!(e->kinds[reg] & 1u << kind)) continue;
+            if (reg < fn->paramCount && vlKind(fn->params[reg]) == kind) continue;
+            fprintf(out, "    %s r%zu_%c = %s;", vlKindTypes[kind], reg, vlKindSuffixes[kind], vlKindZeros[kind]);
+            const VLString* name = fn->registerNames ? &fn->registerNames[reg] : NULL;
+            if (name && name->len) fprintf(out, " /* %.*s */", (int) name->len, name->first);
+            fputc('\n', out);
+        }
+    }
+    e->nextLine = 0;
+
+    size_t current = 0;
+    for (size_t at = 0; at < fn->codeCount; ++at) {
+        vlFindLine(e, fn->positions[at], &line, &column);
+        if (!at || line != current) {
+            if (at) fputc('\n', out);
+            if (line != e->nextLine) vlWriteLineDirective(e, line);
+            ++e->nextLine;
+            current = line;
+            fputs("   ", out);
+        }
+        if (e->targets[at]) fprintf(out, " L%zu:", at);
+        fputc(' ', out);
+        vlWriteInstruction(e, at);
+    }
+    fputc('\n', out);
+    if (e->targets[fn->codeCount]) fprintf(out, "L%zu:;\n", fn->codeCount);
+
+    if (fn == &program->functions[program->functionCount - 1]) {
+        char type[64];
+        fputs("vl_done:\n", out);
+        for (size_t i = 0; i < program->variableCount; ++i) {
+            const VLVariable* variable = &program->variables[i];
+            VLCKind kind = vlKind(variable->type);
+            fprintf(out, "    vl_print_variable(\"%s\", ", vlTypeName(variable->type, type, sizeof(type)));
+            vlWriteString(out, variable->name.first, variable->name.len);
+            if (variable->global) fprintf(out, ", (vl_value) {.%s = g%u}, ", vlKindFields[kind], variable->slot);
+            else fprintf(out, ", (vl_value) {.%s = r%u_%c}, ", vlKindFields[kind], variable->slot,
+                         vlKindSuffixes[kind]);
+            fprintf(out, "%s, %u);\n", vlTypeEnums[variable->type.base], (unsigned) variable->type.rank);
+        }
+    }
+    fputs("}\n", out);
+    free(e->targets);
+    free(e->strings);
+    return true;
+}
+
+
+static void vlWriteStrings(FILE* out, const VLProgram* program, size_t count) {
+    fprintf(out, "\n[[maybe_unused]] static vl_string* vl_strings[%zu];\n\nstatic void vl_init_strings(void) {\n",
+            count ? count : 1);
+    size_t next = 0;
+    for (size_t i = 0; i < program->functionCount; ++i) {
+        const VLFunction* fn = &program->functions[i];
+        for (size_t k = 0; fn->code && k < fn->constantCount; ++k) {
+            if (fn->constantReps[k] != VL_REP_P) continue;
+            const VLStringObject* string = fn->constants[k].p;
+            fprintf(out, "    vl_strings[%zu] = vl_string_constant(", next++);
+            vlWriteString(out, string->data, string->length);
+            fprintf(out, ", %zu);\n", string->length);
+        }
+    }
+    fputs("}\n", out);
+}
+
+
+// ---- FUNCTIONS ---- //
+
+bool vlEmitC(FILE* out, const VLProgram* program, const char* path, const char* source, size_t size) {
+    VLEmitter e = {.out = out, .program = program, .path = path, .lineCount = 1};
+    for (size_t i = 0; i < size; ++i) e.lineCount += source[i] == '\n';
+    size_t* lines = malloc(e.lineCount * sizeof(size_t));
+    if (!lines) return false;
+    lines[0] = 0;
+    for (size_t i = 0, line = 1; i < size; ++i) {
+        if (source[i] == '\n') lines[line++] = i + 1;
+    }
+    e.lines = lines;
+
+    fprintf(out, "// Generated by valley from %s\n\n", path);
+    fputs(vlPrelude, out);
+
+    size_t strings = 0;
+    for (size_t i = 0; i < program->functionCount; ++i) {
+        const VLFunction* fn = &program->functions[i];
+        for (size_t k = 0; fn->code && k < fn->constantCount; ++k) strings += fn->constantReps[k] == VL_REP_P;
+    }
+    vlWriteStrings(out, program, strings);
+
+    if (program->globalCount) fputc('\n', out);
+    for (size_t slot = 0; slot < program->globalCount; ++slot) {
+        VLType type = vlGlobalType(program, slot);
+        fprintf(out, "static %s g%zu;\n", vlKindTypes[vlKind(type)], slot);
+    }
+    fputc('\n', out);
+    for (size_t i = 0; i < program->functionCount; ++i) {
+        if (!program->functions[i].code) continue;
+        vlWriteSignature(out, program, &program->functions[i]);
+        fputs(";\n", out);
+    }
+
+    bool ok = true;
+    size_t firstString = 0;
+    for (size_t i = 0; ok && i < program->functionCount; ++i) {
+        e.fn = &program->functions[i];
+        if (!e.fn->code) continue;
+        fputc('\n', out);
+        ok = vlWriteFunction(&e, firstString);
+        for (size_t k = 0; k < e.fn->constantCount; ++k) firstString += e.fn->constantReps[k] == VL_REP_P;
+    }
+
+    fputs("\nint main(void) {\n"
+          "    vl_init_strings();\n"
+          "    vl_top();\n"
+          "    vl_free_objects();\n"
+          "    return 0;\n"
+          "}\n", out);
+    free(lines);
+    return ok;
+}
+
+
+bool vlBuildNative(const char* cPath, const char* exePath, FILE* out) {
+    const char* cc = getenv("CC");
+    if (!cc || !*cc) cc = VL_DEFAULT_CC;
+    const char* cflags = getenv("CFLAGS");
+    char* flags = strdup(cflags ? cflags : "");
+    static const char spaces[] = " \t\n\v\f\r";
+    size_t words = 0;
+    for (const char* c = flags; c && *(c += strspn(c, spaces)); c += strcspn(c, spaces)) ++words;
+    char** argv = flags ? malloc((words + 9) * sizeof(char*)) : NULL;
+    if (!argv) {
+        free(flags);
+        fprintf(out, VL_ANSI_RED "Error: Out of memory." VL_ANSI_RESET "\n");
+        return false;
+    }
+
+    // $CFLAGS comes after the defaults so it can add warnings or override the optimization level
+    size_t argc = 0;
+    argv[argc++] = (char*) cc;
+    argv[argc++] = "-std=c2x";
+    argv[argc++] = "-O2";
+    argv[argc++] = "-g";
+    char* save;
+    for (char* word = strtok_r(flags, spaces, &save); word; word = strtok_r(NULL, spaces, &save)) argv[argc++] = word;
+    argv[argc++] = "-o";
+    argv[argc++] = (char*) exePath;
+    argv[argc++] = (char*) cPath;
+    argv[argc++] = "-lm";
+    argv[argc] = NULL;
+
+    // Whatever cc prints goes to out with the rest of the unit's output, which in server mode is
+    // the client. Other threads spawn compilers too, so neither end of the pipe may leak into them.
+    pid_t pid;
+    int fds[2] = {-1, -1};
+    int error = pipe(fds) ? errno : 0;
+    if (!error) {
+        fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+        fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+        posix_spawn_file_actions_t actions;
+        error = posix_spawn_file_actions_init(&actions);
+        if (!error) {
+            error = posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+            if (!error) error = posix_spawn_file_actions_adddup2(&actions, fds[1], STDERR_FILENO);
+            if (!error) error = posix_spawnp(&pid, cc, &actions, NULL, argv, environ);
+            posix_spawn_file_actions_destroy(&actions);
+        }
+        close(fds[1]);
+    }
+    free(argv);
+    free(flags);
+    if (error) {
+        if (fds[0] >= 0) close(fds[0]);
+        fprintf(out, VL_ANSI_RED "Error: Unable to run '%s': %s." VL_ANSI_RESET "\n", cc, strerror(error));
+        return false;
+    }
+
+    char buffer[4096];
+    for (ssize_t got; (got = read(fds[0], buffer, sizeof(buffer))) != 0;) {
+        if (got > 0) fwrite(buffer, 1, (size_t) got, out);
+        else if (errno != EINTR) break;
+    }
+    close(fds[0]);
+
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            fprintf(out, VL_ANSI_RED "Error: Lost track of '%s'." VL_ANSI_RESET "\n", cc);
+            return false;
+        }
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+        fprintf(out, VL_ANSI_RED "Error: '%s' failed to build '%s'." VL_ANSI_RESET "\n", cc, exePath);
+        return false;
+    }
+    return true;
+}
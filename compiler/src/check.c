@@ -0,0 +1,1532 @@
+/* ================
+ * src/check.c
+ * VALLEY LANGUAGE COMPILER
+ * Type checker from parsed statement trees to typed ones
+ * ================
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include "../include/check.h"
+#include "../include/vm.h"
+
+#define VL_MAX_EXPR_DEPTH 512
+#define VL_MAX_INSTANCES 1024
+
+typedef struct VLBinding {
+    VLSymbol symbol;
+    VLType type;
+    size_t scope;
+} VLBinding;
+
+// A generic function, which becomes an ordinary one for each list of type arguments it's called with
+typedef struct VLGeneric {
+    const VLStatement* stmt;
+    VLSymbol symbol;
+    VLString name;
+    const VLExpression** params;
+    size_t paramCount;
+    bool called;
+} VLGeneric;
+
+// Where each instance of a generic function is in the program, and what its type parameters stand for
+typedef struct VLInstance {
+    const VLGeneric* generic;
+    size_t function;
+    VLType* args;
+} VLInstance;
+
+// Names resolve the way the compiler will later find them: to the innermost local, then, inside
+// a function, to the top-level variables. Inside an instance, typeArgs gives what the type
+// parameters of generic stand for.
+typedef struct VLChecker {
+    VLProgram* program;
+    VLBinding* locals;
+    size_t localCount;
+    size_t localCapacity;
+    VLBinding* globals;
+    size_t globalCount;
+    size_t globalCapacity;
+    VLGeneric* generics;
+    size_t genericCount;
+    size_t genericCapacity;
+    VLInstance* instances;
+    size_t instanceCount;
+    size_t instanceCapacity;
+    const VLGeneric* generic;
+    const VLType* typeArgs;
+    VLType result;
+    size_t scope;
+    size_t loops;
+    size_t depth;
+    bool topLevel;
+} VLChecker;
+
+static bool vlCheckExpr(VLChecker* c, const VLExpression* expr, VLExpression** out);
+static bool vlCheckStatement(VLChecker* c, const VLStatement* stmt, VLStatement** out);
+
+
+// ---- HELPERS ---- //
+
+static bool vlGrow(void** items, size_t* capacity, size_t count, size_t size) {
+    if (count < *capacity) return true;
+    size_t grown = *capacity ? *capacity * 2 : 16;
+    void* resized = realloc(*items, grown * size);
+    if (!resized) return false;
+    *items = resized;
+    *capacity = grown;
+    return true;
+}
+
+
+static bool vlFail(VLChecker* c, VLStatus status, size_t pos, const char* format, ...) {
+    VLProgram* program = c->program;
+    if (program->status != VL_STATUS_OK) return false;
+    program->status = status;
+    program->pos = pos;
+    program->what = program->detail;
+    va_list args;
+    va_start(args, format);
+    vsnprintf(program->detail, sizeof(program->detail), format, args);
+    va_end(args);
+    return false;
+}
+
+
+static bool vlOutOfMemory(VLChecker* c, size_t pos) {
+    return vlFail(c, VL_STATUS_OUT_OF_MEM, pos, "");
+}
+
+
+static bool vlMismatch(VLChecker* c, size_t pos, VLType expected, VLType found) {
+    char want[64], got[64];
+    return vlFail(c, VL_STATUS_MISMATCH, pos, "expected '%s' but found '%s'", vlTypeName(expected, want, sizeof(want)),
+                  vlTypeName(found, got, sizeof(got)));
+}
+
+
+static VLType vlPrimitive(VLDataType base) {
+    return (VLType) {base, 0};
+}
+
+
+static bool vlSameType(VLType first, VLType second) {
+    return first.base == second.base && first.rank == second.rank;
+}
+
+
+static bool vlIsNumeric(VLType type) {
+    return !type.rank && type.base >= VL_TYPE_BYTE && type.base <= VL_TYPE_DOUBLE;
+}
+
+
+static bool vlIsIntegral(VLType type) {
+    return !type.rank && type.base >= VL_TYPE_BYTE && type.base <= VL_TYPE_LONG;
+}
+
+
+static bool vlIsReference(VLType type) {
+    return type.rank || type.base == VL_TYPE_STR || type.base == VL_TYPE_OBJECT;
+}
+
+
+static bool vlIsNull(VLType type) {
+    return !type.rank && type.base == VL_TYPE_OBJECT;
+}
+
+
+// Implicit conversions only ever widen: byte < short < int < long < float < double
+static bool vlAssignable(VLType from, VLType to) {
+    if (vlSameType(from, to)) return true;
+    if (vlIsNull(from) && vlIsReference(to) && !vlIsNull(to)) return true;
+    return vlIsNumeric(from) && vlIsNumeric(to) && from.base <= to.base;
+}
+
+
+static bool vlCastable(VLType from, VLType to) {
+    bool fromScalar = vlIsNumeric(from) || (!from.rank && from.base == VL_TYPE_CHAR);
+    bool toScalar = vlIsNumeric(to) || (!to.rank && to.base == VL_TYPE_CHAR);
+    return vlAssignable(from, to) || (fromScalar && toScalar);
+}
+
+
+static bool vlIsName(const VLExpression* expr, const char* name) {
+    size_t len = strlen(name);
+    return expr->kind == VL_EXPR_NAME && expr->stringValue.len == len && !memcmp(expr->stringValue.first, name, len);
+}
+
+
+static bool vlIsLiteral(const VLExpression* expr) {
+    return expr->kind >= VL_EXPR_CHAR && expr->kind <= VL_EXPR_BOOL;
+}
+
+
+static bool vlIsNumericLiteral(const VLExpression* expr) {
+    return expr->kind >= VL_EXPR_BYTE && expr->kind <= VL_EXPR_DOUBLE;
+}
+
+
+static bool vlIsDeclaration(const VLExpression* expr) {
+    return expr->kind == VL_EXPR_BINARY &&
+           (expr->binaryOp.operation == VL_OP_DECLARE || expr->binaryOp.operation == VL_OP_DECLARE_FINAL);
+}
+
+
+static bool vlEnter(VLChecker* c, size_t pos) {
+    if (++c->depth > VL_MAX_EXPR_DEPTH) return vlFail(c, VL_STATUS_LIMIT, pos, "nested expressions");
+    return true;
+}
+
+
+static bool vlUnsupported(VLChecker* c, const VLExpression* expr) {
+    VLOperation op;
+    switch (expr->kind) {
+        case VL_EXPR_UNARY: op = expr->unaryOp.operation; break;
+        case VL_EXPR_BINARY: op = expr->binaryOp.operation; break;
+        case VL_EXPR_TERNARY: op = expr->ternaryOp.operation; break;
+        case VL_EXPR_MULTI: op = expr->multiOp.operation; break;
+        default: return vlFail(c, VL_STATUS_UNSUPPORTED, expr->pos, "this expression");
+    }
+    return vlFail(c, VL_STATUS_UNSUPPORTED, expr->pos, "'%s' here", vlOpSpelling(op));
+}
+
+
+// A copy of expr for the checked tree, children and all still shared until replaced
+static bool vlCopy(VLChecker* c, const VLExpression* expr, VLType type, VLExpression** out) {
+    VLExpression* copy = vlArenaAlloc(&c->program->arena, sizeof(VLExpression));
+    if (!copy) return vlOutOfMemory(c, expr->pos);
+    *copy = *expr;
+    copy->type = type;
+    *out = copy;
+    return true;
+}
+
+
+static bool vlCopyChildren(VLChecker* c, VLExpression* copy, size_t count) {
+    VLExpression** children = vlArenaAlloc(&c->program->arena, (count ? count : 1) * sizeof(VLExpression*));
+    if (!children) return vlOutOfMemory(c, copy->pos);
+    copy->multiOp.children = children;
+    copy->multiOp.count = count;
+    return true;
+}
+
+
+static VLType vlLiteralType(const VLExpression* expr) {
+    switch (expr->kind) {
+        case VL_EXPR_STR: return vlPrimitive(VL_TYPE_STR);
+        case VL_EXPR_CHAR: return vlPrimitive(VL_TYPE_CHAR);
+        case VL_EXPR_BYTE: return vlPrimitive(VL_TYPE_BYTE);
+        case VL_EXPR_SHORT: return vlPrimitive(VL_TYPE_SHORT);
+        case VL_EXPR_INT: return vlPrimitive(VL_TYPE_INT);
+        case VL_EXPR_LONG: return vlPrimitive(VL_TYPE_LONG);
+        case VL_EXPR_FLOAT: return vlPrimitive(VL_TYPE_FLOAT);
+        case VL_EXPR_DOUBLE: return vlPrimitive(VL_TYPE_DOUBLE);
+        default: return vlPrimitive(VL_TYPE_BOOL);
+    }
+}
+
+
+// An int literal can initialize a narrower integer when its value fits, so short s = 1 is fine
+static bool vlFitsLiteral(const VLExpression* expr, VLType want) {
+    if (expr->kind != VL_EXPR_INT || want.rank) return false;
+    switch (want.base) {
+        case VL_TYPE_BYTE: return expr->intValue >= INT8_MIN && expr->intValue <= INT8_MAX;
+        case VL_TYPE_SHORT: return expr->intValue >= INT16_MIN && expr->intValue <= INT16_MAX;
+        case VL_TYPE_CHAR: return expr->intValue >= 0 && expr->intValue <= UINT8_MAX;
+        default: return false;
+    }
+}
+
+
+// A primitive literal rewritten as type, which it must be assignable or fit to
+static bool vlRetypeLiteral(VLChecker* c, const VLExpression* expr, VLType type, VLExpression** out) {
+    bool floating = expr->kind == VL_EXPR_FLOAT || expr->kind == VL_EXPR_DOUBLE;
+    VLLong integer = 0;
+    VLDouble real = expr->kind == VL_EXPR_FLOAT ? expr->floatValue : expr->doubleValue;
+    switch (expr->kind) {
+        case VL_EXPR_CHAR: integer = expr->charValue; break;
+        case VL_EXPR_BYTE: integer = expr->byteValue; break;
+        case VL_EXPR_SHORT: integer = expr->shortValue; break;
+        case VL_EXPR_INT: integer = expr->intValue; break;
+        case VL_EXPR_LONG: integer = expr->longValue; break;
+        case VL_EXPR_BOOL: integer = expr->boolValue; break;
+        default: break;
+    }
+
+    VLExpression* literal;
+    if (!vlCopy(c, expr, type, &literal)) return false;
+    switch (type.base) {
+        case VL_TYPE_CHAR: literal->kind = VL_EXPR_CHAR; literal->charValue = (VLChar) integer; break;
+        case VL_TYPE_BYTE: literal->kind = VL_EXPR_BYTE; literal->byteValue = (VLByte) integer; break;
+        case VL_TYPE_SHORT: literal->kind = VL_EXPR_SHORT; literal->shortValue = (VLShort) integer; break;
+        case VL_TYPE_INT: literal->kind = VL_EXPR_INT; literal->intValue = (VLInt) integer; break;
+        case VL_TYPE_LONG: literal->kind = VL_EXPR_LONG; literal->longValue = integer; break;
+        case VL_TYPE_FLOAT:
+            literal->kind = VL_EXPR_FLOAT;
+            literal->floatValue = floating ? (VLFloat) real : (VLFloat) integer;
+            break;
+        case VL_TYPE_DOUBLE:
+            literal->kind = VL_EXPR_DOUBLE;
+            literal->doubleValue = floating ? real : (VLDouble) integer;
+            break;
+        default: literal->kind = VL_EXPR_BOOL; literal->boolValue = (VLBool) integer; break;
+    }
+    *out = literal;
+    return true;
+}
+
+
+// Makes the checked expr in *out have type to, which it must be castable to. Widening a literal
+// just rewrites it; anything else gets wrapped in a cast.
+static bool vlConvertTo(VLChecker* c, VLType to, VLExpression** out) {
+    VLExpression* expr = *out;
+    if (vlSameType(expr->type, to)) return true;
+    if (vlIsLiteral(expr) && vlAssignable(expr->type, to)) return vlRetypeLiteral(c, expr, to, out);
+
+    VLExpression* cast = vlArenaAlloc(&c->program->arena, sizeof(VLExpression));
+    if (!cast) return vlOutOfMemory(c, expr->pos);
+    *cast = (VLExpression) {.kind = VL_EXPR_BINARY, .pos = expr->pos, .type = to};
+    cast->binaryOp.operation = VL_OP_CAST;
+    cast->binaryOp.first = expr;
+    cast->binaryOp.second = NULL;
+    *out = cast;
+    return true;
+}
+
+
+static bool vlResolveType(VLChecker* c, const VLExpression* expr, VLType* type, bool* variadic) {
+    static const struct {
+        const char* name;
+        VLDataType type;
+    } primitives[] = {
+        {"void", VL_TYPE_VOID}, {"str", VL_TYPE_STR}, {"char", VL_TYPE_CHAR}, {"byte", VL_TYPE_BYTE},
+        {"short", VL_TYPE_SHORT}, {"int", VL_TYPE_INT}, {"long", VL_TYPE_LONG}, {"float", VL_TYPE_FLOAT},
+        {"double", VL_TYPE_DOUBLE}, {"bool", VL_TYPE_BOOL},
+    };
+
+    size_t rank = 0;
+    if (variadic) *variadic = false;
+    if (variadic && expr->kind == VL_EXPR_UNARY && expr->unaryOp.operation == VL_OP_EXTEND) {
+        *variadic = true;
+        ++rank;
+        expr = expr->unaryOp.child;
+    }
+    while (expr->kind == VL_EXPR_MULTI && expr->multiOp.operation == VL_OP_INDEX && expr->multiOp.count == 1) {
+        ++rank;
+        expr = expr->multiOp.children[0];
+    }
+    if (expr->kind != VL_EXPR_NAME) return vlFail(c, VL_STATUS_UNSUPPORTED, expr->pos, "type expression");
+    if (rank > UINT8_MAX) return vlFail(c, VL_STATUS_LIMIT, expr->pos, "array dimensions");
+
+    for (size_t i = 0; i < sizeof(primitives) / sizeof(primitives[0]); ++i) {
+        if (vlIsName(expr, primitives[i].name)) {
+            if (primitives[i].type == VL_TYPE_VOID && rank) break;
+            *type = (VLType) {primitives[i].type, (uint8_t) rank};
+            return true;
+        }
+    }
+    for (size_t i = 0; c->generic && i < c->generic->paramCount; ++i) {
+        if (c->generic->params[i]->symbol != expr->symbol) continue;
+        VLType arg = c->typeArgs[i];
+        if (arg.rank + rank > UINT8_MAX) return vlFail(c, VL_STATUS_LIMIT, expr->pos, "array dimensions");
+        *type = (VLType) {arg.base, (uint8_t) (arg.rank + rank)};
+        return true;
+    }
+    return vlFail(c, VL_STATUS_UNDEFINED, expr->pos, "%.*s", (int) expr->stringValue.len, expr->stringValue.first);
+}
+
+
+static const VLBinding* vlResolve(const VLChecker* c, VLSymbol symbol) {
+    for (size_t i = c->localCount; i-- > 0;) {
+        if (c->locals[i].symbol == symbol) return &c->locals[i];
+    }
+    if (!c->topLevel) {
+        for (size_t i = 0; i < c->globalCount; ++i) {
+            if (c->globals[i].symbol == symbol) return &c->globals[i];
+        }
+    }
+    return NULL;
+}
+
+
+static bool vlBind(VLChecker* c, const VLExpression* name, VLType type) {
+    for (size_t i = c->localCount; i-- > 0 && c->locals[i].scope == c->scope;) {
+        if (c->locals[i].symbol == name->symbol) {
+            return vlFail(c, VL_STATUS_REDEFINED, name->pos, "%.*s", (int) name->stringValue.len,
+                          name->stringValue.first);
+        }
+    }
+    if (!vlGrow((void**) &c->locals, &c->localCapacity, c->localCount, sizeof(VLBinding))) {
+        return vlOutOfMemory(c, name->pos);
+    }
+    c->locals[c->localCount++] = (VLBinding) {name->symbol, type, c->scope};
+    return true;
+}
+
+
+static VLFunction* vlFindFunction(const VLChecker* c, VLSymbol symbol) {
+    VLProgram* program = c->program;
+    for (size_t i = 0; i < program->functionCount; ++i) {
+        const VLFunction* fn = &program->functions[i];
+        if (fn->symbol == symbol && fn->name.len && !fn->instance) return &program->functions[i];
+    }
+    return NULL;
+}
+
+
+static VLGeneric* vlFindGeneric(const VLChecker* c, VLSymbol symbol) {
+    for (size_t i = 0; i < c->genericCount; ++i) {
+        if (c->generics[i].symbol == symbol) return &c->generics[i];
+    }
+    return NULL;
+}
+
+
+// Checks expr as a value of type want. Literals are rewritten as that type, and array literals
+// take their element type from it.
+static bool vlCheckAs(VLChecker* c, const VLExpression* expr, VLType want, VLExpression** out);
+
+
+static bool vlArrayLiteral(VLChecker* c, const VLExpression* expr, VLType type, VLExpression** out) {
+    size_t count = expr->multiOp.count;
+    VLType element = {type.base, (uint8_t) (type.rank - 1)};
+    VLExpression* array;
+    if (!vlCopy(c, expr, type, &array) || !vlCopyChildren(c, array, count)) return false;
+    for (size_t i = 0; i < count; ++i) {
+        if (!vlCheckAs(c, expr->multiOp.children[i], element, &array->multiOp.children[i])) return false;
+    }
+    *out = array;
+    return true;
+}
+
+
+// The type of an array literal nobody said the type of: that of its elements, promoted, if they
+// are all literals
+static bool vlLiteralArrayType(VLChecker* c, const VLExpression* expr, VLType* type) {
+    bool known = false;
+    for (size_t i = 0; i < expr->multiOp.count; ++i) {
+        const VLExpression* item = expr->multiOp.children[i];
+        VLType element;
+        if (item->kind == VL_EXPR_MULTI && item->multiOp.operation == VL_OP_ARR_INIT) {
+            if (!vlLiteralArrayType(c, item, &element)) return false;
+        } else if (item->kind >= VL_EXPR_STR && item->kind <= VL_EXPR_BOOL) {
+            element = vlLiteralType(item);
+        } else {
+            return vlFail(c, VL_STATUS_UNSUPPORTED, expr->pos, "array literal without a declared type");
+        }
+        if (!known) {
+            *type = element;
+            known = true;
+        } else if (vlAssignable(*type, element)) {
+            *type = element;
+        } else if (!vlAssignable(element, *type)) {
+            return vlMismatch(c, item->pos, *type, element);
+        }
+    }
+    if (!known) return vlFail(c, VL_STATUS_UNSUPPORTED, expr->pos, "array literal without a declared type");
+    if (type->rank == UINT8_MAX) return vlFail(c, VL_STATUS_LIMIT, expr->pos, "array dimensions");
+    ++type->rank;
+    return true;
+}
+
+
+static bool vlCheckAs(VLChecker* c, const VLExpression* expr, VLType want, VLExpression** out) {
+    if (vlIsLiteral(expr)) {
+        VLType type = vlLiteralType(expr);
+        if (!vlAssignable(type, want) && !vlFitsLiteral(expr, want)) return vlMismatch(c, expr->pos, want, type);
+        return vlRetypeLiteral(c, expr, want, out);
+    }
+    if (expr->kind == VL_EXPR_MULTI && expr->multiOp.operation == VL_OP_ARR_INIT && want.rank) {
+        return vlEnter(c, expr->pos) && vlArrayLiteral(c, expr, want, out) && (--c->depth, true);
+    }
+    if (!vlCheckExpr(c, expr, out)) return false;
+    if (!vlAssignable((*out)->type, want)) return vlMismatch(c, expr->pos, want, (*out)->type);
+    return vlConvertTo(c, want, out);
+}
+
+
+static bool vlCheckName(VLChecker* c, const VLExpression* expr, VLExpression** out) {
+    const VLBinding* binding = vlResolve(c, expr->symbol);
+    if (binding) return vlCopy(c, expr, binding->type, out);
+    if (vlIsName(expr, "null")) return vlCopy(c, expr, vlPrimitive(VL_TYPE_OBJECT), out);
+    return vlFail(c, VL_STATUS_UNDEFINED, expr->pos, "%.*s", (int) expr->stringValue.len, expr->stringValue.first);
+}
+
+
+static bool vlIndexable(VLChecker* c, const VLExpression* expr, VLType type) {
+    if (!type.rank) return vlFail(c, VL_STATUS_MISMATCH, expr->pos, "only arrays can be indexed");
+    return true;
+}
+
+
+static bool vlCheckIndex(VLChecker* c, const VLExpression* expr, VLExpression** out) {
+    VLExpression* index;
+    if (!vlCopy(c, expr, vlPrimitive(VL_TYPE_VOID), &index) || !vlCopyChildren(c, index, 2)) return false;
+    VLExpression** children = index->multiOp.children;
+    if (!vlCheckExpr(c, expr->multiOp.children[0], &children[0])) return false;
+    if (!vlIndexable(c, expr, children[0]->type)) return false;
+    if (!vlCheckAs(c, expr->multiOp.children[1], vlPrimitive(VL_TYPE_INT), &children[1])) return false;
+    index->type = (VLType) {children[0]->type.base, (uint8_t) (children[0]->type.rank - 1)};
+    *out = index;
+    return true;
+}
+
+
+static bool vlCheckMember(VLChecker* c, const VLExpression* expr, VLExpression** out);
+
+
+// Somewhere a value can be stored: a variable, an array element or an array's capacity
+static bool vlCheckPlace(VLChecker* c, const VLExpression* target, VLExpression** out) {
+    if (target->kind == VL_EXPR_NAME) {
+        const VLBinding* binding = vlResolve(c, target->symbol);
+        if (!binding) {
+            return vlFail(c, VL_STATUS_UNDEFINED, target->pos, "%.*s", (int) target->stringValue.len,
+                          target->stringValue.first);
+        }
+        return vlCopy(c, target, binding->type, out);
+    }
+    if (target->kind == VL_EXPR_MULTI && target->multiOp.operation == VL_OP_INDEX && target->multiOp.count == 2) {
+        return vlCheckIndex(c, target, out);
+    }
+    if (target->kind == VL_EXPR_BINARY && target->binaryOp.operation == VL_OP_MEMBER &&
+        vlIsName(target->binaryOp.second, "capacity")) {
+        return vlCheckMember(c, target, out);
+    }
+    return vlFail(c, VL_STATUS_UNSUPPORTED, target->pos, "assignment to this expression");
+}
+
+
+// The type left op right computes in, given the types of its sides
+static bool vlArithmeticType(VLChecker* c, VLOperation op, VLType left, VLType right, size_t pos, VLType* type) {
+    bool shift = op == VL_OP_LSHIFT || op == VL_OP_RSHIFT;
+    bool bitwise = shift || op == VL_OP_AND || op == VL_OP_OR || op == VL_OP_XOR;
+
+    // Bitwise operators also work on bools
+    if (bitwise && !shift && !left.rank && !right.rank && left.base == VL_TYPE_BOOL && right.base == VL_TYPE_BOOL) {
+        *type = left;
+        return true;
+    }
+
+    // The shifted value keeps its type, and the count is taken modulo its width
+    if (shift) {
+        if (!vlIsIntegral(left) || !vlIsIntegral(right)) {
+            return vlMismatch(c, pos, vlPrimitive(VL_TYPE_INT), vlIsIntegral(left) ? right : left);
+        }
+        *type = left;
+        return true;
+    }
+
+    if (!vlIsNumeric(left) || !vlIsNumeric(right)) {
+        return vlMismatch(c, pos, vlPrimitive(VL_TYPE_DOUBLE), vlIsNumeric(left) ? right : left);
+    }
+    *type = left.base > right.base ? left : right;
+    if (bitwise && !vlIsIntegral(*type)) return vlMismatch(c, pos, vlPrimitive(VL_TYPE_LONG), *type);
+    return true;
+}
+
+
+// A numeric literal operand takes the other side's type when it widens to it, so x % 2 with x a
+// double needs no conversion at run time
+static bool vlLiteralOperand(VLChecker* c, const VLExpression* expr, VLType other, VLExpression** out) {
+    VLType type = vlLiteralType(expr);
+    if (vlIsNumeric(other) && vlAssignable(type, other)) type = other;
+    return vlRetypeLiteral(c, expr, type, out);
+}
+
+
+static bool vlCheckOperands(VLChecker* c, const VLExpression* expr, VLExpression** left, VLExpression** right) {
+    const VLExpression* first = expr->binaryOp.first;
+    const VLExpression* second = expr->binaryOp.second;
+    VLOperation op = expr->binaryOp.operation;
+    bool shift = op == VL_OP_LSHIFT || op == VL_OP_RSHIFT;
+
+    // A shift takes its type from the left side alone
+    if (!shift && vlIsNumericLiteral(first) && !vlIsNumericLiteral(second)) {
+        return vlCheckExpr(c, second, right) && vlLiteralOperand(c, first, (*right)->type, left);
+    }
+    if (!vlCheckExpr(c, first, left)) return false;
+    if (vlIsNumericLiteral(second)) return vlLiteralOperand(c, second, (*left)->type, right);
+    return vlCheckExpr(c, second, right);
+}
+
+
+static bool vlCheckArithmetic(VLChecker* c, const VLExpression* expr, VLExpression** out) {
+    VLOperation op = expr->binaryOp.operation;
+    VLExpression* binary;
+    if (!vlCopy(c, expr, vlPrimitive(VL_TYPE_VOID), &binary)) return false;
+    if (!vlCheckOperands(c, expr, &binary->binaryOp.first, &binary->binaryOp.second)) return false;
+    if (!vlArithmeticType(c, op, binary->binaryOp.first->type, binary->binaryOp.second->type, expr->pos,
+                          &binary->type)) {
+        return false;
+    }
+    bool shift = op == VL_OP_LSHIFT || op == VL_OP_RSHIFT;
+    if (!vlConvertTo(c, binary->type, &binary->binaryOp.first)) return false;
+    if (!shift && !vlConvertTo(c, binary->type, &binary->binaryOp.second)) return false;
+    *out = binary;
+    return true;
+}
+
+
+static bool vlCheckComparison(VLChecker* c, const VLExpression* expr, VLExpression** out) {
+    VLOperation op = expr->binaryOp.operation;
+    VLExpression* comparison;
+    if (!vlCopy(c, expr, vlPrimitive(VL_TYPE_BOOL), &comparison)) return false;
+    VLExpression** left = &comparison->binaryOp.first;
+    VLExpression** right = &comparison->binaryOp.second;
+    if (!vlCheckOperands(c, expr, left, right)) return false;
+    *out = comparison;
+
+    VLType leftType = (*left)->type, rightType = (*right)->type;
+    bool equality = op == VL_OP_EQ || op == VL_OP_NEQ || op == VL_OP_SAME || op == VL_OP_NSAME;
+    if (vlIsNumeric(leftType) && vlIsNumeric(rightType)) {
+        VLType common = leftType.base > rightType.base ? leftType : rightType;
+        return vlConvertTo(c, common, left) && vlConvertTo(c, common, right);
+    }
+    if (!leftType.rank && !rightType.rank && leftType.base == rightType.base &&
+        (leftType.base == VL_TYPE_BOOL || leftType.base == VL_TYPE_CHAR)) {
+        return true;
+    }
+    if (equality && vlIsReference(leftType) && vlIsReference(rightType) &&
+        (vlAssignable(leftType, rightType) || vlAssignable(rightType, leftType))) {
+        return true;
+    }
+    return vlMismatch(c, expr->pos, leftType, rightType);
+}
+
+
+static VLOperation vlCompoundOperation(VLOperation op) {
+    switch (op) {
+        case VL_OP_ADD_PUT: return VL_OP_ADD;
+        case VL_OP_SUB_PUT: return VL_OP_SUB;
+        case VL_OP_MUL_PUT: return VL_OP_MUL;
+        case VL_OP_DIV_PUT: return VL_OP_DIV;
+        case VL_OP_MOD_PUT: return VL_OP_MOD;
+        case VL_OP_EXP_PUT: return VL_OP_EXP;
+        case VL_OP_AND_PUT: return VL_OP_AND;
+        case VL_OP_XOR_PUT: return VL_OP_XOR;
+        case VL_OP_OR_PUT: return VL_OP_OR;
+        case VL_OP_LSHIFT_PUT: return VL_OP_LSHIFT;
+        case VL_OP_RSHIFT_PUT: return VL_OP_RSHIFT;
+        default: return VL_OP_PUT;
+    }
+}
+
+
+// Plain and compound assignment. A compound assignment's value is brought to the type the
+// operation computes in, and the result converted back to the target's type, so int i; i += 1.5
+// truncates like an explicit cast would.
+static bool vlCheckAssign(VLChecker* c, const VLExpression* expr, VLExpression** out) {
+    const VLExpression* target = expr->binaryOp.first;
+    const VLExpression* value = expr->binaryOp.second;
+    VLOperation op = vlCompoundOperation(expr->binaryOp.operation);
+    if (vlIsDeclaration(target)) {
+        return vlFail(c, VL_STATUS_UNSUPPORTED, target->pos, "a declaration inside an expression");
+    }
+    VLExpression* assign;
+    if (!vlCopy(c, expr, vlPrimitive(VL_TYPE_VOID), &assign)) return false;
+    if (!vlCheckPlace(c, target, &assign->binaryOp.first)) return false;
+    VLType type = assign->type = assign->binaryOp.first->type;
+    VLExpression** checked = &assign->binaryOp.second;
+    *out = assign;
+    if (op == VL_OP_PUT) return vlCheckAs(c, value, type, checked);
+
+    VLType computed;
+    bool ok = vlIsNumericLiteral(value) ? vlLiteralOperand(c, value, type, checked) : vlCheckExpr(c, value, checked);
+    if (!ok || !vlArithmeticType(c, op, type, (*checked)->type, expr->pos, &computed)) return false;
+    if (!vlCastable(computed, type)) return vlMismatch(c, expr->pos, type, computed);
+    return op == VL_OP_LSHIFT || op == VL_OP_RSHIFT || vlConvertTo(c, computed, checked);
+}
+
+
+static bool vlCheckUnary(VLChecker* c, const VLExpression* expr, VLExpression** out) {
+    VLOperation op = expr->unaryOp.operation;
+    VLExpression* unary;
+    if (!vlCopy(c, expr, vlPrimitive(VL_TYPE_VOID), &unary)) return false;
+    VLExpression** child = &unary->unaryOp.child;
+    switch (op) {
+        case VL_OP_INC_BEF:
+        case VL_OP_INC_AFT:
+        case VL_OP_DEC_BEF:
+        case VL_OP_DEC_AFT:
+            if (!vlCheckPlace(c, expr->unaryOp.child, child)) return false;
+            if (!vlIsNumeric((*child)->type)) return vlMismatch(c, expr->pos, vlPrimitive(VL_TYPE_INT), (*child)->type);
+            break;
+        case VL_OP_POS:
+        case VL_OP_NEG:
+        case VL_OP_NOT:
+        case VL_OP_LNOT:
+            if (!vlCheckExpr(c, expr->unaryOp.child, child)) return false;
+            break;
+        default:
+            return vlUnsupported(c, expr);
+    }
+
+    VLType type = unary->type = (*child)->type;
+    *out = unary;
+    if (op == VL_OP_LNOT && (type.rank || type.base != VL_TYPE_BOOL)) {
+        return vlMismatch(c, expr->pos, vlPrimitive(VL_TYPE_BOOL), type);
+    }
+    if (op == VL_OP_NOT && !vlIsIntegral(type)) return vlMismatch(c, expr->pos, vlPrimitive(VL_TYPE_INT), type);
+    if ((op == VL_OP_POS || op == VL_OP_NEG) && !vlIsNumeric(type)) {
+        return vlMismatch(c, expr->pos, vlPrimitive(VL_TYPE_INT), type);
+    }
+    return true;
+}
+
+
+static bool vlCheckLogical(VLChecker* c, const VLExpression* expr, VLExpression** out) {
+    VLType boolean = vlPrimitive(VL_TYPE_BOOL);
+    VLExpression* logical;
+    if (!vlCopy(c, expr, boolean, &logical)) return false;
+    *out = logical;
+    return vlCheckAs(c, expr->binaryOp.first, boolean, &logical->binaryOp.first) &&
+           vlCheckAs(c, expr->binaryOp.second, boolean, &logical->binaryOp.second);
+}
+
+
+static bool vlCheckCast(VLChecker* c, const VLExpression* expr, VLExpression** out) {
+    VLExpression* cast;
+    if (!vlCopy(c, expr, vlPrimitive(VL_TYPE_VOID), &cast)) return false;
+    if (!vlResolveType(c, expr->binaryOp.second, &cast->type, NULL)) return false;
+    if (!vlCheckExpr(c, expr->binaryOp.first, &cast->binaryOp.first)) return false;
+    VLType from = cast->binaryOp.first->type;
+    if (!vlCastable(from, cast->type)) return vlMismatch(c, expr->pos, cast->type, from);
+    *out = cast;
+    return true;
+}
+
+
+// The length of an array or string, or the capacity of an array
+static bool vlCheckMember(VLChecker* c, const VLExpression* expr, VLExpression** out) {
+    bool capacity = vlIsName(expr->binaryOp.second, "capacity");
+    if (!capacity && !vlIsName(expr->binaryOp.second, "length")) return vlUnsupported(c, expr);
+    VLExpression* member;
+    if (!vlCopy(c, expr, vlPrimitive(VL_TYPE_INT), &member)) return false;
+    if (!vlCheckExpr(c, expr->binaryOp.first, &member->binaryOp.first)) return false;
+    VLType object = member->binaryOp.first->type;
+    if (capacity && !object.rank) return vlFail(c, VL_STATUS_MISMATCH, expr->pos, "only arrays have a capacity");
+    if (!object.rank && object.base != VL_TYPE_STR) {
+        return vlFail(c, VL_STATUS_MISMATCH, expr->pos, "only arrays and strings have a length");
+    }
+    *out = member;
+    return true;
+}
+
+
+static bool vlCheckBinary(VLChecker* c, const VLExpression* expr, VLExpression** out) {
+    switch (expr->binaryOp.operation) {
+        case VL_OP_ADD:
+        case VL_OP_SUB:
+        case VL_OP_MUL:
+        case VL_OP_DIV:
+        case VL_OP_MOD:
+        case VL_OP_EXP:
+        case VL_OP_AND:
+        case VL_OP_XOR:
+        case VL_OP_OR:
+        case VL_OP_LSHIFT:
+        case VL_OP_RSHIFT:
+            return vlCheckArithmetic(c, expr, out);
+        case VL_OP_LAND:
+        case VL_OP_LOR:
+        case VL_OP_LXOR:
+            return vlCheckLogical(c, expr, out);
+        case VL_OP_EQ:
+        case VL_OP_NEQ:
+        case VL_OP_LT:
+        case VL_OP_GT:
+        case VL_OP_LTEQ:
+        case VL_OP_GTEQ:
+        case VL_OP_SAME:
+        case VL_OP_NSAME:
+            return vlCheckComparison(c, expr, out);
+        case VL_OP_PUT:
+        case VL_OP_ADD_PUT:
+        case VL_OP_SUB_PUT:
+        case VL_OP_MUL_PUT:
+        case VL_OP_DIV_PUT:
+        case VL_OP_MOD_PUT:
+        case VL_OP_EXP_PUT:
+        case VL_OP_AND_PUT:
+        case VL_OP_XOR_PUT:
+        case VL_OP_OR_PUT:
+        case VL_OP_LSHIFT_PUT:
+        case VL_OP_RSHIFT_PUT:
+            return vlCheckAssign(c, expr, out);
+        case VL_OP_CAST:
+            return vlCheckCast(c, expr, out);
+        case VL_OP_MEMBER:
+            return vlCheckMember(c, expr, out);
+        default:
+            return vlUnsupported(c, expr);
+    }
+}
+
+
+static bool vlCommonType(VLChecker* c, VLType first, VLType second, size_t pos, VLType* common) {
+    if (vlIsNumeric(first) && vlIsNumeric(second)) {
+        *common = first.base > second.base ? first : second;
+    } else if (vlAssignable(first, second)) {
+        *common = second;
+    } else if (vlAssignable(second, first)) {
+        *common = first;
+    } else {
+        return vlMismatch(c, pos, first, second);
+    }
+    return true;
+}
+
+
+static bool vlCheckConditional(VLChecker* c, const VLExpression* expr, VLExpression** out) {
+    VLExpression* conditional;
+    if (!vlCopy(c, expr, vlPrimitive(VL_TYPE_VOID), &conditional)) return false;
+    VLExpression** first = &conditional->ternaryOp.second;
+    VLExpression** second = &conditional->ternaryOp.third;
+    if (!vlCheckAs(c, expr->ternaryOp.first, vlPrimitive(VL_TYPE_BOOL), &conditional->ternaryOp.first)) return false;
+    if (!vlCheckExpr(c, expr->ternaryOp.second, first) || !vlCheckExpr(c, expr->ternaryOp.third, second)) return false;
+    if (!vlCommonType(c, (*first)->type, (*second)->type, expr->pos, &conditional->type)) return false;
+    *out = conditional;
+    return vlConvertTo(c, conditional->type, first) && vlConvertTo(c, conditional->type, second);
+}
+
+
+// T[](length = n), or just T[](n), makes an array of n zeroed elements
+static bool vlCheckArrayConstructor(VLChecker* c, const VLExpression* expr, VLExpression** out) {
+    VLExpression* constructor;
+    if (!vlCopy(c, expr, vlPrimitive(VL_TYPE_VOID), &constructor)) return false;
+    if (!vlResolveType(c, expr->multiOp.children[0], &constructor->type, NULL)) return false;
+    if (expr->multiOp.count != 2) return vlFail(c, VL_STATUS_ARGUMENTS, expr->pos, "[]");
+    const VLExpression* size = expr->multiOp.children[1];
+    if (size->kind == VL_EXPR_BINARY && size->binaryOp.operation == VL_OP_PUT) {
+        if (!vlIsName(size->binaryOp.first, "length")) return vlUnsupported(c, size);
+        size = size->binaryOp.second;
+    }
+    if (!vlCopyChildren(c, constructor, 2)) return false;
+    constructor->multiOp.children[0] = expr->multiOp.children[0];
+    *out = constructor;
+    return vlCheckAs(c, size, vlPrimitive(VL_TYPE_INT), &constructor->multiOp.children[1]);
+}
+
+
+// a.add(item, index = -1) inserts item into the array a at index, which counts from the end when
+// it is negative, so by default it appends. The checked call always passes the index.
+static bool vlCheckArrayAdd(VLChecker* c, const VLExpression* expr, VLExpression** out) {
+    const VLExpression* callee = expr->multiOp.children[0];
+    if (!vlIsName(callee->binaryOp.second, "add")) {
+        return vlFail(c, VL_STATUS_UNSUPPORTED, callee->pos, "calls through expressions");
+    }
+    VLExpression* call;
+    if (!vlCopy(c, expr, vlPrimitive(VL_TYPE_VOID), &call) || !vlCopyChildren(c, call, 3)) return false;
+    VLExpression** children = call->multiOp.children;
+    if (!vlCopy(c, callee, vlPrimitive(VL_TYPE_VOID), &children[0])) return false;
+    if (!vlCheckExpr(c, callee->binaryOp.first, &children[0]->binaryOp.first)) return false;
+    VLType array = children[0]->binaryOp.first->type;
+    if (!array.rank) return vlFail(c, VL_STATUS_MISMATCH, callee->pos, "only arrays can be added to");
+    size_t argCount = expr->multiOp.count - 1;
+    if (argCount < 1 || argCount > 2) return vlFail(c, VL_STATUS_ARGUMENTS, expr->pos, "add");
+
+    VLType element = {array.base, (uint8_t) (array.rank - 1)};
+    *out = call;
+    if (!vlCheckAs(c, expr->multiOp.children[1], element, &children[1])) return false;
+    if (argCount == 2) return vlCheckAs(c, expr->multiOp.children[2], vlPrimitive(VL_TYPE_INT), &children[2]);
+    if (!vlCopy(c, expr, vlPrimitive(VL_TYPE_INT), &children[2])) return false;
+    children[2]->kind = VL_EXPR_INT;
+    children[2]->intValue = -1;
+    return true;
+}
+
+
+static bool vlInstantiate(VLChecker* c, VLGeneric* generic, const VLType* typeArgs, size_t pos, size_t* index);
+
+
+// Which type parameter of generic a type such as T or T[] is made from, if any, with rank set to
+// how many array dimensions it adds
+static size_t vlTypeParam(const VLGeneric* generic, const VLExpression* type, size_t* rank) {
+    *rank = 0;
+    while (type->kind == VL_EXPR_MULTI && type->multiOp.operation == VL_OP_INDEX && type->multiOp.count == 1) {
+        ++*rank;
+        type = type->multiOp.children[0];
+    }
+    for (size_t i = 0; type->kind == VL_EXPR_NAME && i < generic->paramCount; ++i) {
+        if (generic->params[i]->symbol == type->symbol) return i;
+    }
+    return SIZE_MAX;
+}
+
+
+// A call to a generic function takes each type argument to be the common type of the arguments
+// whose parameters have that type parameter's type, then calls the instance for those
+static bool vlCheckGenericCall(VLChecker* c, const VLExpression* expr, VLGeneric* generic, VLExpression** out) {
+    const VLExpression* signature = generic->stmt->function.signature->binaryOp.second;
+    const VLExpression* const* params = (const VLExpression* const*) signature->multiOp.children + 1;
+    size_t paramCount = signature->multiOp.count - 1;
+    size_t argCount = expr->multiOp.count - 1;
+    if (argCount > paramCount) {
+        return vlFail(c, VL_STATUS_ARGUMENTS, expr->pos, "%.*s", (int) generic->name.len, generic->name.first);
+    }
+
+    VLExpression* call;
+    VLType* typeArgs = vlArenaAlloc(&c->program->arena, generic->paramCount * sizeof(VLType));
+    if (!typeArgs) return vlOutOfMemory(c, expr->pos);
+    if (!vlCopy(c, expr, vlPrimitive(VL_TYPE_VOID), &call) || !vlCopyChildren(c, call, paramCount + 1)) return false;
+    VLExpression** args = call->multiOp.children + 1;
+    for (size_t i = 0; i < generic->paramCount; ++i) typeArgs[i] = vlPrimitive(VL_TYPE_VOID);
+    for (size_t i = 0; i < paramCount; ++i) args[i] = NULL;
+
+    for (size_t i = 0; i < argCount; ++i) {
+        const VLExpression* param = params[i];
+        if (param->kind == VL_EXPR_BINARY && param->binaryOp.operation == VL_OP_PUT) param = param->binaryOp.first;
+        size_t rank, typeParam = vlTypeParam(generic, param->binaryOp.first, &rank);
+        if (typeParam == SIZE_MAX) continue;
+        if (!vlCheckExpr(c, expr->multiOp.children[i + 1], &args[i])) return false;
+        VLType found = args[i]->type;
+        if (vlIsNull(found)) continue;
+        if (found.rank < rank || (found.base == VL_TYPE_VOID && !found.rank)) {
+            char name[64];
+            const VLExpression* paramName = param->binaryOp.second;
+            return vlFail(c, VL_STATUS_MISMATCH, args[i]->pos, "'%s' does not fit parameter '%.*s'",
+                          vlTypeName(found, name, sizeof(name)), (int) paramName->stringValue.len,
+                          paramName->stringValue.first);
+        }
+        VLType arg = {found.base, (uint8_t) (found.rank - rank)};
+        if (typeArgs[typeParam].base == VL_TYPE_VOID) typeArgs[typeParam] = arg;
+        else if (!vlCommonType(c, typeArgs[typeParam], arg, args[i]->pos, &typeArgs[typeParam])) return false;
+    }
+    for (size_t i = 0; i < generic->paramCount; ++i) {
+        if (typeArgs[i].base != VL_TYPE_VOID) continue;
+        return vlFail(c, VL_STATUS_MISMATCH, expr->pos, "unable to infer '%.*s' for '%.*s'",
+                      (int) generic->params[i]->stringValue.len, generic->params[i]->stringValue.first,
+                      (int) generic->name.len, generic->name.first);
+    }
+
+    size_t index;
+    if (!vlInstantiate(c, generic, typeArgs, expr->pos, &index)) return false;
+    const VLFunction* fn = &c->program->functions[index];
+    const VLType* paramTypes = fn->params;
+    const VLExpression** defaults = fn->defaults;
+    call->type = fn->result;
+    if (!vlCopy(c, expr->multiOp.children[0], vlPrimitive(VL_TYPE_VOID), &call->multiOp.children[0])) return false;
+    call->multiOp.children[0]->stringValue = fn->name;
+    for (size_t i = 0; i < paramCount; ++i) {
+        if (args[i]) {
+            VLType found = args[i]->type;
+            if (!vlAssignable(found, paramTypes[i])) return vlMismatch(c, args[i]->pos, paramTypes[i], found);
+            if (!vlConvertTo(c, paramTypes[i], &args[i])) return false;
+            continue;
+        }
+        const VLExpression* arg = i < argCount ? expr->multiOp.children[i + 1] : defaults[i];
+        if (!arg) {
+            return vlFail(c, VL_STATUS_ARGUMENTS, expr->pos, "%.*s", (int) generic->name.len, generic->name.first);
+        }
+        if (!vlCheckAs(c, arg, paramTypes[i], &args[i])) return false;
+    }
+    *out = call;
+    return true;
+}
+
+
+static bool vlCheckCall(VLChecker* c, const VLExpression* expr, VLExpression** out) {
+    const VLExpression* callee = expr->multiOp.children[0];
+    if (callee->kind == VL_EXPR_MULTI && callee->multiOp.operation == VL_OP_INDEX && callee->multiOp.count == 1) {
+        return vlCheckArrayConstructor(c, expr, out);
+    }
+    if (callee->kind == VL_EXPR_BINARY && callee->binaryOp.operation == VL_OP_MEMBER) {
+        return vlCheckArrayAdd(c, expr, out);
+    }
+    if (callee->kind != VL_EXPR_NAME) return vlFail(c, VL_STATUS_UNSUPPORTED, callee->pos, "calls through expressions");
+
+    const VLFunction* fn = vlFindFunction(c, callee->symbol);
+    VLGeneric* generic = fn ? NULL : vlFindGeneric(c, callee->symbol);
+    if (generic) return vlCheckGenericCall(c, expr, generic, out);
+    if (!fn || (!fn->body && fn->native == VL_NO_NATIVE)) {
+        return vlFail(c, VL_STATUS_UNDEFINED, callee->pos, "%.*s", (int) callee->stringValue.len,
+                      callee->stringValue.first);
+    }
+    size_t argCount = expr->multiOp.count - 1;
+    size_t fixed = fn->paramCount - fn->variadic;
+    if (argCount > fixed && !fn->variadic) {
+        return vlFail(c, VL_STATUS_ARGUMENTS, expr->pos, "%.*s", (int) fn->name.len, fn->name.first);
+    }
+
+    VLExpression* call;
+    if (!vlCopy(c, expr, fn->result, &call) || !vlCopyChildren(c, call, fn->paramCount + 1)) return false;
+    VLExpression** args = call->multiOp.children + 1;
+    call->multiOp.children[0] = expr->multiOp.children[0];
+    for (size_t i = 0; i < fixed; ++i) {
+        const VLExpression* arg = i < argCount ? expr->multiOp.children[i + 1] : fn->defaults[i];
+        if (!arg) return vlFail(c, VL_STATUS_ARGUMENTS, expr->pos, "%.*s", (int) fn->name.len, fn->name.first);
+        if (!vlCheckAs(c, arg, fn->params[i], &args[i])) return false;
+    }
+
+    // Extra arguments to a variadic function are packed into an array, unless one array is spread
+    if (fn->variadic) {
+        VLType packType = fn->params[fixed];
+        size_t rest = argCount > fixed ? argCount - fixed : 0;
+        const VLExpression* first = rest ? expr->multiOp.children[fixed + 1] : NULL;
+        if (rest == 1 && first->kind == VL_EXPR_UNARY && first->unaryOp.operation == VL_OP_EXTEND) {
+            if (!vlCheckAs(c, first->unaryOp.child, packType, &args[fixed])) return false;
+        } else {
+            VLExpression items = {.kind = VL_EXPR_MULTI, .pos = expr->pos};
+            items.multiOp.operation = VL_OP_ARR_INIT;
+            items.multiOp.children = expr->multiOp.children + fixed + 1;
+            items.multiOp.count = rest;
+            if (!vlArrayLiteral(c, &items, packType, &args[fixed])) return false;
+        }
+    }
+    *out = call;
+    return true;
+}
+
+
+static bool vlCheckMulti(VLChecker* c, const VLExpression* expr, VLExpression** out) {
+    VLType type;
+    switch (expr->multiOp.operation) {
+        case VL_OP_CALL:
+            return vlCheckCall(c, expr, out);
+        case VL_OP_INDEX:
+            if (expr->multiOp.count != 2) return vlUnsupported(c, expr);
+            return vlCheckIndex(c, expr, out);
+        case VL_OP_ARR_INIT:
+            return vlLiteralArrayType(c, expr, &type) && vlArrayLiteral(c, expr, type, out);
+        default:
+            return vlUnsupported(c, expr);
+    }
+}
+
+
+static bool vlCheckExpr(VLChecker* c, const VLExpression* expr, VLExpression** out) {
+    if (!vlEnter(c, expr->pos)) return false;
+    bool ok;
+    switch (expr->kind) {
+        case VL_EXPR_NAME:
+            ok = vlCheckName(c, expr, out);
+            break;
+        case VL_EXPR_UNARY:
+            ok = vlCheckUnary(c, expr, out);
+            break;
+        case VL_EXPR_BINARY:
+            ok = vlCheckBinary(c, expr, out);
+            break;
+        case VL_EXPR_TERNARY:
+            ok = expr->ternaryOp.operation == VL_OP_COND ? vlCheckConditional(c, expr, out) : vlUnsupported(c, expr);
+            break;
+        case VL_EXPR_MULTI:
+            ok = vlCheckMulti(c, expr, out);
+            break;
+        default:
+            ok = vlCopy(c, expr, vlLiteralType(expr), out);
+            break;
+    }
+    --c->depth;
+    return ok;
+}
+
+
+// Declares a variable, initialized by put's value when it is the assignment decl appears in. The
+// copy of decl and its name both carry the variable's type.
+static bool vlCheckDeclare(VLChecker* c, const VLExpression* decl, const VLExpression* put, VLExpression** out) {
+    const VLExpression* name = decl->binaryOp.second;
+    VLType type;
+    if (name->kind != VL_EXPR_NAME) return vlFail(c, VL_STATUS_UNSUPPORTED, name->pos, "this declaration");
+    if (!vlResolveType(c, decl->binaryOp.first, &type, NULL)) return false;
+    if (type.base == VL_TYPE_VOID) return vlFail(c, VL_STATUS_MISMATCH, decl->pos, "variables can't be 'void'");
+
+    VLExpression* declaration;
+    if (!vlCopy(c, decl, type, &declaration) || !vlCopy(c, name, type, &declaration->binaryOp.second)) return false;
+    *out = declaration;
+    if (put) {
+        VLExpression* init;
+        if (!vlCopy(c, put, type, &init) || !vlCheckAs(c, put->binaryOp.second, type, &init->binaryOp.second)) {
+            return false;
+        }
+        init->binaryOp.first = declaration;
+        *out = init;
+    }
+    return vlBind(c, name, type);
+}
+
+
+// An expression evaluated for its side effects, which may declare a variable
+static bool vlCheckEffect(VLChecker* c, const VLExpression* expr, VLExpression** out) {
+    if (vlIsDeclaration(expr)) return vlCheckDeclare(c, expr, NULL, out);
+    bool put = expr->kind == VL_EXPR_BINARY && expr->binaryOp.operation == VL_OP_PUT;
+    if (put && vlIsDeclaration(expr->binaryOp.first)) return vlCheckDeclare(c, expr->binaryOp.first, expr, out);
+    return vlCheckExpr(c, expr, out);
+}
+
+
+static bool vlCheckCondition(VLChecker* c, const VLExpression* expr, VLExpression** out) {
+    return vlCheckAs(c, expr, vlPrimitive(VL_TYPE_BOOL), out);
+}
+
+
+static size_t vlOpenScope(VLChecker* c) {
+    ++c->scope;
+    return c->localCount;
+}
+
+
+static void vlCloseScope(VLChecker* c, size_t localCount) {
+    --c->scope;
+    c->localCount = localCount;
+}
+
+
+// A nested statement gets a scope of its own, even when it isn't a block
+static bool vlCheckScoped(VLChecker* c, const VLStatement* stmt, VLStatement** out) {
+    size_t scope = vlOpenScope(c);
+    bool ok = vlCheckStatement(c, stmt, out);
+    vlCloseScope(c, scope);
+    return ok;
+}
+
+
+// Checked in the order the compiler lays loops out: body, step, then condition
+static bool vlCheckLoop(VLChecker* c, const VLStatement* stmt, VLStatement* loop) {
+    ++c->loops;
+    bool ok = vlCheckScoped(c, stmt->loop.body, &loop->loop.body);
+    --c->loops;
+    if (ok && stmt->loop.step) ok = vlCheckEffect(c, stmt->loop.step, &loop->loop.step);
+    if (ok && stmt->loop.condition) ok = vlCheckCondition(c, stmt->loop.condition, &loop->loop.condition);
+    return ok;
+}
+
+
+static bool vlCheckForEach(VLChecker* c, const VLStatement* stmt, VLStatement* loop) {
+    const VLExpression* item = stmt->forEach.item;
+    if (!vlIsDeclaration(item) || item->binaryOp.second->kind != VL_EXPR_NAME) {
+        return vlFail(c, VL_STATUS_UNSUPPORTED, item->pos, "a for-each without a declared item");
+    }
+    size_t scope = vlOpenScope(c);
+    VLExpression** iterable = &loop->forEach.iterable;
+    if (!vlCheckExpr(c, stmt->forEach.iterable, iterable)) return false;
+    if (!vlIndexable(c, stmt->forEach.iterable, (*iterable)->type)) return false;
+    VLType element = {(*iterable)->type.base, (uint8_t) ((*iterable)->type.rank - 1)};
+
+    VLType type;
+    if (!vlResolveType(c, item->binaryOp.first, &type, NULL)) return false;
+    if (!vlAssignable(element, type)) return vlMismatch(c, item->pos, type, element);
+    VLExpression* declaration;
+    if (!vlCopy(c, item, type, &declaration)) return false;
+    if (!vlCopy(c, item->binaryOp.second, type, &declaration->binaryOp.second)) return false;
+    loop->forEach.item = declaration;
+    if (!vlBind(c, item->binaryOp.second, type)) return false;
+
+    ++c->loops;
+    bool ok = vlCheckScoped(c, stmt->forEach.body, &loop->forEach.body);
+    --c->loops;
+    vlCloseScope(c, scope);
+    return ok;
+}
+
+
+static bool vlCheckReturn(VLChecker* c, const VLStatement* stmt, VLStatement* ret) {
+    if (!stmt->expr) {
+        if (c->result.base != VL_TYPE_VOID) return vlMismatch(c, stmt->pos, c->result, vlPrimitive(VL_TYPE_VOID));
+        return true;
+    }
+    if (c->result.base == VL_TYPE_VOID) {
+        return vlFail(c, VL_STATUS_MISMATCH, stmt->pos, "returning a value from 'void'");
+    }
+    return vlCheckAs(c, stmt->expr, c->result, &ret->expr);
+}
+
+
+static bool vlCheckStatementAt(VLChecker* c, const VLStatement* stmt, VLStatement* copy) {
+    switch (stmt->kind) {
+        case VL_STMT_EXPR:
+            return vlCheckEffect(c, stmt->expr, &copy->expr);
+        case VL_STMT_BLOCK:
+            copy->block.items = vlArenaAlloc(&c->program->arena, (stmt->block.count ? stmt->block.count : 1) *
+                                                                     sizeof(VLStatement*));
+            if (!copy->block.items) return vlOutOfMemory(c, stmt->pos);
+            for (size_t i = 0; i < stmt->block.count; ++i) {
+                if (!vlCheckStatement(c, stmt->block.items[i], &copy->block.items[i])) return false;
+            }
+            return true;
+        case VL_STMT_IF:
+            return vlCheckCondition(c, stmt->ifStmt.condition, &copy->ifStmt.condition) &&
+                   vlCheckScoped(c, stmt->ifStmt.then, &copy->ifStmt.then) &&
+                   (!stmt->ifStmt.otherwise || vlCheckScoped(c, stmt->ifStmt.otherwise, &copy->ifStmt.otherwise));
+        case VL_STMT_FOR: {
+            size_t scope = vlOpenScope(c);
+            bool ok = (!stmt->loop.init || vlCheckEffect(c, stmt->loop.init, &copy->loop.init)) &&
+                      vlCheckLoop(c, stmt, copy);
+            vlCloseScope(c, scope);
+            return ok;
+        }
+        case VL_STMT_WHILE:
+        case VL_STMT_DO_WHILE:
+            return vlCheckLoop(c, stmt, copy);
+        case VL_STMT_FOR_EACH:
+            return vlCheckForEach(c, stmt, copy);
+        case VL_STMT_WITH: {
+            size_t scope = vlOpenScope(c);
+            bool ok = vlCheckEffect(c, stmt->with.setup, &copy->with.setup) &&
+                      vlCheckScoped(c, stmt->with.body, &copy->with.body);
+            vlCloseScope(c, scope);
+            return ok;
+        }
+        case VL_STMT_RETURN:
+            return vlCheckReturn(c, stmt, copy);
+        case VL_STMT_BREAK:
+        case VL_STMT_CONTINUE:
+            if (c->loops) return true;
+            return vlFail(c, VL_STATUS_UNEXPECTED, stmt->pos, stmt->kind == VL_STMT_BREAK ? "break" : "continue");
+        case VL_STMT_FUNCTION:
+            // Top-level functions are checked on their own
+            if (c->topLevel && !c->scope) return true;
+            return vlFail(c, VL_STATUS_UNSUPPORTED, stmt->pos, "nested functions");
+        case VL_STMT_CLASS:
+            return vlFail(c, VL_STATUS_UNSUPPORTED, stmt->pos, "classes");
+        case VL_STMT_IMPORT:
+            return vlFail(c, VL_STATUS_UNSUPPORTED, stmt->pos, "imports");
+        default:
+            return vlFail(c, VL_STATUS_UNSUPPORTED, stmt->pos, "'throw'");
+    }
+}
+
+
+static bool vlCheckStatement(VLChecker* c, const VLStatement* stmt, VLStatement** out) {
+    VLStatement* copy = vlArenaAlloc(&c->program->arena, sizeof(VLStatement));
+    if (!copy) return vlOutOfMemory(c, stmt->pos);
+    *copy = *stmt;
+    *out = copy;
+    return vlCheckStatementAt(c, stmt, copy);
+}
+
+
+static bool vlParamDeclaration(VLChecker* c, const VLExpression* param, const VLExpression** name,
+                               const VLExpression** init, VLType* type, bool* variadic) {
+    *init = NULL;
+    if (param->kind == VL_EXPR_BINARY && param->binaryOp.operation == VL_OP_PUT) {
+        *init = param->binaryOp.second;
+        param = param->binaryOp.first;
+    }
+    if (!vlIsDeclaration(param) || param->binaryOp.second->kind != VL_EXPR_NAME) {
+        return vlFail(c, VL_STATUS_UNSUPPORTED, param->pos, "this parameter");
+    }
+    *name = param->binaryOp.second;
+    return vlResolveType(c, param->binaryOp.first, type, variadic);
+}
+
+
+static bool vlSignatureText(VLChecker* c, const VLFunction* fn, char* buffer, size_t size) {
+    char name[64];
+    int used = snprintf(buffer, size, "%s(", vlTypeName(fn->result, name, sizeof(name)));
+    for (size_t i = 0; i < fn->paramCount && used > 0 && (size_t) used < size; ++i) {
+        used += snprintf(buffer + used, size - (size_t) used, "%s%s", i ? "," : "",
+                         vlTypeName(fn->params[i], name, sizeof(name)));
+    }
+    if (used <= 0 || (size_t) used + 2 > size) return vlFail(c, VL_STATUS_LIMIT, fn->pos, "parameters");
+    strcpy(buffer + used, ")");
+    return true;
+}
+
+
+static bool vlDeclareFunction(VLChecker* c, const VLStatement* stmt) {
+    const VLExpression* signature = stmt->function.signature;
+    if (!vlIsDeclaration(signature) || signature->binaryOp.second->kind != VL_EXPR_MULTI ||
+        signature->binaryOp.second->multiOp.children[0]->kind != VL_EXPR_NAME) {
+        return vlFail(c, VL_STATUS_UNSUPPORTED, stmt->pos, "this kind of function");
+    }
+    const VLExpression* call = signature->binaryOp.second;
+    const VLExpression* name = call->multiOp.children[0];
+    size_t paramCount = call->multiOp.count - 1;
+    VLFunction fn = {.name = name->stringValue, .symbol = name->symbol, .signature = signature,
+                     .body = stmt->function.body, .native = VL_NO_NATIVE, .pos = stmt->pos, .paramCount = paramCount};
+    if (!vlResolveType(c, signature->binaryOp.first, &fn.result, NULL)) return false;
+
+    fn.params = malloc((paramCount ? paramCount : 1) * sizeof(VLType));
+    fn.defaults = malloc((paramCount ? paramCount : 1) * sizeof(VLExpression*));
+    if (!fn.params || !fn.defaults) {
+        free(fn.params);
+        free(fn.defaults);
+        return vlOutOfMemory(c, stmt->pos);
+    }
+    bool ok = true;
+    for (size_t i = 0; ok && i < paramCount; ++i) {
+        const VLExpression* paramName;
+        bool variadic;
+        const VLExpression* param = call->multiOp.children[i + 1];
+        ok = vlParamDeclaration(c, param, &paramName, &fn.defaults[i], &fn.params[i], &variadic);
+        if (ok && variadic && i + 1 < paramCount) {
+            ok = vlFail(c, VL_STATUS_UNSUPPORTED, paramName->pos, "a variadic parameter before the last");
+        }
+        fn.variadic = variadic;
+    }
+
+    char text[256], other[256];
+    if (ok && vlFindGeneric(c, fn.symbol)) {
+        ok = vlFail(c, VL_STATUS_REDEFINED, stmt->pos, "%.*s", (int) fn.name.len, fn.name.first);
+    }
+    VLFunction* existing = ok ? vlFindFunction(c, fn.symbol) : NULL;
+    if (ok && existing) {
+        // A prototype and a definition of the same function merge into one
+        ok = vlSignatureText(c, existing, other, sizeof(other)) && vlSignatureText(c, &fn, text, sizeof(text));
+        if (ok && (strcmp(text, other) || (existing->body && fn.body))) {
+            ok = vlFail(c, VL_STATUS_REDEFINED, stmt->pos, "%.*s", (int) fn.name.len, fn.name.first);
+        }
+        if (ok && fn.body) {
+            existing->body = fn.body;
+            existing->signature = fn.signature;
+            existing->native = VL_NO_NATIVE;
+            memcpy(existing->defaults, fn.defaults, paramCount * sizeof(VLExpression*));
+        }
+    } else if (ok) {
+        if (!fn.body) {
+            fn.native = vlFindNative(fn.name);
+            ok = vlSignatureText(c, &fn, text, sizeof(text));
+            if (ok && fn.native != VL_NO_NATIVE && strcmp(text, vlNatives[fn.native].signature)) {
+                ok = vlFail(c, VL_STATUS_MISMATCH, stmt->pos, "'%.*s' is built in as '%s'", (int) fn.name.len,
+                            fn.name.first, vlNatives[fn.native].signature);
+            }
+        }
+        VLProgram* program = c->program;
+        if (ok && !vlGrow((void**) &program->functions, &program->functionCapacity, program->functionCount,
+                          sizeof(VLFunction))) {
+            ok = vlOutOfMemory(c, stmt->pos);
+        }
+        if (ok) {
+            program->functions[program->functionCount++] = fn;
+            return true;
+        }
+    }
+    free(fn.params);
+    free(fn.defaults);
+    return ok;
+}
+
+
+// Generic functions are only checked as their instances, once what their type parameters stand for
+// is known
+static bool vlDeclareGeneric(VLChecker* c, const VLStatement* stmt) {
+    const VLExpression* signature = stmt->function.signature;
+    if (!vlIsDeclaration(signature) || signature->binaryOp.second->kind != VL_EXPR_MULTI ||
+        signature->binaryOp.second->multiOp.children[0]->kind != VL_EXPR_NAME) {
+        return vlFail(c, VL_STATUS_UNSUPPORTED, stmt->pos, "this kind of function");
+    }
+    const VLExpression* call = signature->binaryOp.second;
+    const VLExpression* name = call->multiOp.children[0];
+    if (vlFindFunction(c, name->symbol) || vlFindGeneric(c, name->symbol)) {
+        return vlFail(c, VL_STATUS_REDEFINED, stmt->pos, "%.*s", (int) name->stringValue.len, name->stringValue.first);
+    }
+
+    const VLExpression* list = stmt->function.params;
+    VLGeneric generic = {.stmt = stmt, .symbol = name->symbol, .name = name->stringValue,
+                         .paramCount = list->multiOp.count};
+    generic.params = vlArenaAlloc(&c->program->arena, generic.paramCount * sizeof(VLExpression*));
+    if (!generic.params) return vlOutOfMemory(c, stmt->pos);
+    for (size_t i = 0; i < generic.paramCount; ++i) {
+        const VLExpression* param = list->multiOp.children[i];
+        if (param->kind == VL_EXPR_BINARY && param->binaryOp.operation == VL_OP_DECLARE &&
+            vlIsName(param->binaryOp.first, "type")) {
+            param = param->binaryOp.second;
+        }
+        if (param->kind != VL_EXPR_NAME) return vlFail(c, VL_STATUS_UNSUPPORTED, param->pos, "this type parameter");
+        for (size_t j = 0; j < i; ++j) {
+            if (generic.params[j]->symbol == param->symbol) {
+                return vlFail(c, VL_STATUS_REDEFINED, param->pos, "%.*s", (int) param->stringValue.len,
+                              param->stringValue.first);
+            }
+        }
+        generic.params[i] = param;
+    }
+    for (size_t i = 1; i < call->multiOp.count; ++i) {
+        const VLExpression* param = call->multiOp.children[i];
+        if (param->kind == VL_EXPR_BINARY && param->binaryOp.operation == VL_OP_PUT) param = param->binaryOp.first;
+        if (!vlIsDeclaration(param)) return vlFail(c, VL_STATUS_UNSUPPORTED, param->pos, "this parameter");
+        const VLExpression* type = param->binaryOp.first;
+        if (type->kind == VL_EXPR_UNARY && type->unaryOp.operation == VL_OP_EXTEND) {
+            return vlFail(c, VL_STATUS_UNSUPPORTED, param->pos, "variadic generic functions");
+        }
+    }
+
+    if (!vlGrow((void**) &c->generics, &c->genericCapacity, c->genericCount, sizeof(VLGeneric))) {
+        return vlOutOfMemory(c, stmt->pos);
+    }
+    c->generics[c->genericCount++] = generic;
+    return true;
+}
+
+
+// The instance of generic for typeArgs, made the first time they're asked for. Its signature is
+// resolved with the type parameters standing for typeArgs, and its body is checked the same way
+// along with the other functions.
+static bool vlInstantiate(VLChecker* c, VLGeneric* generic, const VLType* typeArgs, size_t pos, size_t* index) {
+    VLProgram* program = c->program;
+    for (size_t i = 0; i < c->instanceCount; ++i) {
+        const VLInstance* instance = &c->instances[i];
+        bool same = instance->generic == generic;
+        for (size_t k = 0; same && k < generic->paramCount; ++k) same = vlSameType(instance->args[k], typeArgs[k]);
+        if (same) {
+            ++program->reusedInstances;
+            *index = instance->function;
+            return true;
+        }
+    }
+    if (c->instanceCount == VL_MAX_INSTANCES) return vlFail(c, VL_STATUS_LIMIT, pos, "generic instances");
+
+    // Named for the type arguments, as in pair<int,str[]>
+    char name[256], type[64];
+    int used = snprintf(name, sizeof(name), "%.*s<", (int) generic->name.len, generic->name.first);
+    for (size_t k = 0; k < generic->paramCount && used > 0 && (size_t) used < sizeof(name); ++k) {
+        used += snprintf(name + used, sizeof(name) - (size_t) used, "%s%s", k ? "," : "",
+                         vlTypeName(typeArgs[k], type, sizeof(type)));
+    }
+    if (used <= 0 || (size_t) used + 2 > sizeof(name)) return vlFail(c, VL_STATUS_LIMIT, pos, "type arguments");
+    strcpy(name + used, ">");
+    size_t length = (size_t) used + 1;
+    char* text = vlArenaAlloc(&program->arena, length);
+    VLType* args = vlArenaAlloc(&program->arena, generic->paramCount * sizeof(VLType));
+    if (!text || !args) return vlOutOfMemory(c, pos);
+    memcpy(text, name, length);
+    memcpy(args, typeArgs, generic->paramCount * sizeof(VLType));
+
+    const VLStatement* stmt = generic->stmt;
+    const VLExpression* signature = stmt->function.signature;
+    const VLExpression* call = signature->binaryOp.second;
+    size_t paramCount = call->multiOp.count - 1;
+    VLFunction fn = {.name = {text, length}, .symbol = generic->symbol, .instance = true, .signature = signature,
+                     .body = stmt->function.body, .native = VL_NO_NATIVE, .pos = stmt->pos, .paramCount = paramCount};
+    fn.params = malloc((paramCount ? paramCount : 1) * sizeof(VLType));
+    fn.defaults = malloc((paramCount ? paramCount : 1) * sizeof(VLExpression*));
+    bool ok = fn.params && fn.defaults;
+    if (!ok) vlOutOfMemory(c, pos);
+
+    const VLGeneric* outer = c->generic;
+    const VLType* outerArgs = c->typeArgs;
+    c->generic = generic;
+    c->typeArgs = args;
+    ok = ok && vlResolveType(c, signature->binaryOp.first, &fn.result, NULL);
+    for (size_t i = 0; ok && i < paramCount; ++i) {
+        const VLExpression* paramName;
+        bool variadic;
+        ok = vlParamDeclaration(c, call->multiOp.children[i + 1], &paramName, &fn.defaults[i], &fn.params[i],
+                                &variadic);
+    }
+    c->generic = outer;
+    c->typeArgs = outerArgs;
+
+    if (ok && (!vlGrow((void**) &program->functions, &program->functionCapacity, program->functionCount,
+                       sizeof(VLFunction)) ||
+               !vlGrow((void**) &c->instances, &c->instanceCapacity, c->instanceCount, sizeof(VLInstance)))) {
+        ok = vlOutOfMemory(c, pos);
+    }
+    if (!ok) {
+        free(fn.params);
+        free(fn.defaults);
+        return false;
+    }
+    if (!generic->called) {
+        generic->called = true;
+        ++program->genericCount;
+    }
+    *index = program->functionCount;
+    program->functions[program->functionCount++] = fn;
+    c->instances[c->instanceCount++] = (VLInstance) {generic, *index, args};
+    return true;
+}
+
+
+static void vlResetChecker(VLChecker* c, VLType result, bool topLevel) {
+    c->generic = NULL;
+    c->typeArgs = NULL;
+    c->result = result;
+    c->topLevel = topLevel;
+    c->localCount = 0;
+    c->scope = 0;
+    c->loops = 0;
+    c->depth = 0;
+}
+
+
+// Checks the function at index, which might be an instance. Checking can make more instances, so
+// the function is found afresh to store its checked body.
+static bool vlCheckFunction(VLChecker* c, size_t index) {
+    const VLFunction* fn = &c->program->functions[index];
+    vlResetChecker(c, fn->result, false);
+    for (size_t i = 0; i < c->instanceCount; ++i) {
+        if (c->instances[i].function != index) continue;
+        c->generic = c->instances[i].generic;
+        c->typeArgs = c->instances[i].args;
+    }
+    const VLExpression* call = fn->signature->binaryOp.second;
+    for (size_t i = 0; i < fn->paramCount; ++i) {
+        const VLExpression* name;
+        const VLExpression* init;
+        bool variadic;
+        VLType type;
+        if (!vlParamDeclaration(c, call->multiOp.children[i + 1], &name, &init, &type, &variadic)) return false;
+        if (!vlBind(c, name, fn->params[i])) return false;
+    }
+    VLStatement* body;
+    if (!vlCheckStatement(c, fn->body, &body)) return false;
+    c->program->functions[index].body = body;
+    return true;
+}
+
+
+// Checks the functions from *next on, including any instances made along the way
+static bool vlCheckFunctions(VLChecker* c, size_t* next) {
+    for (; *next < c->program->functionCount; ++*next) {
+        if (c->program->functions[*next].body && !vlCheckFunction(c, *next)) return false;
+    }
+    return true;
+}
+
+
+// Functions see the variables declared directly at the top level, wherever they are declared
+static bool vlDeclareGlobals(VLChecker* c, const VLStatement* const* items, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        const VLExpression* expr = items[i]->kind == VL_STMT_EXPR ? items[i]->expr : NULL;
+        if (expr && expr->kind == VL_EXPR_BINARY && expr->binaryOp.operation == VL_OP_PUT) expr = expr->binaryOp.first;
+        if (!expr || !vlIsDeclaration(expr) || expr->binaryOp.second->kind != VL_EXPR_NAME) continue;
+
+        VLBinding global = {.symbol = expr->binaryOp.second->symbol};
+        bool known = false;
+        for (size_t j = 0; j < c->globalCount && !known; ++j) known = c->globals[j].symbol == global.symbol;
+        if (known) continue;
+        if (!vlResolveType(c, expr->binaryOp.first, &global.type, NULL)) return false;
+        if (!vlGrow((void**) &c->globals, &c->globalCapacity, c->globalCount, sizeof(VLBinding))) {
+            return vlOutOfMemory(c, expr->pos);
+        }
+        c->globals[c->globalCount++] = global;
+    }
+    return true;
+}
+
+
+static bool vlCheckUnit(VLChecker* c, const VLStatement* tree, VLStatement** checked) {
+    bool block = tree->kind == VL_STMT_BLOCK;
+    const VLStatement* const* items = block ? (const VLStatement* const*) tree->block.items : &tree;
+    size_t count = block ? tree->block.count : 1;
+
+    for (size_t i = 0; i < count; ++i) {
+        if (items[i]->kind != VL_STMT_FUNCTION) continue;
+        if (!(items[i]->function.params ? vlDeclareGeneric(c, items[i]) : vlDeclareFunction(c, items[i]))) return false;
+    }
+    if (!vlDeclareGlobals(c, items, count)) return false;
+
+    // The top-level code can call for instances nothing else did, which are checked after it
+    size_t next = 0;
+    if (!vlCheckFunctions(c, &next)) return false;
+    vlResetChecker(c, vlPrimitive(VL_TYPE_VOID), true);
+    return vlCheckStatement(c, tree, checked) && vlCheckFunctions(c, &next);
+}
+
+
+// ---- FUNCTIONS ---- //
+
+bool vlCheckProgram(VLProgram* program, const VLStatement* tree, VLStatement** checked) {
+    VLChecker checker = {.program = program};
+    bool ok = vlCheckUnit(&checker, tree, checked) && program->status == VL_STATUS_OK;
+    if (!ok && program->status == VL_STATUS_OK) program->status = VL_STATUS_OUT_OF_MEM;
+    free(checker.locals);
+    free(checker.globals);
+    free(checker.generics);
+    free(checker.instances);
+    return ok;
+}
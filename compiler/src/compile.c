@@ -0,0 +1,1491 @@
+/* ================
+ * src/compile.c
+ * VALLEY LANGUAGE COMPILER
+ * Compiler from checked statement trees to register bytecode
+ * ================
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include "../include/bytecode.h"
+
+#define VL_NO_REGISTER UINT32_MAX
+
+typedef struct VLLocal {
+    VLSymbol symbol;
+    VLType type;
+    uint32_t slot;
+    size_t scope;
+    bool global;
+} VLLocal;
+
+typedef struct VLScope {
+    size_t localCount;
+    uint32_t localTop;
+} VLScope;
+
+typedef struct VLJump {
+    size_t at;
+    size_t loop;
+    bool isBreak;
+} VLJump;
+
+// Registers are handed out like a stack. Locals sit below localTop for as long as they are in
+// scope and temporaries above it, so a statement gives back all of its temporaries by resetting
+// top to localTop.
+typedef struct VLCompiler {
+    VLProgram* program;
+    VLFunction* function;
+    VLLocal* locals;
+    size_t localCount;
+    size_t localCapacity;
+    VLLocal* globals;
+    size_t globalCount;
+    size_t globalCapacity;
+    VLSymbol* captured;
+    size_t capturedCount;
+    size_t capturedCapacity;
+    VLJump* jumps;
+    size_t jumpCount;
+    size_t jumpCapacity;
+    uint32_t top;
+    uint32_t localTop;
+    size_t loop;
+    size_t loopCount;
+    size_t scope;
+    bool topLevel;
+} VLCompiler;
+
+static bool vlExpr(VLCompiler* c, const VLExpression* expr, uint32_t dest);
+static bool vlStatement(VLCompiler* c, const VLStatement* stmt);
+
+
+// ---- HELPERS ---- //
+
+static bool vlGrow(void** items, size_t* capacity, size_t count, size_t size) {
+    if (count < *capacity) return true;
+    size_t grown = *capacity ? *capacity * 2 : 16;
+    void* resized = realloc(*items, grown * size);
+    if (!resized) return false;
+    *items = resized;
+    *capacity = grown;
+    return true;
+}
+
+
+static bool vlFail(VLCompiler* c, VLStatus status, size_t pos, const char* format, ...) {
+    VLProgram* program = c->program;
+    if (program->status != VL_STATUS_OK) return false;
+    program->status = status;
+    program->pos = pos;
+    program->what = program->detail;
+    va_list args;
+    va_start(args, format);
+    vsnprintf(program->detail, sizeof(program->detail), format, args);
+    va_end(args);
+    return false;
+}
+
+
+static bool vlOutOfMemory(VLCompiler* c, size_t pos) {
+    return vlFail(c, VL_STATUS_OUT_OF_MEM, pos, "");
+}
+
+
+static bool vlSameType(VLType first, VLType second) {
+    return first.base == second.base && first.rank == second.rank;
+}
+
+
+static bool vlIsNumeric(VLType type) {
+    return !type.rank && type.base >= VL_TYPE_BYTE && type.base <= VL_TYPE_DOUBLE;
+}
+
+
+static bool vlEmit(VLCompiler* c, uint32_t ins, size_t pos) {
+    VLFunction* fn = c->function;
+    if (fn->codeCount == fn->codeCapacity) {
+        size_t capacity = fn->codeCapacity ? fn->codeCapacity * 2 : 64;
+        uint32_t* code = realloc(fn->code, capacity * sizeof(uint32_t));
+        if (code) fn->code = code;
+        size_t* positions = realloc(fn->positions, capacity * sizeof(size_t));
+        if (positions) fn->positions = positions;
+        if (!code || !positions) return vlOutOfMemory(c, pos);
+        fn->codeCapacity = capacity;
+    }
+    fn->positions[fn->codeCount] = pos;
+    fn->code[fn->codeCount++] = ins;
+    return true;
+}
+
+
+static bool vlEmitABC(VLCompiler* c, VLOpcode op, uint32_t a, uint32_t b, uint32_t cc, size_t pos) {
+    return vlEmit(c, VL_ENCODE_ABC(op, a, b, cc), pos);
+}
+
+
+static bool vlEmitMove(VLCompiler* c, uint32_t dest, uint32_t src, VLRep rep, size_t pos) {
+    return dest == src || vlEmitABC(c, VL_BC_MOVE, dest, src, rep, pos);
+}
+
+
+// Emits a jump to be pointed somewhere with vlPatchJump once the target is known
+static bool vlEmitJump(VLCompiler* c, VLOpcode op, uint32_t reg, size_t pos, size_t* at) {
+    *at = c->function->codeCount;
+    return vlEmit(c, op == VL_BC_JMP ? VL_ENCODE_SAX(op, 0) : VL_ENCODE_ABX(op, reg, VL_SBX_BIAS), pos);
+}
+
+
+static bool vlPatchJump(VLCompiler* c, size_t at, size_t target) {
+    VLFunction* fn = c->function;
+    uint32_t ins = fn->code[at];
+    int64_t offset = (int64_t) target - (int64_t) at - 1;
+    if (VL_INS_OP(ins) == VL_BC_JMP) {
+        if (offset < -VL_SAX_BIAS || offset > VL_SAX_BIAS) {
+            return vlFail(c, VL_STATUS_LIMIT, fn->positions[at], "instructions");
+        }
+        fn->code[at] = VL_ENCODE_SAX(VL_BC_JMP, offset);
+    } else {
+        if (offset < -VL_SBX_BIAS || offset > VL_SBX_BIAS) {
+            return vlFail(c, VL_STATUS_LIMIT, fn->positions[at], "instructions");
+        }
+        fn->code[at] = VL_ENCODE_ABX(VL_INS_OP(ins), VL_INS_A(ins), offset + VL_SBX_BIAS);
+    }
+    return true;
+}
+
+
+static bool vlEmitJumpTo(VLCompiler* c, VLOpcode op, uint32_t reg, size_t target, size_t pos) {
+    size_t at;
+    return vlEmitJump(c, op, reg, pos, &at) && vlPatchJump(c, at, target);
+}
+
+
+static bool vlReserve(VLCompiler* c, uint32_t count, size_t pos, uint32_t* first) {
+    if (c->top + count > VL_MAX_REGISTERS) return vlFail(c, VL_STATUS_LIMIT, pos, "registers");
+    *first = c->top;
+    c->top += count;
+    if (c->top > c->function->registerCount) c->function->registerCount = c->top;
+    return true;
+}
+
+
+// Somewhere to build a value that takes several instructions. Writing straight into a local
+// would clobber it while the rest of the expression may still read it.
+static bool vlScratch(VLCompiler* c, uint32_t dest, size_t pos, uint32_t* reg) {
+    if (dest >= c->localTop && dest != VL_NO_REGISTER) {
+        *reg = dest;
+        return true;
+    }
+    return vlReserve(c, 1, pos, reg);
+}
+
+
+// Strings are compared by their contents, so each distinct literal is only stored once
+static bool vlSameConstant(VLValue first, VLValue second, VLRep rep) {
+    if (rep != VL_REP_P) return !memcmp(&first, &second, sizeof(VLValue));
+    const VLStringObject* a = first.p;
+    const VLStringObject* b = second.p;
+    return a->length == b->length && !memcmp(a->data, b->data, a->length);
+}
+
+
+static bool vlConstant(VLCompiler* c, VLValue value, VLRep rep, size_t pos, uint32_t* index) {
+    VLFunction* fn = c->function;
+    for (size_t i = 0; i < fn->constantCount; ++i) {
+        if (fn->constantReps[i] == rep && vlSameConstant(fn->constants[i], value, rep)) {
+            *index = (uint32_t) i;
+            return true;
+        }
+    }
+    if (fn->constantCount == VL_MAX_CONSTANTS) return vlFail(c, VL_STATUS_LIMIT, pos, "constants");
+    size_t capacity = fn->constantCapacity;
+    if (!vlGrow((void**) &fn->constants, &fn->constantCapacity, fn->constantCount, sizeof(VLValue))) {
+        return vlOutOfMemory(c, pos);
+    }
+    if (fn->constantCapacity != capacity) {
+        VLRep* reps = realloc(fn->constantReps, fn->constantCapacity * sizeof(VLRep));
+        if (!reps) return vlOutOfMemory(c, pos);
+        fn->constantReps = reps;
+    }
+    *index = (uint32_t) fn->constantCount;
+    fn->constantReps[fn->constantCount] = rep;
+    fn->constants[fn->constantCount++] = value;
+    return true;
+}
+
+
+static bool vlLoadValue(VLCompiler* c, uint32_t dest, VLValue value, VLRep rep, size_t pos) {
+    if ((rep == VL_REP_I || rep == VL_REP_L) && value.i >= -VL_SBX_BIAS && value.i <= VL_SBX_BIAS) {
+        return vlEmit(c, VL_ENCODE_ABX(VL_BC_LOADI, dest, value.i + VL_SBX_BIAS), pos);
+    }
+    if (rep == VL_REP_P && !value.p) return vlEmitABC(c, VL_BC_LOADNULL, dest, 0, 0, pos);
+    uint32_t index;
+    return vlConstant(c, value, rep, pos, &index) && vlEmit(c, VL_ENCODE_ABX(VL_BC_LOADK, dest, index), pos);
+}
+
+
+// The checker leaves every primitive literal of the kind matching its type
+static VLValue vlLiteralValue(const VLExpression* expr) {
+    VLValue value = {0};
+    switch (expr->kind) {
+        case VL_EXPR_CHAR: value.i = expr->charValue; break;
+        case VL_EXPR_BYTE: value.i = expr->byteValue; break;
+        case VL_EXPR_SHORT: value.i = expr->shortValue; break;
+        case VL_EXPR_INT: value.i = expr->intValue; break;
+        case VL_EXPR_LONG: value.i = expr->longValue; break;
+        case VL_EXPR_FLOAT: value.f = expr->floatValue; break;
+        case VL_EXPR_DOUBLE: value.d = expr->doubleValue; break;
+        default: value.i = expr->boolValue; break;
+    }
+    return value;
+}
+
+
+static bool vlStringConstant(VLCompiler* c, const VLExpression* expr, uint32_t dest) {
+    VLArena* arena = &c->program->arena;
+    VLString text = expr->hasEscapes ? vlDecodeString(arena, expr->stringValue) : expr->stringValue;
+    VLStringObject* string = text.first ? vlArenaAlloc(arena, sizeof(VLStringObject) + text.len + 1) : NULL;
+    if (!string) return vlOutOfMemory(c, expr->pos);
+    string->header = (VLObject) {0};
+    string->length = text.len;
+    memcpy(string->data, text.first, text.len);
+    string->data[text.len] = '\0';
+    return vlLoadValue(c, dest, (VLValue) {.p = string}, VL_REP_P, expr->pos);
+}
+
+
+static const VLLocal* vlResolve(const VLCompiler* c, VLSymbol symbol) {
+    for (size_t i = c->localCount; i-- > 0;) {
+        if (c->locals[i].symbol == symbol) return &c->locals[i];
+    }
+    if (!c->topLevel) {
+        for (size_t i = 0; i < c->globalCount; ++i) {
+            if (c->globals[i].symbol == symbol) return &c->globals[i];
+        }
+    }
+    return NULL;
+}
+
+
+static bool vlIsCaptured(const VLCompiler* c, VLSymbol symbol) {
+    for (size_t i = 0; i < c->capturedCount; ++i) {
+        if (c->captured[i] == symbol) return true;
+    }
+    return false;
+}
+
+
+static bool vlAddLocal(VLCompiler* c, VLLocal local, const VLExpression* name) {
+    if (!vlGrow((void**) &c->locals, &c->localCapacity, c->localCount, sizeof(VLLocal))) {
+        return vlOutOfMemory(c, name->pos);
+    }
+    local.scope = c->scope;
+    c->locals[c->localCount++] = local;
+
+    VLFunction* fn = c->function;
+    if (local.global) return true;
+    if (!fn->registerNames && !(fn->registerNames = calloc(VL_MAX_REGISTERS, sizeof(VLString)))) {
+        return vlOutOfMemory(c, name->pos);
+    }
+    if (!fn->registerNames[local.slot].len) fn->registerNames[local.slot] = name->stringValue;
+    return true;
+}
+
+
+// The function a checked callee names. Instances of a generic function share its symbol, so the
+// checker renamed calls to them after the instance.
+static size_t vlFindFunction(const VLCompiler* c, const VLExpression* callee) {
+    VLProgram* program = c->program;
+    for (size_t i = 0; i < program->functionCount; ++i) {
+        const VLFunction* fn = &program->functions[i];
+        if (fn->symbol == callee->symbol && fn->name.len == callee->stringValue.len &&
+            !memcmp(fn->name.first, callee->stringValue.first, fn->name.len)) {
+            return i;
+        }
+    }
+    return SIZE_MAX;
+}
+
+
+// Whether a conversion takes no instruction, as widening within a representation doesn't
+static bool vlFreeConversion(VLType from, VLType to) {
+    if (vlSameType(from, to) || vlRep(to) == VL_REP_P) return true;
+    if (vlRep(from) != vlRep(to)) return false;
+    switch (to.base) {
+        case VL_TYPE_BYTE:
+        case VL_TYPE_CHAR: return false;
+        case VL_TYPE_SHORT: return from.base == VL_TYPE_BYTE;
+        default: return true;
+    }
+}
+
+
+// Converts the value in src from one type to the other, which must be castable, leaving it in dest
+static bool vlConvert(VLCompiler* c, uint32_t dest, uint32_t src, VLType from, VLType to, size_t pos) {
+    static const int conversions[4][4] = {
+        {-1, VL_BC_MOVE, VL_BC_I2F, VL_BC_I2D},
+        {VL_BC_L2I, -1, VL_BC_L2F, VL_BC_L2D},
+        {VL_BC_F2I, VL_BC_F2L, -1, VL_BC_F2D},
+        {VL_BC_D2I, VL_BC_D2L, VL_BC_D2F, -1},
+    };
+    if (vlFreeConversion(from, to)) return vlEmitMove(c, dest, src, vlRep(to), pos);
+
+    VLRep fromRep = vlRep(from), toRep = vlRep(to);
+    if (fromRep != toRep) {
+        VLOpcode op = (VLOpcode) conversions[fromRep][toRep];
+        if (op == VL_BC_MOVE ? !vlEmitMove(c, dest, src, toRep, pos) : !vlEmitABC(c, op, dest, src, 0, pos)) {
+            return false;
+        }
+        src = dest;
+    }
+    VLOpcode narrow;
+    switch (to.base) {
+        case VL_TYPE_BYTE: narrow = VL_BC_NARROWB; break;
+        case VL_TYPE_SHORT: narrow = VL_BC_NARROWS; break;
+        case VL_TYPE_CHAR: narrow = VL_BC_NARROWC; break;
+        default: return vlEmitMove(c, dest, src, toRep, pos);
+    }
+    if (from.base == VL_TYPE_BYTE && to.base == VL_TYPE_SHORT) return vlEmitMove(c, dest, src, toRep, pos);
+    return vlEmitABC(c, narrow, dest, src, 0, pos);
+}
+
+
+// Brings the value in *reg to another type, converting into a fresh temporary when it differs
+static bool vlPromote(VLCompiler* c, uint32_t* reg, VLType from, VLType to, size_t pos) {
+    if (vlSameType(from, to)) return true;
+    uint32_t converted;
+    if (!vlReserve(c, 1, pos, &converted) || !vlConvert(c, converted, *reg, from, to, pos)) return false;
+    *reg = converted;
+    return true;
+}
+
+
+static VLOpcode vlLoadOpcode(VLElementKind kind) {
+    return (VLOpcode) (VL_BC_AGET_I8 + kind);
+}
+
+
+// Bytes are stored the same way whether they are signed or not
+static VLOpcode vlStoreOpcode(VLElementKind kind) {
+    return (VLOpcode) (VL_BC_ASET_I8 + (kind == VL_ELEM_I8 ? 0 : kind - 1));
+}
+
+
+// Keeps byte and short arithmetic, done on ints, inside the range of its type
+static bool vlNarrowResult(VLCompiler* c, uint32_t dest, VLType type, size_t pos) {
+    if (type.rank) return true;
+    switch (type.base) {
+        case VL_TYPE_BYTE: return vlEmitABC(c, VL_BC_NARROWB, dest, dest, 0, pos);
+        case VL_TYPE_SHORT: return vlEmitABC(c, VL_BC_NARROWS, dest, dest, 0, pos);
+        default: return true;
+    }
+}
+
+
+static bool vlIsCast(const VLExpression* expr) {
+    return expr->kind == VL_EXPR_BINARY && expr->binaryOp.operation == VL_OP_CAST;
+}
+
+
+static bool vlIsName(const VLExpression* expr, const char* name) {
+    size_t len = strlen(name);
+    return expr->kind == VL_EXPR_NAME && expr->stringValue.len == len && !memcmp(expr->stringValue.first, name, len);
+}
+
+
+// The register of the local expr names, if it names one
+static bool vlLocalRegister(const VLCompiler* c, const VLExpression* expr, uint32_t* reg) {
+    if (expr->kind != VL_EXPR_NAME) return false;
+    const VLLocal* local = vlResolve(c, expr->symbol);
+    if (!local || local->global) return false;
+    *reg = local->slot;
+    return true;
+}
+
+
+// A register holding expr's value: a local's own register when expr names one, or is one
+// converted for free, else a temporary
+static bool vlExprAny(VLCompiler* c, const VLExpression* expr, uint32_t* reg) {
+    while (vlIsCast(expr) && vlFreeConversion(expr->binaryOp.first->type, expr->type)) expr = expr->binaryOp.first;
+    if (vlLocalRegister(c, expr, reg)) return true;
+    return vlReserve(c, 1, expr->pos, reg) && vlExpr(c, expr, *reg);
+}
+
+
+// An array of the items listed, or with pack set a variadic pack of them, which has to be dropped
+// once the call it's for returns
+static bool vlArrayLiteral(VLCompiler* c, const VLExpression* expr, uint32_t dest, bool pack) {
+    size_t count = expr->multiOp.count;
+    VLType element = {expr->type.base, (uint8_t) (expr->type.rank - 1)};
+    VLElementKind kind = vlElementKind(element);
+    uint32_t array, index, length;
+    uint32_t saved = c->top;
+    if (!vlScratch(c, dest, expr->pos, &array) || !vlReserve(c, 2, expr->pos, &index)) return false;
+    length = index + 1;
+
+    VLValue size = {.i = (VLLong) count};
+    if (!vlLoadValue(c, length, size, VL_REP_I, expr->pos)) return false;
+    if (!vlEmitABC(c, pack ? VL_BC_NEWPACK : VL_BC_NEWARR, array, length, kind, expr->pos)) return false;
+    for (size_t i = 0; i < count; ++i) {
+        const VLExpression* item = expr->multiOp.children[i];
+        uint32_t value;
+        VLValue at = {.i = (VLLong) i};
+        if (!vlLoadValue(c, index, at, VL_REP_I, item->pos) || !vlExprAny(c, item, &value)) return false;
+        if (!vlEmitABC(c, vlStoreOpcode(kind), array, index, value, item->pos)) return false;
+        c->top = length + 1;
+    }
+    bool ok = vlEmitMove(c, dest, array, VL_REP_P, expr->pos);
+    c->top = saved;
+    return ok;
+}
+
+
+// Names the checker resolved to nothing can only be null
+static bool vlLoadName(VLCompiler* c, const VLExpression* expr, uint32_t dest) {
+    const VLLocal* local = vlResolve(c, expr->symbol);
+    if (!local) return vlEmitABC(c, VL_BC_LOADNULL, dest, 0, 0, expr->pos);
+    if (local->global) return vlEmit(c, VL_ENCODE_ABX(VL_BC_GETG, dest, local->slot), expr->pos);
+    return vlEmitMove(c, dest, local->slot, vlRep(local->type), expr->pos);
+}
+
+
+// Emits left op right into dest, both of type, but for a shift whose count may be any integer
+static bool vlArithmetic(VLCompiler* c, VLOperation op, VLType type, uint32_t left, uint32_t right, uint32_t dest,
+                         size_t pos) {
+    VLOpcode base;
+    switch (op) {
+        case VL_OP_ADD: base = VL_BC_ADD_I; break;
+        case VL_OP_SUB: base = VL_BC_SUB_I; break;
+        case VL_OP_MUL: base = VL_BC_MUL_I; break;
+        case VL_OP_DIV: base = VL_BC_DIV_I; break;
+        case VL_OP_MOD: base = VL_BC_MOD_I; break;
+        case VL_OP_EXP: base = VL_BC_EXP_I; break;
+        case VL_OP_AND: base = VL_BC_AND_I; break;
+        case VL_OP_OR: base = VL_BC_OR_I; break;
+        case VL_OP_XOR: base = VL_BC_XOR_I; break;
+        case VL_OP_LSHIFT: base = VL_BC_SHL_I; break;
+        default: base = VL_BC_SHR_I; break;
+    }
+    bool bitwise = base >= VL_BC_AND_I;
+    VLRep rep = vlRep(type);
+
+    // The count of a byte or short shift is taken modulo its width
+    if ((op == VL_OP_LSHIFT || op == VL_OP_RSHIFT) && (type.base == VL_TYPE_BYTE || type.base == VL_TYPE_SHORT)) {
+        uint32_t count;
+        VLValue mask = {.i = type.base == VL_TYPE_BYTE ? 7 : 15};
+        if (!vlReserve(c, 1, pos, &count) || !vlLoadValue(c, count, mask, VL_REP_I, pos)) return false;
+        if (!vlEmitABC(c, VL_BC_AND_I, count, count, right, pos)) return false;
+        right = count;
+    }
+    uint32_t opcode = bitwise ? base + (rep == VL_REP_L) : base + rep;
+    return vlEmitABC(c, opcode, dest, left, right, pos) && vlNarrowResult(c, dest, type, pos);
+}
+
+
+// Small integer steps such as i + 1 become a single ADDI
+static bool vlImmediate(const VLExpression* expr, VLOperation op, VLType type, int* step) {
+    if ((op != VL_OP_ADD && op != VL_OP_SUB) || (type.base != VL_TYPE_INT && type.base != VL_TYPE_LONG) || type.rank) {
+        return false;
+    }
+    if (expr->kind < VL_EXPR_BYTE || expr->kind > VL_EXPR_LONG) return false;
+    VLLong value = vlLiteralValue(expr).i;
+    if (op == VL_OP_SUB) value = -value;
+    if (value < INT8_MIN || value > INT8_MAX) return false;
+    *step = (int) value;
+    return true;
+}
+
+
+static bool vlBinary(VLCompiler* c, const VLExpression* expr, uint32_t dest) {
+    uint32_t saved = c->top, left, right;
+    VLOperation op = expr->binaryOp.operation;
+    int step;
+    if (!vlExprAny(c, expr->binaryOp.first, &left)) return false;
+
+    bool ok;
+    if (vlImmediate(expr->binaryOp.second, op, expr->type, &step)) {
+        VLOpcode opcode = expr->type.base == VL_TYPE_LONG ? VL_BC_ADDI_L : VL_BC_ADDI_I;
+        ok = vlEmitABC(c, opcode, dest, left, (uint32_t) step, expr->pos);
+    } else {
+        ok = vlExprAny(c, expr->binaryOp.second, &right) &&
+             vlArithmetic(c, op, expr->type, left, right, dest, expr->pos);
+    }
+    c->top = saved;
+    return ok;
+}
+
+
+// Both sides already share a type unless they are references
+static bool vlComparison(VLCompiler* c, const VLExpression* expr, uint32_t dest) {
+    uint32_t saved = c->top, left, right;
+    VLOperation op = expr->binaryOp.operation;
+    VLType leftType = expr->binaryOp.first->type, rightType = expr->binaryOp.second->type;
+    if (!vlExprAny(c, expr->binaryOp.first, &left) || !vlExprAny(c, expr->binaryOp.second, &right)) return false;
+
+    // Greater-than is less-than with the operands swapped
+    if (op == VL_OP_GT || op == VL_OP_GTEQ) {
+        uint32_t reg = left;
+        left = right;
+        right = reg;
+        op = op == VL_OP_GT ? VL_OP_LT : VL_OP_LTEQ;
+    }
+    VLOpcode base;
+    switch (op) {
+        case VL_OP_EQ: case VL_OP_SAME: base = VL_BC_EQ_I; break;
+        case VL_OP_NEQ: case VL_OP_NSAME: base = VL_BC_NE_I; break;
+        case VL_OP_LT: base = VL_BC_LT_I; break;
+        default: base = VL_BC_LE_I; break;
+    }
+
+    VLOpcode opcode = base;
+    if (vlIsNumeric(leftType)) {
+        opcode = base + vlRep(leftType);
+    } else if (vlRep(leftType) == VL_REP_P) {
+        bool strings = (leftType.base == VL_TYPE_STR && !leftType.rank) ||
+                       (rightType.base == VL_TYPE_STR && !rightType.rank);
+        bool same = op == VL_OP_SAME || op == VL_OP_NSAME;
+        opcode = base + (strings && !same ? 4 : 5);
+    }
+    bool ok = vlEmitABC(c, opcode, dest, left, right, expr->pos);
+    c->top = saved;
+    return ok;
+}
+
+
+// Somewhere a value can be stored: a local's register, a global slot, an array element or an
+// array's capacity
+typedef struct VLPlace {
+    enum { VL_PLACE_LOCAL, VL_PLACE_GLOBAL, VL_PLACE_ELEMENT, VL_PLACE_CAPACITY } kind;
+    uint32_t reg;
+    uint32_t index;
+    VLType type;
+} VLPlace;
+
+
+static bool vlPlace(VLCompiler* c, const VLExpression* target, VLPlace* place) {
+    place->type = target->type;
+    if (target->kind == VL_EXPR_NAME) {
+        const VLLocal* local = vlResolve(c, target->symbol);
+        place->kind = local->global ? VL_PLACE_GLOBAL : VL_PLACE_LOCAL;
+        place->reg = local->slot;
+        return true;
+    }
+    if (target->kind == VL_EXPR_BINARY) {
+        place->kind = VL_PLACE_CAPACITY;
+        return vlExprAny(c, target->binaryOp.first, &place->reg);
+    }
+    place->kind = VL_PLACE_ELEMENT;
+    return vlExprAny(c, target->multiOp.children[0], &place->reg) &&
+           vlExprAny(c, target->multiOp.children[1], &place->index);
+}
+
+
+static bool vlReadPlace(VLCompiler* c, const VLPlace* place, uint32_t dest, size_t pos) {
+    switch (place->kind) {
+        case VL_PLACE_LOCAL:
+            return vlEmitMove(c, dest, place->reg, vlRep(place->type), pos);
+        case VL_PLACE_GLOBAL:
+            return vlEmit(c, VL_ENCODE_ABX(VL_BC_GETG, dest, place->reg), pos);
+        case VL_PLACE_CAPACITY:
+            return vlEmitABC(c, VL_BC_CAP, dest, place->reg, 0, pos);
+        default:
+            return vlEmitABC(c, vlLoadOpcode(vlElementKind(place->type)), dest, place->reg, place->index, pos);
+    }
+}
+
+
+static bool vlWritePlace(VLCompiler* c, const VLPlace* place, uint32_t src, size_t pos) {
+    switch (place->kind) {
+        case VL_PLACE_LOCAL:
+            return vlEmitMove(c, place->reg, src, vlRep(place->type), pos);
+        case VL_PLACE_GLOBAL:
+            return vlEmit(c, VL_ENCODE_ABX(VL_BC_SETG, src, place->reg), pos);
+        case VL_PLACE_CAPACITY:
+            return vlEmitABC(c, VL_BC_SETCAP, place->reg, src, 0, pos);
+        default:
+            return vlEmitABC(c, vlStoreOpcode(vlElementKind(place->type)), place->reg, place->index, src, pos);
+    }
+}
+
+
+static bool vlIncrement(VLCompiler* c, const VLExpression* expr, uint32_t dest) {
+    VLOperation op = expr->unaryOp.operation;
+    int step = op == VL_OP_INC_BEF || op == VL_OP_INC_AFT ? 1 : -1;
+    bool post = op == VL_OP_INC_AFT || op == VL_OP_DEC_AFT;
+    uint32_t saved = c->top, value;
+    VLPlace place;
+    if (!vlPlace(c, expr->unaryOp.child, &place)) return false;
+
+    if (place.kind == VL_PLACE_LOCAL) {
+        value = place.reg;
+    } else if (!vlReserve(c, 1, expr->pos, &value) || !vlReadPlace(c, &place, value, expr->pos)) {
+        return false;
+    }
+    if (post && dest != VL_NO_REGISTER && !vlEmitMove(c, dest, value, vlRep(place.type), expr->pos)) return false;
+
+    VLRep rep = vlRep(place.type);
+    if (rep == VL_REP_I || rep == VL_REP_L) {
+        if (!vlEmitABC(c, rep == VL_REP_L ? VL_BC_ADDI_L : VL_BC_ADDI_I, value, value, (uint32_t) step, expr->pos)) {
+            return false;
+        }
+        if (!vlNarrowResult(c, value, place.type, expr->pos)) return false;
+    } else {
+        uint32_t one;
+        VLValue constant = {0};
+        if (rep == VL_REP_F) constant.f = (VLFloat) step; else constant.d = step;
+        if (!vlReserve(c, 1, expr->pos, &one) || !vlLoadValue(c, one, constant, rep, expr->pos)) return false;
+        if (!vlEmitABC(c, VL_BC_ADD_I + rep, value, value, one, expr->pos)) return false;
+    }
+
+    if (place.kind != VL_PLACE_LOCAL && !vlWritePlace(c, &place, value, expr->pos)) return false;
+    if (!post && dest != VL_NO_REGISTER && !vlEmitMove(c, dest, value, vlRep(place.type), expr->pos)) return false;
+    c->top = saved;
+    return true;
+}
+
+
+static VLOperation vlCompoundOperation(VLOperation op) {
+    switch (op) {
+        case VL_OP_ADD_PUT: return VL_OP_ADD;
+        case VL_OP_SUB_PUT: return VL_OP_SUB;
+        case VL_OP_MUL_PUT: return VL_OP_MUL;
+        case VL_OP_DIV_PUT: return VL_OP_DIV;
+        case VL_OP_MOD_PUT: return VL_OP_MOD;
+        case VL_OP_EXP_PUT: return VL_OP_EXP;
+        case VL_OP_AND_PUT: return VL_OP_AND;
+        case VL_OP_XOR_PUT: return VL_OP_XOR;
+        case VL_OP_OR_PUT: return VL_OP_OR;
+        case VL_OP_LSHIFT_PUT: return VL_OP_LSHIFT;
+        case VL_OP_RSHIFT_PUT: return VL_OP_RSHIFT;
+        default: return VL_OP_PUT;
+    }
+}
+
+
+// Plain and compound assignment. A compound assignment computes in its value's type, which for
+// anything but a shift the checker made the wider of the two, and converts back to the target's.
+static bool vlAssign(VLCompiler* c, const VLExpression* expr, uint32_t dest) {
+    const VLExpression* value = expr->binaryOp.second;
+    VLOperation op = vlCompoundOperation(expr->binaryOp.operation);
+    uint32_t saved = c->top, result;
+    VLPlace place;
+    if (!vlPlace(c, expr->binaryOp.first, &place)) return false;
+
+    if (op == VL_OP_PUT) {
+        if (place.kind == VL_PLACE_LOCAL) {
+            result = place.reg;
+            if (!vlExpr(c, value, result)) return false;
+        } else if (!vlExprAny(c, value, &result) || !vlWritePlace(c, &place, result, expr->pos)) {
+            return false;
+        }
+    } else {
+        uint32_t current, right;
+        if (place.kind == VL_PLACE_LOCAL) {
+            current = place.reg;
+        } else if (!vlReserve(c, 1, expr->pos, &current) || !vlReadPlace(c, &place, current, expr->pos)) {
+            return false;
+        }
+        result = current;
+
+        int step;
+        if (vlImmediate(value, op, place.type, &step)) {
+            VLOpcode opcode = place.type.base == VL_TYPE_LONG ? VL_BC_ADDI_L : VL_BC_ADDI_I;
+            if (!vlEmitABC(c, opcode, result, current, (uint32_t) step, expr->pos)) return false;
+        } else {
+            // Unless the result has to be converted back, it can go straight to where it's stored
+            bool shift = op == VL_OP_LSHIFT || op == VL_OP_RSHIFT;
+            VLType type = shift ? place.type : value->type;
+            uint32_t computed = result;
+            if (!vlExprAny(c, value, &right)) return false;
+            if (!vlSameType(type, place.type) && !vlReserve(c, 1, expr->pos, &computed)) return false;
+            if (!vlPromote(c, &current, place.type, type, expr->pos)) return false;
+            if (!vlArithmetic(c, op, type, current, right, computed, expr->pos)) return false;
+            if (!vlConvert(c, result, computed, type, place.type, expr->pos)) return false;
+        }
+        if (place.kind != VL_PLACE_LOCAL && !vlWritePlace(c, &place, result, expr->pos)) return false;
+    }
+
+    bool ok = dest == VL_NO_REGISTER || vlEmitMove(c, dest, result, vlRep(place.type), expr->pos);
+    c->top = saved;
+    return ok;
+}
+
+
+static bool vlUnary(VLCompiler* c, const VLExpression* expr, uint32_t dest) {
+    VLOperation op = expr->unaryOp.operation;
+    if (op >= VL_OP_INC_BEF && op <= VL_OP_DEC_AFT) return vlIncrement(c, expr, dest);
+
+    uint32_t saved = c->top, reg;
+    if (!vlExprAny(c, expr->unaryOp.child, &reg)) return false;
+    bool ok;
+    if (op == VL_OP_LNOT) {
+        ok = vlEmitABC(c, VL_BC_LNOT, dest, reg, 0, expr->pos);
+    } else if (op == VL_OP_NOT) {
+        ok = vlEmitABC(c, vlRep(expr->type) == VL_REP_L ? VL_BC_NOT_L : VL_BC_NOT_I, dest, reg, 0, expr->pos);
+    } else {
+        ok = op == VL_OP_POS ? vlEmitMove(c, dest, reg, vlRep(expr->type), expr->pos)
+                             : vlEmitABC(c, VL_BC_NEG_I + vlRep(expr->type), dest, reg, 0, expr->pos) &&
+                               vlNarrowResult(c, dest, expr->type, expr->pos);
+    }
+    c->top = saved;
+    return ok;
+}
+
+
+static bool vlLogical(VLCompiler* c, const VLExpression* expr, uint32_t dest) {
+    uint32_t saved = c->top, result;
+    size_t skip;
+    if (!vlScratch(c, dest, expr->pos, &result) || !vlExpr(c, expr->binaryOp.first, result)) return false;
+    VLOpcode op = expr->binaryOp.operation == VL_OP_LAND ? VL_BC_JF : VL_BC_JT;
+    if (!vlEmitJump(c, op, result, expr->pos, &skip)) return false;
+    if (!vlExpr(c, expr->binaryOp.second, result)) return false;
+    if (!vlPatchJump(c, skip, c->function->codeCount)) return false;
+    bool ok = vlEmitMove(c, dest, result, VL_REP_I, expr->pos);
+    c->top = saved;
+    return ok;
+}
+
+
+// Both branches build into the same register, already converted to the common type
+static bool vlConditional(VLCompiler* c, const VLExpression* expr, uint32_t dest) {
+    uint32_t result, condition;
+    size_t otherwise, done;
+    if (!vlScratch(c, dest, expr->pos, &result)) return false;
+    uint32_t saved = c->top;
+    if (!vlExprAny(c, expr->ternaryOp.first, &condition)) return false;
+    if (!vlEmitJump(c, VL_BC_JF, condition, expr->pos, &otherwise)) return false;
+    c->top = saved;
+
+    if (!vlExpr(c, expr->ternaryOp.second, result)) return false;
+    if (!vlEmitJump(c, VL_BC_JMP, 0, expr->pos, &done)) return false;
+    if (!vlPatchJump(c, otherwise, c->function->codeCount)) return false;
+    if (!vlExpr(c, expr->ternaryOp.third, result)) return false;
+    if (!vlPatchJump(c, done, c->function->codeCount)) return false;
+    return vlEmitMove(c, dest, result, vlRep(expr->type), expr->pos);
+}
+
+
+// Explicit casts and those the checker added alike. A local converts straight out of its
+// register, anything else in place.
+static bool vlCast(VLCompiler* c, const VLExpression* expr, uint32_t dest) {
+    const VLExpression* value = expr->binaryOp.first;
+    uint32_t src = dest;
+    if (vlFreeConversion(value->type, expr->type)) return vlExpr(c, value, dest);
+    if (!vlLocalRegister(c, value, &src) && !vlExpr(c, value, dest)) return false;
+    return vlConvert(c, dest, src, value->type, expr->type, expr->pos);
+}
+
+
+// .length of an array or string, or .capacity of an array
+static bool vlMember(VLCompiler* c, const VLExpression* expr, uint32_t dest) {
+    VLOpcode op = vlIsName(expr->binaryOp.second, "capacity") ? VL_BC_CAP : VL_BC_LEN;
+    uint32_t saved = c->top, object;
+    if (!vlExprAny(c, expr->binaryOp.first, &object)) return false;
+    bool ok = vlEmitABC(c, op, dest, object, 0, expr->pos);
+    c->top = saved;
+    return ok;
+}
+
+
+static bool vlBinaryExpr(VLCompiler* c, const VLExpression* expr, uint32_t dest) {
+    VLOperation op = expr->binaryOp.operation;
+    switch (op) {
+        case VL_OP_LAND:
+        case VL_OP_LOR:
+            return vlLogical(c, expr, dest);
+        case VL_OP_LXOR: {
+            uint32_t saved = c->top, left, right;
+            bool ok = vlExprAny(c, expr->binaryOp.first, &left) && vlExprAny(c, expr->binaryOp.second, &right) &&
+                      vlEmitABC(c, VL_BC_NE_I, dest, left, right, expr->pos);
+            c->top = saved;
+            return ok;
+        }
+        case VL_OP_EQ:
+        case VL_OP_NEQ:
+        case VL_OP_LT:
+        case VL_OP_GT:
+        case VL_OP_LTEQ:
+        case VL_OP_GTEQ:
+        case VL_OP_SAME:
+        case VL_OP_NSAME:
+            return vlComparison(c, expr, dest);
+        case VL_OP_CAST:
+            return vlCast(c, expr, dest);
+        case VL_OP_MEMBER:
+            return vlMember(c, expr, dest);
+        default:
+            if (op == VL_OP_PUT || vlCompoundOperation(op) != VL_OP_PUT) return vlAssign(c, expr, dest);
+            return vlBinary(c, expr, dest);
+    }
+}
+
+
+static bool vlIndex(VLCompiler* c, const VLExpression* expr, uint32_t dest) {
+    uint32_t saved = c->top, array, index;
+    if (!vlExprAny(c, expr->multiOp.children[0], &array) || !vlExprAny(c, expr->multiOp.children[1], &index)) {
+        return false;
+    }
+    bool ok = vlEmitABC(c, vlLoadOpcode(vlElementKind(expr->type)), dest, array, index, expr->pos);
+    c->top = saved;
+    return ok;
+}
+
+
+// T[](n) makes an array of n zeroed elements
+static bool vlArrayConstructor(VLCompiler* c, const VLExpression* expr, uint32_t dest) {
+    uint32_t saved = c->top, length;
+    VLType element = {expr->type.base, (uint8_t) (expr->type.rank - 1)};
+    if (!vlExprAny(c, expr->multiOp.children[1], &length)) return false;
+    bool ok = dest == VL_NO_REGISTER || vlEmitABC(c, VL_BC_NEWARR, dest, length, vlElementKind(element), expr->pos);
+    c->top = saved;
+    return ok;
+}
+
+
+// a.add(item, index) opens a slot at index, which the checker always fills in, and stores the
+// item there
+static bool vlArrayAdd(VLCompiler* c, const VLExpression* expr) {
+    const VLExpression* item = expr->multiOp.children[1];
+    uint32_t saved = c->top, array, value, index, slot;
+    if (!vlExprAny(c, expr->multiOp.children[0]->binaryOp.first, &array) || !vlExprAny(c, item, &value) ||
+        !vlExprAny(c, expr->multiOp.children[2], &index) || !vlReserve(c, 1, expr->pos, &slot)) {
+        return false;
+    }
+    bool ok = vlEmitABC(c, VL_BC_AINS, slot, array, index, expr->pos) &&
+              vlEmitABC(c, vlStoreOpcode(vlElementKind(item->type)), array, slot, value, expr->pos);
+    c->top = saved;
+    return ok;
+}
+
+
+// Arguments, one per parameter, go in consecutive registers from base, which becomes the callee's
+// first register and receives the result. Calls through a type or a member are the array
+// constructor and a.add. The arguments packed for a variadic callee that doesn't let its pack
+// escape go in a pack, kept below base too so it can be dropped after the call.
+static bool vlCall(VLCompiler* c, const VLExpression* expr, uint32_t dest) {
+    const VLExpression* callee = expr->multiOp.children[0];
+    if (callee->kind == VL_EXPR_MULTI) return vlArrayConstructor(c, expr, dest);
+    if (callee->kind == VL_EXPR_BINARY) return vlArrayAdd(c, expr);
+
+    size_t index = vlFindFunction(c, callee);
+    const VLFunction* fn = &c->program->functions[index];
+    const VLExpression* items = fn->variadic ? expr->multiOp.children[fn->paramCount] : NULL;
+    bool pack = items && !fn->packEscapes && items->kind == VL_EXPR_MULTI && items->multiOp.operation == VL_OP_ARR_INIT;
+    uint32_t saved = c->top, base, packed = 0;
+    if (pack && !vlReserve(c, 1, expr->pos, &packed)) return false;
+    if (!vlReserve(c, fn->paramCount ? (uint32_t) fn->paramCount : 1, expr->pos, &base)) return false;
+    for (size_t i = 0; i < fn->paramCount; ++i) {
+        uint32_t reg = base + (uint32_t) i;
+        if (pack && i + 1 == fn->paramCount) {
+            if (!vlArrayLiteral(c, items, packed, true) || !vlEmitMove(c, reg, packed, VL_REP_P, expr->pos)) {
+                return false;
+            }
+        } else if (!vlExpr(c, expr->multiOp.children[i + 1], reg)) {
+            return false;
+        }
+        c->top = base + (uint32_t) fn->paramCount;
+    }
+
+    bool ok = fn->native == VL_NO_NATIVE ? vlEmit(c, VL_ENCODE_ABX(VL_BC_CALL, base, index), expr->pos)
+                                         : vlEmit(c, VL_ENCODE_ABX(VL_BC_CALLN, base, fn->native), expr->pos);
+    if (ok && pack) ok = vlEmitABC(c, VL_BC_DROPPACK, packed, 0, 0, expr->pos);
+    if (ok && dest != VL_NO_REGISTER) ok = vlEmitMove(c, dest, base, vlRep(fn->result), expr->pos);
+    c->top = saved;
+    return ok;
+}
+
+
+static bool vlMulti(VLCompiler* c, const VLExpression* expr, uint32_t dest) {
+    switch (expr->multiOp.operation) {
+        case VL_OP_CALL: return vlCall(c, expr, dest);
+        case VL_OP_INDEX: return vlIndex(c, expr, dest);
+        default: return vlArrayLiteral(c, expr, dest, false);
+    }
+}
+
+
+static bool vlExpr(VLCompiler* c, const VLExpression* expr, uint32_t dest) {
+    switch (expr->kind) {
+        case VL_EXPR_NAME: return vlLoadName(c, expr, dest);
+        case VL_EXPR_STR: return vlStringConstant(c, expr, dest);
+        case VL_EXPR_UNARY: return vlUnary(c, expr, dest);
+        case VL_EXPR_BINARY: return vlBinaryExpr(c, expr, dest);
+        case VL_EXPR_TERNARY: return vlConditional(c, expr, dest);
+        case VL_EXPR_MULTI: return vlMulti(c, expr, dest);
+        default: return vlLoadValue(c, dest, vlLiteralValue(expr), vlRep(expr->type), expr->pos);
+    }
+}
+
+
+static bool vlIsDeclaration(const VLExpression* expr) {
+    return expr->kind == VL_EXPR_BINARY &&
+           (expr->binaryOp.operation == VL_OP_DECLARE || expr->binaryOp.operation == VL_OP_DECLARE_FINAL);
+}
+
+
+static const VLLocal* vlFindGlobal(const VLCompiler* c, VLSymbol symbol) {
+    for (size_t i = 0; i < c->globalCount; ++i) {
+        if (c->globals[i].symbol == symbol) return &c->globals[i];
+    }
+    return NULL;
+}
+
+
+// Declares a local, or at the top level a global when a function refers to it, and initializes
+// it to init or else to zero
+static bool vlDeclare(VLCompiler* c, const VLExpression* decl, const VLExpression* init) {
+    const VLExpression* name = decl->binaryOp.second;
+    VLType type = decl->type;
+    const VLLocal* global = c->topLevel && !c->scope ? vlFindGlobal(c, name->symbol) : NULL;
+    VLLocal local = {.symbol = name->symbol, .type = type, .global = global != NULL};
+    uint32_t reg;
+    if (!vlReserve(c, 1, decl->pos, &reg)) return false;
+    bool ok = init ? vlExpr(c, init, reg) : vlLoadValue(c, reg, (VLValue) {0}, vlRep(type), decl->pos);
+    if (!ok) return false;
+
+    if (global) {
+        local.slot = global->slot;
+        if (!vlEmit(c, VL_ENCODE_ABX(VL_BC_SETG, reg, local.slot), decl->pos)) return false;
+        c->top = c->localTop;
+    } else {
+        local.slot = reg;
+        c->top = c->localTop = reg + 1;
+    }
+
+    if (c->topLevel && !c->scope) {
+        VLProgram* program = c->program;
+        if (!vlGrow((void**) &program->variables, &program->variableCapacity, program->variableCount,
+                    sizeof(VLVariable))) {
+            return vlOutOfMemory(c, decl->pos);
+        }
+        program->variables[program->variableCount++] = (VLVariable) {name->stringValue, type, local.slot, local.global};
+    }
+    return vlAddLocal(c, local, name);
+}
+
+
+// An expression evaluated for its side effects, which may declare a variable
+static bool vlEffect(VLCompiler* c, const VLExpression* expr) {
+    if (vlIsDeclaration(expr)) return vlDeclare(c, expr, NULL);
+    bool put = expr->kind == VL_EXPR_BINARY && expr->binaryOp.operation == VL_OP_PUT;
+    if (put && vlIsDeclaration(expr->binaryOp.first)) {
+        return vlDeclare(c, expr->binaryOp.first, expr->binaryOp.second);
+    }
+
+    // Assignments, increments and calls leave their value nowhere
+    uint32_t reg;
+    bool ok;
+    if (expr->kind == VL_EXPR_BINARY &&
+        (expr->binaryOp.operation == VL_OP_PUT || vlCompoundOperation(expr->binaryOp.operation) != VL_OP_PUT)) {
+        ok = vlAssign(c, expr, VL_NO_REGISTER);
+    } else if (expr->kind == VL_EXPR_UNARY && expr->unaryOp.operation >= VL_OP_INC_BEF &&
+               expr->unaryOp.operation <= VL_OP_DEC_AFT) {
+        ok = vlIncrement(c, expr, VL_NO_REGISTER);
+    } else if (expr->kind == VL_EXPR_MULTI && expr->multiOp.operation == VL_OP_CALL) {
+        ok = vlCall(c, expr, VL_NO_REGISTER);
+    } else {
+        ok = vlReserve(c, 1, expr->pos, &reg) && vlExpr(c, expr, reg);
+    }
+    c->top = c->localTop;
+    return ok;
+}
+
+
+static bool vlCondition(VLCompiler* c, const VLExpression* expr, VLOpcode jump, size_t* at) {
+    uint32_t reg;
+    bool ok = vlExprAny(c, expr, &reg) && vlEmitJump(c, jump, reg, expr->pos, at);
+    c->top = c->localTop;
+    return ok;
+}
+
+
+static VLScope vlOpenScope(VLCompiler* c) {
+    ++c->scope;
+    return (VLScope) {c->localCount, c->localTop};
+}
+
+
+// Forgets the scope's locals and hands their registers back
+static void vlCloseScope(VLCompiler* c, VLScope scope) {
+    --c->scope;
+    c->localCount = scope.localCount;
+    c->top = c->localTop = scope.localTop;
+}
+
+
+// A nested statement gets a scope of its own, even when it isn't a block
+static bool vlScoped(VLCompiler* c, const VLStatement* stmt) {
+    VLScope scope = vlOpenScope(c);
+    bool ok = vlStatement(c, stmt);
+    vlCloseScope(c, scope);
+    return ok;
+}
+
+
+static size_t vlOpenLoop(VLCompiler* c) {
+    size_t outer = c->loop;
+    c->loop = ++c->loopCount;
+    return outer;
+}
+
+
+static bool vlCloseLoop(VLCompiler* c, size_t outer, size_t exit, size_t next) {
+    bool ok = true;
+    while (c->jumpCount && c->jumps[c->jumpCount - 1].loop == c->loop) {
+        VLJump jump = c->jumps[--c->jumpCount];
+        ok = ok && vlPatchJump(c, jump.at, jump.isBreak ? exit : next);
+    }
+    c->loop = outer;
+    return ok;
+}
+
+
+// Loops test at the bottom, so each iteration takes one conditional jump and nothing else
+static bool vlLoop(VLCompiler* c, const VLStatement* stmt) {
+    size_t entry, outer = vlOpenLoop(c);
+    if (stmt->kind != VL_STMT_DO_WHILE && !vlEmitJump(c, VL_BC_JMP, 0, stmt->pos, &entry)) return false;
+    size_t top = c->function->codeCount;
+    if (!vlScoped(c, stmt->loop.body)) return false;
+
+    size_t next = c->function->codeCount;
+    if (stmt->kind != VL_STMT_DO_WHILE) {
+        if (stmt->loop.step && !vlEffect(c, stmt->loop.step)) return false;
+        if (!vlPatchJump(c, entry, c->function->codeCount)) return false;
+    }
+    if (stmt->loop.condition) {
+        size_t back;
+        if (!vlCondition(c, stmt->loop.condition, VL_BC_JT, &back) || !vlPatchJump(c, back, top)) return false;
+    } else if (!vlEmitJumpTo(c, VL_BC_JMP, 0, top, stmt->pos)) {
+        return false;
+    }
+    return vlCloseLoop(c, outer, c->function->codeCount, next);
+}
+
+
+static bool vlIsEmpty(const VLStatement* stmt) {
+    return stmt->kind == VL_STMT_BLOCK && !stmt->block.count;
+}
+
+
+static const VLStatement* vlOnlyStatement(const VLStatement* stmt) {
+    while (stmt && stmt->kind == VL_STMT_BLOCK && stmt->block.count == 1) stmt = stmt->block.items[0];
+    return stmt;
+}
+
+
+static bool vlIsIntegral(VLType type) {
+    VLRep rep = vlRep(type);
+    return !type.rank && (rep == VL_REP_I || rep == VL_REP_L);
+}
+
+
+static bool vlIsVariable(const VLExpression* expr, VLSymbol symbol) {
+    return expr->kind == VL_EXPR_NAME && expr->symbol == symbol;
+}
+
+
+// Whether a for-each over an array of primitives does nothing but fold each element into one
+// variable, with a compound +=, *=, &=, |= or ^= or as a minimum or maximum kept by
+// if (n < least) least = n, leaving the variable in *acc and how it folds in *op. Integers may be
+// widened on the way in; floats have to fold into their own type.
+static bool vlIsReduction(const VLStatement* stmt, const VLExpression** acc, VLReduceOp* op) {
+    const VLExpression* item = stmt->forEach.item;
+    VLType arrayType = stmt->forEach.iterable->type;
+    VLType elementType = {arrayType.base, 0};
+    VLSymbol symbol = item->binaryOp.second->symbol;
+    if (arrayType.rank != 1 || vlRep(elementType) == VL_REP_P || !vlSameType(item->type, elementType)) return false;
+
+    const VLStatement* body = vlOnlyStatement(stmt->forEach.body);
+    const VLExpression* expr = body && body->kind == VL_STMT_EXPR ? body->expr : NULL;
+    if (expr && expr->kind == VL_EXPR_BINARY) {
+        switch (expr->binaryOp.operation) {
+            case VL_OP_ADD_PUT: *op = VL_REDUCE_ADD; break;
+            case VL_OP_MUL_PUT: *op = VL_REDUCE_MUL; break;
+            case VL_OP_AND_PUT: *op = VL_REDUCE_AND; break;
+            case VL_OP_OR_PUT: *op = VL_REDUCE_OR; break;
+            case VL_OP_XOR_PUT: *op = VL_REDUCE_XOR; break;
+            default: return false;
+        }
+        *acc = expr->binaryOp.first;
+        const VLExpression* value = expr->binaryOp.second;
+        if (vlIsIntegral(elementType)) {
+            if (!vlIsIntegral((*acc)->type)) return false;
+            while (vlIsCast(value) && vlIsIntegral(value->type)) value = value->binaryOp.first;
+        } else if (!vlSameType((*acc)->type, elementType)) {
+            return false;
+        }
+        return (*acc)->kind == VL_EXPR_NAME && (*acc)->symbol != symbol && vlIsVariable(value, symbol);
+    }
+
+    if (!body || body->kind != VL_STMT_IF || (body->ifStmt.otherwise && !vlIsEmpty(body->ifStmt.otherwise))) {
+        return false;
+    }
+    const VLExpression* test = body->ifStmt.condition;
+    const VLStatement* then = vlOnlyStatement(body->ifStmt.then);
+    expr = then && then->kind == VL_STMT_EXPR ? then->expr : NULL;
+    if (!expr || expr->kind != VL_EXPR_BINARY || expr->binaryOp.operation != VL_OP_PUT) return false;
+    *acc = expr->binaryOp.first;
+    if ((*acc)->kind != VL_EXPR_NAME || (*acc)->symbol == symbol || !vlSameType((*acc)->type, elementType) ||
+        !vlIsVariable(expr->binaryOp.second, symbol) || test->kind != VL_EXPR_BINARY) {
+        return false;
+    }
+    VLOperation comparison = test->binaryOp.operation;
+    if (comparison != VL_OP_LT && comparison != VL_OP_GT) return false;
+    bool itemFirst = vlIsVariable(test->binaryOp.first, symbol) && vlIsVariable(test->binaryOp.second, (*acc)->symbol);
+    bool accFirst = vlIsVariable(test->binaryOp.first, (*acc)->symbol) && vlIsVariable(test->binaryOp.second, symbol);
+    if (!itemFirst && !accFirst) return false;
+    *op = (comparison == VL_OP_LT) == itemFirst ? VL_REDUCE_MIN : VL_REDUCE_MAX;
+    return true;
+}
+
+
+// A reduction reads the array once, with no bounds checks, and leaves the folding to REDUCE.
+// Integers come out of it as longs and are wrapped back to the variable's type.
+static bool vlReduction(VLCompiler* c, const VLStatement* stmt, const VLExpression* acc, VLReduceOp op) {
+    VLType longType = {VL_TYPE_LONG, 0};
+    VLElementKind element = vlElementKind(stmt->forEach.item->type);
+    bool strict = c->program->strictFloat && (element == VL_ELEM_F32 || element == VL_ELEM_F64);
+    uint32_t saved = c->top, array, value;
+    VLPlace place;
+    if (!vlExprAny(c, stmt->forEach.iterable, &array) || !vlPlace(c, acc, &place)) return false;
+    if (place.kind == VL_PLACE_LOCAL) {
+        value = place.reg;
+    } else if (!vlReserve(c, 1, stmt->pos, &value) || !vlReadPlace(c, &place, value, stmt->pos)) {
+        return false;
+    }
+    if (!vlEmitABC(c, VL_BC_REDUCE, value, array, VL_REDUCE_MODE(element, op, strict), stmt->pos)) return false;
+    bool wrap = op != VL_REDUCE_MIN && op != VL_REDUCE_MAX && place.type.base != VL_TYPE_BOOL;
+    if (wrap && vlIsIntegral(place.type) && !vlConvert(c, value, value, longType, place.type, stmt->pos)) return false;
+    if (place.kind != VL_PLACE_LOCAL && !vlWritePlace(c, &place, value, stmt->pos)) return false;
+    c->top = saved;
+    return true;
+}
+
+
+// The array, its length and the index live in hidden locals so the body can't disturb them
+static bool vlForEach(VLCompiler* c, const VLStatement* stmt) {
+    const VLExpression* reduced;
+    VLReduceOp op;
+    if (vlIsReduction(stmt, &reduced, &op)) return vlReduction(c, stmt, reduced, op);
+
+    const VLExpression* item = stmt->forEach.item;
+    uint32_t array, length, index, element, test;
+    VLType arrayType = stmt->forEach.iterable->type;
+    VLScope scope = vlOpenScope(c);
+    if (!vlReserve(c, 3, stmt->pos, &array)) return false;
+    length = array + 1;
+    index = array + 2;
+    if (!vlExpr(c, stmt->forEach.iterable, array)) return false;
+    VLType elementType = {arrayType.base, (uint8_t) (arrayType.rank - 1)};
+    if (!vlEmitABC(c, VL_BC_LEN, length, array, 0, stmt->pos)) return false;
+    if (!vlLoadValue(c, index, (VLValue) {0}, VL_REP_I, stmt->pos)) return false;
+    c->localTop = c->top = index + 1;
+
+    size_t entry, back, outer = vlOpenLoop(c);
+    if (!vlReserve(c, 1, item->pos, &element)) return false;
+    c->localTop = c->top;
+    VLLocal local = {.symbol = item->binaryOp.second->symbol, .type = item->type, .slot = element};
+    if (!vlAddLocal(c, local, item->binaryOp.second) || !vlEmitJump(c, VL_BC_JMP, 0, stmt->pos, &entry)) return false;
+
+    size_t top = c->function->codeCount;
+    if (!vlEmitABC(c, vlLoadOpcode(vlElementKind(elementType)), element, array, index, stmt->pos)) return false;
+    if (!vlConvert(c, element, element, elementType, item->type, stmt->pos)) return false;
+    if (!vlScoped(c, stmt->forEach.body)) return false;
+
+    size_t next = c->function->codeCount;
+    if (!vlEmitABC(c, VL_BC_ADDI_I, index, index, 1, stmt->pos)) return false;
+    if (!vlPatchJump(c, entry, c->function->codeCount)) return false;
+    if (!vlReserve(c, 1, stmt->pos, &test) || !vlEmitABC(c, VL_BC_LT_I, test, index, length, stmt->pos)) return false;
+    if (!vlEmitJump(c, VL_BC_JT, test, stmt->pos, &back) || !vlPatchJump(c, back, top)) return false;
+    vlCloseScope(c, scope);
+    return vlCloseLoop(c, outer, c->function->codeCount, next);
+}
+
+
+static bool vlStatementAt(VLCompiler* c, const VLStatement* stmt) {
+    size_t jump;
+    uint32_t reg;
+    switch (stmt->kind) {
+        case VL_STMT_EXPR:
+            return vlEffect(c, stmt->expr);
+        case VL_STMT_BLOCK:
+            for (size_t i = 0; i < stmt->block.count; ++i) {
+                if (!vlStatement(c, stmt->block.items[i])) return false;
+            }
+            return true;
+        case VL_STMT_IF:
+            if (!vlCondition(c, stmt->ifStmt.condition, VL_BC_JF, &jump) || !vlScoped(c, stmt->ifStmt.then)) {
+                return false;
+            }
+            if (stmt->ifStmt.otherwise && !vlIsEmpty(stmt->ifStmt.otherwise)) {
+                size_t done;
+                if (!vlEmitJump(c, VL_BC_JMP, 0, stmt->pos, &done)) return false;
+                if (!vlPatchJump(c, jump, c->function->codeCount) || !vlScoped(c, stmt->ifStmt.otherwise)) return false;
+                jump = done;
+            }
+            return vlPatchJump(c, jump, c->function->codeCount);
+        case VL_STMT_FOR: {
+            VLScope scope = vlOpenScope(c);
+            bool ok = (!stmt->loop.init || vlEffect(c, stmt->loop.init)) && vlLoop(c, stmt);
+            vlCloseScope(c, scope);
+            return ok;
+        }
+        case VL_STMT_WHILE:
+        case VL_STMT_DO_WHILE:
+            return vlLoop(c, stmt);
+        case VL_STMT_FOR_EACH:
+            return vlForEach(c, stmt);
+        case VL_STMT_WITH: {
+            VLScope scope = vlOpenScope(c);
+            bool ok = vlEffect(c, stmt->with.setup) && vlScoped(c, stmt->with.body);
+            vlCloseScope(c, scope);
+            return ok;
+        }
+        case VL_STMT_RETURN:
+            if (!stmt->expr) return vlEmitABC(c, VL_BC_RETV, 0, 0, 0, stmt->pos);
+            return vlExprAny(c, stmt->expr, &reg) && vlEmitABC(c, VL_BC_RET, reg, 0, 0, stmt->pos);
+        case VL_STMT_BREAK:
+        case VL_STMT_CONTINUE:
+            if (!vlGrow((void**) &c->jumps, &c->jumpCapacity, c->jumpCount, sizeof(VLJump))) {
+                return vlOutOfMemory(c, stmt->pos);
+            }
+            if (!vlEmitJump(c, VL_BC_JMP, 0, stmt->pos, &jump)) return false;
+            c->jumps[c->jumpCount++] = (VLJump) {jump, c->loop, stmt->kind == VL_STMT_BREAK};
+            return true;
+        default:
+            // The checker only lets top-level functions through, and those are compiled on their own
+            return true;
+    }
+}
+
+
+static bool vlStatement(VLCompiler* c, const VLStatement* stmt) {
+    return vlStatementAt(c, stmt) && c->program->status == VL_STATUS_OK;
+}
+
+
+static bool vlAddCaptured(VLCompiler* c, VLSymbol symbol) {
+    if (vlIsCaptured(c, symbol)) return true;
+    if (!vlGrow((void**) &c->captured, &c->capturedCapacity, c->capturedCount, sizeof(VLSymbol))) return false;
+    c->captured[c->capturedCount++] = symbol;
+    return true;
+}
+
+
+// The checker has already bounded how deeply expressions nest
+static bool vlCaptureExpr(VLCompiler* c, const VLExpression* expr) {
+    if (!expr) return true;
+    if (expr->kind == VL_EXPR_NAME) return vlAddCaptured(c, expr->symbol) || vlOutOfMemory(c, expr->pos);
+    for (size_t i = 0, count = vlExprChildCount(expr); i < count; ++i) {
+        if (!vlCaptureExpr(c, vlExprChild(expr, i))) return false;
+    }
+    return true;
+}
+
+
+// Collects every name a function body mentions. Top-level variables among them become globals,
+// which is more than strictly needed when a function's own local shares a name, but never less.
+static bool vlCaptureStatement(VLCompiler* c, const VLStatement* stmt) {
+    if (!stmt) return true;
+    switch (stmt->kind) {
+        case VL_STMT_EXPR:
+        case VL_STMT_RETURN:
+        case VL_STMT_THROW:
+            return vlCaptureExpr(c, stmt->expr);
+        case VL_STMT_BLOCK:
+            for (size_t i = 0; i < stmt->block.count; ++i) {
+                if (!vlCaptureStatement(c, stmt->block.items[i])) return false;
+            }
+            return true;
+        case VL_STMT_IF:
+            return vlCaptureExpr(c, stmt->ifStmt.condition) && vlCaptureStatement(c, stmt->ifStmt.then) &&
+                   vlCaptureStatement(c, stmt->ifStmt.otherwise);
+        case VL_STMT_FOR:
+        case VL_STMT_WHILE:
+        case VL_STMT_DO_WHILE:
+            return vlCaptureExpr(c, stmt->loop.init) && vlCaptureExpr(c, stmt->loop.condition) &&
+                   vlCaptureExpr(c, stmt->loop.step) && vlCaptureStatement(c, stmt->loop.body);
+        case VL_STMT_FOR_EACH:
+            return vlCaptureExpr(c, stmt->forEach.iterable) && vlCaptureStatement(c, stmt->forEach.body);
+        case VL_STMT_WITH:
+            return vlCaptureExpr(c, stmt->with.setup) && vlCaptureStatement(c, stmt->with.body);
+        default:
+            return true;
+    }
+}
+
+
+static bool vlIsPack(const VLExpression* expr, VLSymbol pack) {
+    return expr->kind == VL_EXPR_NAME && expr->symbol == pack;
+}
+
+
+// Whether expr uses the pack named pack in a way that could let it outlive the call. Reading its
+// length, reading and writing its elements and passing it on as the pack of a callee that doesn't
+// let its own escape are safe; anything else is taken to be an escape.
+static bool vlPackEscapesExpr(const VLCompiler* c, const VLExpression* expr, VLSymbol pack) {
+    if (!expr) return false;
+    if (vlIsPack(expr, pack)) return true;
+    if (expr->kind == VL_EXPR_BINARY && expr->binaryOp.operation == VL_OP_MEMBER &&
+        vlIsPack(expr->binaryOp.first, pack) && vlIsName(expr->binaryOp.second, "length")) {
+        return false;
+    }
+    size_t count = vlExprChildCount(expr);
+    if (expr->kind == VL_EXPR_MULTI && expr->multiOp.operation == VL_OP_INDEX && count == 2 &&
+        vlIsPack(expr->multiOp.children[0], pack)) {
+        return vlPackEscapesExpr(c, expr->multiOp.children[1], pack);
+    }
+    if (expr->kind == VL_EXPR_MULTI && expr->multiOp.operation == VL_OP_CALL &&
+        expr->multiOp.children[0]->kind == VL_EXPR_NAME && vlIsPack(expr->multiOp.children[count - 1], pack)) {
+        const VLFunction* fn = &c->program->functions[vlFindFunction(c, expr->multiOp.children[0])];
+        if (fn->variadic && !fn->packEscapes) --count;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        if (vlPackEscapesExpr(c, vlExprChild(expr, i), pack)) return true;
+    }
+    return false;
+}
+
+
+static bool vlPackEscapes(const VLCompiler* c, const VLStatement* stmt, VLSymbol pack) {
+    if (!stmt) return false;
+    switch (stmt->kind) {
+        case VL_STMT_EXPR:
+        case VL_STMT_RETURN:
+        case VL_STMT_THROW:
+            return vlPackEscapesExpr(c, stmt->expr, pack);
+        case VL_STMT_BLOCK:
+            for (size_t i = 0; i < stmt->block.count; ++i) {
+                if (vlPackEscapes(c, stmt->block.items[i], pack)) return true;
+            }
+            return false;
+        case VL_STMT_IF:
+            return vlPackEscapesExpr(c, stmt->ifStmt.condition, pack) || vlPackEscapes(c, stmt->ifStmt.then, pack) ||
+                   vlPackEscapes(c, stmt->ifStmt.otherwise, pack);
+        case VL_STMT_FOR:
+        case VL_STMT_WHILE:
+        case VL_STMT_DO_WHILE:
+            return vlPackEscapesExpr(c, stmt->loop.init, pack) || vlPackEscapesExpr(c, stmt->loop.condition, pack) ||
+                   vlPackEscapesExpr(c, stmt->loop.step, pack) || vlPackEscapes(c, stmt->loop.body, pack);
+        case VL_STMT_FOR_EACH:
+            return (!vlIsPack(stmt->forEach.iterable, pack) && vlPackEscapesExpr(c, stmt->forEach.iterable, pack)) ||
+                   vlPackEscapes(c, stmt->forEach.body, pack);
+        case VL_STMT_WITH:
+            return vlPackEscapesExpr(c, stmt->with.setup, pack) || vlPackEscapes(c, stmt->with.body, pack);
+        default:
+            return false;
+    }
+}
+
+
+// Packs are first assumed not to escape any variadic function with a body, which lets recursive
+// and mutually recursive functions pass theirs on. Each function found to let its pack escape can then spoil
+// the ones that pass theirs to it, until nothing changes.
+static void vlFindEscapingPacks(VLCompiler* c) {
+    VLProgram* program = c->program;
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (size_t i = 0; i < program->functionCount; ++i) {
+            VLFunction* fn = &program->functions[i];
+            if (!fn->variadic || fn->packEscapes) continue;
+            const VLExpression* param = fn->signature->binaryOp.second->multiOp.children[fn->paramCount];
+            if (param->binaryOp.operation == VL_OP_PUT) param = param->binaryOp.first;
+            fn->packEscapes = !fn->body || vlPackEscapes(c, fn->body, param->binaryOp.second->symbol);
+            changed = changed || fn->packEscapes;
+        }
+    }
+}
+
+
+static void vlResetCompiler(VLCompiler* c, VLFunction* fn, bool topLevel) {
+    c->function = fn;
+    c->topLevel = topLevel;
+    c->localCount = 0;
+    c->top = c->localTop = 0;
+    c->jumpCount = 0;
+    c->loop = 0;
+    c->scope = 0;
+}
+
+
+static bool vlCompileFunction(VLCompiler* c, VLFunction* fn) {
+    vlResetCompiler(c, fn, false);
+    const VLExpression* call = fn->signature->binaryOp.second;
+    uint32_t first;
+    if (!vlReserve(c, (uint32_t) fn->paramCount, fn->pos, &first)) return false;
+    for (size_t i = 0; i < fn->paramCount; ++i) {
+        const VLExpression* param = call->multiOp.children[i + 1];
+        if (param->binaryOp.operation == VL_OP_PUT) param = param->binaryOp.first;
+        VLLocal local = {.symbol = param->binaryOp.second->symbol, .type = fn->params[i], .slot = (uint32_t) i};
+        if (!vlAddLocal(c, local, param->binaryOp.second)) return false;
+    }
+    c->localTop = c->top;
+    if (!vlStatement(c, fn->body)) return false;
+
+    // Falling off the end returns nothing, or the zero value of the result type
+    if (fn->result.base == VL_TYPE_VOID) return vlEmitABC(c, VL_BC_RETV, 0, 0, 0, fn->pos);
+    uint32_t reg;
+    return vlReserve(c, 1, fn->pos, &reg) && vlLoadValue(c, reg, (VLValue) {0}, vlRep(fn->result), fn->pos) &&
+           vlEmitABC(c, VL_BC_RET, reg, 0, 0, fn->pos);
+}
+
+
+static bool vlCompileUnitCode(VLCompiler* c, const VLStatement* tree) {
+    bool block = tree->kind == VL_STMT_BLOCK;
+    const VLStatement* const* items = block ? (const VLStatement* const*) tree->block.items : &tree;
+    size_t count = block ? tree->block.count : 1;
+    VLProgram* program = c->program;
+
+    for (size_t i = 0; i < program->functionCount; ++i) {
+        if (!vlCaptureStatement(c, program->functions[i].body)) return false;
+    }
+    vlFindEscapingPacks(c);
+
+    // Top-level variables that functions refer to get global slots up front
+    for (size_t i = 0; i < count; ++i) {
+        const VLExpression* expr = items[i]->kind == VL_STMT_EXPR ? items[i]->expr : NULL;
+        if (expr && expr->kind == VL_EXPR_BINARY && expr->binaryOp.operation == VL_OP_PUT) expr = expr->binaryOp.first;
+        if (!expr || !vlIsDeclaration(expr)) continue;
+        VLSymbol symbol = expr->binaryOp.second->symbol;
+        if (!vlIsCaptured(c, symbol) || vlFindGlobal(c, symbol)) continue;
+        VLLocal global = {.symbol = symbol, .type = expr->type, .slot = (uint32_t) program->globalCount,
+                          .global = true};
+        if (!vlGrow((void**) &c->globals, &c->globalCapacity, c->globalCount, sizeof(VLLocal))) {
+            return vlOutOfMemory(c, expr->pos);
+        }
+        c->globals[c->globalCount++] = global;
+        ++program->globalCount;
+    }
+
+    for (size_t i = 0; i < program->functionCount; ++i) {
+        if (program->functions[i].body && !vlCompileFunction(c, &program->functions[i])) return false;
+    }
+
+    VLFunction main = {.native = VL_NO_NATIVE, .symbol = VL_NO_SYMBOL, .pos = tree->pos};
+    if (!vlGrow((void**) &program->functions, &program->functionCapacity, program->functionCount, sizeof(VLFunction))) {
+        return vlOutOfMemory(c, tree->pos);
+    }
+    program->functions[program->functionCount++] = main;
+    vlResetCompiler(c, &program->functions[program->functionCount - 1], true);
+    for (size_t i = 0; i < count; ++i) {
+        if (!vlStatement(c, items[i])) return false;
+    }
+    return vlEmitABC(c, VL_BC_RETV, 0, 0, 0, tree->pos);
+}
+
+
+// ---- FUNCTIONS ---- //
+
+bool vlCompileProgram(VLProgram* program, const VLStatement* tree) {
+    VLCompiler compiler = {.program = program};
+    bool ok = vlCompileUnitCode(&compiler, tree) && program->status == VL_STATUS_OK;
+    if (!ok && program->status == VL_STATUS_OK) program->status = VL_STATUS_OUT_OF_MEM;
+    free(compiler.locals);
+    free(compiler.globals);
+    free(compiler.captured);
+    free(compiler.jumps);
+    return ok;
+}
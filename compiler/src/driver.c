@@ -0,0 +1,463 @@
+/* ================
+ * src/driver.c
+ * VALLEY LANGUAGE COMPILER
+ * Multi-file compilation on a worker pool
+ * ================
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "../include/driver.h"
+#include "../include/cache.h"
+#include "../include/tokens.h"
+#include "../include/bytecode.h"
+#include "../include/check.h"
+#include "../include/vm.h"
+#include "../include/cgen.h"
+
+
+// ---- HELPERS ---- //
+
+static bool vlAddUnit(VLBuild* build, const char* path, size_t size) {
+    if (build->count == build->capacity) {
+        size_t capacity = build->capacity ? build->capacity * 2 : 16;
+        VLUnit* units = realloc(build->units, capacity * sizeof(VLUnit));
+        if (!units) return false;
+        build->units = units;
+        build->capacity = capacity;
+    }
+    VLUnit unit = {.path = strdup(path), .size = size};
+    if (!unit.path) return false;
+    build->units[build->count++] = unit;
+    return true;
+}
+
+
+static bool vlHasExtension(const char* name) {
+    size_t len = strlen(name), extLen = strlen(VL_SOURCE_EXTENSION);
+    return len > extLen && !strcmp(name + len - extLen, VL_SOURCE_EXTENSION);
+}
+
+
+static int vlCompareNames(const void* a, const void* b) {
+    return strcmp(*(const char* const*) a, *(const char* const*) b);
+}
+
+
+// Adds every source file under dir, visiting entries in name order so builds are reproducible
+static bool vlAddDirectory(VLBuild* build, const char* dir) {
+    DIR* handle = opendir(dir);
+    if (!handle) return false;
+
+    char** names = NULL;
+    size_t count = 0, capacity = 0;
+    bool ok = true;
+    struct dirent* entry;
+    while (ok && (entry = readdir(handle))) {
+        if (entry->d_name[0] == '.') continue;
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 32;
+            char** grown = realloc(names, capacity * sizeof(char*));
+            if (!grown) {
+                ok = false;
+                break;
+            }
+            names = grown;
+        }
+        if (!(names[count] = strdup(entry->d_name))) ok = false;
+        else ++count;
+    }
+    closedir(handle);
+    qsort(names, count, sizeof(char*), vlCompareNames);
+
+    for (size_t i = 0; i < count; ++i) {
+        if (ok) {
+            size_t len = strlen(dir) + strlen(names[i]) + 2;
+            char* path = malloc(len);
+            struct stat info;
+            if (!path) {
+                ok = false;
+            } else {
+                snprintf(path, len, "%s/%s", dir, names[i]);
+                // Symlinked directories are skipped so a link cycle can't recurse forever
+                if (lstat(path, &info) == 0 && S_ISDIR(info.st_mode)) {
+                    ok = vlAddDirectory(build, path);
+                } else if (vlHasExtension(names[i]) && stat(path, &info) == 0 && S_ISREG(info.st_mode)) {
+                    ok = vlAddUnit(build, path, (size_t) info.st_size);
+                }
+            }
+            free(path);
+        }
+        free(names[i]);
+    }
+    free(names);
+    return ok;
+}
+
+
+static bool vlWantsProgram(const VLDriverOptions* options) {
+    return options->dumpTypes || options->dumpBytecode || options->run || options->emitC || options->native;
+}
+
+
+// Lowers a program to C in a temporary file and builds it into an executable named after the
+// source, minus its extension, or with .out added when it has none
+static bool vlBuildExecutable(const VLUnit* unit, const VLProgram* program, const VLSource* source, FILE* out) {
+    size_t length = strlen(unit->path);
+    size_t extension = strlen(VL_SOURCE_EXTENSION);
+    bool stem = length > extension && !strcmp(unit->path + length - extension, VL_SOURCE_EXTENSION);
+    char* exePath = malloc(length + 5);
+    char cPath[] = "/tmp/valley-XXXXXX.c";
+    int fd = exePath ? mkstemps(cPath, 2) : -1;
+    FILE* file = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (!file) {
+        if (fd >= 0) {
+            close(fd);
+            unlink(cPath);
+        }
+        free(exePath);
+        fprintf(out, VL_ANSI_RED "Error: Unable to write C for '%s'." VL_ANSI_RESET "\n", unit->path);
+        return false;
+    }
+    if (stem) snprintf(exePath, length + 5, "%.*s", (int) (length - extension), unit->path);
+    else snprintf(exePath, length + 5, "%s.out", unit->path);
+
+    bool ok = vlEmitC(file, program, unit->path, source->data, source->size);
+    ok = !fclose(file) && ok;
+    if (!ok) fprintf(out, VL_ANSI_RED "Error: Unable to write C for '%s'." VL_ANSI_RESET "\n", unit->path);
+    if (ok) ok = vlBuildNative(cPath, exePath, out);
+    if (ok) fprintf(out, "------------ NATIVE: %s ------------\n%s\n", unit->path, exePath);
+    unlink(cPath);
+    free(exePath);
+    return ok;
+}
+
+
+// Finds the line and column of pos with the line index of the unit's token stream when it was
+// lexed up front, and by scanning the text otherwise
+static void vlLocateIn(const VLSource* source, const VLTokenStream* stream, size_t pos, size_t* line,
+                       size_t* column) {
+    if (stream && stream->lineCount) vlLineColumn(stream, pos, line, column);
+    else vlLocate(source->data, pos, line, column);
+}
+
+
+// Type-checks a parsed tree and compiles the checked copy to bytecode, then prints, runs, lowers
+// and builds it as asked. A program with generic functions also reports the code their instances
+// add. Errors from checking, compiling or running are reported against the line and column they
+// come from, like those from parsing.
+static bool vlExecute(VLUnit* unit, const VLDriverOptions* options, const VLSource* source,
+                      const VLTokenStream* stream, const VLStatement* tree, FILE* out) {
+    VLProgram program;
+    vlInitProgram(&program);
+    program.strictFloat = options->strictFloat;
+    VLStatement* checked = NULL;
+    double start = options->stats ? vlStatsClock() : 0;
+    bool ok = vlCheckProgram(&program, tree, &checked);
+    if (options->stats) unit->stats.seconds[VL_PASS_CHECK] = vlStatsClock() - start;
+    if (ok && options->dumpTypes) {
+        fprintf(out, "------------ TYPES: %s ------------\n", unit->path);
+        vlPrintStatement(out, checked, 0);
+    }
+    if (ok) {
+        start = options->stats ? vlStatsClock() : 0;
+        ok = vlCompileProgram(&program, checked);
+        if (options->stats) unit->stats.seconds[VL_PASS_COMPILE] = vlStatsClock() - start;
+    }
+    VLStatus status = program.status;
+    const char* what = program.what;
+    size_t pos = program.pos;
+    if (ok && options->dumpBytecode) {
+        fprintf(out, "------------ BYTECODE: %s ------------\n", unit->path);
+        vlPrintProgram(out, &program);
+    }
+    if (ok && program.genericCount) {
+        fprintf(out, "------------ GENERICS: %s ------------\n", unit->path);
+        vlPrintInstances(out, &program);
+    }
+
+    VLMachine machine;
+    if (ok && options->run) {
+        start = options->stats ? vlStatsClock() : 0;
+        bool ran = vlInitMachine(&machine, &program) && (!options->jit || vlEnableJit(&machine)) &&
+                   vlRunProgram(&machine);
+        if (options->stats) unit->stats.seconds[VL_PASS_RUN] = vlStatsClock() - start;
+        if (ran) {
+            if (machine.jit) {
+                fprintf(out, "------------ JIT: %s ------------\n", unit->path);
+                fprintf(out, "%zu functions, %zu bytes of code in %.1f us\n", machine.jit->compiled,
+                        machine.jit->size, machine.jit->seconds * 1e6);
+            }
+            fprintf(out, "------------ RUN: %s ------------\n", unit->path);
+            vlPrintVariables(out, &machine);
+        } else {
+            ok = false;
+            status = machine.status;
+            what = machine.what;
+            pos = machine.pos;
+        }
+        vlFreeMachine(&machine);
+    }
+
+    if (ok && options->emitC) {
+        fprintf(out, "------------ C: %s ------------\n", unit->path);
+        if (!vlEmitC(out, &program, unit->path, source->data, source->size)) {
+            ok = false;
+            status = VL_STATUS_OUT_OF_MEM;
+            what = "";
+        }
+    }
+
+    if (!ok) {
+        size_t line, column;
+        vlLocateIn(source, stream, pos, &line, &column);
+        fprintf(out, "%s:%zu:%zu: ", unit->path, line, column);
+        vlReportError(out, status, what ? what : "");
+    } else if (options->native) {
+        ok = vlBuildExecutable(unit, &program, source, out);
+    }
+    vlFreeProgram(&program);
+    return ok;
+}
+
+
+// Parses one file's worth of statements, writing any diagnostic against its line and column
+static bool vlParseSource(VLUnit* unit, const VLDriverOptions* options, const VLSource* source, FILE* out) {
+    VLParser parser;
+    vlInitParser(&parser, source->data, source->size);
+    VLTokenStream stream = {0};
+    double start = 0;
+    if (options->stats) {
+        start = vlStatsClock();
+        bool lexed = vlLexAll(&parser, &stream);
+        unit->stats.seconds[VL_PASS_LEX] = vlStatsClock() - start;
+        vlCountTokens(&unit->stats, &stream);
+
+        // A lexical error may come after a syntax error, so start over without the stream to
+        // report the same first error as an unmeasured build would
+        if (lexed) {
+            vlAttachTokenStream(&parser, &stream);
+        } else {
+            vlFreeParser(&parser);
+            vlInitParser(&parser, source->data, source->size);
+        }
+        start = vlStatsClock();
+    }
+    vlGrabToken(&parser);
+
+    VLStatement* tree = NULL;
+    if (options->dumpTokens) {
+        fprintf(out, "------------ TOKENS: %s ------------\n", unit->path);
+        while (parser.status == VL_STATUS_OK && parser.token.kind != VL_TOKEN_EOF) {
+            vlPrintToken(out, parser.token);
+            vlGrabToken(&parser);
+        }
+        fprintf(out, "\n");
+    } else {
+        tree = vlParseUnit(&parser);
+        if (tree) {
+            unit->statements = tree->block.count;
+            if (options->dumpTree) {
+                fprintf(out, "------------ TREE: %s ------------\n", unit->path);
+                vlPrintStatement(out, tree, 0);
+            }
+        }
+    }
+
+    if (options->stats) {
+        unit->stats.seconds[VL_PASS_PARSE] = vlStatsClock() - start;
+        if (tree && !vlCountStatement(&unit->stats, tree)) parser.status = VL_STATUS_OUT_OF_MEM;
+        unit->stats.folded = parser.folded;
+        unit->stats.arena = parser.arena.stats;
+        unit->stats.heapBytes = vlParserFootprint(&parser, &stream);
+    }
+
+    bool ok = parser.status == VL_STATUS_OK;
+    if (!ok) {
+        size_t line, column;
+        vlLocateIn(source, &stream, vlErrorPos(&parser), &line, &column);
+        fprintf(out, "%s:%zu:%zu: ", unit->path, line, column);
+        vlReportStatus(out, &parser);
+    } else if (tree && vlWantsProgram(options)) {
+        ok = vlExecute(unit, options, source, &stream, tree, out);
+    }
+    unit->folded = parser.folded;
+    unit->arena = parser.arena.stats;
+    vlFreeTokenStream(&stream);
+    vlFreeParser(&parser);
+    return ok;
+}
+
+
+// Like vlParseSource, but reusing a cached tree when these exact contents have been parsed before
+static bool vlParseCached(VLUnit* unit, const VLDriverOptions* options, const VLSource* source, FILE* out) {
+    uint64_t hash = vlHashSource(source->data, source->size);
+    VLModule* module = vlCacheLookup(options->cache, hash, source->data, source->size);
+    if (!module) {
+        module = vlParseModule(source->data, source->size, hash);
+        if (module) module = vlCacheInsert(options->cache, module);
+    }
+    if (!module) {
+        fprintf(out, VL_ANSI_RED "Error: Ran out of available memory." VL_ANSI_RESET "\n");
+        return false;
+    }
+
+    if (module->tree) {
+        unit->statements = module->tree->block.count;
+        if (options->dumpTree) {
+            fprintf(out, "------------ TREE: %s ------------\n", unit->path);
+            vlPrintStatement(out, module->tree, 0);
+        }
+    } else {
+        const char* message = module->message ? module->message : "\n";
+        fprintf(out, "%s:%zu:%zu: %s", unit->path, module->line, module->column, message);
+    }
+    unit->folded = module->parser.folded;
+    unit->arena = module->parser.arena.stats;
+    if (module->tree && vlWantsProgram(options)) {
+        return vlExecute(unit, options, source, NULL, module->tree, out);
+    }
+    return module->tree != NULL;
+}
+
+
+static int vlWorker(void* arg) {
+    VLBuild* build = arg;
+    size_t index;
+    while ((index = atomic_fetch_add(&build->next, 1)) < build->count) {
+        VLUnit* unit = &build->units[build->schedule[index]];
+        unit->ok = vlCompileUnit(unit, &build->options);
+    }
+    return 0;
+}
+
+
+typedef struct {
+    size_t size;
+    size_t index;
+} VLScheduled;
+
+static int vlCompareSizes(const void* a, const void* b) {
+    const VLScheduled* left = a;
+    const VLScheduled* right = b;
+    if (left->size != right->size) return left->size < right->size ? 1 : -1;
+    return left->index < right->index ? -1 : left->index > right->index;
+}
+
+
+// ---- FUNCTIONS ---- //
+
+size_t vlDefaultJobs(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? (size_t) cpus : 1;
+}
+
+
+void vlInitBuild(VLBuild* build, VLDriverOptions options) {
+    VLBuild init = {.options = options};
+    *build = init;
+    atomic_init(&build->next, 0);
+}
+
+
+void vlFreeBuild(VLBuild* build) {
+    for (size_t i = 0; i < build->count; ++i) {
+        free(build->units[i].path);
+        free(build->units[i].output);
+    }
+    free(build->units);
+    free(build->schedule);
+    build->units = NULL;
+    build->schedule = NULL;
+    build->count = build->capacity = 0;
+}
+
+
+bool vlAddInput(VLBuild* build, const char* path) {
+    // Files named directly are taken whatever their extension; directories contribute their .vl files
+    struct stat info;
+    if (stat(path, &info) == 0 && S_ISDIR(info.st_mode)) return vlAddDirectory(build, path);
+    return vlAddUnit(build, path, stat(path, &info) == 0 ? (size_t) info.st_size : 0);
+}
+
+
+bool vlCompileUnit(VLUnit* unit, const VLDriverOptions* options) {
+    FILE* out = open_memstream(&unit->output, &unit->outputSize);
+    if (!out) return false;
+
+    bool ok;
+    VLSource source;
+    double start = options->stats ? vlStatsClock() : 0;
+    if (vlLoadSource(&source, unit->path)) {
+        unit->size = source.size;
+        if (options->stats) {
+            unit->stats.seconds[VL_PASS_READ] = vlStatsClock() - start;
+            unit->stats.bytes = source.size;
+        }
+        if (options->cache && !options->dumpTokens) ok = vlParseCached(unit, options, &source, out);
+        else ok = vlParseSource(unit, options, &source, out);
+        vlFreeSource(&source);
+    } else {
+        fprintf(out, VL_ANSI_RED "Error: Unable to load file '%s'." VL_ANSI_RESET "\n", unit->path);
+        ok = false;
+    }
+
+    fclose(out);
+    return ok;
+}
+
+
+bool vlRunBuild(VLBuild* build) {
+    free(build->schedule);
+    size_t slots = build->count ? build->count : 1;
+    build->schedule = malloc(slots * sizeof(size_t));
+    VLScheduled* order = malloc(slots * sizeof(VLScheduled));
+    if (!build->schedule || !order) {
+        free(order);
+        return false;
+    }
+
+    // Biggest files go first, so one large file picked up last can't leave every other worker idle
+    for (size_t i = 0; i < build->count; ++i) {
+        VLScheduled scheduled = {build->units[i].size, i};
+        order[i] = scheduled;
+    }
+    qsort(order, build->count, sizeof(VLScheduled), vlCompareSizes);
+    for (size_t i = 0; i < build->count; ++i) build->schedule[i] = order[i].index;
+    free(order);
+    atomic_store(&build->next, 0);
+
+    size_t jobs = build->options.jobs ? build->options.jobs : vlDefaultJobs();
+    if (jobs > build->count) jobs = build->count;
+    if (jobs <= 1) {
+        vlWorker(build);
+        return true;
+    }
+
+    // The calling thread is one of the workers
+    thrd_t* threads = malloc((jobs - 1) * sizeof(thrd_t));
+    size_t started = 0;
+    if (threads) {
+        while (started < jobs - 1 && thrd_create(&threads[started], vlWorker, build) == thrd_success) ++started;
+    }
+    vlWorker(build);
+    for (size_t i = 0; i < started; ++i) thrd_join(threads[i], NULL);
+    free(threads);
+    return true;
+}
+
+
+bool vlWriteUnits(const VLBuild* build, FILE* out) {
+    bool ok = true;
+    for (size_t i = 0; i < build->count; ++i) {
+        const VLUnit* unit = &build->units[i];
+        if (unit->outputSize) fwrite(unit->output, 1, unit->outputSize, out);
+        ok = ok && unit->ok;
+    }
+    return ok;
+}
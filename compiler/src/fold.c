@@ -0,0 +1,342 @@
+/* ================
+ * src/fold.c
+ * VALLEY LANGUAGE COMPILER
+ * Constant folding of operators over literal operands
+ * ================
+ */
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "../include/fold.h"
+
+
+// ---- HELPERS ---- //
+
+static bool vlIsIntegral(VLExprKind kind) {
+    return kind >= VL_EXPR_BYTE && kind <= VL_EXPR_LONG;
+}
+
+
+static unsigned vlKindBits(VLExprKind kind) {
+    switch (kind) {
+        case VL_EXPR_BYTE: return 8;
+        case VL_EXPR_SHORT: return 16;
+        case VL_EXPR_INT: return 32;
+        default: return 64;
+    }
+}
+
+
+static VLLong vlIntegerOf(const VLExpression* expr) {
+    switch (expr->kind) {
+        case VL_EXPR_BYTE: return expr->byteValue;
+        case VL_EXPR_SHORT: return expr->shortValue;
+        case VL_EXPR_INT: return expr->intValue;
+        default: return expr->longValue;
+    }
+}
+
+
+static VLDouble vlFloatingOf(const VLExpression* expr) {
+    return expr->kind == VL_EXPR_FLOAT ? expr->floatValue : expr->doubleValue;
+}
+
+
+// Truncates to the width of kind, wrapping around the way the machine types do
+static void vlSetInteger(VLExpression* expr, VLExprKind kind, uint64_t value) {
+    expr->kind = kind;
+    switch (kind) {
+        case VL_EXPR_BYTE: expr->byteValue = (VLByte) value; break;
+        case VL_EXPR_SHORT: expr->shortValue = (VLShort) value; break;
+        case VL_EXPR_INT: expr->intValue = (VLInt) value; break;
+        default: expr->longValue = (VLLong) value; break;
+    }
+}
+
+
+static void vlSetFloating(VLExpression* expr, VLExprKind kind, VLDouble value) {
+    expr->kind = kind;
+    if (kind == VL_EXPR_FLOAT) {
+        expr->floatValue = (VLFloat) value;
+    } else {
+        expr->doubleValue = value;
+    }
+}
+
+
+static void vlSetBool(VLExpression* expr, bool value) {
+    expr->kind = VL_EXPR_BOOL;
+    expr->boolValue = value;
+}
+
+
+// Widening only: integers to wider integers or to floating point, float to double
+static void vlConvert(VLExpression* expr, VLExprKind kind) {
+    if (expr->kind == kind) return;
+    if (vlIsIntegral(expr->kind)) {
+        VLLong value = vlIntegerOf(expr);
+        if (vlIsIntegral(kind)) {
+            vlSetInteger(expr, kind, (uint64_t) value);
+        } else if (kind == VL_EXPR_FLOAT) {
+            vlSetFloating(expr, kind, (VLFloat) value);
+        } else {
+            vlSetFloating(expr, kind, (VLDouble) value);
+        }
+    } else {
+        vlSetFloating(expr, kind, vlFloatingOf(expr));
+    }
+}
+
+
+static bool vlCompare(VLOperation op, int order, bool unordered, bool* result) {
+    switch (op) {
+        case VL_OP_EQ: *result = !unordered && order == 0; return true;
+        case VL_OP_NEQ: *result = unordered || order != 0; return true;
+        case VL_OP_LT: *result = !unordered && order < 0; return true;
+        case VL_OP_GT: *result = !unordered && order > 0; return true;
+        case VL_OP_LTEQ: *result = !unordered && order <= 0; return true;
+        case VL_OP_GTEQ: *result = !unordered && order >= 0; return true;
+        default: return false;
+    }
+}
+
+
+// Arithmetic is done on 64 bits and then cut down to the result's width, which gives the same
+// answer as doing it at that width. Division by zero is left for run time to report.
+static bool vlFoldInteger(VLOperation op, VLExprKind kind, VLLong x, VLLong y, VLExpression* result) {
+    uint64_t a = (uint64_t) x, b = (uint64_t) y, value;
+    unsigned mask = vlKindBits(kind) - 1;
+    bool truth;
+    if (vlCompare(op, (x > y) - (x < y), false, &truth)) {
+        vlSetBool(result, truth);
+        return true;
+    }
+
+    switch (op) {
+        case VL_OP_ADD: value = a + b; break;
+        case VL_OP_SUB: value = a - b; break;
+        case VL_OP_MUL: value = a * b; break;
+        case VL_OP_DIV:
+            if (y == 0) return false;
+            value = y == -1 ? 0 - a : (uint64_t) (x / y);
+            break;
+        case VL_OP_MOD:
+            if (y == 0) return false;
+            value = y == -1 ? 0 : (uint64_t) (x % y);
+            break;
+        case VL_OP_EXP:
+            if (y < 0) return false;
+            for (value = 1; b; b >>= 1, a *= a) {
+                if (b & 1) value *= a;
+            }
+            break;
+        case VL_OP_AND: value = a & b; break;
+        case VL_OP_XOR: value = a ^ b; break;
+        case VL_OP_OR: value = a | b; break;
+        case VL_OP_LSHIFT: value = a << (b & mask); break;
+        case VL_OP_RSHIFT: value = (uint64_t) (x >> (b & mask)); break;
+        default: return false;
+    }
+    vlSetInteger(result, kind, value);
+    return true;
+}
+
+
+// Float operands are exact in a double, and the basic operations rounded once more to float give
+// the same result as doing them in float
+static bool vlFoldFloating(VLOperation op, VLExprKind kind, VLDouble x, VLDouble y, VLExpression* result) {
+    VLDouble value;
+    bool truth;
+    if (vlCompare(op, (x > y) - (x < y), isunordered(x, y), &truth)) {
+        vlSetBool(result, truth);
+        return true;
+    }
+
+    switch (op) {
+        case VL_OP_ADD: value = x + y; break;
+        case VL_OP_SUB: value = x - y; break;
+        case VL_OP_MUL: value = x * y; break;
+        case VL_OP_DIV: value = x / y; break;
+        case VL_OP_MOD: value = fmod(x, y); break;
+        case VL_OP_EXP: value = pow(x, y); break;
+        default: return false;
+    }
+    vlSetFloating(result, kind, value);
+    return true;
+}
+
+
+static bool vlFoldBool(VLOperation op, bool x, bool y, VLExpression* result) {
+    switch (op) {
+        case VL_OP_AND:
+        case VL_OP_LAND: vlSetBool(result, x && y); return true;
+        case VL_OP_OR:
+        case VL_OP_LOR: vlSetBool(result, x || y); return true;
+        case VL_OP_XOR:
+        case VL_OP_LXOR:
+        case VL_OP_NEQ: vlSetBool(result, x != y); return true;
+        case VL_OP_EQ: vlSetBool(result, x == y); return true;
+        default: return false;
+    }
+}
+
+
+static bool vlFoldUnary(VLOperation op, VLExpression* operand) {
+    VLExprKind kind = operand->kind;
+    switch (op) {
+        case VL_OP_POS:
+            return kind >= VL_EXPR_BYTE && kind <= VL_EXPR_DOUBLE;
+        case VL_OP_NEG:
+            if (vlIsIntegral(kind)) {
+                vlSetInteger(operand, kind, 0 - (uint64_t) vlIntegerOf(operand));
+                return true;
+            }
+            if (kind == VL_EXPR_FLOAT || kind == VL_EXPR_DOUBLE) {
+                vlSetFloating(operand, kind, -vlFloatingOf(operand));
+                return true;
+            }
+            return false;
+        case VL_OP_NOT:
+            if (!vlIsIntegral(kind)) return false;
+            vlSetInteger(operand, kind, ~(uint64_t) vlIntegerOf(operand));
+            return true;
+        case VL_OP_LNOT:
+            if (kind != VL_EXPR_BOOL) return false;
+            operand->boolValue = !operand->boolValue;
+            return true;
+        default:
+            return false;
+    }
+}
+
+
+static bool vlFoldBinary(VLOperation op, VLExpression* first, VLExpression* second) {
+    VLExprKind kind;
+    if (op == VL_OP_LSHIFT || op == VL_OP_RSHIFT) {
+        // The shifted value keeps its own type; the count is taken modulo its width
+        if (!vlIsIntegral(first->kind) || !vlIsIntegral(second->kind)) return false;
+        return vlFoldInteger(op, first->kind, vlIntegerOf(first), vlIntegerOf(second), first);
+    }
+    if (vlPromoteKinds(first->kind, second->kind, &kind)) {
+        VLExpression left = *first, right = *second;
+        vlConvert(&left, kind);
+        vlConvert(&right, kind);
+        if (vlIsIntegral(kind)) return vlFoldInteger(op, kind, vlIntegerOf(&left), vlIntegerOf(&right), first);
+        return vlFoldFloating(op, kind, vlFloatingOf(&left), vlFloatingOf(&right), first);
+    }
+    if (first->kind == VL_EXPR_BOOL && second->kind == VL_EXPR_BOOL) {
+        return vlFoldBool(op, first->boolValue, second->boolValue, first);
+    }
+    if (first->kind == VL_EXPR_CHAR && second->kind == VL_EXPR_CHAR) {
+        unsigned char x = (unsigned char) first->charValue, y = (unsigned char) second->charValue;
+        bool truth;
+        if (!vlCompare(op, (x > y) - (x < y), false, &truth)) return false;
+        vlSetBool(first, truth);
+        return true;
+    }
+    return false;
+}
+
+
+// Counts the nodes under root, which may be nested far too deep to recurse over
+static size_t vlExprSize(VLParser* parser, VLExpression* root) {
+    size_t capacity = 64, count = 0, size = 0;
+    VLExpression** stack = malloc(capacity * sizeof(VLExpression*));
+    if (!stack) {
+        parser->status = VL_STATUS_OUT_OF_MEM;
+        return 0;
+    }
+    stack[count++] = root;
+    while (count) {
+        VLExpression* expr = stack[--count];
+        size_t children = vlExprChildCount(expr);
+        ++size;
+        if (count + children > capacity) {
+            while (count + children > capacity) capacity *= 2;
+            VLExpression** grown = realloc(stack, capacity * sizeof(VLExpression*));
+            if (!grown) {
+                parser->status = VL_STATUS_OUT_OF_MEM;
+                break;
+            }
+            stack = grown;
+        }
+        for (size_t i = 0; i < children; ++i) {
+            VLExpression* child = vlExprChild(expr, i);
+            if (child) stack[count++] = child;
+        }
+    }
+    free(stack);
+    return size;
+}
+
+
+// A conditional has the promoted type of its two branches, so dropping one is only exact when
+// both are literals whose kinds agree. Anything else waits for the checker, which has to see
+// both branches to report a mismatch between them.
+static VLExpression* vlFoldConditional(VLParser* parser, VLExpression** args) {
+    if (args[0]->kind != VL_EXPR_BOOL) return NULL;
+    VLExpression* chosen = args[0]->boolValue ? args[1] : args[2];
+    VLExpression* dropped = args[0]->boolValue ? args[2] : args[1];
+    if (!vlIsConstantExpr(chosen) || !vlIsConstantExpr(dropped)) return NULL;
+
+    VLExprKind kind;
+    if (vlPromoteKinds(chosen->kind, dropped->kind, &kind)) {
+        vlConvert(chosen, kind);
+    } else if (chosen->kind != dropped->kind) {
+        return NULL;
+    }
+    parser->folded += 2 + vlExprSize(parser, dropped);
+    return chosen;
+}
+
+
+// ---- FUNCTIONS ---- //
+
+bool vlPromoteKinds(VLExprKind first, VLExprKind second, VLExprKind* result) {
+    if (first < VL_EXPR_BYTE || first > VL_EXPR_DOUBLE || second < VL_EXPR_BYTE || second > VL_EXPR_DOUBLE) {
+        return false;
+    }
+    *result = first > second ? first : second;
+    return true;
+}
+
+
+bool vlIsConstantExpr(const VLExpression* expr) {
+    return expr->kind >= VL_EXPR_STR && expr->kind <= VL_EXPR_BOOL;
+}
+
+
+VLExpression* vlFoldOperation(VLParser* parser, VLOperation op, VLExpression** args, size_t pos) {
+    VLExpression* result = args[0];
+    size_t count = vlNumOperands(op);
+    if (count == 3) {
+        return op == VL_OP_COND ? vlFoldConditional(parser, args) : NULL;
+    }
+    if (!vlIsConstantExpr(args[0])) return NULL;
+
+    if (count == 1) {
+        if (!vlFoldUnary(op, args[0])) return NULL;
+    } else if ((op == VL_OP_LAND || op == VL_OP_LOR) && args[0]->kind == VL_EXPR_BOOL &&
+               args[0]->boolValue == (op == VL_OP_LOR)) {
+        // The second operand is never evaluated, so it doesn't need to be constant
+        parser->folded += 1 + vlExprSize(parser, args[1]);
+        return result;
+    } else if (!vlIsConstantExpr(args[1]) || !vlFoldBinary(op, args[0], args[1])) {
+        return NULL;
+    }
+
+    if (pos < result->pos) result->pos = pos;
+    parser->folded += count;
+    return result;
+}
+
+
+void vlFoldArrayInit(VLExpression** elements, size_t count) {
+    if (!count) return;
+    VLExprKind kind = elements[0]->kind;
+    for (size_t i = 0; i < count; ++i) {
+        if (!vlPromoteKinds(kind, elements[i]->kind, &kind)) return;
+    }
+    for (size_t i = 0; i < count; ++i) vlConvert(elements[i], kind);
+}
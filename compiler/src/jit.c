@@ -0,0 +1,741 @@
+/* ================
+ * src/jit.c
+ * VALLEY LANGUAGE COMPILER
+ * x86-64 JIT for functions over primitives and array reads
+ * ================
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "../include/jit.h"
+#include "../include/vm.h"
+#include "../include/stats.h"
+
+#ifdef VL_JIT_SUPPORTED
+#include <threads.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+
+// ---- HELPERS ---- //
+
+#ifdef VL_JIT_SUPPORTED
+
+// Emits its bytes, given as a list of constants
+#define VL_EMIT(a, ...) vlEmitBytes(a, (const uint8_t[]) {__VA_ARGS__}, sizeof((const uint8_t[]) {__VA_ARGS__}))
+
+// Where a jump goes: an instruction's index, or one of these
+#define VL_TARGET_EXIT SIZE_MAX
+
+// x86-64 general purpose registers, by encoding
+#define VL_RAX 0
+#define VL_RCX 1
+#define VL_RDX 2
+#define VL_RSI 6
+#define VL_RDI 7
+
+#define VL_CONTEXT_OFFSET(field) ((uint32_t) offsetof(VLJitContext, field))
+#define VL_ARRAY_OFFSET(field) ((uint32_t) offsetof(VLArrayObject, field))
+
+typedef struct VLPatch {
+    size_t pos;
+    size_t target;
+} VLPatch;
+
+// A stub at the end of each function records where an error happened and returns its code
+typedef struct VLStub {
+    size_t pos;
+    uint32_t at;
+    int code;
+} VLStub;
+
+// Registers live in the interpreter's stack, addressed from rbx; r12 holds the context. Jumps
+// and calls are patched once everything they could go to has been placed.
+typedef struct VLAssembler {
+    uint8_t* data;
+    size_t size;
+    size_t capacity;
+    bool failed;
+    size_t* labels;
+    VLPatch* jumps;
+    size_t jumpCount;
+    size_t jumpCapacity;
+    VLStub* stubs;
+    size_t stubCount;
+    size_t stubCapacity;
+    VLPatch* calls;
+    size_t callCount;
+    size_t callCapacity;
+} VLAssembler;
+
+
+static bool vlGrowList(void** items, size_t* capacity, size_t count, size_t size) {
+    if (count < *capacity) return true;
+    size_t grown = *capacity ? *capacity * 2 : 16;
+    void* resized = realloc(*items, grown * size);
+    if (!resized) return false;
+    *items = resized;
+    *capacity = grown;
+    return true;
+}
+
+
+static void vlEmitBytes(VLAssembler* a, const uint8_t* bytes, size_t count) {
+    if (!vlGrowList((void**) &a->data, &a->capacity, a->size + count, 1)) {
+        a->failed = true;
+        return;
+    }
+    memcpy(a->data + a->size, bytes, count);
+    a->size += count;
+}
+
+
+static void vlEmit32(VLAssembler* a, uint32_t value) {
+    VL_EMIT(a, (uint8_t) value, (uint8_t) (value >> 8), (uint8_t) (value >> 16), (uint8_t) (value >> 24));
+}
+
+
+static void vlEmit64(VLAssembler* a, uint64_t value) {
+    vlEmit32(a, (uint32_t) value);
+    vlEmit32(a, (uint32_t) (value >> 32));
+}
+
+
+static void vlPatch32(VLAssembler* a, size_t pos, uint32_t value) {
+    for (int i = 0; i < 4; ++i) a->data[pos + (size_t) i] = (uint8_t) (value >> (8 * i));
+}
+
+
+// Ends a jump or call with a 32-bit displacement to fill in later
+static void vlEmitJump(VLAssembler* a, size_t target) {
+    if (!vlGrowList((void**) &a->jumps, &a->jumpCapacity, a->jumpCount, sizeof(VLPatch))) {
+        a->failed = true;
+        return;
+    }
+    a->jumps[a->jumpCount++] = (VLPatch) {a->size, target};
+    vlEmit32(a, 0);
+}
+
+
+static void vlEmitStub(VLAssembler* a, uint32_t at, int code) {
+    if (!vlGrowList((void**) &a->stubs, &a->stubCapacity, a->stubCount, sizeof(VLStub))) {
+        a->failed = true;
+        return;
+    }
+    a->stubs[a->stubCount++] = (VLStub) {a->size, at, code};
+    vlEmit32(a, 0);
+}
+
+
+// mov reg, [rbx + 8 * index], and the same for stores and scalar doubles in xmm registers
+static void vlLoad(VLAssembler* a, int reg, uint32_t index) {
+    VL_EMIT(a, 0x48, 0x8B, (uint8_t) (0x83 | reg << 3));
+    vlEmit32(a, index * 8);
+}
+
+
+static void vlStore(VLAssembler* a, int reg, uint32_t index) {
+    VL_EMIT(a, 0x48, 0x89, (uint8_t) (0x83 | reg << 3));
+    vlEmit32(a, index * 8);
+}
+
+
+static void vlLoadDouble(VLAssembler* a, int xmm, uint32_t index) {
+    VL_EMIT(a, 0xF2, 0x0F, 0x10, (uint8_t) (0x83 | xmm << 3));
+    vlEmit32(a, index * 8);
+}
+
+
+static void vlStoreDouble(VLAssembler* a, int xmm, uint32_t index) {
+    VL_EMIT(a, 0xF2, 0x0F, 0x11, (uint8_t) (0x83 | xmm << 3));
+    vlEmit32(a, index * 8);
+}
+
+
+// movsxd rax, eax narrows a result back to int the way vlWrapInt does
+static void vlWrap(VLAssembler* a) {
+    VL_EMIT(a, 0x48, 0x63, 0xC0);
+}
+
+
+static void vlCallHelper(VLAssembler* a, const void* helper) {
+    VL_EMIT(a, 0x48, 0xB8);
+    vlEmit64(a, (uint64_t) (uintptr_t) helper);
+    VL_EMIT(a, 0xFF, 0xD0);
+}
+
+
+// Helpers for what would take too long to spell out in machine code, matching src/vm.c
+static VLLong vlJitTruncateInt(VLDouble value) {
+    if (isnan(value)) return 0;
+    if (value <= (VLDouble) INT32_MIN) return INT32_MIN;
+    if (value >= (VLDouble) INT32_MAX) return INT32_MAX;
+    return (VLLong) value;
+}
+
+
+static VLLong vlJitTruncateLong(VLDouble value) {
+    if (isnan(value)) return 0;
+    if (value <= (VLDouble) INT64_MIN) return INT64_MIN;
+    if (value >= (VLDouble) INT64_MAX) return INT64_MAX;
+    return (VLLong) value;
+}
+
+
+// Zero to a negative power is checked for before this is called
+static VLLong vlJitPower(VLLong x, VLLong y) {
+    if (y < 0) return x == 1 ? 1 : x == -1 ? (y & 1 ? -1 : 1) : 0;
+    uint64_t a = (uint64_t) x, b = (uint64_t) y, value = 1;
+    for (; b; b >>= 1, a *= a) {
+        if (b & 1) value *= a;
+    }
+    return (VLLong) value;
+}
+
+
+static bool vlIsPrimitive(VLType type) {
+    if (type.rank || type.base == VL_TYPE_FLOAT) return false;
+    VLRep rep = vlRep(type);
+    return rep == VL_REP_I || rep == VL_REP_L || rep == VL_REP_D;
+}
+
+
+// Whether fn takes primitives or arrays, returns a primitive and only uses instructions compiled
+// here. Arrays are only ever read, so a variadic function's pack is just another array parameter;
+// calls are checked separately, once it's known which callees qualify.
+static bool vlCanCompile(const VLFunction* fn) {
+    if (!fn->code || !fn->name.len || fn->native != VL_NO_NATIVE) return false;
+    if (!(vlIsPrimitive(fn->result) || fn->result.base == VL_TYPE_VOID)) return false;
+    for (size_t i = 0; i < fn->paramCount; ++i) {
+        if (!vlIsPrimitive(fn->params[i]) && !fn->params[i].rank) return false;
+    }
+    for (size_t at = 0; at < fn->codeCount; ++at) {
+        switch ((VLOpcode) VL_INS_OP(fn->code[at])) {
+            case VL_BC_MOVE: case VL_BC_LOADK: case VL_BC_LOADI:
+            case VL_BC_I2D: case VL_BC_L2I: case VL_BC_L2D: case VL_BC_D2I: case VL_BC_D2L:
+            case VL_BC_NARROWB: case VL_BC_NARROWS: case VL_BC_NARROWC:
+            case VL_BC_ADD_I: case VL_BC_ADD_L: case VL_BC_ADD_D:
+            case VL_BC_SUB_I: case VL_BC_SUB_L: case VL_BC_SUB_D:
+            case VL_BC_MUL_I: case VL_BC_MUL_L: case VL_BC_MUL_D:
+            case VL_BC_DIV_I: case VL_BC_DIV_L: case VL_BC_DIV_D:
+            case VL_BC_MOD_I: case VL_BC_MOD_L: case VL_BC_MOD_D:
+            case VL_BC_EXP_I: case VL_BC_EXP_L: case VL_BC_EXP_D:
+            case VL_BC_ADDI_I: case VL_BC_ADDI_L:
+            case VL_BC_NEG_I: case VL_BC_NEG_L: case VL_BC_NEG_D:
+            case VL_BC_NOT_I: case VL_BC_NOT_L: case VL_BC_LNOT:
+            case VL_BC_AND_I: case VL_BC_AND_L: case VL_BC_OR_I: case VL_BC_OR_L: case VL_BC_XOR_I: case VL_BC_XOR_L:
+            case VL_BC_SHL_I: case VL_BC_SHL_L: case VL_BC_SHR_I: case VL_BC_SHR_L:
+            case VL_BC_EQ_I: case VL_BC_EQ_L: case VL_BC_EQ_D:
+            case VL_BC_NE_I: case VL_BC_NE_L: case VL_BC_NE_D:
+            case VL_BC_LT_I: case VL_BC_LT_L: case VL_BC_LT_D:
+            case VL_BC_LE_I: case VL_BC_LE_L: case VL_BC_LE_D:
+            case VL_BC_JMP: case VL_BC_JT: case VL_BC_JF:
+            case VL_BC_GETG: case VL_BC_SETG:
+            case VL_BC_CALL: case VL_BC_RET: case VL_BC_RETV:
+            case VL_BC_LEN:
+            case VL_BC_AGET_I8: case VL_BC_AGET_U8: case VL_BC_AGET_I16: case VL_BC_AGET_I32:
+            case VL_BC_AGET_I64: case VL_BC_AGET_F64:
+                break;
+            case VL_BC_REDUCE:
+                // A float array folds into a float, which no register here holds
+                if (VL_REDUCE_ELEMENT(VL_INS_C(fn->code[at])) == VL_ELEM_F32) return false;
+                break;
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+
+// rax = [B] op [C] for the integer operations that map onto one instruction, given as its
+// encoding with rax as destination and rcx as source
+static void vlIntBinary(VLAssembler* a, uint32_t ins, const uint8_t* op, size_t length, bool wrap) {
+    vlLoad(a, VL_RAX, VL_INS_B(ins));
+    vlLoad(a, VL_RCX, VL_INS_C(ins));
+    vlEmitBytes(a, op, length);
+    if (wrap) vlWrap(a);
+    vlStore(a, VL_RAX, VL_INS_A(ins));
+}
+
+
+static void vlDoubleBinary(VLAssembler* a, uint32_t ins, uint8_t op) {
+    vlLoadDouble(a, 0, VL_INS_B(ins));
+    vlLoadDouble(a, 1, VL_INS_C(ins));
+    VL_EMIT(a, 0xF2, 0x0F, op, 0xC1);
+    vlStoreDouble(a, 0, VL_INS_A(ins));
+}
+
+
+static void vlIntCompare(VLAssembler* a, uint32_t ins, uint8_t setcc) {
+    vlLoad(a, VL_RAX, VL_INS_B(ins));
+    vlLoad(a, VL_RCX, VL_INS_C(ins));
+    VL_EMIT(a, 0x48, 0x39, 0xC8, 0x0F, setcc, 0xC0, 0x0F, 0xB6, 0xC0);
+    vlStore(a, VL_RAX, VL_INS_A(ins));
+}
+
+
+// ucomisd sets the parity flag for NaN, which every comparison but != has to treat as false.
+// Less-than compares the other way around so the carry flag alone decides.
+static void vlDoubleCompare(VLAssembler* a, uint32_t ins, VLOpcode op) {
+    vlLoadDouble(a, 0, VL_INS_B(ins));
+    vlLoadDouble(a, 1, VL_INS_C(ins));
+    switch (op) {
+        case VL_BC_EQ_D: VL_EMIT(a, 0x66, 0x0F, 0x2E, 0xC1, 0x0F, 0x94, 0xC0, 0x0F, 0x9B, 0xC1, 0x20, 0xC8); break;
+        case VL_BC_NE_D: VL_EMIT(a, 0x66, 0x0F, 0x2E, 0xC1, 0x0F, 0x95, 0xC0, 0x0F, 0x9A, 0xC1, 0x08, 0xC8); break;
+        case VL_BC_LT_D: VL_EMIT(a, 0x66, 0x0F, 0x2E, 0xC8, 0x0F, 0x97, 0xC0); break;
+        default: VL_EMIT(a, 0x66, 0x0F, 0x2E, 0xC8, 0x0F, 0x93, 0xC0); break;
+    }
+    VL_EMIT(a, 0x0F, 0xB6, 0xC0);
+    vlStore(a, VL_RAX, VL_INS_A(ins));
+}
+
+
+// Long division special-cases -1 so the lowest long doesn't trap; ints can't reach it
+static void vlDivide(VLAssembler* a, uint32_t ins, uint32_t at, bool modulo, bool wide) {
+    vlLoad(a, VL_RAX, VL_INS_B(ins));
+    vlLoad(a, VL_RCX, VL_INS_C(ins));
+    VL_EMIT(a, 0x48, 0x85, 0xC9, 0x0F, 0x84);
+    vlEmitStub(a, at, VL_JIT_DIVIDE);
+    if (wide && modulo) {
+        VL_EMIT(a, 0x48, 0x83, 0xF9, 0xFF, 0x75, 0x04, 0x31, 0xC0, 0xEB, 0x08);
+    } else if (wide) {
+        VL_EMIT(a, 0x48, 0x83, 0xF9, 0xFF, 0x75, 0x05, 0x48, 0xF7, 0xD8, 0xEB, 0x05);
+    }
+    VL_EMIT(a, 0x48, 0x99, 0x48, 0xF7, 0xF9);
+    if (modulo) VL_EMIT(a, 0x48, 0x89, 0xD0);
+    else if (!wide) vlWrap(a);
+    vlStore(a, VL_RAX, VL_INS_A(ins));
+}
+
+
+static void vlPower(VLAssembler* a, uint32_t ins, uint32_t at, bool wrap) {
+    VL_EMIT(a, 0x48, 0x8B, 0xBB);
+    vlEmit32(a, VL_INS_B(ins) * 8);
+    VL_EMIT(a, 0x48, 0x8B, 0xB3);
+    vlEmit32(a, VL_INS_C(ins) * 8);
+    VL_EMIT(a, 0x48, 0x85, 0xF6, 0x79, 0x09, 0x48, 0x85, 0xFF, 0x0F, 0x84);
+    vlEmitStub(a, at, VL_JIT_DIVIDE);
+    vlCallHelper(a, (const void*) vlJitPower);
+    if (wrap) vlWrap(a);
+    vlStore(a, VL_RAX, VL_INS_A(ins));
+}
+
+
+static void vlDoubleHelper(VLAssembler* a, uint32_t ins, const void* helper) {
+    vlLoadDouble(a, 0, VL_INS_B(ins));
+    vlLoadDouble(a, 1, VL_INS_C(ins));
+    vlCallHelper(a, helper);
+    vlStoreDouble(a, 0, VL_INS_A(ins));
+}
+
+
+// Leaves element [C] of the array in [B] in rax, extended by load the way the interpreter does. A
+// failed check goes to its stub with the array in rax and the index in rcx.
+static void vlArrayGet(VLAssembler* a, uint32_t ins, uint32_t at, const uint8_t* load, size_t length) {
+    vlLoad(a, VL_RAX, VL_INS_B(ins));
+    VL_EMIT(a, 0x48, 0x85, 0xC0, 0x0F, 0x84);
+    vlEmitStub(a, at, VL_JIT_NULL_INDEX);
+    vlLoad(a, VL_RCX, VL_INS_C(ins));
+    // An unsigned comparison, so negative indices fail it too
+    VL_EMIT(a, 0x48, 0x3B, 0x88);
+    vlEmit32(a, VL_ARRAY_OFFSET(length));
+    VL_EMIT(a, 0x0F, 0x83);
+    vlEmitStub(a, at, VL_JIT_BOUNDS);
+    VL_EMIT(a, 0x48, 0x8B, 0x90);
+    vlEmit32(a, VL_ARRAY_OFFSET(data));
+    vlEmitBytes(a, load, length);
+    vlStore(a, VL_RAX, VL_INS_A(ins));
+}
+
+
+// Calls into other compiled code count against the same frame limit and stack as the interpreter
+static void vlCall(VLAssembler* a, const VLProgram* program, uint32_t ins, uint32_t at) {
+    size_t index = VL_INS_BX(ins);
+    const VLFunction* callee = &program->functions[index];
+    VL_EMIT(a, 0x49, 0x83, 0xAC, 0x24);
+    vlEmit32(a, VL_CONTEXT_OFFSET(depth));
+    VL_EMIT(a, 0x01, 0x0F, 0x88);
+    vlEmitStub(a, at, VL_JIT_OVERFLOW);
+    VL_EMIT(a, 0x48, 0x8D, 0xBB);
+    vlEmit32(a, VL_INS_A(ins) * 8);
+    VL_EMIT(a, 0x48, 0x8D, 0x87);
+    vlEmit32(a, (uint32_t) callee->registerCount * 8);
+    VL_EMIT(a, 0x49, 0x3B, 0x84, 0x24);
+    vlEmit32(a, VL_CONTEXT_OFFSET(stackEnd));
+    VL_EMIT(a, 0x0F, 0x87);
+    vlEmitStub(a, at, VL_JIT_OVERFLOW);
+
+    VL_EMIT(a, 0x4C, 0x89, 0xE6, 0xE8);
+    if (!vlGrowList((void**) &a->calls, &a->callCapacity, a->callCount, sizeof(VLPatch))) a->failed = true;
+    else a->calls[a->callCount++] = (VLPatch) {a->size, index};
+    vlEmit32(a, 0);
+    VL_EMIT(a, 0x49, 0x83, 0x84, 0x24);
+    vlEmit32(a, VL_CONTEXT_OFFSET(depth));
+    VL_EMIT(a, 0x01, 0x85, 0xC0, 0x0F, 0x85);
+    vlEmitJump(a, VL_TARGET_EXIT);
+}
+
+
+static void vlInstruction(VLAssembler* a, const VLProgram* program, const VLFunction* fn, uint32_t at) {
+    uint32_t ins = fn->code[at];
+    VLOpcode op = (VLOpcode) VL_INS_OP(ins);
+    uint32_t dest = VL_INS_A(ins);
+    switch (op) {
+        case VL_BC_MOVE:
+            vlLoad(a, VL_RAX, VL_INS_B(ins));
+            vlStore(a, VL_RAX, dest);
+            break;
+        case VL_BC_LOADK:
+            VL_EMIT(a, 0x48, 0xB8);
+            vlEmit64(a, (uint64_t) fn->constants[VL_INS_BX(ins)].i);
+            vlStore(a, VL_RAX, dest);
+            break;
+        case VL_BC_LOADI:
+            VL_EMIT(a, 0x48, 0xC7, 0xC0);
+            vlEmit32(a, (uint32_t) VL_INS_SBX(ins));
+            vlStore(a, VL_RAX, dest);
+            break;
+
+        case VL_BC_I2D:
+        case VL_BC_L2D:
+            vlLoad(a, VL_RAX, VL_INS_B(ins));
+            VL_EMIT(a, 0xF2, 0x48, 0x0F, 0x2A, 0xC0);
+            vlStoreDouble(a, 0, dest);
+            break;
+        case VL_BC_D2I:
+        case VL_BC_D2L:
+            vlLoadDouble(a, 0, VL_INS_B(ins));
+            vlCallHelper(a, op == VL_BC_D2I ? (const void*) vlJitTruncateInt : (const void*) vlJitTruncateLong);
+            vlStore(a, VL_RAX, dest);
+            break;
+        case VL_BC_L2I:
+        case VL_BC_NARROWB:
+        case VL_BC_NARROWS:
+        case VL_BC_NARROWC:
+            vlLoad(a, VL_RAX, VL_INS_B(ins));
+            if (op == VL_BC_L2I) vlWrap(a);
+            else if (op == VL_BC_NARROWB) VL_EMIT(a, 0x48, 0x0F, 0xBE, 0xC0);
+            else if (op == VL_BC_NARROWS) VL_EMIT(a, 0x48, 0x0F, 0xBF, 0xC0);
+            else VL_EMIT(a, 0x0F, 0xB6, 0xC0);
+            vlStore(a, VL_RAX, dest);
+            break;
+
+        case VL_BC_ADD_I: vlIntBinary(a, ins, (const uint8_t[]) {0x48, 0x01, 0xC8}, 3, true); break;
+        case VL_BC_ADD_L: vlIntBinary(a, ins, (const uint8_t[]) {0x48, 0x01, 0xC8}, 3, false); break;
+        case VL_BC_SUB_I: vlIntBinary(a, ins, (const uint8_t[]) {0x48, 0x29, 0xC8}, 3, true); break;
+        case VL_BC_SUB_L: vlIntBinary(a, ins, (const uint8_t[]) {0x48, 0x29, 0xC8}, 3, false); break;
+        case VL_BC_MUL_I: vlIntBinary(a, ins, (const uint8_t[]) {0x48, 0x0F, 0xAF, 0xC1}, 4, true); break;
+        case VL_BC_MUL_L: vlIntBinary(a, ins, (const uint8_t[]) {0x48, 0x0F, 0xAF, 0xC1}, 4, false); break;
+        case VL_BC_AND_I:
+        case VL_BC_AND_L: vlIntBinary(a, ins, (const uint8_t[]) {0x48, 0x21, 0xC8}, 3, false); break;
+        case VL_BC_OR_I:
+        case VL_BC_OR_L: vlIntBinary(a, ins, (const uint8_t[]) {0x48, 0x09, 0xC8}, 3, false); break;
+        case VL_BC_XOR_I:
+        case VL_BC_XOR_L: vlIntBinary(a, ins, (const uint8_t[]) {0x48, 0x31, 0xC8}, 3, false); break;
+        case VL_BC_SHL_I: vlIntBinary(a, ins, (const uint8_t[]) {0x83, 0xE1, 0x1F, 0x48, 0xD3, 0xE0}, 6, true); break;
+        case VL_BC_SHL_L: vlIntBinary(a, ins, (const uint8_t[]) {0x48, 0xD3, 0xE0}, 3, false); break;
+        case VL_BC_SHR_I: vlIntBinary(a, ins, (const uint8_t[]) {0x83, 0xE1, 0x1F, 0x48, 0xD3, 0xF8}, 6, false); break;
+        case VL_BC_SHR_L: vlIntBinary(a, ins, (const uint8_t[]) {0x48, 0xD3, 0xF8}, 3, false); break;
+
+        case VL_BC_ADD_D: vlDoubleBinary(a, ins, 0x58); break;
+        case VL_BC_SUB_D: vlDoubleBinary(a, ins, 0x5C); break;
+        case VL_BC_MUL_D: vlDoubleBinary(a, ins, 0x59); break;
+        case VL_BC_DIV_D: vlDoubleBinary(a, ins, 0x5E); break;
+        case VL_BC_MOD_D: vlDoubleHelper(a, ins, (const void*) fmod); break;
+        case VL_BC_EXP_D: vlDoubleHelper(a, ins, (const void*) pow); break;
+
+        case VL_BC_DIV_I: vlDivide(a, ins, at, false, false); break;
+        case VL_BC_DIV_L: vlDivide(a, ins, at, false, true); break;
+        case VL_BC_MOD_I: vlDivide(a, ins, at, true, false); break;
+        case VL_BC_MOD_L: vlDivide(a, ins, at, true, true); break;
+        case VL_BC_EXP_I: vlPower(a, ins, at, true); break;
+        case VL_BC_EXP_L: vlPower(a, ins, at, false); break;
+
+        case VL_BC_ADDI_I:
+        case VL_BC_ADDI_L:
+            vlLoad(a, VL_RAX, VL_INS_B(ins));
+            VL_EMIT(a, 0x48, 0x05);
+            vlEmit32(a, (uint32_t) (int32_t) VL_INS_SC(ins));
+            if (op == VL_BC_ADDI_I) vlWrap(a);
+            vlStore(a, VL_RAX, dest);
+            break;
+        case VL_BC_NEG_I:
+        case VL_BC_NEG_L:
+        case VL_BC_NEG_D:
+        case VL_BC_NOT_I:
+        case VL_BC_NOT_L:
+        case VL_BC_LNOT:
+            vlLoad(a, VL_RAX, VL_INS_B(ins));
+            if (op == VL_BC_NEG_D) VL_EMIT(a, 0x48, 0x0F, 0xBA, 0xF8, 0x3F);
+            else if (op == VL_BC_NEG_I || op == VL_BC_NEG_L) VL_EMIT(a, 0x48, 0xF7, 0xD8);
+            else if (op == VL_BC_LNOT) VL_EMIT(a, 0x48, 0x85, 0xC0, 0x0F, 0x94, 0xC0, 0x0F, 0xB6, 0xC0);
+            else VL_EMIT(a, 0x48, 0xF7, 0xD0);
+            if (op == VL_BC_NEG_I) vlWrap(a);
+            vlStore(a, VL_RAX, dest);
+            break;
+
+        case VL_BC_EQ_I:
+        case VL_BC_EQ_L: vlIntCompare(a, ins, 0x94); break;
+        case VL_BC_NE_I:
+        case VL_BC_NE_L: vlIntCompare(a, ins, 0x95); break;
+        case VL_BC_LT_I:
+        case VL_BC_LT_L: vlIntCompare(a, ins, 0x9C); break;
+        case VL_BC_LE_I:
+        case VL_BC_LE_L: vlIntCompare(a, ins, 0x9E); break;
+        case VL_BC_EQ_D:
+        case VL_BC_NE_D:
+        case VL_BC_LT_D:
+        case VL_BC_LE_D: vlDoubleCompare(a, ins, op); break;
+
+        case VL_BC_JMP:
+            VL_EMIT(a, 0xE9);
+            vlEmitJump(a, at + 1 + (size_t) (ptrdiff_t) VL_INS_SAX(ins));
+            break;
+        case VL_BC_JT:
+        case VL_BC_JF:
+            vlLoad(a, VL_RAX, dest);
+            VL_EMIT(a, 0x48, 0x85, 0xC0, 0x0F, op == VL_BC_JT ? 0x85 : 0x84);
+            vlEmitJump(a, at + 1 + (size_t) (ptrdiff_t) VL_INS_SBX(ins));
+            break;
+
+        case VL_BC_GETG:
+            VL_EMIT(a, 0x49, 0x8B, 0x84, 0x24);
+            vlEmit32(a, VL_CONTEXT_OFFSET(globals));
+            VL_EMIT(a, 0x48, 0x8B, 0x80);
+            vlEmit32(a, VL_INS_BX(ins) * 8);
+            vlStore(a, VL_RAX, dest);
+            break;
+        case VL_BC_SETG:
+            VL_EMIT(a, 0x49, 0x8B, 0x8C, 0x24);
+            vlEmit32(a, VL_CONTEXT_OFFSET(globals));
+            vlLoad(a, VL_RAX, dest);
+            VL_EMIT(a, 0x48, 0x89, 0x81);
+            vlEmit32(a, VL_INS_BX(ins) * 8);
+            break;
+
+        case VL_BC_LEN:
+            vlLoad(a, VL_RAX, VL_INS_B(ins));
+            VL_EMIT(a, 0x48, 0x85, 0xC0, 0x0F, 0x84);
+            vlEmitStub(a, at, VL_JIT_NULL_LENGTH);
+            VL_EMIT(a, 0x48, 0x8B, 0x80);
+            vlEmit32(a, VL_ARRAY_OFFSET(length));
+            vlStore(a, VL_RAX, dest);
+            break;
+        case VL_BC_AGET_I8: vlArrayGet(a, ins, at, (const uint8_t[]) {0x48, 0x0F, 0xBE, 0x04, 0x0A}, 5); break;
+        case VL_BC_AGET_U8: vlArrayGet(a, ins, at, (const uint8_t[]) {0x48, 0x0F, 0xB6, 0x04, 0x0A}, 5); break;
+        case VL_BC_AGET_I16: vlArrayGet(a, ins, at, (const uint8_t[]) {0x48, 0x0F, 0xBF, 0x04, 0x4A}, 5); break;
+        case VL_BC_AGET_I32: vlArrayGet(a, ins, at, (const uint8_t[]) {0x48, 0x63, 0x04, 0x8A}, 4); break;
+        case VL_BC_AGET_I64:
+        case VL_BC_AGET_F64: vlArrayGet(a, ins, at, (const uint8_t[]) {0x48, 0x8B, 0x04, 0xCA}, 4); break;
+        case VL_BC_REDUCE:
+            VL_EMIT(a, 0x48, 0x8B, 0xBB);
+            vlEmit32(a, VL_INS_B(ins) * 8);
+            VL_EMIT(a, 0x48, 0x85, 0xFF, 0x0F, 0x84);
+            vlEmitStub(a, at, VL_JIT_NULL_LENGTH);
+            VL_EMIT(a, 0x48, 0x8B, 0xB3);
+            vlEmit32(a, dest * 8);
+            VL_EMIT(a, 0xBA);
+            vlEmit32(a, VL_INS_C(ins));
+            vlCallHelper(a, (const void*) vlReduceArray);
+            vlStore(a, VL_RAX, dest);
+            break;
+
+        case VL_BC_CALL: vlCall(a, program, ins, at); break;
+        case VL_BC_RET:
+            vlLoad(a, VL_RAX, dest);
+            vlStore(a, VL_RAX, 0);
+            [[fallthrough]];
+        default:
+            VL_EMIT(a, 0x31, 0xC0, 0xE9);
+            vlEmitJump(a, VL_TARGET_EXIT);
+            break;
+    }
+}
+
+
+// Keeps rbx, r12 and r13 across the body, the last only so calls out see an aligned stack
+static void vlFunction(VLAssembler* a, const VLProgram* program, const VLFunction* fn, uint32_t index) {
+    a->jumpCount = a->stubCount = 0;
+    VL_EMIT(a, 0x53, 0x41, 0x54, 0x41, 0x55, 0x48, 0x89, 0xFB, 0x49, 0x89, 0xF4);
+    for (uint32_t at = 0; at < fn->codeCount && !a->failed; ++at) {
+        a->labels[at] = a->size;
+        vlInstruction(a, program, fn, at);
+    }
+    size_t exit = a->size;
+    a->labels[fn->codeCount] = exit;
+    VL_EMIT(a, 0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3);
+    for (size_t i = 0; i < a->stubCount && !a->failed; ++i) {
+        const VLStub* stub = &a->stubs[i];
+        vlPatch32(a, stub->pos, (uint32_t) (a->size - (stub->pos + 4)));
+        if (stub->code == VL_JIT_BOUNDS) {
+            VL_EMIT(a, 0x49, 0x89, 0x8C, 0x24);
+            vlEmit32(a, VL_CONTEXT_OFFSET(index));
+            VL_EMIT(a, 0x48, 0x8B, 0x90);
+            vlEmit32(a, VL_ARRAY_OFFSET(length));
+            VL_EMIT(a, 0x49, 0x89, 0x94, 0x24);
+            vlEmit32(a, VL_CONTEXT_OFFSET(length));
+        }
+        VL_EMIT(a, 0x41, 0xC7, 0x84, 0x24);
+        vlEmit32(a, VL_CONTEXT_OFFSET(at));
+        vlEmit32(a, stub->at);
+        VL_EMIT(a, 0x41, 0xC7, 0x84, 0x24);
+        vlEmit32(a, VL_CONTEXT_OFFSET(function));
+        vlEmit32(a, index);
+        VL_EMIT(a, 0xB8);
+        vlEmit32(a, (uint32_t) stub->code);
+        VL_EMIT(a, 0xE9);
+        vlEmit32(a, (uint32_t) (exit - (a->size + 4)));
+    }
+    for (size_t i = 0; i < a->jumpCount && !a->failed; ++i) {
+        const VLPatch* jump = &a->jumps[i];
+        size_t target = jump->target == VL_TARGET_EXIT ? exit : a->labels[jump->target];
+        vlPatch32(a, jump->pos, (uint32_t) (target - (jump->pos + 4)));
+    }
+}
+
+
+static once_flag vlPerfMapOnce = ONCE_FLAG_INIT;
+static mtx_t vlPerfMapLock;
+static bool vlPerfMapStarted;
+
+
+static void vlInitPerfMapLock(void) {
+    mtx_init(&vlPerfMapLock, mtx_plain);
+}
+
+
+// Lists each compiled function the way perf expects of a JIT, as "start size name" in hex. The
+// first JIT in the process truncates whatever an earlier process with the same pid left behind;
+// later ones, possibly on other threads, append.
+static void vlWritePerfMap(const VLJit* jit, const VLProgram* program, const size_t* starts) {
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/perf-%ld.map", (long) getpid());
+    call_once(&vlPerfMapOnce, vlInitPerfMapLock);
+    mtx_lock(&vlPerfMapLock);
+    FILE* map = fopen(path, vlPerfMapStarted ? "a" : "w");
+    if (!map) {
+        mtx_unlock(&vlPerfMapLock);
+        return;
+    }
+    vlPerfMapStarted = true;
+    for (size_t i = 0; i < program->functionCount; ++i) {
+        if (!jit->entries[i]) continue;
+        size_t end = jit->size;
+        for (size_t next = i + 1; next < program->functionCount; ++next) {
+            if (!jit->entries[next]) continue;
+            end = starts[next];
+            break;
+        }
+        const VLFunction* fn = &program->functions[i];
+        fprintf(map, "%lx %zx valley:%.*s\n", (unsigned long) (uintptr_t) (jit->code + starts[i]), end - starts[i],
+                (int) fn->name.len, fn->name.first);
+    }
+    fclose(map);
+    mtx_unlock(&vlPerfMapLock);
+}
+
+#endif /* VL_JIT_SUPPORTED */
+
+
+// ---- FUNCTIONS ---- //
+
+bool vlInitJit(VLJit* jit, const VLProgram* program) {
+    memset(jit, 0, sizeof(VLJit));
+    jit->entries = calloc(program->functionCount ? program->functionCount : 1, sizeof(VLJitEntry));
+    if (!jit->entries) return false;
+
+#ifdef VL_JIT_SUPPORTED
+    double start = vlStatsClock();
+    size_t count = program->functionCount;
+    bool* eligible = calloc(count ? count : 1, sizeof(bool));
+    size_t* starts = calloc(count ? count : 1, sizeof(size_t));
+    size_t longest = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (program->functions[i].codeCount > longest) longest = program->functions[i].codeCount;
+    }
+    VLAssembler a = {.labels = malloc((longest + 1) * sizeof(size_t))};
+    bool ok = eligible && starts && a.labels;
+
+    // A function calling one that can't be compiled has to stay in the interpreter too
+    for (size_t i = 0; ok && i < count; ++i) eligible[i] = vlCanCompile(&program->functions[i]);
+    for (bool changed = ok; changed;) {
+        changed = false;
+        for (size_t i = 0; i < count; ++i) {
+            const VLFunction* fn = &program->functions[i];
+            for (size_t at = 0; eligible[i] && at < fn->codeCount; ++at) {
+                uint32_t ins = fn->code[at];
+                if (VL_INS_OP(ins) != VL_BC_CALL || eligible[VL_INS_BX(ins)]) continue;
+                eligible[i] = false;
+                changed = true;
+            }
+        }
+    }
+
+    for (size_t i = 0; ok && i < count; ++i) {
+        if (!eligible[i]) continue;
+        starts[i] = a.size;
+        vlFunction(&a, program, &program->functions[i], (uint32_t) i);
+        ++jit->compiled;
+    }
+    for (size_t i = 0; ok && !a.failed && i < a.callCount; ++i) {
+        const VLPatch* call = &a.calls[i];
+        vlPatch32(&a, call->pos, (uint32_t) (starts[call->target] - (call->pos + 4)));
+    }
+    ok = ok && !a.failed;
+
+    // Written while only writable, then switched to only executable
+    if (ok && a.size) {
+        size_t page = (size_t) sysconf(_SC_PAGESIZE);
+        size_t size = (a.size + page - 1) / page * page;
+        void* code = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (code == MAP_FAILED) {
+            ok = false;
+        } else {
+            memcpy(code, a.data, a.size);
+            if (mprotect(code, size, PROT_READ | PROT_EXEC)) {
+                munmap(code, size);
+                ok = false;
+            } else {
+                jit->code = code;
+                jit->size = a.size;
+            }
+        }
+    }
+    for (size_t i = 0; ok && jit->code && i < count; ++i) {
+        if (eligible[i]) jit->entries[i] = (VLJitEntry) (void*) (jit->code + starts[i]);
+    }
+    if (ok && jit->code) vlWritePerfMap(jit, program, starts);
+    jit->seconds = vlStatsClock() - start;
+
+    free(a.data);
+    free(a.labels);
+    free(a.jumps);
+    free(a.stubs);
+    free(a.calls);
+    free(eligible);
+    free(starts);
+    if (!ok) {
+        vlFreeJit(jit);
+        return false;
+    }
+#else
+    (void) program;
+#endif
+    return true;
+}
+
+
+void vlFreeJit(VLJit* jit) {
+#ifdef VL_JIT_SUPPORTED
+    if (jit->code) {
+        size_t page = (size_t) sysconf(_SC_PAGESIZE);
+        munmap(jit->code, (jit->size + page - 1) / page * page);
+    }
+#endif
+    free(jit->entries);
+    memset(jit, 0, sizeof(VLJit));
+}
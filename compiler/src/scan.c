@@ -0,0 +1,297 @@
+/* ================
+ * src/scan.c
+ * VALLEY LANGUAGE COMPILER
+ * Character classes and bulk scanning kernels
+ * ================
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define VL_SCAN_X86 1
+#endif
+
+#include "../include/valley.h"
+
+
+// ---- CHARACTER CLASSES ---- //
+
+#define VL_CC_RANGE(first, last, cls) [first ... last] = cls
+
+// Matches the "C" locale ctype classification, but never consults the current locale
+const uint8_t vlCharClass[256] = {
+    ['\t'] = VL_CC_SPACE | VL_CC_BLANK,
+    VL_CC_RANGE('\n', '\r', VL_CC_SPACE),
+    [' '] = VL_CC_SPACE | VL_CC_BLANK,
+    VL_CC_RANGE('!', '/', VL_CC_PUNCT),
+    VL_CC_RANGE('0', '9', VL_CC_DIGIT),
+    VL_CC_RANGE(':', '@', VL_CC_PUNCT),
+    VL_CC_RANGE('A', 'Z', VL_CC_ALPHA),
+    VL_CC_RANGE('[', '^', VL_CC_PUNCT),
+    ['_'] = VL_CC_PUNCT | VL_CC_UNDERSCORE,
+    ['`'] = VL_CC_PUNCT,
+    VL_CC_RANGE('a', 'z', VL_CC_ALPHA),
+    VL_CC_RANGE('{', '~', VL_CC_PUNCT),
+};
+
+
+// ---- SCALAR KERNELS ---- //
+
+static const char* vlSkipSpaceScalar(const char* p, const char* end) {
+    while (p < end && VL_IS_SPACE(*p)) ++p;
+    return p;
+}
+
+
+static const char* vlSkipNameScalar(const char* p, const char* end) {
+    while (p < end && VL_IS_NAME(*p)) ++p;
+    return p;
+}
+
+
+static const char* vlFindLineStopScalar(const char* p, const char* end) {
+    while (p < end && *p != '\n' && *p != '\\') ++p;
+    return p;
+}
+
+
+static const char* vlFindStringStopScalar(const char* p, const char* end) {
+    while (p < end && *p != '"' && *p != '\\' && *p != '\n' && *p != '\r' && *p != '\t') ++p;
+    return p;
+}
+
+
+static const char* vlFindBlockEndScalar(const char* p, const char* end) {
+    while (end - p >= 2) {
+        if (p[0] == '*' && p[1] == '/') return p + 2;
+        ++p;
+    }
+    return end;
+}
+
+
+static const VLScanner vlScalarScanner = {
+    .name = "scalar",
+    .skipSpace = vlSkipSpaceScalar,
+    .skipName = vlSkipNameScalar,
+    .findLineStop = vlFindLineStopScalar,
+    .findStringStop = vlFindStringStopScalar,
+    .findBlockEnd = vlFindBlockEndScalar,
+};
+
+
+#ifdef VL_SCAN_X86
+
+// ---- SSE2 KERNELS ---- //
+
+// Each kernel builds a mask of the bytes it wants to stop at, then hands the tail to the scalar version
+
+static inline __m128i vlSpaceMask128(__m128i bytes) {
+    // '\t' through '\r' are the five bytes whose distance from '\t' is at most 4
+    __m128i control = _mm_subs_epu8(_mm_sub_epi8(bytes, _mm_set1_epi8('\t')), _mm_set1_epi8(4));
+    return _mm_or_si128(_mm_cmpeq_epi8(control, _mm_setzero_si128()), _mm_cmpeq_epi8(bytes, _mm_set1_epi8(' ')));
+}
+
+
+static inline __m128i vlNameMask128(__m128i bytes) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i lower = _mm_sub_epi8(_mm_or_si128(bytes, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+    __m128i alpha = _mm_cmpeq_epi8(_mm_subs_epu8(lower, _mm_set1_epi8(25)), zero);
+    __m128i digit = _mm_cmpeq_epi8(_mm_subs_epu8(_mm_sub_epi8(bytes, _mm_set1_epi8('0')), _mm_set1_epi8(9)), zero);
+    __m128i under = _mm_cmpeq_epi8(bytes, _mm_set1_epi8('_'));
+    return _mm_or_si128(_mm_or_si128(alpha, digit), under);
+}
+
+
+static const char* vlSkipSpaceSSE2(const char* p, const char* end) {
+    while (end - p >= 16) {
+        unsigned mask = ~_mm_movemask_epi8(vlSpaceMask128(_mm_loadu_si128((const __m128i*) p))) & 0xFFFF;
+        if (mask) return p + __builtin_ctz(mask);
+        p += 16;
+    }
+    return vlSkipSpaceScalar(p, end);
+}
+
+
+static const char* vlSkipNameSSE2(const char* p, const char* end) {
+    while (end - p >= 16) {
+        unsigned mask = ~_mm_movemask_epi8(vlNameMask128(_mm_loadu_si128((const __m128i*) p))) & 0xFFFF;
+        if (mask) return p + __builtin_ctz(mask);
+        p += 16;
+    }
+    return vlSkipNameScalar(p, end);
+}
+
+
+static const char* vlFindLineStopSSE2(const char* p, const char* end) {
+    while (end - p >= 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i*) p);
+        __m128i stops = _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n')),
+                                     _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\\')));
+        unsigned mask = _mm_movemask_epi8(stops);
+        if (mask) return p + __builtin_ctz(mask);
+        p += 16;
+    }
+    return vlFindLineStopScalar(p, end);
+}
+
+
+static const char* vlFindStringStopSSE2(const char* p, const char* end) {
+    while (end - p >= 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i*) p);
+        __m128i quote = _mm_cmpeq_epi8(bytes, _mm_set1_epi8('"'));
+        __m128i escape = _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\\'));
+        // '\t', '\n' and '\r' all end a string; '\v' and '\f' between them don't, so they're compared one by one
+        __m128i tab = _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\t'));
+        __m128i newline = _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n')),
+                                       _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\r')));
+        __m128i stops = _mm_or_si128(_mm_or_si128(quote, escape), _mm_or_si128(tab, newline));
+        unsigned mask = _mm_movemask_epi8(stops);
+        if (mask) return p + __builtin_ctz(mask);
+        p += 16;
+    }
+    return vlFindStringStopScalar(p, end);
+}
+
+
+static const char* vlFindBlockEndSSE2(const char* p, const char* end) {
+    // Compare each byte and its successor at once, so 17 bytes must be readable
+    while (end - p >= 17) {
+        __m128i first = _mm_loadu_si128((const __m128i*) p);
+        __m128i second = _mm_loadu_si128((const __m128i*) (p + 1));
+        __m128i close = _mm_and_si128(_mm_cmpeq_epi8(first, _mm_set1_epi8('*')),
+                                      _mm_cmpeq_epi8(second, _mm_set1_epi8('/')));
+        unsigned mask = _mm_movemask_epi8(close);
+        if (mask) return p + __builtin_ctz(mask) + 2;
+        p += 16;
+    }
+    return vlFindBlockEndScalar(p, end);
+}
+
+
+static const VLScanner vlSSE2Scanner = {
+    .name = "sse2",
+    .skipSpace = vlSkipSpaceSSE2,
+    .skipName = vlSkipNameSSE2,
+    .findLineStop = vlFindLineStopSSE2,
+    .findStringStop = vlFindStringStopSSE2,
+    .findBlockEnd = vlFindBlockEndSSE2,
+};
+
+
+// ---- AVX2 KERNELS ---- //
+
+#define VL_AVX2 __attribute__((target("avx2")))
+
+VL_AVX2 static inline __m256i vlSpaceMask256(__m256i bytes) {
+    __m256i control = _mm256_subs_epu8(_mm256_sub_epi8(bytes, _mm256_set1_epi8('\t')), _mm256_set1_epi8(4));
+    return _mm256_or_si256(_mm256_cmpeq_epi8(control, _mm256_setzero_si256()),
+                           _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' ')));
+}
+
+
+VL_AVX2 static inline __m256i vlNameMask256(__m256i bytes) {
+    __m256i zero = _mm256_setzero_si256();
+    __m256i lower = _mm256_sub_epi8(_mm256_or_si256(bytes, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+    __m256i alpha = _mm256_cmpeq_epi8(_mm256_subs_epu8(lower, _mm256_set1_epi8(25)), zero);
+    __m256i digit = _mm256_cmpeq_epi8(_mm256_subs_epu8(_mm256_sub_epi8(bytes, _mm256_set1_epi8('0')),
+                                                       _mm256_set1_epi8(9)), zero);
+    __m256i under = _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('_'));
+    return _mm256_or_si256(_mm256_or_si256(alpha, digit), under);
+}
+
+
+VL_AVX2 static const char* vlSkipSpaceAVX2(const char* p, const char* end) {
+    while (end - p >= 32) {
+        uint32_t mask = ~(uint32_t) _mm256_movemask_epi8(vlSpaceMask256(_mm256_loadu_si256((const __m256i*) p)));
+        if (mask) return p + __builtin_ctz(mask);
+        p += 32;
+    }
+    return vlSkipSpaceSSE2(p, end);
+}
+
+
+VL_AVX2 static const char* vlSkipNameAVX2(const char* p, const char* end) {
+    while (end - p >= 32) {
+        uint32_t mask = ~(uint32_t) _mm256_movemask_epi8(vlNameMask256(_mm256_loadu_si256((const __m256i*) p)));
+        if (mask) return p + __builtin_ctz(mask);
+        p += 32;
+    }
+    return vlSkipNameSSE2(p, end);
+}
+
+
+VL_AVX2 static const char* vlFindLineStopAVX2(const char* p, const char* end) {
+    while (end - p >= 32) {
+        __m256i bytes = _mm256_loadu_si256((const __m256i*) p);
+        __m256i stops = _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\n')),
+                                        _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\\')));
+        uint32_t mask = (uint32_t) _mm256_movemask_epi8(stops);
+        if (mask) return p + __builtin_ctz(mask);
+        p += 32;
+    }
+    return vlFindLineStopSSE2(p, end);
+}
+
+
+VL_AVX2 static const char* vlFindStringStopAVX2(const char* p, const char* end) {
+    while (end - p >= 32) {
+        __m256i bytes = _mm256_loadu_si256((const __m256i*) p);
+        __m256i quote = _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('"'));
+        __m256i escape = _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\\'));
+        __m256i tab = _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\t'));
+        __m256i newline = _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\n')),
+                                          _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\r')));
+        __m256i stops = _mm256_or_si256(_mm256_or_si256(quote, escape), _mm256_or_si256(tab, newline));
+        uint32_t mask = (uint32_t) _mm256_movemask_epi8(stops);
+        if (mask) return p + __builtin_ctz(mask);
+        p += 32;
+    }
+    return vlFindStringStopSSE2(p, end);
+}
+
+
+VL_AVX2 static const char* vlFindBlockEndAVX2(const char* p, const char* end) {
+    while (end - p >= 33) {
+        __m256i first = _mm256_loadu_si256((const __m256i*) p);
+        __m256i second = _mm256_loadu_si256((const __m256i*) (p + 1));
+        __m256i close = _mm256_and_si256(_mm256_cmpeq_epi8(first, _mm256_set1_epi8('*')),
+                                         _mm256_cmpeq_epi8(second, _mm256_set1_epi8('/')));
+        uint32_t mask = (uint32_t) _mm256_movemask_epi8(close);
+        if (mask) return p + __builtin_ctz(mask) + 2;
+        p += 32;
+    }
+    return vlFindBlockEndSSE2(p, end);
+}
+
+
+static const VLScanner vlAVX2Scanner = {
+    .name = "avx2",
+    .skipSpace = vlSkipSpaceAVX2,
+    .skipName = vlSkipNameAVX2,
+    .findLineStop = vlFindLineStopAVX2,
+    .findStringStop = vlFindStringStopAVX2,
+    .findBlockEnd = vlFindBlockEndAVX2,
+};
+
+#endif /* VL_SCAN_X86 */
+
+
+// ---- FUNCTIONS ---- //
+
+const VLScanner* vlGetScanner(void) {
+    // VALLEY_SCAN=scalar|sse2|avx2 pins a specific kernel set, mostly for comparing their output
+    const char* forced = getenv("VALLEY_SCAN");
+
+#ifdef VL_SCAN_X86
+    if (forced && strcmp(forced, "sse2") == 0) return &vlSSE2Scanner;
+    if (forced && strcmp(forced, "scalar") == 0) return &vlScalarScanner;
+    if (__builtin_cpu_supports("avx2")) return &vlAVX2Scanner;
+    return &vlSSE2Scanner;
+#else
+    (void) forced;
+    return &vlScalarScanner;
+#endif
+}
@@ -0,0 +1,259 @@
+/* ================
+ * src/server.c
+ * VALLEY LANGUAGE COMPILER
+ * Persistent compile server and its client over a Unix socket
+ * ================
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "../include/server.h"
+#include "../include/cache.h"
+
+
+// ---- HELPERS ---- //
+
+static bool vlSocketAddress(struct sockaddr_un* address, const char* path) {
+    struct sockaddr_un init = {.sun_family = AF_UNIX};
+    *address = init;
+    if (strlen(path) >= sizeof(address->sun_path)) return false;
+    strcpy(address->sun_path, path);
+    return true;
+}
+
+
+static bool vlWriteAll(int fd, const char* data, size_t size) {
+    while (size) {
+        ssize_t written = write(fd, data, size);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+        data += written;
+        size -= (size_t) written;
+    }
+    return true;
+}
+
+
+// Reads until the other end closes, giving up past limit bytes; the result is NUL-terminated
+static char* vlReadAll(int fd, size_t limit, size_t* size) {
+    size_t capacity = 4096, used = 0;
+    char* data = malloc(capacity);
+    while (data) {
+        if (used + 1 == capacity) {
+            if (capacity > limit) break;
+            char* grown = realloc(data, capacity * 2);
+            if (!grown) break;
+            data = grown;
+            capacity *= 2;
+        }
+        ssize_t got = read(fd, data + used, capacity - used - 1);
+        if (got < 0 && errno == EINTR) continue;
+        if (got < 0) break;
+        if (got == 0) {
+            data[used] = '\0';
+            *size = used;
+            return data;
+        }
+        used += (size_t) got;
+    }
+    free(data);
+    return NULL;
+}
+
+
+// Runs one request against the warm cache, writing the reply body to out; returns the exit status
+static int vlHandleRequest(VLModuleCache* cache, const VLDriverOptions* defaults, char* request, FILE* out,
+                           bool* stop) {
+    VLDriverOptions options = *defaults;
+    options.cache = cache;
+    options.watch = false;
+
+    char* line = strtok(request, "\n");
+    if (!line || strcmp(line, VL_REQUEST_MAGIC)) {
+        fprintf(out, VL_ANSI_RED "Error: Malformed request." VL_ANSI_RESET "\n");
+        return 2;
+    }
+
+    VLBuild build;
+    vlInitBuild(&build, options);
+    int status = 0;
+    while ((line = strtok(NULL, "\n"))) {
+        if (!strncmp(line, "jobs ", 5)) {
+            build.options.jobs = strtoul(line + 5, NULL, 10);
+        } else if (!strcmp(line, "tokens")) {
+            build.options.dumpTokens = true;
+        } else if (!strcmp(line, "tree")) {
+            build.options.dumpTree = true;
+        } else if (!strcmp(line, "types")) {
+            build.options.dumpTypes = true;
+        } else if (!strcmp(line, "bytecode")) {
+            build.options.dumpBytecode = true;
+        } else if (!strcmp(line, "run")) {
+            build.options.run = true;
+        } else if (!strcmp(line, "jit")) {
+            build.options.jit = true;
+        } else if (!strcmp(line, "emit-c")) {
+            build.options.emitC = true;
+        } else if (!strcmp(line, "native")) {
+            build.options.native = true;
+        } else if (!strcmp(line, "strict-fp")) {
+            build.options.strictFloat = true;
+        } else if (!strcmp(line, "shutdown")) {
+            *stop = true;
+        } else if (!strncmp(line, "input ", 6)) {
+            if (!vlAddInput(&build, line + 6)) {
+                fprintf(out, VL_ANSI_RED "Error: Unable to read '%s'." VL_ANSI_RESET "\n", line + 6);
+                status = 1;
+            }
+        }
+    }
+
+    // Only trimmed between builds, since a running build may still be printing any cached tree
+    vlTrimCache(cache);
+    size_t hits = cache->hits, misses = cache->misses;
+    if (build.count && !vlRunBuild(&build)) {
+        fprintf(out, VL_ANSI_RED "Error: Ran out of available memory." VL_ANSI_RESET "\n");
+        status = 1;
+    } else if (!vlWriteUnits(&build, out)) {
+        status = 1;
+    }
+
+    fprintf(out, "Server: %zu files, %zu cached, %zu parsed; %zu modules (%zu bytes) resident\n", build.count,
+            cache->hits - hits, cache->misses - misses, cache->count, cache->bytes);
+    vlFreeBuild(&build);
+    return status;
+}
+
+
+// ---- FUNCTIONS ---- //
+
+bool vlServe(const char* socketPath, const VLDriverOptions* defaults, FILE* log) {
+    struct sockaddr_un address;
+    if (!vlSocketAddress(&address, socketPath)) {
+        fprintf(log, VL_ANSI_RED "Error: Socket path '%s' is too long." VL_ANSI_RESET "\n", socketPath);
+        return false;
+    }
+
+    // Clear out a socket left behind by a server that didn't shut down cleanly, but nothing else
+    struct stat info;
+    if (lstat(socketPath, &info) == 0 && S_ISSOCK(info.st_mode)) unlink(socketPath);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener < 0 || bind(listener, (struct sockaddr*) &address, sizeof(address)) < 0 || listen(listener, 16) < 0) {
+        fprintf(log, VL_ANSI_RED "Error: Unable to listen on '%s'." VL_ANSI_RESET "\n", socketPath);
+        if (listener >= 0) close(listener);
+        return false;
+    }
+
+    VLModuleCache cache;
+    if (!vlInitCache(&cache, VL_CACHE_DEFAULT_BYTES)) {
+        close(listener);
+        unlink(socketPath);
+        return false;
+    }
+
+    // A client that hangs up early must not take the server down with it
+    signal(SIGPIPE, SIG_IGN);
+    fprintf(log, "Listening on %s\n", socketPath);
+    fflush(log);
+
+    bool stop = false;
+    while (!stop) {
+        int client = accept(listener, NULL, NULL);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            break;
+        }
+
+        size_t size;
+        char* request = vlReadAll(client, VL_MAX_REQUEST_BYTES, &size);
+        char* body = NULL;
+        size_t bodySize = 0;
+        FILE* out = open_memstream(&body, &bodySize);
+        int status = 2;
+        if (request && out) {
+            status = vlHandleRequest(&cache, defaults, request, out, &stop);
+        } else if (out) {
+            fprintf(out, VL_ANSI_RED "Error: Unable to read request." VL_ANSI_RESET "\n");
+        }
+        if (out) fclose(out);
+
+        char header[16];
+        int headerSize = snprintf(header, sizeof(header), "%d\n", status);
+        if (vlWriteAll(client, header, (size_t) headerSize) && body) vlWriteAll(client, body, bodySize);
+        close(client);
+
+        fprintf(log, "Request: status %d, %zu modules resident\n", status, cache.count);
+        fflush(log);
+        free(request);
+        free(body);
+    }
+
+    vlFreeCache(&cache);
+    close(listener);
+    unlink(socketPath);
+    return true;
+}
+
+
+int vlRequest(const char* socketPath, const VLDriverOptions* options, const char** inputs, size_t inputCount,
+              bool stop, FILE* out) {
+    struct sockaddr_un address;
+    int fd = vlSocketAddress(&address, socketPath) ? socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0) : -1;
+    if (fd < 0 || connect(fd, (struct sockaddr*) &address, sizeof(address)) < 0) {
+        fprintf(out, VL_ANSI_RED "Error: No server listening on '%s'." VL_ANSI_RESET "\n", socketPath);
+        if (fd >= 0) close(fd);
+        return 1;
+    }
+
+    char* request = NULL;
+    size_t requestSize = 0;
+    FILE* stream = open_memstream(&request, &requestSize);
+    if (!stream) {
+        close(fd);
+        return 1;
+    }
+    fprintf(stream, "%s\n", VL_REQUEST_MAGIC);
+    if (options->jobs) fprintf(stream, "jobs %zu\n", options->jobs);
+    if (options->dumpTokens) fprintf(stream, "tokens\n");
+    if (options->dumpTree) fprintf(stream, "tree\n");
+    if (options->dumpTypes) fprintf(stream, "types\n");
+    if (options->dumpBytecode) fprintf(stream, "bytecode\n");
+    if (options->run) fprintf(stream, "run\n");
+    if (options->jit) fprintf(stream, "jit\n");
+    if (options->emitC) fprintf(stream, "emit-c\n");
+    if (options->native) fprintf(stream, "native\n");
+    if (options->strictFloat) fprintf(stream, "strict-fp\n");
+    if (stop) fprintf(stream, "shutdown\n");
+
+    // The server has its own working directory, so send absolute paths whenever they resolve
+    for (size_t i = 0; i < inputCount; ++i) {
+        char* resolved = realpath(inputs[i], NULL);
+        fprintf(stream, "input %s\n", resolved ? resolved : inputs[i]);
+        free(resolved);
+    }
+    fclose(stream);
+
+    bool sent = vlWriteAll(fd, request, requestSize);
+    free(request);
+    size_t replySize = 0;
+    char* reply = sent && shutdown(fd, SHUT_WR) == 0 ? vlReadAll(fd, SIZE_MAX / 2, &replySize) : NULL;
+    close(fd);
+    if (!reply) {
+        fprintf(out, VL_ANSI_RED "Error: Lost the connection to the server." VL_ANSI_RESET "\n");
+        return 1;
+    }
+
+    char* body = strchr(reply, '\n');
+    int status = atoi(reply);
+    if (body) fwrite(body + 1, 1, replySize - (size_t) (body + 1 - reply), out);
+    free(reply);
+    return status;
+}
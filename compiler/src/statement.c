@@ -0,0 +1,675 @@
+/* ================
+ * src/statement.c
+ * VALLEY LANGUAGE COMPILER
+ * Statement parsing
+ * ================
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/valley.h"
+#include "../include/tokens.h"
+
+
+// ---- HELPERS ---- //
+
+static VLStatement* vlParseNested(VLParser* parser, size_t depth);
+
+
+static void vlFailExpected(VLParser* parser, const char* what) {
+    if (parser->status != VL_STATUS_OK) return;
+    parser->status = VL_STATUS_EXPECTED;
+    parser->what = what;
+}
+
+
+// Consumes a token of the given kind, or fails with VL_STATUS_EXPECTED
+static bool vlExpect(VLParser* parser, VLTokenKind kind) {
+    if (parser->status != VL_STATUS_OK) return false;
+    if (parser->token.kind != kind) {
+        vlFailExpected(parser, vlTokenSpelling(kind));
+        return false;
+    }
+    vlGrabToken(parser);
+    return parser->status == VL_STATUS_OK;
+}
+
+
+// The token after the current one, without consuming anything
+static VLToken vlLookAhead(VLParser* parser) {
+    if (parser->tokens) return vlPeekToken(parser, 1);
+
+    const char* cursor = parser->cursor;
+    VLToken token = parser->token;
+    VLStatus status = parser->status;
+    vlGrabToken(parser);
+    VLToken next = parser->token;
+    parser->cursor = cursor;
+    parser->token = token;
+    parser->status = status;
+    return next;
+}
+
+
+static bool vlIsName(VLToken token, const char* name) {
+    size_t len = strlen(name);
+    return token.kind == VL_TOKEN_NAME && token.stringValue.len == len && !memcmp(token.stringValue.first, name, len);
+}
+
+
+static bool vlPushStatement(VLParser* parser, VLStatement* stmt) {
+    if (!stmt) return false;
+    if (parser->statementCount == parser->statementCapacity) {
+        size_t capacity = parser->statementCapacity ? parser->statementCapacity * 2 : 64;
+        VLStatement** statements = realloc(parser->statements, capacity * sizeof(VLStatement*));
+        if (!statements) {
+            parser->status = VL_STATUS_OUT_OF_MEM;
+            return false;
+        }
+        parser->statements = statements;
+        parser->statementCapacity = capacity;
+    }
+    parser->statements[parser->statementCount++] = stmt;
+    return true;
+}
+
+
+// Class headers collect their lists on the operand stack, above anything vlParseExpr leaves behind
+static bool vlPushItem(VLParser* parser, VLExpression* expr) {
+    if (!expr) return false;
+    if (parser->operandCount == parser->operandCapacity) {
+        size_t capacity = parser->operandCapacity ? parser->operandCapacity * 2 : 64;
+        VLExpression** operands = realloc(parser->operands, capacity * sizeof(VLExpression*));
+        if (!operands) {
+            parser->status = VL_STATUS_OUT_OF_MEM;
+            return false;
+        }
+        parser->operands = operands;
+        parser->operandCapacity = capacity;
+    }
+    parser->operands[parser->operandCount++] = expr;
+    return true;
+}
+
+
+// Moves the operands above base into a new VL_EXPR_MULTI
+static VLExpression* vlCollectItems(VLParser* parser, VLOperation op, size_t pos, size_t base) {
+    size_t count = parser->operandCount - base;
+    VLExpression* expr = vlNewExpr(parser, VL_EXPR_MULTI, pos);
+    VLExpression** children = vlArenaAlloc(&parser->arena, count * sizeof(VLExpression*));
+    parser->operandCount = base;
+    if (!expr || (count && !children)) {
+        parser->status = VL_STATUS_OUT_OF_MEM;
+        return NULL;
+    }
+    if (count) memcpy(children, parser->operands + base, count * sizeof(VLExpression*));
+    expr->multiOp.operation = op;
+    expr->multiOp.children = children;
+    expr->multiOp.count = count;
+    return expr;
+}
+
+
+static VLExpression* vlParseName(VLParser* parser) {
+    if (parser->status != VL_STATUS_OK) return NULL;
+    if (parser->token.kind != VL_TOKEN_NAME) {
+        vlFailExpected(parser, "name");
+        return NULL;
+    }
+    VLExpression* expr = vlNewExpr(parser, VL_EXPR_NAME, parser->token.pos);
+    if (!expr) return NULL;
+    expr->stringValue = parser->token.stringValue;
+    expr->symbol = parser->token.symbol;
+    vlGrabToken(parser);
+    return parser->status == VL_STATUS_OK ? expr : NULL;
+}
+
+
+static VLExpression* vlNewBinary(VLParser* parser, VLOperation op, VLExpression* first, VLExpression* second) {
+    VLExpression* expr = vlNewExpr(parser, VL_EXPR_BINARY, first->pos);
+    if (!expr) return NULL;
+    expr->binaryOp.operation = op;
+    expr->binaryOp.first = first;
+    expr->binaryOp.second = second;
+    return expr;
+}
+
+
+// Closes a type argument list, splitting '>>' so that List<List<T>> works
+static bool vlExpectAngle(VLParser* parser) {
+    if (parser->status == VL_STATUS_OK && parser->token.kind == VL_SYM_RSHIFT) {
+        parser->token.kind = VL_SYM_GT;
+        ++parser->token.pos;
+        return true;
+    }
+    return vlExpect(parser, VL_SYM_GT);
+}
+
+
+// Parses a type such as io.Stream, List<T> or T[] in a class header, where '<' can't be an operator
+static VLExpression* vlParseTypeRef(VLParser* parser, size_t depth) {
+    if (depth > VL_MAX_STMT_DEPTH) {
+        parser->status = VL_STATUS_TOO_DEEP;
+        return NULL;
+    }
+
+    VLExpression* type = vlParseName(parser);
+    while (type && parser->token.kind == VL_SYM_DOT) {
+        vlGrabToken(parser);
+        VLExpression* member = vlParseName(parser);
+        type = member ? vlNewBinary(parser, VL_OP_MEMBER, type, member) : NULL;
+    }
+
+    if (type && parser->token.kind == VL_SYM_LT) {
+        size_t pos = parser->token.pos;
+        size_t base = parser->operandCount;
+        vlPushItem(parser, type);
+        vlGrabToken(parser);
+        do {
+            if (parser->token.kind == VL_SYM_COMMA) vlGrabToken(parser);
+            vlPushItem(parser, vlParseTypeRef(parser, depth + 1));
+        } while (parser->status == VL_STATUS_OK && parser->token.kind == VL_SYM_COMMA);
+        type = vlExpectAngle(parser) ? vlCollectItems(parser, VL_OP_GENERIC, pos, base) : NULL;
+        if (!type) parser->operandCount = base;
+    }
+
+    while (type && parser->token.kind == VL_SYM_L_SQUARE) {
+        size_t pos = parser->token.pos;
+        size_t base = parser->operandCount;
+        vlGrabToken(parser);
+        if (!vlPushItem(parser, type) || !vlExpect(parser, VL_SYM_R_SQUARE)) {
+            parser->operandCount = base;
+            return NULL;
+        }
+        type = vlCollectItems(parser, VL_OP_INDEX, pos, base);
+    }
+    return type;
+}
+
+
+// Parses `( expression )`, leaving the token after the ')'
+static VLExpression* vlParseCondition(VLParser* parser) {
+    if (!vlExpect(parser, VL_SYM_L_PAREN)) return NULL;
+    VLExpression* condition = vlParseExpr(parser, VL_TYPE_BOOL, false, false, false);
+    if (!condition || !vlExpect(parser, VL_SYM_R_PAREN)) return NULL;
+    return condition;
+}
+
+
+static VLStatement* vlParseBlock(VLParser* parser, size_t depth) {
+    size_t pos = parser->token.pos;
+    if (!vlExpect(parser, VL_SYM_L_CURLY)) return NULL;
+
+    size_t base = parser->statementCount;
+    while (parser->status == VL_STATUS_OK && parser->token.kind != VL_SYM_R_CURLY) {
+        if (parser->token.kind == VL_TOKEN_EOF) {
+            parser->status = VL_STATUS_UNCLOSED;
+            parser->what = vlTokenSpelling(VL_SYM_L_CURLY);
+            break;
+        }
+        vlPushStatement(parser, vlParseNested(parser, depth + 1));
+    }
+
+    VLStatement* block = NULL;
+    if (parser->status == VL_STATUS_OK) {
+        vlGrabToken(parser);
+        size_t count = parser->statementCount - base;
+        block = vlNewStatement(parser, VL_STMT_BLOCK, pos);
+        VLStatement** items = vlArenaAlloc(&parser->arena, count * sizeof(VLStatement*));
+        if (block && (items || !count)) {
+            if (count) memcpy(items, parser->statements + base, count * sizeof(VLStatement*));
+            block->block.items = items;
+            block->block.count = count;
+        } else {
+            parser->status = VL_STATUS_OUT_OF_MEM;
+            block = NULL;
+        }
+    }
+    parser->statementCount = base;
+    return block;
+}
+
+
+// Handles both `if` and each `elif`, which nests as the else branch of the one before it
+static VLStatement* vlParseIf(VLParser* parser, size_t depth) {
+    VLStatement* stmt = vlNewStatement(parser, VL_STMT_IF, parser->token.pos);
+    if (!stmt) return NULL;
+    vlGrabToken(parser);
+    if (!(stmt->ifStmt.condition = vlParseCondition(parser))) return NULL;
+    if (!(stmt->ifStmt.then = vlParseNested(parser, depth + 1))) return NULL;
+
+    if (parser->token.kind == VL_KW_ELIF) {
+        if (!(stmt->ifStmt.otherwise = vlParseIf(parser, depth + 1))) return NULL;
+    } else if (parser->token.kind == VL_KW_ELSE) {
+        vlGrabToken(parser);
+        if (!(stmt->ifStmt.otherwise = vlParseNested(parser, depth + 1))) return NULL;
+    }
+    return stmt;
+}
+
+
+static VLStatement* vlParseFor(VLParser* parser, size_t depth) {
+    VLStatement* stmt = vlNewStatement(parser, VL_STMT_FOR, parser->token.pos);
+    if (!stmt) return NULL;
+    vlGrabToken(parser);
+    if (!vlExpect(parser, VL_SYM_L_PAREN)) return NULL;
+
+    VLExpression* first = vlParseExpr(parser, VL_TYPE_VOID, false, true, true);
+    if (parser->status != VL_STATUS_OK) return NULL;
+
+    if (first && parser->token.kind == VL_SYM_COLON) {
+        vlGrabToken(parser);
+        stmt->kind = VL_STMT_FOR_EACH;
+        stmt->forEach.item = first;
+        stmt->forEach.iterable = vlParseExpr(parser, VL_TYPE_VOID, false, false, false);
+        if (!stmt->forEach.iterable || !vlExpect(parser, VL_SYM_R_PAREN)) return NULL;
+        if (!(stmt->forEach.body = vlParseNested(parser, depth + 1))) return NULL;
+        return stmt;
+    }
+
+    stmt->loop.init = first;
+    if (!vlExpect(parser, VL_SYM_SEMICOLON)) return NULL;
+    stmt->loop.condition = vlParseExpr(parser, VL_TYPE_BOOL, false, false, true);
+    if (!vlExpect(parser, VL_SYM_SEMICOLON)) return NULL;
+    stmt->loop.step = vlParseExpr(parser, VL_TYPE_VOID, false, true, true);
+    if (!vlExpect(parser, VL_SYM_R_PAREN)) return NULL;
+    if (!(stmt->loop.body = vlParseNested(parser, depth + 1))) return NULL;
+    return stmt;
+}
+
+
+// `while (condition : step)`, where the step runs after each pass like the last clause of a for
+static VLStatement* vlParseWhile(VLParser* parser, size_t depth) {
+    VLStatement* stmt = vlNewStatement(parser, VL_STMT_WHILE, parser->token.pos);
+    if (!stmt) return NULL;
+    vlGrabToken(parser);
+    if (!vlExpect(parser, VL_SYM_L_PAREN)) return NULL;
+    if (!(stmt->loop.condition = vlParseExpr(parser, VL_TYPE_BOOL, false, false, false))) return NULL;
+    if (parser->token.kind == VL_SYM_COLON) {
+        vlGrabToken(parser);
+        if (!(stmt->loop.step = vlParseExpr(parser, VL_TYPE_VOID, false, true, false))) return NULL;
+    }
+    if (!vlExpect(parser, VL_SYM_R_PAREN)) return NULL;
+    if (!(stmt->loop.body = vlParseNested(parser, depth + 1))) return NULL;
+    return stmt;
+}
+
+
+static VLStatement* vlParseDoWhile(VLParser* parser, size_t depth) {
+    VLStatement* stmt = vlNewStatement(parser, VL_STMT_DO_WHILE, parser->token.pos);
+    if (!stmt) return NULL;
+    vlGrabToken(parser);
+    if (!(stmt->loop.body = vlParseNested(parser, depth + 1))) return NULL;
+    if (!vlExpect(parser, VL_KW_WHILE)) return NULL;
+    if (!(stmt->loop.condition = vlParseCondition(parser))) return NULL;
+    if (!vlExpect(parser, VL_SYM_SEMICOLON)) return NULL;
+    return stmt;
+}
+
+
+static VLStatement* vlParseWith(VLParser* parser, size_t depth) {
+    VLStatement* stmt = vlNewStatement(parser, VL_STMT_WITH, parser->token.pos);
+    if (!stmt) return NULL;
+    vlGrabToken(parser);
+    if (!vlExpect(parser, VL_SYM_L_PAREN)) return NULL;
+    if (!(stmt->with.setup = vlParseExpr(parser, VL_TYPE_VOID, false, true, false))) return NULL;
+    if (!vlExpect(parser, VL_SYM_R_PAREN)) return NULL;
+    if (!(stmt->with.body = vlParseNested(parser, depth + 1))) return NULL;
+    return stmt;
+}
+
+
+// return, throw, break and continue; only the first two take an expression
+static VLStatement* vlParseJump(VLParser* parser, VLStmtKind kind) {
+    VLStatement* stmt = vlNewStatement(parser, kind, parser->token.pos);
+    if (!stmt) return NULL;
+    vlGrabToken(parser);
+    if (kind == VL_STMT_RETURN || kind == VL_STMT_THROW) {
+        stmt->expr = vlParseExpr(parser, VL_TYPE_VOID, false, true, kind == VL_STMT_RETURN);
+        if (parser->status != VL_STATUS_OK) return NULL;
+    }
+    if (!vlExpect(parser, VL_SYM_SEMICOLON)) return NULL;
+    return stmt;
+}
+
+
+// Parses a type parameter list such as `<type T, U>`, starting at the '<'
+static VLExpression* vlParseTypeParams(VLParser* parser) {
+    size_t pos = parser->token.pos;
+    size_t base = parser->operandCount;
+    vlGrabToken(parser);
+    do {
+        if (parser->token.kind == VL_SYM_COMMA) vlGrabToken(parser);
+        // Either a bare name or a kind and a name, as in `type T`
+        VLExpression* param = vlParseName(parser);
+        if (param && parser->token.kind == VL_TOKEN_NAME) {
+            VLExpression* name = vlParseName(parser);
+            param = name ? vlNewBinary(parser, VL_OP_DECLARE, param, name) : NULL;
+        }
+        vlPushItem(parser, param);
+    } while (parser->status == VL_STATUS_OK && parser->token.kind == VL_SYM_COMMA);
+    VLExpression* params = vlExpectAngle(parser) ? vlCollectItems(parser, VL_OP_LIST, pos, base) : NULL;
+    if (!params) parser->operandCount = base;
+    return params;
+}
+
+
+// `class Name <type T, U> is Base, List<T> { members }`
+static VLStatement* vlParseClass(VLParser* parser, size_t depth) {
+    VLStatement* stmt = vlNewStatement(parser, VL_STMT_CLASS, parser->token.pos);
+    if (!stmt) return NULL;
+    vlGrabToken(parser);
+    if (!(stmt->classDef.name = vlParseName(parser))) return NULL;
+    if (parser->token.kind == VL_SYM_LT && !(stmt->classDef.params = vlParseTypeParams(parser))) return NULL;
+
+    if (parser->token.kind == VL_KW_IS) {
+        size_t pos = parser->token.pos;
+        size_t base = parser->operandCount;
+        do {
+            vlGrabToken(parser);
+            vlPushItem(parser, vlParseTypeRef(parser, depth + 1));
+        } while (parser->status == VL_STATUS_OK && parser->token.kind == VL_SYM_COMMA);
+        stmt->classDef.supers = parser->status == VL_STATUS_OK ? vlCollectItems(parser, VL_OP_LIST, pos, base) : NULL;
+        if (!stmt->classDef.supers) {
+            parser->operandCount = base;
+            return NULL;
+        }
+    }
+
+    if (!(stmt->classDef.body = vlParseBlock(parser, depth + 1))) return NULL;
+    return stmt;
+}
+
+
+static VLStatement* vlParseImport(VLParser* parser, size_t depth) {
+    VLStatement* stmt = vlNewStatement(parser, VL_STMT_IMPORT, parser->token.pos);
+    if (!stmt) return NULL;
+    vlGrabToken(parser);
+    if (parser->token.kind == VL_SYM_L_CURLY) {
+        if (!(stmt->import.body = vlParseBlock(parser, depth + 1))) return NULL;
+        return stmt;
+    }
+    if (!(stmt->import.module = vlParseExpr(parser, VL_TYPE_VOID, false, false, false))) return NULL;
+    if (!vlExpect(parser, VL_SYM_SEMICOLON)) return NULL;
+    return stmt;
+}
+
+
+// A declaration followed by a parameter list, as in `double sum(...)`; constructors have no type
+static bool vlIsSignature(const VLExpression* expr, bool typed) {
+    if (expr->kind == VL_EXPR_BINARY
+            && (expr->binaryOp.operation == VL_OP_DECLARE || expr->binaryOp.operation == VL_OP_DECLARE_FINAL)) {
+        expr = expr->binaryOp.second;
+    } else if (typed) {
+        return false;
+    }
+    return expr->kind == VL_EXPR_MULTI && expr->multiOp.operation == VL_OP_CALL;
+}
+
+
+// Expression statements, plus function definitions and prototypes, which start out looking like one
+static VLStatement* vlParseSimple(VLParser* parser, size_t depth) {
+    VLStatement* stmt = vlNewStatement(parser, VL_STMT_EXPR, parser->token.pos);
+    if (!stmt) return NULL;
+    VLExpression* expr = vlParseExpr(parser, VL_TYPE_VOID, false, true, false);
+    if (!expr) return NULL;
+
+    if (parser->token.kind == VL_SYM_L_CURLY && vlIsSignature(expr, false)) {
+        stmt->kind = VL_STMT_FUNCTION;
+        stmt->function.signature = expr;
+        if (!(stmt->function.body = vlParseBlock(parser, depth + 1))) return NULL;
+        return stmt;
+    }
+
+    if (!vlExpect(parser, VL_SYM_SEMICOLON)) return NULL;
+    if (vlIsSignature(expr, true)) {
+        stmt->kind = VL_STMT_FUNCTION;
+        stmt->function.signature = expr;
+    } else {
+        stmt->expr = expr;
+    }
+    return stmt;
+}
+
+
+// `<type T> T max(T a, T b) { body }`, a function over any type T. Generic functions always have
+// a body, since each call site's type arguments get a copy of it.
+static VLStatement* vlParseGeneric(VLParser* parser, size_t depth) {
+    VLExpression* params = vlParseTypeParams(parser);
+    if (!params) return NULL;
+    VLStatement* stmt = vlParseSimple(parser, depth);
+    if (!stmt) return NULL;
+    if (stmt->kind != VL_STMT_FUNCTION || !stmt->function.body) {
+        vlFailExpected(parser, "{");
+        return NULL;
+    }
+    stmt->function.params = params;
+    return stmt;
+}
+
+
+static uint32_t vlParseModifiers(VLParser* parser) {
+    uint32_t modifiers = 0;
+    while (parser->status == VL_STATUS_OK) {
+        VLToken token = parser->token;
+        if (token.kind == VL_KW_PUBLIC) modifiers |= VL_MOD_PUBLIC;
+        else if (token.kind == VL_KW_PROTECTED) modifiers |= VL_MOD_PROTECTED;
+        else if (token.kind == VL_KW_PRIVATE) modifiers |= VL_MOD_PRIVATE;
+        else if (token.kind == VL_KW_STATIC) modifiers |= VL_MOD_STATIC;
+        // get and set are only accessor modifiers when a declaration follows; otherwise they're names
+        else if ((vlIsName(token, "get") || vlIsName(token, "set")) && vlLookAhead(parser).kind == VL_TOKEN_NAME) {
+            modifiers |= token.stringValue.first[0] == 'g' ? VL_MOD_GET : VL_MOD_SET;
+        } else break;
+        vlGrabToken(parser);
+    }
+    return modifiers;
+}
+
+
+static VLStatement* vlParseNested(VLParser* parser, size_t depth) {
+    if (parser->status != VL_STATUS_OK) return NULL;
+    if (depth > VL_MAX_STMT_DEPTH) {
+        parser->status = VL_STATUS_TOO_DEEP;
+        return NULL;
+    }
+
+    size_t pos = parser->token.pos;
+    uint32_t modifiers = vlParseModifiers(parser);
+    if (parser->status != VL_STATUS_OK) return NULL;
+
+    VLStatement* stmt;
+    switch (parser->token.kind) {
+        case VL_SYM_L_CURLY:    stmt = vlParseBlock(parser, depth); break;
+        case VL_KW_IF:          stmt = vlParseIf(parser, depth); break;
+        case VL_KW_FOR:         stmt = vlParseFor(parser, depth); break;
+        case VL_KW_WHILE:       stmt = vlParseWhile(parser, depth); break;
+        case VL_KW_DO:          stmt = vlParseDoWhile(parser, depth); break;
+        case VL_KW_WITH:        stmt = vlParseWith(parser, depth); break;
+        case VL_KW_RETURN:      stmt = vlParseJump(parser, VL_STMT_RETURN); break;
+        case VL_KW_THROW:       stmt = vlParseJump(parser, VL_STMT_THROW); break;
+        case VL_KW_BREAK:       stmt = vlParseJump(parser, VL_STMT_BREAK); break;
+        case VL_KW_CONTINUE:    stmt = vlParseJump(parser, VL_STMT_CONTINUE); break;
+        case VL_KW_CLASS:       stmt = vlParseClass(parser, depth); break;
+        case VL_SYM_LT:         stmt = vlParseGeneric(parser, depth); break;
+        case VL_KW_IMPORT:      stmt = vlParseImport(parser, depth); break;
+        case VL_KW_ELIF:
+        case VL_KW_ELSE:
+        case VL_KW_SWITCH:
+        case VL_KW_CASE:
+        case VL_KW_DEFAULT:
+        case VL_KW_TRY:
+        case VL_KW_CATCH:
+        case VL_KW_FINALLY:
+            parser->status = VL_STATUS_UNEXPECTED;
+            parser->what = vlTokenSpelling(parser->token.kind);
+            return NULL;
+        default:                stmt = vlParseSimple(parser, depth); break;
+    }
+    if (!stmt || parser->status != VL_STATUS_OK) return NULL;
+
+    if (modifiers) {
+        switch (stmt->kind) {
+            case VL_STMT_EXPR:
+            case VL_STMT_FUNCTION:
+            case VL_STMT_CLASS:
+            case VL_STMT_IMPORT:
+                stmt->modifiers = modifiers;
+                stmt->pos = pos;
+                break;
+            default:
+                parser->status = VL_STATUS_UNEXPECTED;
+                parser->what = "modifier";
+                return NULL;
+        }
+    }
+    return stmt;
+}
+
+
+static void vlPrintOptional(FILE* out, const char* before, const VLExpression* expr) {
+    fprintf(out, "%s", before);
+    if (expr) vlPrintExpr(out, expr);
+    else fprintf(out, "_");
+}
+
+
+// ---- FUNCTIONS ---- //
+
+VLStatement* vlNewStatement(VLParser* parser, VLStmtKind kind, size_t pos) {
+    VLStatement* stmt = vlArenaAlloc(&parser->arena, sizeof(VLStatement));
+    if (!stmt) {
+        parser->status = VL_STATUS_OUT_OF_MEM;
+        return NULL;
+    }
+    VLStatement init = {.kind = kind, .pos = pos};
+    *stmt = init;
+    return stmt;
+}
+
+
+VLStatement* vlParseStatement(VLParser* parser) {
+    return vlParseNested(parser, 0);
+}
+
+
+VLStatement* vlParseUnit(VLParser* parser) {
+    // Top-level statements until the end of the file, as one block
+    VLStatement* unit = vlNewStatement(parser, VL_STMT_BLOCK, 0);
+    if (!unit) return NULL;
+
+    size_t base = parser->statementCount;
+    while (parser->status == VL_STATUS_OK && parser->token.kind != VL_TOKEN_EOF) {
+        vlPushStatement(parser, vlParseNested(parser, 0));
+    }
+
+    size_t count = parser->statementCount - base;
+    parser->statementCount = base;
+    if (parser->status != VL_STATUS_OK) return NULL;
+
+    VLStatement** items = vlArenaAlloc(&parser->arena, count * sizeof(VLStatement*));
+    if (count && !items) {
+        parser->status = VL_STATUS_OUT_OF_MEM;
+        return NULL;
+    }
+    if (count) memcpy(items, parser->statements + base, count * sizeof(VLStatement*));
+    unit->block.items = items;
+    unit->block.count = count;
+    return unit;
+}
+
+
+void vlPrintStatement(FILE* out, const VLStatement* stmt, size_t depth) {
+    fprintf(out, "%*s", (int) (depth * 2), "");
+    if (stmt->modifiers & VL_MOD_PUBLIC) fprintf(out, "public ");
+    if (stmt->modifiers & VL_MOD_PROTECTED) fprintf(out, "protected ");
+    if (stmt->modifiers & VL_MOD_PRIVATE) fprintf(out, "private ");
+    if (stmt->modifiers & VL_MOD_STATIC) fprintf(out, "static ");
+    if (stmt->modifiers & VL_MOD_GET) fprintf(out, "get ");
+    if (stmt->modifiers & VL_MOD_SET) fprintf(out, "set ");
+
+    switch (stmt->kind) {
+        case VL_STMT_EXPR:
+            vlPrintExpr(out, stmt->expr);
+            fprintf(out, "\n");
+            break;
+        case VL_STMT_BLOCK:
+            fprintf(out, "block\n");
+            for (size_t i = 0; i < stmt->block.count; ++i) vlPrintStatement(out, stmt->block.items[i], depth + 1);
+            break;
+        case VL_STMT_IF:
+            vlPrintOptional(out, "if ", stmt->ifStmt.condition);
+            fprintf(out, "\n");
+            vlPrintStatement(out, stmt->ifStmt.then, depth + 1);
+            if (stmt->ifStmt.otherwise) {
+                fprintf(out, "%*selse\n", (int) (depth * 2), "");
+                vlPrintStatement(out, stmt->ifStmt.otherwise, depth + 1);
+            }
+            break;
+        case VL_STMT_FOR:
+            vlPrintOptional(out, "for ", stmt->loop.init);
+            vlPrintOptional(out, "; ", stmt->loop.condition);
+            vlPrintOptional(out, "; ", stmt->loop.step);
+            fprintf(out, "\n");
+            vlPrintStatement(out, stmt->loop.body, depth + 1);
+            break;
+        case VL_STMT_FOR_EACH:
+            vlPrintOptional(out, "for ", stmt->forEach.item);
+            vlPrintOptional(out, " : ", stmt->forEach.iterable);
+            fprintf(out, "\n");
+            vlPrintStatement(out, stmt->forEach.body, depth + 1);
+            break;
+        case VL_STMT_WHILE:
+            vlPrintOptional(out, "while ", stmt->loop.condition);
+            if (stmt->loop.step) vlPrintOptional(out, " : ", stmt->loop.step);
+            fprintf(out, "\n");
+            vlPrintStatement(out, stmt->loop.body, depth + 1);
+            break;
+        case VL_STMT_DO_WHILE:
+            fprintf(out, "do\n");
+            vlPrintStatement(out, stmt->loop.body, depth + 1);
+            fprintf(out, "%*s", (int) (depth * 2), "");
+            vlPrintOptional(out, "while ", stmt->loop.condition);
+            fprintf(out, "\n");
+            break;
+        case VL_STMT_WITH:
+            vlPrintOptional(out, "with ", stmt->with.setup);
+            fprintf(out, "\n");
+            vlPrintStatement(out, stmt->with.body, depth + 1);
+            break;
+        case VL_STMT_RETURN:
+        case VL_STMT_THROW:
+            fprintf(out, stmt->kind == VL_STMT_RETURN ? "return" : "throw");
+            if (stmt->expr) vlPrintOptional(out, " ", stmt->expr);
+            fprintf(out, "\n");
+            break;
+        case VL_STMT_BREAK:
+            fprintf(out, "break\n");
+            break;
+        case VL_STMT_CONTINUE:
+            fprintf(out, "continue\n");
+            break;
+        case VL_STMT_FUNCTION:
+            vlPrintOptional(out, "function ", stmt->function.signature);
+            if (stmt->function.params) vlPrintOptional(out, " ", stmt->function.params);
+            fprintf(out, "\n");
+            if (stmt->function.body) vlPrintStatement(out, stmt->function.body, depth + 1);
+            break;
+        case VL_STMT_CLASS:
+            vlPrintOptional(out, "class ", stmt->classDef.name);
+            if (stmt->classDef.params) vlPrintOptional(out, " ", stmt->classDef.params);
+            if (stmt->classDef.supers) vlPrintOptional(out, " is ", stmt->classDef.supers);
+            fprintf(out, "\n");
+            vlPrintStatement(out, stmt->classDef.body, depth + 1);
+            break;
+        case VL_STMT_IMPORT:
+            fprintf(out, "import");
+            if (stmt->import.module) vlPrintOptional(out, " ", stmt->import.module);
+            fprintf(out, "\n");
+            if (stmt->import.body) vlPrintStatement(out, stmt->import.body, depth + 1);
+            break;
+        default:
+            fprintf(out, "<UNKNOWN>\n");
+            break;
+    }
+}
@@ -0,0 +1,253 @@
+/* ================
+ * src/stats.c
+ * VALLEY LANGUAGE COMPILER
+ * Per-pass compile statistics
+ * ================
+ */
+
+#include <stdlib.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "../include/stats.h"
+#include "../include/driver.h"
+
+
+// ---- HELPERS ---- //
+
+static const char* vlTokenKindNames[VL_TOKEN_KIND_COUNT] = {
+    "EOF", "NAME", "STR", "CHAR", "BYTE", "SHORT", "INT", "LONG", "FLOAT", "DOUBLE", "BOOL",
+#define VL_KW_NAME(name, spelling) "KW_" #name,
+    VL_KEYWORDS(VL_KW_NAME)
+#undef VL_KW_NAME
+#define VL_SYM_NAME(name, spelling) "SYM_" #name,
+    VL_SYMBOLS(VL_SYM_NAME)
+#undef VL_SYM_NAME
+};
+
+static const char* vlExprKindNames[VL_EXPR_KIND_COUNT] = {
+    "NAME", "STR", "CHAR", "BYTE", "SHORT", "INT", "LONG", "FLOAT", "DOUBLE", "BOOL", "UNARY", "BINARY", "TERNARY",
+    "MULTI",
+};
+
+
+// Expressions can nest far deeper than the C stack allows, so they're walked with an explicit stack
+static bool vlCountExpr(VLUnitStats* stats, const VLExpression* root) {
+    if (!root) return true;
+    size_t count = 1, capacity = 64;
+    const VLExpression** pending = malloc(capacity * sizeof(VLExpression*));
+    if (!pending) return false;
+    pending[0] = root;
+
+    while (count) {
+        const VLExpression* expr = pending[--count];
+        ++stats->exprs;
+        ++stats->exprKinds[expr->kind];
+
+        size_t children = vlExprChildCount(expr);
+        if (count + children > capacity) {
+            while (count + children > capacity) capacity *= 2;
+            const VLExpression** grown = realloc(pending, capacity * sizeof(VLExpression*));
+            if (!grown) {
+                free(pending);
+                return false;
+            }
+            pending = grown;
+        }
+        for (size_t i = 0; i < children; ++i) {
+            const VLExpression* child = vlExprChild(expr, i);
+            if (child) pending[count++] = child;
+        }
+    }
+
+    free(pending);
+    return true;
+}
+
+
+static void vlWriteCounts(FILE* out, const char* key, const size_t* counts, const char* const* names, size_t kinds) {
+    fprintf(out, "\"%s\": {", key);
+    bool first = true;
+    for (size_t i = 0; i < kinds; ++i) {
+        if (!counts[i]) continue;
+        fprintf(out, "%s\"%s\": %zu", first ? "" : ", ", names[i], counts[i]);
+        first = false;
+    }
+    fprintf(out, "}");
+}
+
+
+// Paths are the only free-form text in the output
+static void vlWriteJsonString(FILE* out, const char* str) {
+    fputc('"', out);
+    for (; *str; ++str) {
+        unsigned char c = (unsigned char) *str;
+        if (c == '"' || c == '\\') fprintf(out, "\\%c", c);
+        else if (c < 0x20) fprintf(out, "\\u%04x", c);
+        else fputc(c, out);
+    }
+    fputc('"', out);
+}
+
+
+static void vlWriteUnitStats(FILE* out, const VLUnitStats* stats, const char* indent) {
+    fprintf(out, "%s\"bytes\": %zu,\n", indent, stats->bytes);
+    fprintf(out, "%s\"seconds\": {", indent);
+    for (VLPass pass = 0; pass < VL_PASS_COUNT; ++pass) {
+        fprintf(out, "%s\"%s\": %.9f", pass ? ", " : "", vlPassName(pass), stats->seconds[pass]);
+    }
+    fprintf(out, "},\n");
+    fprintf(out, "%s\"tokens\": %zu,\n%s", indent, stats->tokens, indent);
+    vlWriteCounts(out, "tokenKinds", stats->tokenKinds, vlTokenKindNames, VL_TOKEN_KIND_COUNT);
+    fprintf(out, ",\n%s\"exprs\": %zu,\n%s", indent, stats->exprs, indent);
+    vlWriteCounts(out, "exprKinds", stats->exprKinds, vlExprKindNames, VL_EXPR_KIND_COUNT);
+    fprintf(out, ",\n%s\"statements\": %zu,\n", indent, stats->statements);
+    fprintf(out, "%s\"foldedNodes\": %zu,\n", indent, stats->folded);
+    fprintf(out, "%s\"arena\": {\"allocations\": %zu, \"bytesUsed\": %zu, \"bytesReserved\": %zu, \"blocks\": %zu},\n",
+            indent, stats->arena.allocations, stats->arena.bytesUsed, stats->arena.bytesReserved, stats->arena.blocks);
+    fprintf(out, "%s\"heapBytes\": %zu", indent, stats->heapBytes);
+}
+
+
+// ---- FUNCTIONS ---- //
+
+double vlStatsClock(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) now.tv_sec + (double) now.tv_nsec * 1e-9;
+}
+
+
+const char* vlPassName(VLPass pass) {
+    switch (pass) {
+        case VL_PASS_READ:      return "read";
+        case VL_PASS_LEX:       return "lex";
+        case VL_PASS_PARSE:     return "parse";
+        case VL_PASS_CHECK:     return "check";
+        case VL_PASS_COMPILE:   return "compile";
+        case VL_PASS_RUN:       return "run";
+        default:                return "<UNKNOWN>";
+    }
+}
+
+
+const char* vlTokenKindName(VLTokenKind kind) {
+    return (size_t) kind < VL_TOKEN_KIND_COUNT ? vlTokenKindNames[kind] : "<UNKNOWN>";
+}
+
+
+const char* vlExprKindName(VLExprKind kind) {
+    return (size_t) kind < VL_EXPR_KIND_COUNT ? vlExprKindNames[kind] : "<UNKNOWN>";
+}
+
+
+void vlCountTokens(VLUnitStats* stats, const VLTokenStream* stream) {
+    // The trailing EOF isn't counted as a token
+    for (size_t i = 0; i < stream->count; ++i) ++stats->tokenKinds[stream->tokens[i].kind];
+    stats->tokens += stream->count ? stream->count - 1 : 0;
+    if (stream->count) --stats->tokenKinds[VL_TOKEN_EOF];
+}
+
+
+bool vlCountStatement(VLUnitStats* stats, const VLStatement* stmt) {
+    if (!stmt) return true;
+    ++stats->statements;
+    switch (stmt->kind) {
+        case VL_STMT_EXPR:
+        case VL_STMT_RETURN:
+        case VL_STMT_THROW:
+            return vlCountExpr(stats, stmt->expr);
+        case VL_STMT_BLOCK:
+            for (size_t i = 0; i < stmt->block.count; ++i) {
+                if (!vlCountStatement(stats, stmt->block.items[i])) return false;
+            }
+            return true;
+        case VL_STMT_IF:
+            return vlCountExpr(stats, stmt->ifStmt.condition) && vlCountStatement(stats, stmt->ifStmt.then) &&
+                   vlCountStatement(stats, stmt->ifStmt.otherwise);
+        case VL_STMT_FOR:
+        case VL_STMT_WHILE:
+        case VL_STMT_DO_WHILE:
+            return vlCountExpr(stats, stmt->loop.init) && vlCountExpr(stats, stmt->loop.condition) &&
+                   vlCountExpr(stats, stmt->loop.step) && vlCountStatement(stats, stmt->loop.body);
+        case VL_STMT_FOR_EACH:
+            return vlCountExpr(stats, stmt->forEach.item) && vlCountExpr(stats, stmt->forEach.iterable) &&
+                   vlCountStatement(stats, stmt->forEach.body);
+        case VL_STMT_WITH:
+            return vlCountExpr(stats, stmt->with.setup) && vlCountStatement(stats, stmt->with.body);
+        case VL_STMT_FUNCTION:
+            return vlCountExpr(stats, stmt->function.signature) && vlCountExpr(stats, stmt->function.params) &&
+                   vlCountStatement(stats, stmt->function.body);
+        case VL_STMT_CLASS:
+            return vlCountExpr(stats, stmt->classDef.name) && vlCountExpr(stats, stmt->classDef.params) &&
+                   vlCountExpr(stats, stmt->classDef.supers) && vlCountStatement(stats, stmt->classDef.body);
+        case VL_STMT_IMPORT:
+            return vlCountExpr(stats, stmt->import.module) && vlCountStatement(stats, stmt->import.body);
+        default:
+            return true;
+    }
+}
+
+
+size_t vlParserFootprint(const VLParser* parser, const VLTokenStream* stream) {
+    size_t bytes = parser->arena.stats.bytesReserved;
+    bytes += parser->operatorCapacity * sizeof(VLPendingOp);
+    bytes += parser->operandCapacity * sizeof(VLExpression*);
+    bytes += parser->statementCapacity * sizeof(VLStatement*);
+    bytes += parser->symbols.capacity * (sizeof(VLString) + sizeof(uint32_t));
+    bytes += parser->symbols.slotCount * sizeof(VLSymbol);
+    if (stream) {
+        bytes += stream->capacity * sizeof(VLPackedToken);
+        bytes += stream->literalCapacity * sizeof(VLLiteral);
+        bytes += stream->lineCount * sizeof(uint32_t);
+    }
+    return bytes;
+}
+
+
+void vlAddStats(VLUnitStats* total, const VLUnitStats* unit) {
+    for (VLPass pass = 0; pass < VL_PASS_COUNT; ++pass) total->seconds[pass] += unit->seconds[pass];
+    total->bytes += unit->bytes;
+    total->tokens += unit->tokens;
+    for (size_t i = 0; i < VL_TOKEN_KIND_COUNT; ++i) total->tokenKinds[i] += unit->tokenKinds[i];
+    total->exprs += unit->exprs;
+    for (size_t i = 0; i < VL_EXPR_KIND_COUNT; ++i) total->exprKinds[i] += unit->exprKinds[i];
+    total->statements += unit->statements;
+    total->folded += unit->folded;
+    total->arena.allocations += unit->arena.allocations;
+    total->arena.bytesUsed += unit->arena.bytesUsed;
+    total->arena.bytesReserved += unit->arena.bytesReserved;
+    total->arena.blocks += unit->arena.blocks;
+    total->heapBytes += unit->heapBytes;
+}
+
+
+size_t vlPeakResidentBytes(void) {
+    // ru_maxrss is in kilobytes on Linux
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+    return (size_t) usage.ru_maxrss * 1024;
+}
+
+
+void vlWriteStatsJson(FILE* out, const VLBuild* build, double seconds) {
+    VLUnitStats total = {0};
+
+    size_t jobs = build->options.jobs ? build->options.jobs : vlDefaultJobs();
+    if (jobs > build->count) jobs = build->count;
+
+    fprintf(out, "{\n  \"files\": [");
+    for (size_t i = 0; i < build->count; ++i) {
+        const VLUnit* unit = &build->units[i];
+        vlAddStats(&total, &unit->stats);
+        fprintf(out, "%s\n    {\n      \"path\": ", i ? "," : "");
+        vlWriteJsonString(out, unit->path);
+        fprintf(out, ",\n      \"ok\": %s,\n", unit->ok ? "true" : "false");
+        vlWriteUnitStats(out, &unit->stats, "      ");
+        fprintf(out, "\n    }");
+    }
+    fprintf(out, "\n  ],\n  \"total\": {\n    \"files\": %zu,\n    \"jobs\": %zu,\n", build->count, jobs);
+    fprintf(out, "    \"wallSeconds\": %.9f,\n    \"peakRssBytes\": %zu,\n", seconds, vlPeakResidentBytes());
+    vlWriteUnitStats(out, &total, "    ");
+    fprintf(out, "\n  }\n}\n");
+}
@@ -0,0 +1,105 @@
+/* ================
+ * src/symbols.c
+ * VALLEY LANGUAGE COMPILER
+ * Identifier interning
+ * ================
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/valley.h"
+
+
+// ---- HELPERS ---- //
+
+static uint32_t vlHashName(const char* str, size_t len) {
+    // FNV-1a, which is plenty for short identifiers
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= (unsigned char) str[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+
+static bool vlGrowSlots(VLSymbolTable* table) {
+    size_t slotCount = table->slotCount ? table->slotCount * 2 : 64;
+    VLSymbol* slots = malloc(slotCount * sizeof(VLSymbol));
+    if (!slots) return false;
+    memset(slots, 0xFF, slotCount * sizeof(VLSymbol));
+
+    for (VLSymbol symbol = 0; symbol < table->count; ++symbol) {
+        size_t slot = table->hashes[symbol] & (slotCount - 1);
+        while (slots[slot] != VL_NO_SYMBOL) slot = (slot + 1) & (slotCount - 1);
+        slots[slot] = symbol;
+    }
+
+    free(table->slots);
+    table->slots = slots;
+    table->slotCount = slotCount;
+    return true;
+}
+
+
+// ---- FUNCTIONS ---- //
+
+void vlInitSymbols(VLSymbolTable* table, VLArena* storage) {
+    VLSymbolTable init = {.storage = storage};
+    *table = init;
+}
+
+
+void vlFreeSymbols(VLSymbolTable* table) {
+    // Spellings belong to the storage arena, so only the index arrays are released here
+    free(table->names);
+    free(table->hashes);
+    free(table->slots);
+    vlInitSymbols(table, table->storage);
+}
+
+
+VLSymbol vlIntern(VLSymbolTable* table, const char* str, size_t len) {
+    // Keep the load factor under 3/4 so probe sequences stay short
+    if ((table->count + 1) * 4 > table->slotCount * 3 && !vlGrowSlots(table)) return VL_NO_SYMBOL;
+
+    uint32_t hash = vlHashName(str, len);
+    size_t mask = table->slotCount - 1;
+    size_t slot = hash & mask;
+    while (table->slots[slot] != VL_NO_SYMBOL) {
+        VLSymbol symbol = table->slots[slot];
+        if (table->hashes[symbol] == hash && table->names[symbol].len == len
+                && memcmp(table->names[symbol].first, str, len) == 0) {
+            return symbol;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    if (table->count == table->capacity) {
+        size_t capacity = table->capacity ? table->capacity * 2 : 64;
+        VLString* names = realloc(table->names, capacity * sizeof(VLString));
+        if (!names) return VL_NO_SYMBOL;
+        table->names = names;
+        uint32_t* hashes = realloc(table->hashes, capacity * sizeof(uint32_t));
+        if (!hashes) return VL_NO_SYMBOL;
+        table->hashes = hashes;
+        table->capacity = capacity;
+    }
+
+    // Arena memory never moves, so VLStrings handed out stay valid for the arena's lifetime
+    char* name = vlArenaString(table->storage, str, len);
+    if (!name) return VL_NO_SYMBOL;
+
+    VLSymbol symbol = (VLSymbol) table->count++;
+    VLString string = {name, len};
+    table->names[symbol] = string;
+    table->hashes[symbol] = hash;
+    table->slots[slot] = symbol;
+    return symbol;
+}
+
+
+VLString vlSymbolName(const VLSymbolTable* table, VLSymbol symbol) {
+    return table->names[symbol];
+}
@@ -0,0 +1,190 @@
+/* ================
+ * src/tokens.c
+ * VALLEY LANGUAGE COMPILER
+ * Whole-unit packed token streams
+ * ================
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/tokens.h"
+
+
+// ---- HELPERS ---- //
+
+static bool vlIndexLines(VLParser* parser, VLTokenStream* stream) {
+    size_t capacity = 64;
+    stream->lineStarts = malloc(capacity * sizeof(uint32_t));
+    if (!stream->lineStarts) return false;
+    stream->lineStarts[stream->lineCount++] = 0;
+
+    const char* p = parser->source;
+    while ((p = memchr(p, '\n', (size_t) (parser->end - p)))) {
+        if (stream->lineCount == capacity) {
+            capacity *= 2;
+            uint32_t* grown = realloc(stream->lineStarts, capacity * sizeof(uint32_t));
+            if (!grown) return false;
+            stream->lineStarts = grown;
+        }
+        stream->lineStarts[stream->lineCount++] = (uint32_t) (++p - parser->source);
+    }
+    return true;
+}
+
+
+static bool vlHasLiteral(VLTokenKind kind) {
+    return kind >= VL_TOKEN_STR && kind <= VL_TOKEN_BOOL;
+}
+
+
+static bool vlPackToken(VLParser* parser, VLTokenStream* stream) {
+    VLToken token = parser->token;
+    uint32_t payload = 0;
+
+    if (token.kind == VL_TOKEN_NAME) {
+        payload = token.symbol;
+    } else if (vlHasLiteral(token.kind)) {
+        if (stream->literalCount == stream->literalCapacity) {
+            size_t capacity = stream->literalCapacity ? stream->literalCapacity * 2 : 256;
+            VLLiteral* literals = realloc(stream->literals, capacity * sizeof(VLLiteral));
+            if (!literals) {
+                parser->status = VL_STATUS_OUT_OF_MEM;
+                return false;
+            }
+            stream->literals = literals;
+            stream->literalCapacity = capacity;
+        }
+
+        VLLiteral literal = {0};
+        switch (token.kind) {
+            case VL_TOKEN_STR:
+                literal.stringValue = token.stringValue;
+                literal.hasEscapes = token.hasEscapes;
+                break;
+            case VL_TOKEN_CHAR:     literal.charValue = token.charValue; break;
+            case VL_TOKEN_BYTE:     literal.byteValue = token.byteValue; break;
+            case VL_TOKEN_SHORT:    literal.shortValue = token.shortValue; break;
+            case VL_TOKEN_INT:      literal.intValue = token.intValue; break;
+            case VL_TOKEN_LONG:     literal.longValue = token.longValue; break;
+            case VL_TOKEN_FLOAT:    literal.floatValue = token.floatValue; break;
+            case VL_TOKEN_DOUBLE:   literal.doubleValue = token.doubleValue; break;
+            default:                literal.boolValue = token.boolValue; break;
+        }
+        payload = (uint32_t) stream->literalCount;
+        stream->literals[stream->literalCount++] = literal;
+    }
+
+    // Offsets are 32 bits and payloads 24, which caps a single unit at 4 GiB and 16M literals or names
+    if (payload > VL_MAX_PAYLOAD || token.pos > UINT32_MAX) {
+        parser->status = VL_STATUS_TOO_LARGE;
+        parser->what = token.pos > UINT32_MAX ? "4 GiB of text" : "16M literals or distinct names";
+        return false;
+    }
+
+    if (stream->count == stream->capacity) {
+        size_t capacity = stream->capacity ? stream->capacity * 2 : 1024;
+        VLPackedToken* tokens = realloc(stream->tokens, capacity * sizeof(VLPackedToken));
+        if (!tokens) {
+            parser->status = VL_STATUS_OUT_OF_MEM;
+            return false;
+        }
+        stream->tokens = tokens;
+        stream->capacity = capacity;
+    }
+
+    VLPackedToken packed = {.offset = (uint32_t) token.pos, .kind = token.kind, .payload = payload};
+    stream->tokens[stream->count++] = packed;
+    return true;
+}
+
+
+// ---- FUNCTIONS ---- //
+
+bool vlLexAll(VLParser* parser, VLTokenStream* stream) {
+    VLTokenStream init = {.symbols = &parser->symbols};
+    *stream = init;
+
+    if (!vlIndexLines(parser, stream)) {
+        parser->status = VL_STATUS_OUT_OF_MEM;
+        return false;
+    }
+
+    do {
+        vlGrabToken(parser);
+        if (parser->status != VL_STATUS_OK) return false;
+        if (!vlPackToken(parser, stream)) return false;
+    } while (parser->token.kind != VL_TOKEN_EOF);
+
+    return true;
+}
+
+
+void vlFreeTokenStream(VLTokenStream* stream) {
+    free(stream->tokens);
+    free(stream->literals);
+    free(stream->lineStarts);
+    VLTokenStream init = {0};
+    *stream = init;
+}
+
+
+VLToken vlUnpackToken(const VLTokenStream* stream, size_t index) {
+    VLPackedToken packed = stream->tokens[index];
+    VLToken token = {.kind = packed.kind, .pos = packed.offset};
+
+    if (packed.kind == VL_TOKEN_NAME) {
+        token.stringValue = vlSymbolName(stream->symbols, packed.payload);
+        token.symbol = packed.payload;
+        return token;
+    }
+    if (!vlHasLiteral(packed.kind)) return token;
+
+    const VLLiteral* literal = &stream->literals[packed.payload];
+    switch (packed.kind) {
+        case VL_TOKEN_STR:
+            token.stringValue = literal->stringValue;
+            token.hasEscapes = literal->hasEscapes;
+            break;
+        case VL_TOKEN_CHAR:     token.charValue = literal->charValue; break;
+        case VL_TOKEN_BYTE:     token.byteValue = literal->byteValue; break;
+        case VL_TOKEN_SHORT:    token.shortValue = literal->shortValue; break;
+        case VL_TOKEN_INT:      token.intValue = literal->intValue; break;
+        case VL_TOKEN_LONG:     token.longValue = literal->longValue; break;
+        case VL_TOKEN_FLOAT:    token.floatValue = literal->floatValue; break;
+        case VL_TOKEN_DOUBLE:   token.doubleValue = literal->doubleValue; break;
+        case VL_TOKEN_BOOL:     token.boolValue = literal->boolValue; break;
+        default: break;
+    }
+    return token;
+}
+
+
+void vlLineColumn(const VLTokenStream* stream, size_t offset, size_t* line, size_t* column) {
+    // Binary search for the last line starting at or before offset; both results are 1-based
+    size_t low = 0, high = stream->lineCount;
+    while (high - low > 1) {
+        size_t mid = low + (high - low) / 2;
+        if (stream->lineStarts[mid] <= offset) low = mid;
+        else high = mid;
+    }
+    *line = low + 1;
+    *column = offset - stream->lineStarts[low] + 1;
+}
+
+
+void vlAttachTokenStream(VLParser* parser, const VLTokenStream* stream) {
+    parser->tokens = stream;
+    parser->tokenIndex = 0;
+}
+
+
+VLToken vlPeekToken(const VLParser* parser, size_t ahead) {
+    // The current token sits just before tokenIndex. Before the first grab there is none, which
+    // reads as EOF, as does anything past the end.
+    const VLTokenStream* stream = parser->tokens;
+    size_t last = stream->count - 1;
+    if ((parser->tokenIndex == 0 && ahead == 0) || ahead > last) return vlUnpackToken(stream, last);
+    size_t index = parser->tokenIndex + ahead - 1;
+    return vlUnpackToken(stream, index < last ? index : last);
+}
@@ -8,529 +8,759 @@
 
 #include <stdlib.h>
 #include <stdio.h>
-#include <ctype.h>
 #include <string.h>
+#include <threads.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "../include/valley.h"
+#include "../include/tokens.h"
+#include "../include/fold.h"
+#include "../include/number.h"
+
+
+// ---- SYMBOL DFA ---- //
+
+// Transition table for every VL_SYMBOLS spelling. State 0 is dead, state 1 is the start state,
+// and class 0 covers every character that never appears in a spelling.
+static struct {
+    uint8_t classes[256];
+    uint8_t next[VL_SYM_MAX_STATES][VL_SYM_CLASSES];
+    VLTokenKind accept[VL_SYM_MAX_STATES];
+} vlSymbolDfa;
+
+static once_flag vlSymbolDfaOnce = ONCE_FLAG_INIT;
+
+
+static void vlBuildSymbolDfa(void) {
+#define VL_SYM_ENTRY(name, spelling) {VL_SYM_##name, spelling},
+    static const struct {
+        VLTokenKind kind;
+        const char* spelling;
+    } symbols[] = {VL_SYMBOLS(VL_SYM_ENTRY)};
+#undef VL_SYM_ENTRY
+
+    uint8_t classCount = 1;
+    uint8_t stateCount = 2;
+    for (size_t i = 0; i < sizeof(symbols) / sizeof(symbols[0]); ++i) {
+        uint8_t state = 1;
+        for (const char* c = symbols[i].spelling; *c; ++c) {
+            uint8_t* cls = &vlSymbolDfa.classes[(unsigned char) *c];
+            if (!*cls) *cls = classCount++;
+            uint8_t* next = &vlSymbolDfa.next[state][*cls];
+            if (!*next) *next = stateCount++;
+            state = *next;
+        }
+        vlSymbolDfa.accept[state] = symbols[i].kind;
+    }
+}
 
 
 // ---- FUNCTIONS ---- //
 
-void vlPrintToken(VLToken token) {
-    switch (token.kind) {
-        case VL_TOKEN_EOF:      printf("<EOF>"); break;
-        case VL_TOKEN_NAME:     printf("%s", token.stringValue.first); break;
-        case VL_TOKEN_STR:      printf("\"%s\"", token.stringValue.first); break;
-        case VL_TOKEN_CHAR:     printf("\'%c\'", token.charValue); break;
-        case VL_TOKEN_BYTE:     printf("%db", token.byteValue); break;
-        case VL_TOKEN_SHORT:    printf("%ds", token.shortValue); break;
-        case VL_TOKEN_INT:      printf("%d", token.intValue); break;
-        case VL_TOKEN_LONG:     printf("%ldl", token.longValue); break;
-        case VL_TOKEN_FLOAT:    printf("%ff", token.floatValue); break;
-        case VL_TOKEN_DOUBLE:   printf("%f", token.doubleValue); break;
-        case VL_TOKEN_BOOL:     printf(token.boolValue ? "TRUE" : "FALSE"); break;
-        case VL_KW_IS:          printf("IS"); break;
-        case VL_KW_IF:          printf("IF"); break;
-        case VL_KW_ELIF:        printf("ELIF"); break;
-        case VL_KW_ELSE:        printf("ELSE"); break;
-        case VL_KW_FOR:         printf("FOR"); break;
-        case VL_KW_WHILE:       printf("WHILE"); break;
-        case VL_KW_DO:          printf("DO"); break;
-        case VL_KW_BREAK:       printf("BREAK"); break;
-        case VL_KW_CONTINUE:    printf("CONTINUE"); break;
-        case VL_KW_SWITCH:      printf("SWITCH"); break;
-        case VL_KW_CASE:        printf("CASE"); break;
-        case VL_KW_DEFAULT:     printf("DEFAULT"); break;
-        case VL_KW_WITH:        printf("WITH"); break;
-        case VL_KW_TRY:         printf("TRY"); break;
-        case VL_KW_CATCH:       printf("CATCH"); break;
-        case VL_KW_FINALLY:     printf("FINALLY"); break;
-        case VL_KW_THROW:       printf("THROW"); break;
-        case VL_KW_RETURN:      printf("RETURN"); break;
-        case VL_KW_FINAL:       printf("FINAL"); break;
-        case VL_KW_PUBLIC:      printf("PUBLIC"); break;
-        case VL_KW_PROTECTED:   printf("PROTECTED"); break;
-        case VL_KW_PRIVATE:     printf("PRIVATE"); break;
-        case VL_KW_STATIC:      printf("STATIC"); break;
-        case VL_KW_IMPORT:      printf("IMPORT"); break;
-        case VL_SYM_ADD:        printf("+"); break;
-        case VL_SYM_SUB:        printf("-"); break;
-        case VL_SYM_MUL:        printf("*"); break;
-        case VL_SYM_DIV:        printf("/"); break;
-        case VL_SYM_MOD:        printf("%%"); break;
-        case VL_SYM_EXP:        printf("**"); break;
-        case VL_SYM_NOT:        printf("~"); break;
-        case VL_SYM_AND:        printf("&"); break;
-        case VL_SYM_XOR:        printf("^"); break;
-        case VL_SYM_OR:         printf("|"); break;
-        case VL_SYM_LSHIFT:     printf("<<"); break;
-        case VL_SYM_RSHIFT:     printf(">>"); break;
-        case VL_SYM_LNOT:       printf("!"); break;
-        case VL_SYM_LAND:       printf("&&"); break;
-        case VL_SYM_LXOR:       printf("^^"); break;
-        case VL_SYM_LOR:        printf("||"); break;
-        case VL_SYM_EQ:         printf("=="); break;
-        case VL_SYM_NEQ:        printf("!="); break;
-        case VL_SYM_LT:         printf("<"); break;
-        case VL_SYM_GT:         printf(">"); break;
-        case VL_SYM_LTEQ:       printf("<="); break;
-        case VL_SYM_GTEQ:       printf(">="); break;
-        case VL_SYM_SAME:       printf("==="); break;
-        case VL_SYM_NSAME:      printf("!=="); break;
-        case VL_SYM_INC:        printf("++"); break;
-        case VL_SYM_DEC:        printf("--"); break;
-        case VL_SYM_PUT:        printf("="); break;
-        case VL_SYM_ADD_PUT:    printf("+="); break;
-        case VL_SYM_SUB_PUT:    printf("-="); break;
-        case VL_SYM_MUL_PUT:    printf("*="); break;
-        case VL_SYM_DIV_PUT:    printf("/="); break;
-        case VL_SYM_MOD_PUT:    printf("%%="); break;
-        case VL_SYM_EXP_PUT:    printf("**="); break;
-        case VL_SYM_AND_PUT:    printf("&="); break;
-        case VL_SYM_XOR_PUT:    printf("^="); break;
-        case VL_SYM_OR_PUT:     printf("|="); break;
-        case VL_SYM_LSHIFT_PUT: printf("<<="); break;
-        case VL_SYM_RSHIFT_PUT: printf(">>="); break;
-        case VL_SYM_COLON:      printf(":"); break;
-        case VL_SYM_SEMICOLON:  printf(";"); break;
-        case VL_SYM_COMMA:      printf(","); break;
-        case VL_SYM_L_CURLY:    printf("{"); break;
-        case VL_SYM_R_CURLY:    printf("}"); break;
-        case VL_SYM_COND:       printf("?"); break;
-        case VL_SYM_L_PAREN:    printf("("); break;
-        case VL_SYM_R_PAREN:    printf(")"); break;
-        case VL_SYM_L_SQUARE:   printf("["); break;
-        case VL_SYM_R_SQUARE:   printf("]"); break;
-        case VL_SYM_DOT:        printf("."); break;
-        case VL_SYM_ARROW:      printf("->"); break;
-        case VL_SYM_ELLIPSIS:   printf("..."); break;
-        default:                printf("<UNKNOWN>"); break;
-    }
-    printf(" ");
+bool vlLoadSource(VLSource* source, const char* path) {
+    VLSource empty = {.data = NULL, .size = 0, .mapped = false};
+    *source = empty;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        return false;
+    }
+
+    // Regular files are mapped directly; empty files can't be mapped, but there's nothing to read anyway
+    if (S_ISREG(info.st_mode)) {
+        if (info.st_size > 0) {
+            void* data = mmap(NULL, (size_t) info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED) {
+                madvise(data, (size_t) info.st_size, MADV_SEQUENTIAL);
+                source->data = data;
+                source->size = (size_t) info.st_size;
+                source->mapped = true;
+            }
+        }
+        if (source->mapped || info.st_size == 0) {
+            close(fd);
+            return true;
+        }
+    }
+
+    // Pipes, terminals and anything unmappable get slurped into one buffer up front
+    size_t capacity = 1 << 16;
+    char* data = malloc(capacity);
+    while (data) {
+        if (source->size == capacity) {
+            capacity *= 2;
+            char* grown = realloc(data, capacity);
+            if (!grown) break;
+            data = grown;
+        }
+        ssize_t count = read(fd, data + source->size, capacity - source->size);
+        if (count < 0) break;
+        if (count == 0) {
+            close(fd);
+            source->data = data;
+            return true;
+        }
+        source->size += (size_t) count;
+    }
+
+    free(data);
+    close(fd);
+    source->size = 0;
+    return false;
 }
 
 
-void vlGrabNameToken(VLParser* parser) {
-    size_t pos = parser->pos;
-    char* name = calloc(1, sizeof(char));
-    size_t len = 0;
+void vlFreeSource(VLSource* source) {
+    if (source->mapped) {
+        munmap(source->data, source->size);
+    } else {
+        free(source->data);
+    }
+    source->data = NULL;
+    source->size = 0;
+    source->mapped = false;
+}
 
-    int c = VL_READ();
-    while (!VL_EOF() && (isalpha(c) || isdigit(c) || c == '_')) {
-        name = realloc(name, len + sizeof(c) + sizeof(char));
-        if (!name) {
+
+void vlInitParser(VLParser* parser, const char* source, size_t size) {
+    VLParser init = {
+        .source = source,
+        .cursor = source,
+        .end = source + size,
+        .scanner = vlGetScanner(),
+        .token = {.kind = VL_TOKEN_EOF, .pos = 0},
+        .status = VL_STATUS_OK,
+        .errorPos = VL_NO_POS,
+    };
+    *parser = init;
+    vlInitArena(&parser->arena);
+    vlInitSymbols(&parser->symbols, &parser->arena);
+
+#define VL_KW_STRING(name, spelling) spelling,
+    static const char* keywords[] = {VL_KEYWORDS(VL_KW_STRING)};
+#undef VL_KW_STRING
+    for (size_t i = 0; i < VL_KEYWORD_COUNT; ++i) {
+        if (vlIntern(&parser->symbols, keywords[i], strlen(keywords[i])) == VL_NO_SYMBOL) {
             parser->status = VL_STATUS_OUT_OF_MEM;
             return;
         }
-        strncat(name, (const char*) &c, 1);
-        ++len;
-        c = VL_READ();
     }
-    VL_UNREAD(c);
-
-    VL_CHECK_KW("is", IS);
-    VL_CHECK_KW("if", IF);
-    VL_CHECK_KW("elif", ELIF);
-    VL_CHECK_KW("else", ELSE);
-    VL_CHECK_KW("for", FOR);
-    VL_CHECK_KW("while", WHILE);
-    VL_CHECK_KW("do", DO);
-    VL_CHECK_KW("break", BREAK);
-    VL_CHECK_KW("continue", CONTINUE);
-    VL_CHECK_KW("switch", SWITCH);
-    VL_CHECK_KW("case", CASE);
-    VL_CHECK_KW("default", DEFAULT);
-    VL_CHECK_KW("with", WITH);
-    VL_CHECK_KW("try", TRY);
-    VL_CHECK_KW("catch", CATCH);
-    VL_CHECK_KW("finally", FINALLY);
-    VL_CHECK_KW("throw", THROW);
-    VL_CHECK_KW("return", RETURN);
-    VL_CHECK_KW("final", FINAL);
-    VL_CHECK_KW("public", PUBLIC);
-    VL_CHECK_KW("protected", PROTECTED);
-    VL_CHECK_KW("private", PRIVATE);
-    VL_CHECK_KW("static", STATIC);
-    VL_CHECK_KW("import", IMPORT);
-
-    VLString string = {name, len};
-    VLToken token = {.kind = VL_TOKEN_NAME, .pos = pos, .stringValue = string};
+    if (vlIntern(&parser->symbols, "true", 4) != VL_SYMBOL_TRUE
+            || vlIntern(&parser->symbols, "false", 5) != VL_SYMBOL_FALSE) {
+        parser->status = VL_STATUS_OUT_OF_MEM;
+    }
+}
+
+
+void vlFreeParser(VLParser* parser) {
+    free(parser->operators);
+    free(parser->operands);
+    free(parser->statements);
+    vlFreeSymbols(&parser->symbols);
+    vlFreeArena(&parser->arena);
+}
+
+
+VLExpression* vlNewExpr(VLParser* parser, VLExprKind kind, size_t pos) {
+    VLExpression* expr = vlArenaAlloc(&parser->arena, sizeof(VLExpression));
+    if (!expr) {
+        parser->status = VL_STATUS_OUT_OF_MEM;
+        return NULL;
+    }
+    VLExpression init = {.kind = kind, .pos = pos};
+    *expr = init;
+    return expr;
+}
+
+
+VLString vlDecodeString(VLArena* arena, VLString raw) {
+    // Decoding only ever shrinks the text, so the raw length is enough room
+    char* decoded = vlArenaAlloc(arena, raw.len + 1);
+    VLString string = {decoded, 0};
+    if (!decoded) return string;
+
+    for (size_t i = 0; i < raw.len; ++i) {
+        char ch = raw.first[i];
+        if (ch == '\\' && i + 1 < raw.len) {
+            ch = raw.first[++i];
+            switch (ch) {
+                case 'n': ch = '\n'; break;
+                case 'r': ch = '\r'; break;
+                case 't': ch = '\t'; break;
+                default: break;
+            }
+        }
+        decoded[string.len++] = ch;
+    }
+    decoded[string.len] = '\0';
+    return string;
+}
+
+
+void vlPrintString(FILE* out, VLString string, bool hasEscapes) {
+    if (!hasEscapes) {
+        fwrite(string.first, 1, string.len, out);
+        return;
+    }
+
+    // Decode while printing, writing the runs between escapes in one go
+    const char* p = string.first;
+    const char* end = p + string.len;
+    while (p < end) {
+        const char* escape = memchr(p, '\\', (size_t) (end - p));
+        if (!escape || escape + 1 == end) {
+            fwrite(p, 1, (size_t) (end - p), out);
+            return;
+        }
+        fwrite(p, 1, (size_t) (escape - p), out);
+        switch (escape[1]) {
+            case 'n': fputc('\n', out); break;
+            case 'r': fputc('\r', out); break;
+            case 't': fputc('\t', out); break;
+            default: fputc(escape[1], out); break;
+        }
+        p = escape + 2;
+    }
+}
+
+
+void vlPrintToken(FILE* out, VLToken token) {
+    switch (token.kind) {
+        case VL_TOKEN_EOF:      fprintf(out, "<EOF>"); break;
+        case VL_TOKEN_NAME:     fprintf(out, "%s", token.stringValue.first); break;
+        case VL_TOKEN_STR:
+            fputc('"', out);
+            vlPrintString(out, token.stringValue, token.hasEscapes);
+            fputc('"', out);
+            break;
+        case VL_TOKEN_CHAR:     fprintf(out, "\'%c\'", token.charValue); break;
+        case VL_TOKEN_BYTE:     fprintf(out, "%db", token.byteValue); break;
+        case VL_TOKEN_SHORT:    fprintf(out, "%ds", token.shortValue); break;
+        case VL_TOKEN_INT:      fprintf(out, "%d", token.intValue); break;
+        case VL_TOKEN_LONG:     fprintf(out, "%ldl", token.longValue); break;
+        case VL_TOKEN_FLOAT:    fprintf(out, "%ff", token.floatValue); break;
+        case VL_TOKEN_DOUBLE:   fprintf(out, "%f", token.doubleValue); break;
+        case VL_TOKEN_BOOL:     fprintf(out, token.boolValue ? "TRUE" : "FALSE"); break;
+#define VL_KW_PRINT(name, spelling) case VL_KW_##name: fprintf(out, #name); break;
+        VL_KEYWORDS(VL_KW_PRINT)
+#undef VL_KW_PRINT
+#define VL_SYM_PRINT(name, spelling) case VL_SYM_##name: fprintf(out, "%s", spelling); break;
+        VL_SYMBOLS(VL_SYM_PRINT)
+#undef VL_SYM_PRINT
+        default:                fprintf(out, "<UNKNOWN>"); break;
+    }
+    fprintf(out, " ");
+}
+
+
+const char* vlTypeName(VLType type, char* buffer, size_t size) {
+    static const char* names[] = {
+        "void", "str", "char", "byte", "short", "int", "long", "float", "double", "bool", "object", "array",
+        "typename", "function",
+    };
+    const char* base = !type.rank && type.base == VL_TYPE_OBJECT ? "null" : names[type.base];
+    size_t used = (size_t) snprintf(buffer, size, "%s", base);
+    for (size_t i = 0; i < type.rank && used + 2 < size; ++i, used += 2) {
+        memcpy(buffer + used, "[]", 3);
+    }
+    return buffer;
+}
+
+
+void vlPrintExpr(FILE* out, const VLExpression* expr) {
+    switch (expr->kind) {
+        case VL_EXPR_NAME:      fprintf(out, "%s", expr->stringValue.first); break;
+        case VL_EXPR_STR:
+            fputc('"', out);
+            vlPrintString(out, expr->stringValue, expr->hasEscapes);
+            fputc('"', out);
+            break;
+        case VL_EXPR_CHAR:      fprintf(out, "\'%c\'", expr->charValue); break;
+        case VL_EXPR_BYTE:      fprintf(out, "%db", expr->byteValue); break;
+        case VL_EXPR_SHORT:     fprintf(out, "%ds", expr->shortValue); break;
+        case VL_EXPR_INT:       fprintf(out, "%d", expr->intValue); break;
+        case VL_EXPR_LONG:      fprintf(out, "%ldl", expr->longValue); break;
+        case VL_EXPR_FLOAT:     fprintf(out, "%ff", expr->floatValue); break;
+        case VL_EXPR_DOUBLE:    fprintf(out, "%f", expr->doubleValue); break;
+        case VL_EXPR_BOOL:      fprintf(out, expr->boolValue ? "TRUE" : "FALSE"); break;
+        case VL_EXPR_UNARY:
+            fprintf(out, "(%s ", vlOpSpelling(expr->unaryOp.operation));
+            vlPrintExpr(out, expr->unaryOp.child);
+            fprintf(out, ")");
+            break;
+        case VL_EXPR_BINARY:
+            // Casts the checker adds have no type expression, only the type they convert to
+            fprintf(out, "(%s ", vlOpSpelling(expr->binaryOp.operation));
+            vlPrintExpr(out, expr->binaryOp.first);
+            if (expr->binaryOp.second) {
+                fprintf(out, " ");
+                vlPrintExpr(out, expr->binaryOp.second);
+            }
+            fprintf(out, ")");
+            break;
+        case VL_EXPR_TERNARY:
+            fprintf(out, "(%s ", vlOpSpelling(expr->ternaryOp.operation));
+            vlPrintExpr(out, expr->ternaryOp.first);
+            fprintf(out, " ");
+            vlPrintExpr(out, expr->ternaryOp.second);
+            fprintf(out, " ");
+            vlPrintExpr(out, expr->ternaryOp.third);
+            fprintf(out, ")");
+            break;
+        case VL_EXPR_MULTI:
+            fprintf(out, "(%s", vlOpSpelling(expr->multiOp.operation));
+            for (size_t i = 0; i < expr->multiOp.count; ++i) {
+                fprintf(out, " ");
+                vlPrintExpr(out, expr->multiOp.children[i]);
+            }
+            fprintf(out, ")");
+            break;
+        default:
+            fprintf(out, "<UNKNOWN>");
+            break;
+    }
+    if (expr->type.base != VL_TYPE_VOID) {
+        char type[64];
+        fprintf(out, ":%s", vlTypeName(expr->type, type, sizeof(type)));
+    }
+}
+
+
+const char* vlTokenSpelling(VLTokenKind kind) {
+    switch (kind) {
+        case VL_TOKEN_EOF:      return "end of file";
+        case VL_TOKEN_NAME:     return "name";
+        case VL_TOKEN_STR:
+        case VL_TOKEN_CHAR:
+        case VL_TOKEN_BYTE:
+        case VL_TOKEN_SHORT:
+        case VL_TOKEN_INT:
+        case VL_TOKEN_LONG:
+        case VL_TOKEN_FLOAT:
+        case VL_TOKEN_DOUBLE:
+        case VL_TOKEN_BOOL:     return "literal";
+#define VL_KW_SPELLING(name, spelling) case VL_KW_##name: return spelling;
+        VL_KEYWORDS(VL_KW_SPELLING)
+#undef VL_KW_SPELLING
+#define VL_SYM_SPELLING(name, spelling) case VL_SYM_##name: return spelling;
+        VL_SYMBOLS(VL_SYM_SPELLING)
+#undef VL_SYM_SPELLING
+        default:                return "<UNKNOWN>";
+    }
+}
+
+
+const char* vlOpSpelling(VLOperation op) {
+    switch (op) {
+        case VL_OP_POS:             return "+";
+        case VL_OP_NEG:             return "-";
+        case VL_OP_ADD:             return "+";
+        case VL_OP_SUB:             return "-";
+        case VL_OP_MUL:             return "*";
+        case VL_OP_DIV:             return "/";
+        case VL_OP_MOD:             return "%";
+        case VL_OP_EXP:             return "**";
+        case VL_OP_NOT:             return "~";
+        case VL_OP_AND:             return "&";
+        case VL_OP_XOR:             return "^";
+        case VL_OP_OR:              return "|";
+        case VL_OP_LSHIFT:          return "<<";
+        case VL_OP_RSHIFT:          return ">>";
+        case VL_OP_LNOT:            return "!";
+        case VL_OP_LAND:            return "&&";
+        case VL_OP_LXOR:            return "^^";
+        case VL_OP_LOR:             return "||";
+        case VL_OP_EQ:              return "==";
+        case VL_OP_NEQ:             return "!=";
+        case VL_OP_LT:              return "<";
+        case VL_OP_GT:              return ">";
+        case VL_OP_LTEQ:            return "<=";
+        case VL_OP_GTEQ:            return ">=";
+        case VL_OP_SAME:            return "===";
+        case VL_OP_NSAME:           return "!==";
+        case VL_OP_IS:              return "is";
+        case VL_OP_INC_BEF:         return "++_";
+        case VL_OP_INC_AFT:         return "_++";
+        case VL_OP_DEC_BEF:         return "--_";
+        case VL_OP_DEC_AFT:         return "_--";
+        case VL_OP_PUT:             return "=";
+        case VL_OP_ADD_PUT:         return "+=";
+        case VL_OP_SUB_PUT:         return "-=";
+        case VL_OP_MUL_PUT:         return "*=";
+        case VL_OP_DIV_PUT:         return "/=";
+        case VL_OP_MOD_PUT:         return "%=";
+        case VL_OP_EXP_PUT:         return "**=";
+        case VL_OP_AND_PUT:         return "&=";
+        case VL_OP_XOR_PUT:         return "^=";
+        case VL_OP_OR_PUT:          return "|=";
+        case VL_OP_LSHIFT_PUT:      return "<<=";
+        case VL_OP_RSHIFT_PUT:      return ">>=";
+        case VL_OP_CAST:            return "->";
+        case VL_OP_MEMBER:          return ".";
+        case VL_OP_COND:            return "?:";
+        case VL_OP_LIST:            return ",";
+        case VL_OP_INDEX:           return "[]";
+        case VL_OP_CALL:            return "()";
+        case VL_OP_ARR_INIT:        return "[...]";
+        case VL_OP_DECLARE:         return "decl";
+        case VL_OP_DECLARE_FINAL:   return "final";
+        case VL_OP_EXTEND:          return "...";
+        case VL_OP_GENERIC:         return "<>";
+        default:                    return "<UNKNOWN>";
+    }
+}
+
+
+void vlGrabNameToken(VLParser* parser) {
+    size_t pos = VL_POS();
+    const char* start = parser->cursor;
+
+    parser->cursor = parser->scanner->skipName(parser->cursor, parser->end);
+
+    VLSymbol symbol = vlIntern(&parser->symbols, start, (size_t) (parser->cursor - start));
+    if (symbol == VL_NO_SYMBOL) {
+        parser->status = VL_STATUS_OUT_OF_MEM;
+        return;
+    }
+
+    // Keywords are interned first when the parser is set up, so their symbols line up with VLTokenKind
+    if (symbol < VL_KEYWORD_COUNT) {
+        VLToken token = {.kind = VL_KW_IS + symbol, .pos = pos};
+        parser->token = token;
+        return;
+    }
+    if (symbol == VL_SYMBOL_TRUE || symbol == VL_SYMBOL_FALSE) {
+        VLToken token = {.kind = VL_TOKEN_BOOL, .pos = pos, .boolValue = symbol == VL_SYMBOL_TRUE};
+        parser->token = token;
+        return;
+    }
+
+    VLString string = vlSymbolName(&parser->symbols, symbol);
+    VLToken token = {.kind = VL_TOKEN_NAME, .pos = pos, .stringValue = string, .symbol = symbol};
     parser->token = token;
 }
 
 
 void vlGrabNumberToken(VLParser* parser) {
-    size_t pos = parser->pos;
-    char* numStr = calloc(1, sizeof(char));
-    size_t len = 0;
+    size_t pos = VL_POS();
+    const char* start = parser->cursor;
     bool isFloating = false;
 
+    // Digits go straight into the mantissa; past the first 19 significant ones they only move the exponent
+    VLDecimal decimal = {0};
+    size_t digits = 0;
     int c = VL_READ();
-    while (!VL_EOF() && (isdigit(c) || c == '.')) {
+    while (VL_IS_DIGIT(c) || c == '.') {
         if (c == '.') {
             if (isFloating) {
+                VL_UNREAD(c);
                 parser->status = VL_STATUS_UNEXPECTED;
                 parser->what = ".";
                 return;
             }
             isFloating = true;
+        } else if (digits < VL_MAX_MANTISSA_DIGITS) {
+            decimal.mantissa = decimal.mantissa * 10 + (uint64_t) (c - '0');
+            if (decimal.mantissa) ++digits;
+            if (isFloating) --decimal.exponent;
+        } else {
+            if (c != '0') decimal.truncated = true;
+            if (!isFloating) ++decimal.exponent;
         }
-        numStr = realloc(numStr, len + sizeof(c) + sizeof(char));
-        if (!numStr) {
-            parser->status = VL_STATUS_OUT_OF_MEM;
-            break;
-        }
-        strncat(numStr, (const char*) &c, 1);
-        ++len;
         c = VL_READ();
     }
+    size_t len = (size_t) (parser->cursor - start) - (c != EOF);
 
-    if (isFloating) {
-        VLDouble num = strtod(numStr, NULL);
+    if (isFloating || c == 'f' || c == 'F' || c == 'd' || c == 'D') {
+        VLToken token = {.pos = pos};
         if (c == 'f' || c == 'F') {
-            VLToken token = {.kind = VL_TOKEN_FLOAT, .pos = pos, .floatValue = (VLFloat) num};
-            parser->token = token;
+            token.kind = VL_TOKEN_FLOAT;
+            if (!vlDecimalToFloat(decimal, &token.floatValue)) {
+                char* numStr = vlArenaString(&parser->arena, start, len);
+                if (!numStr) {
+                    parser->status = VL_STATUS_OUT_OF_MEM;
+                    return;
+                }
+                token.floatValue = strtof(numStr, NULL);
+            }
         } else {
             if (c != 'd' && c != 'D') { VL_UNREAD(c); }
-            VLToken token = {.kind = VL_TOKEN_DOUBLE, .pos = pos, .doubleValue = num};
-            parser->token = token;
+            token.kind = VL_TOKEN_DOUBLE;
+            if (!vlDecimalToDouble(decimal, &token.doubleValue)) {
+                char* numStr = vlArenaString(&parser->arena, start, len);
+                if (!numStr) {
+                    parser->status = VL_STATUS_OUT_OF_MEM;
+                    return;
+                }
+                token.doubleValue = strtod(numStr, NULL);
+            }
         }
+        parser->token = token;
+        return;
+    }
+
+    // Each type takes magnitudes up to 2^(bits - 1), so that negating the literal reaches its minimum;
+    // the parser rejects that magnitude anywhere but right after a unary '-'
+    uint64_t limit;
+    VLToken token = {.pos = pos};
+    if (c == 'b' || c == 'B') {
+        token.kind = VL_TOKEN_BYTE;
+        parser->what = "byte";
+        limit = (uint64_t) INT8_MAX + 1;
+    } else if (c == 's' || c == 'S') {
+        token.kind = VL_TOKEN_SHORT;
+        parser->what = "short";
+        limit = (uint64_t) INT16_MAX + 1;
+    } else if (c == 'l' || c == 'L') {
+        token.kind = VL_TOKEN_LONG;
+        parser->what = "long";
+        limit = (uint64_t) INT64_MAX + 1;
     } else {
-        VLLong num = strtoll(numStr, NULL, 10);
-        if (c == 'b' || c == 'B') {
-            VLToken token = {.kind = VL_TOKEN_BYTE, .pos = pos, .byteValue = (VLByte) num};
-            parser->token = token;
-        } else if (c == 's' || c == 'S') {
-            VLToken token = {.kind = VL_TOKEN_SHORT, .pos = pos, .shortValue = (VLShort) num};
-            parser->token = token;
-        } else if (c == 'l' || c == 'L') {
-            VLToken token = {.kind = VL_TOKEN_LONG, .pos = pos, .longValue = num};
-            parser->token = token;
-        } else if (c == 'f' || c == 'F') {
-            VLToken token = {.kind = VL_TOKEN_FLOAT, .pos = pos, .floatValue = (VLFloat) num};
-            parser->token = token;
-        } else if (c == 'd' || c == 'D') {
-            VLToken token = {.kind = VL_TOKEN_BYTE, .pos = pos, .doubleValue = (VLDouble) num};
-            parser->token = token;
-        } else {
-            if (c != 'i' && c != 'I') { VL_UNREAD(c); }
-            VLToken token = {.kind = VL_TOKEN_INT, .pos = pos, .intValue = (VLInt) num};
-            parser->token = token;
-        }
+        if (c != 'i' && c != 'I') { VL_UNREAD(c); }
+        token.kind = VL_TOKEN_INT;
+        parser->what = "int";
+        limit = (uint64_t) INT32_MAX + 1;
     }
+
+    if (decimal.exponent || decimal.mantissa > limit) {
+        parser->cursor = parser->source + pos;
+        parser->status = VL_STATUS_OVERFLOW;
+        return;
+    }
+    parser->what = NULL;
+
+    // Unsigned to signed conversion wraps, which is exactly what the minimum needs
+    switch (token.kind) {
+        case VL_TOKEN_BYTE: token.byteValue = (VLByte) decimal.mantissa; break;
+        case VL_TOKEN_SHORT: token.shortValue = (VLShort) decimal.mantissa; break;
+        case VL_TOKEN_LONG: token.longValue = (VLLong) decimal.mantissa; break;
+        default: token.intValue = (VLInt) decimal.mantissa; break;
+    }
+    parser->token = token;
 }
 
 
 void vlGrabStringToken(VLParser* parser) {
-    size_t pos = parser->pos;
-    char* rawStr = calloc(1, sizeof(char));
-    size_t len = 0;
+    size_t pos = VL_POS();
+    VL_SKIP(1);
 
-    int c = VL_READ();
-    while (!VL_EOF()) {
-        if (c == '\\') {
-            c = VL_READ();
-            if (VL_EOF()) break;
-            switch (c) {
-                case 'n': c = '\n'; break;
-                case 'r': c = '\r'; break;
-                case 't': c = '\t'; break;
-                default: break;
-            }
-        } else if (c == '"') {
-            VLString string = {rawStr, len};
-            VLToken token = {.kind = VL_TOKEN_STR, .pos = pos, .stringValue = string};
-            parser->token = token;
-            return;
-        } else if (c == '\n' || c == '\r' || c == '\t') {
-            break;
-        }
+    // The token is a view of the raw text between the quotes; escapes are only decoded on demand
+    const char* start = parser->cursor;
+    bool hasEscapes = false;
+    int c;
+    while (true) {
+        parser->cursor = parser->scanner->findStringStop(parser->cursor, parser->end);
+        c = VL_READ();
+        if (c != '\\') break;
+        hasEscapes = true;
+        if (VL_READ() == EOF) break;
+    }
+
+    if (c != '"') {
+        parser->cursor = parser->source + pos;
+        parser->status = VL_STATUS_UNCLOSED;
+        parser->what = "\"";
+        return;
+    }
 
-        rawStr = realloc(rawStr, len + sizeof(c) + sizeof(char));
-        if (!rawStr) {
+    VLString string = {start, (size_t) (parser->cursor - start) - 1};
+    if (parser->copyStrings) {
+        string = vlDecodeString(&parser->arena, string);
+        hasEscapes = false;
+        if (!string.first) {
             parser->status = VL_STATUS_OUT_OF_MEM;
-            break;
+            return;
         }
-        strncat(rawStr, (const char*) &c, 1);
-        ++len;
-        c = VL_READ();
     }
-
-    parser->pos = pos;
-    parser->status = VL_STATUS_UNCLOSED;
-    parser->what = "\"";
+    VLToken token = {.kind = VL_TOKEN_STR, .pos = pos, .stringValue = string, .hasEscapes = hasEscapes};
+    parser->token = token;
 }
 
 
 void vlGrabSymbolToken(VLParser* parser) {
-    size_t pos = parser->pos;
+    call_once(&vlSymbolDfaOnce, vlBuildSymbolDfa);
+
+    size_t pos = VL_POS();
     VLTokenKind sym = VL_TOKEN_EOF;
-    int c0, c1, c2;
-
-    c0 = VL_READ();
-    switch (c0) {
-        case '+':
-            c1 = VL_READ();
-            switch (c1) {
-                case '+': sym = VL_SYM_INC; break;
-                case '=': sym = VL_SYM_ADD_PUT; break;
-                default: sym = VL_SYM_ADD; VL_UNREAD(c1); break;
-            }
-            break;
-        case '-':
-            c1 = VL_READ();
-            switch (c1) {
-                case '-': sym = VL_SYM_DEC; break;
-                case '=': sym = VL_SYM_SUB_PUT; break;
-                case '>': sym = VL_SYM_ARROW; break;
-                default: sym = VL_SYM_SUB; VL_UNREAD(c1); break;
-            }
-            break;
-        case '*':
-            c1 = VL_READ();
-            switch (c1) {
-                case '*':
-                    c2 = VL_READ();
-                    switch (c2) {
-                        case '=': sym = VL_SYM_EXP_PUT; break;
-                        default: sym = VL_SYM_EXP; VL_UNREAD(c2); break;
-                    }
-                    break;
-                case '=': sym = VL_SYM_MUL_PUT; break;
-                default: sym = VL_SYM_MUL; VL_UNREAD(c1); break;
-            }
-            break;
-        case '/':
-            c1 = VL_READ();
-            switch (c1) {
-                case '=': sym = VL_SYM_DIV_PUT; break;
-                default: sym = VL_SYM_DIV; VL_UNREAD(c1); break;
-            }
-            break;
-        case '%':
-            c1 = VL_READ();
-            switch (c1) {
-                case '=': sym = VL_SYM_MOD_PUT; break;
-                default: sym = VL_SYM_MOD; VL_UNREAD(c1); break;
-            }
-            break;
-        case '~': sym = VL_SYM_NOT; break;
-        case '&':
-            c1 = VL_READ();
-            switch (c1) {
-                case '&': sym = VL_SYM_LAND; break;
-                case '=': sym = VL_SYM_AND_PUT; break;
-                default: sym = VL_SYM_AND; VL_UNREAD(c1); break;
-            }
-            break;
-        case '^':
-            c1 = VL_READ();
-            switch (c1) {
-                case '^': sym = VL_SYM_LXOR; break;
-                case '=': sym = VL_SYM_XOR_PUT; break;
-                default: sym = VL_SYM_XOR; VL_UNREAD(c1); break;
-            }
-            break;
-        case '|':
-            c1 = VL_READ();
-            switch (c1) {
-                case '|': sym = VL_SYM_LOR; break;
-                case '=': sym = VL_SYM_OR_PUT; break;
-                default: sym = VL_SYM_OR; VL_UNREAD(c1); break;
-            }
-            break;
-        case '<':
-            c1 = VL_READ();
-            switch (c1) {
-                case '<':
-                    c2 = VL_READ();
-                    switch (c2) {
-                        case '=': sym = VL_SYM_LSHIFT_PUT; break;
-                        default: sym = VL_SYM_LSHIFT; VL_UNREAD(c2); break;
-                    }
-                    break;
-                case '=': sym = VL_SYM_LTEQ; break;
-                default: sym = VL_SYM_LT; VL_UNREAD(c1); break;
-            }
-            break;
-        case '>':
-            c1 = VL_READ();
-            switch (c1) {
-                case '>':
-                    c2 = VL_READ();
-                    switch (c2) {
-                        case '=': sym = VL_SYM_RSHIFT_PUT; break;
-                        default: sym = VL_SYM_RSHIFT; VL_UNREAD(c2); break;
-                    }
-                    break;
-                case '=': sym = VL_SYM_GTEQ; break;
-                default: sym = VL_SYM_GT; VL_UNREAD(c1); break;
-            }
-            break;
-        case '!':
-            c1 = VL_READ();
-            switch (c1) {
-                case '=':
-                    c2 = VL_READ();
-                    switch (c2) {
-                        case '=': sym = VL_SYM_NSAME; break;
-                        default: sym = VL_SYM_NEQ; VL_UNREAD(c2); break;
-                    }
-                    break;
-                default: sym = VL_SYM_LNOT; VL_UNREAD(c1); break;
-            }
-            break;
-        case '=':
-            c1 = VL_READ();
-            switch (c1) {
-                case '=':
-                    c2 = VL_READ();
-                    switch (c2) {
-                        case '=': sym = VL_SYM_SAME; break;
-                        default: sym = VL_SYM_EQ; VL_UNREAD(c2); break;
-                    }
-                    break;
-                default: sym = VL_SYM_PUT; VL_UNREAD(c1); break;
-            }
-            break;
-        case ':': sym = VL_SYM_COLON; break;
-        case ';': sym = VL_SYM_SEMICOLON; break;
-        case ',': sym = VL_SYM_COMMA; break;
-        case '{': sym = VL_SYM_L_CURLY; break;
-        case '}': sym = VL_SYM_R_CURLY; break;
-        case '?': sym = VL_SYM_COND; break;
-        case '(': sym = VL_SYM_L_PAREN; break;
-        case ')': sym = VL_SYM_R_PAREN; break;
-        case '[': sym = VL_SYM_L_SQUARE; break;
-        case ']': sym = VL_SYM_R_SQUARE; break;
-        case '.':
-            c1 = VL_READ();
-            switch (c1) {
-                case '.':
-                    c2 = VL_READ();
-                    switch (c2) {
-                        case '.': sym = VL_SYM_ELLIPSIS; break;
-                        default: sym = VL_SYM_DOT; VL_UNREAD(c2); VL_UNREAD(c1); break;
-                    }
-                    break;
-                default: sym = VL_SYM_DOT; VL_UNREAD(c1); break;
-            }
-            break;
-        default:
-            parser->status = VL_STATUS_UNEXPECTED;
-            parser->what = (const char*) &c0;
-            return;
+    const char* accepted = parser->cursor;
+
+    // Run the DFA as far as it goes, remembering the longest spelling seen; no character is ever pushed back
+    uint8_t state = 1;
+    for (const char* p = parser->cursor; p < parser->end; ++p) {
+        state = vlSymbolDfa.next[state][vlSymbolDfa.classes[(unsigned char) *p]];
+        if (!state) break;
+        if (vlSymbolDfa.accept[state] != VL_TOKEN_EOF) {
+            sym = vlSymbolDfa.accept[state];
+            accepted = p + 1;
+        }
     }
 
+    if (sym == VL_TOKEN_EOF) {
+        parser->unexpected[0] = *parser->cursor;
+        parser->unexpected[1] = '\0';
+        parser->status = VL_STATUS_UNEXPECTED;
+        parser->what = parser->unexpected;
+        return;
+    }
+
+    parser->cursor = accepted;
     VLToken token = {.kind = sym, .pos = pos};
     parser->token = token;
 }
 
 
 void vlSkipLineComment(VLParser* parser) {
-    bool skipNewline = false;
-
-    int c = VL_READ();
-    while (!VL_EOF()) {
-        if (!skipNewline && c == '\n') return;
+    const VLScanner* scanner = parser->scanner;
 
-        if (skipNewline) {
-            if (!isblank(c)) skipNewline = false;
-        } else if (c == '\\') skipNewline = true;
+    while (true) {
+        parser->cursor = scanner->findLineStop(parser->cursor, parser->end);
+        int c = VL_READ();
+        if (c != '\\') return;
 
-        c = VL_READ();
+        // A backslash swallows the next non-blank character, which continues the comment if it's a newline
+        while (VL_IS_BLANK(VL_PEEK())) VL_SKIP(1);
+        if (VL_READ() == EOF) return;
     }
 }
 
 
 void vlSkipBlockComment(VLParser* parser) {
-    bool checkEnd = false;
-
-    int c = VL_READ();
-    while (!VL_EOF()) {
-        if (checkEnd) {
-            if (c == '/') return;
-            checkEnd = false;
-        }
-
-        if (c == '*') checkEnd = true;
-
-        c = VL_READ();
-    }
+    parser->cursor = parser->scanner->findBlockEnd(parser->cursor, parser->end);
 }
 
 
 void vlGrabToken(VLParser* parser) {
-    int c = VL_READ();
+    if (parser->tokens) {
+        // Replaying a stream from vlLexAll; its final EOF token repeats forever. tokenIndex stops one
+        // past it, so the current token is always the one just before tokenIndex.
+        size_t last = parser->tokens->count - 1;
+        parser->token = vlUnpackToken(parser->tokens, parser->tokenIndex < last ? parser->tokenIndex : last);
+        if (parser->tokenIndex <= last) ++parser->tokenIndex;
+        return;
+    }
+
+    VLStatus status = parser->status;
     while (true) {
-        if (VL_EOF()) {
-            VLToken token = {.kind = VL_TOKEN_EOF, .pos = parser->pos};
+        int c = VL_PEEK();
+        if (c == EOF) {
+            VLToken token = {.kind = VL_TOKEN_EOF, .pos = VL_POS()};
             parser->token = token;
             return;
-        } else if (isspace(c)) {
-            c = VL_READ();
+        } else if (VL_IS_SPACE(c)) {
+            parser->cursor = parser->scanner->skipSpace(parser->cursor, parser->end);
             continue;
-        } else if (isalpha(c) || c == '_') {
-            VL_UNREAD(c);
+        } else if (VL_IS_NAME_START(c)) {
             vlGrabNameToken(parser);
-            return;
-        } else if (isdigit(c)) {
-            VL_UNREAD(c);
+            break;
+        } else if (VL_IS_DIGIT(c)) {
             vlGrabNumberToken(parser);
-            return;
-        } else if (ispunct(c)) {
+            break;
+        } else if (VL_IS_PUNCT(c)) {
             if (c == '/') {
-                int c1 = VL_READ();
+                int c1 = VL_PEEK_AT(1);
                 if (c1 == '/') {
+                    VL_SKIP(2);
                     vlSkipLineComment(parser);
-                    c = VL_READ();
                     continue;
                 } else if (c1 == '*') {
+                    VL_SKIP(2);
                     vlSkipBlockComment(parser);
-                    c = VL_READ();
                     continue;
                 }
-                VL_UNREAD(c1);
             } else if (c == '.') {
-                int c1 = VL_READ();
-                VL_UNREAD(c1);
-                if (isdigit(c1)) {
-                    VL_UNREAD(c);
+                if (VL_IS_DIGIT(VL_PEEK_AT(1))) {
                     vlGrabNumberToken(parser);
-                    return;
+                    break;
                 }
             } else if (c == '"') {
                 vlGrabStringToken(parser);
-                return;
+                break;
             }
-            VL_UNREAD(c);
             vlGrabSymbolToken(parser);
-            return;
+            break;
         }
 
         // If c isn't accounted for, skip it
-        c = VL_READ();
+        VL_SKIP(1);
     }
+
+    // A failed grab leaves the cursor on the offending character, past the last good token
+    if (status == VL_STATUS_OK && parser->status != VL_STATUS_OK) parser->errorPos = VL_POS();
 }
 
 
-bool vlNextToken(VLParser* parser) {
-    vlGrabToken(parser);
+void vlLocate(const char* source, size_t pos, size_t* line, size_t* column) {
+    // Only used for diagnostics, so a plain scan from the start is fine
+    size_t lineStart = 0;
+    *line = 1;
+    for (size_t i = 0; i < pos; ++i) {
+        if (source[i] == '\n') {
+            ++*line;
+            lineStart = i + 1;
+        }
+    }
+    *column = pos - lineStart + 1;
+}
 
-    switch (parser->status) {
+
+bool vlReportError(FILE* out, VLStatus status, const char* what) {
+    switch (status) {
         case VL_STATUS_OK:
             return true;
         case VL_STATUS_OUT_OF_MEM:
-            printf(VL_ANSI_RED "Error: Ran out of available memory." VL_ANSI_RESET "\n");
+            fprintf(out, VL_ANSI_RED "Error: Ran out of available memory." VL_ANSI_RESET "\n");
             return false;
         case VL_STATUS_UNEXPECTED:
-            printf(VL_ANSI_RED "Error: Encountered unexpected '%s'." VL_ANSI_RESET "\n", parser->what);
+            fprintf(out, VL_ANSI_RED "Error: Encountered unexpected '%s'." VL_ANSI_RESET "\n", what);
+            return false;
+        case VL_STATUS_SYNTAX:
+            fprintf(out, VL_ANSI_RED "Error: Expected an operator or ';' before '%s'." VL_ANSI_RESET "\n", what);
             return false;
         case VL_STATUS_EXPECTED:
-            printf(VL_ANSI_RED "Error: Expected '%s'." VL_ANSI_RESET "\n", parser->what);
+            fprintf(out, VL_ANSI_RED "Error: Expected '%s'." VL_ANSI_RESET "\n", what);
             return false;
         case VL_STATUS_UNCLOSED:
-            printf(VL_ANSI_RED "Error: Unable to find a matching '%s'." VL_ANSI_RESET "\n", parser->what);
+            fprintf(out, VL_ANSI_RED "Error: Unable to find a matching '%s'." VL_ANSI_RESET "\n", what);
+            return false;
+        case VL_STATUS_NOT_ENOUGH_OPERANDS:
+            fprintf(out, VL_ANSI_RED "Error: Not enough operands for '%s'." VL_ANSI_RESET "\n", what);
+            return false;
+        case VL_STATUS_TOO_DEEP:
+            fprintf(out, VL_ANSI_RED "Error: Statements are nested too deeply." VL_ANSI_RESET "\n");
+            return false;
+        case VL_STATUS_TOO_LARGE:
+            fprintf(out, VL_ANSI_RED "Error: Source is too large, more than %s in one unit." VL_ANSI_RESET "\n", what);
+            return false;
+        case VL_STATUS_OVERFLOW:
+            fprintf(out, VL_ANSI_RED "Error: Literal is too large for type '%s'." VL_ANSI_RESET "\n", what);
+            return false;
+        case VL_STATUS_UNDEFINED:
+            fprintf(out, VL_ANSI_RED "Error: '%s' is not defined." VL_ANSI_RESET "\n", what);
+            return false;
+        case VL_STATUS_REDEFINED:
+            fprintf(out, VL_ANSI_RED "Error: '%s' is already defined." VL_ANSI_RESET "\n", what);
+            return false;
+        case VL_STATUS_MISMATCH:
+            fprintf(out, VL_ANSI_RED "Error: Type mismatch, %s." VL_ANSI_RESET "\n", what);
+            return false;
+        case VL_STATUS_ARGUMENTS:
+            fprintf(out, VL_ANSI_RED "Error: Wrong number of arguments for '%s'." VL_ANSI_RESET "\n", what);
+            return false;
+        case VL_STATUS_UNSUPPORTED:
+            fprintf(out, VL_ANSI_RED "Error: Unable to compile %s yet." VL_ANSI_RESET "\n", what);
+            return false;
+        case VL_STATUS_LIMIT:
+            fprintf(out, VL_ANSI_RED "Error: Too many %s in one function." VL_ANSI_RESET "\n", what);
+            return false;
+        case VL_STATUS_RUNTIME:
+            fprintf(out, VL_ANSI_RED "Error: %s." VL_ANSI_RESET "\n", what);
             return false;
         default:
             return false;
@@ -538,6 +768,28 @@ bool vlNextToken(VLParser* parser) {
 }
 
 
+bool vlReportStatus(FILE* out, const VLParser* parser) {
+    return vlReportError(out, parser->status, parser->what);
+}
+
+
+bool vlCheckStatus(VLParser* parser) {
+    return vlReportStatus(stdout, parser);
+}
+
+
+size_t vlErrorPos(const VLParser* parser) {
+    // The lexer records the character it stopped at; anything later fails at the current token
+    return parser->errorPos != VL_NO_POS ? parser->errorPos : parser->token.pos;
+}
+
+
+bool vlNextToken(VLParser* parser) {
+    vlGrabToken(parser);
+    return vlCheckStatus(parser);
+}
+
+
 VLOperation vlGetOp(VLTokenKind kind, bool prefix) {
     switch (kind) {
         case VL_SYM_ADD: return prefix ? VL_OP_POS : VL_OP_ADD;
@@ -596,6 +848,7 @@ VLPrecedence vlGetPrec(VLOperation op) {
         case VL_OP_CALL:
         case VL_OP_INDEX:
         case VL_OP_MEMBER:
+        case VL_OP_GENERIC:
             return VL_PREC_ACCESS;
         case VL_OP_INC_AFT:
         case VL_OP_DEC_AFT:
@@ -735,6 +988,7 @@ size_t vlNumOperands(VLOperation op) {
 bool vlLToRAssoc(VLPrecedence prec) {
     switch (prec) {
         case VL_PREC_PREFIX:
+        case VL_PREC_CONDITIONAL:
         case VL_PREC_ASSIGNMENT:
             return false;
         default:
@@ -757,6 +1011,7 @@ bool vlEndsExpr(VLTokenKind kind, bool allowComma) {
         case VL_SYM_COLON:
         case VL_SYM_R_PAREN:
         case VL_SYM_R_SQUARE:
+        case VL_SYM_L_CURLY:
         case VL_SYM_R_CURLY:
             return true;
         case VL_SYM_COMMA:
@@ -767,14 +1022,416 @@ bool vlEndsExpr(VLTokenKind kind, bool allowComma) {
 }
 
 
+static bool vlPushOperand(VLParser* parser, VLExpression* expr) {
+    if (!expr) return false;
+    if (parser->operandCount == parser->operandCapacity) {
+        size_t capacity = parser->operandCapacity ? parser->operandCapacity * 2 : 64;
+        VLExpression** operands = realloc(parser->operands, capacity * sizeof(VLExpression*));
+        if (!operands) {
+            parser->status = VL_STATUS_OUT_OF_MEM;
+            return false;
+        }
+        parser->operands = operands;
+        parser->operandCapacity = capacity;
+    }
+    parser->operands[parser->operandCount++] = expr;
+    return true;
+}
+
+
+static bool vlPushOperator(VLParser* parser, VLOperation op, size_t pos, size_t base, size_t enclosing, bool open) {
+    if (parser->operatorCount == parser->operatorCapacity) {
+        size_t capacity = parser->operatorCapacity ? parser->operatorCapacity * 2 : 32;
+        VLPendingOp* operators = realloc(parser->operators, capacity * sizeof(VLPendingOp));
+        if (!operators) {
+            parser->status = VL_STATUS_OUT_OF_MEM;
+            return false;
+        }
+        parser->operators = operators;
+        parser->operatorCapacity = capacity;
+    }
+    VLPendingOp pending = {.operation = op, .pos = pos, .base = base, .enclosing = enclosing, .open = open};
+    parser->operators[parser->operatorCount++] = pending;
+    return true;
+}
+
+
+// Reduces every pending operator above the innermost open entry that should be applied before op
+static void vlReduceBefore(VLParser* parser, size_t operatorBase, VLOperation op) {
+    while (parser->status == VL_STATUS_OK && parser->operatorCount > operatorBase) {
+        VLPendingOp* top = &parser->operators[parser->operatorCount - 1];
+        if (top->open || !vlEvalsBefore(top->operation, op)) break;
+        vlMakeOperand(parser);
+    }
+}
+
+
+// Reduces everything above the open entry at index group
+static void vlReduceTo(VLParser* parser, size_t group) {
+    while (parser->status == VL_STATUS_OK && parser->operatorCount > group + 1) vlMakeOperand(parser);
+}
+
+
+// Replaces the open group at the top of the operator stack with a VL_EXPR_MULTI of its operands
+static void vlCloseGroup(VLParser* parser) {
+    VLPendingOp opener = parser->operators[--parser->operatorCount];
+    size_t count = parser->operandCount - opener.base;
+
+    // Plain parentheses around a single expression only group it
+    if (opener.operation == VL_OP_LIST && count == 1) return;
+
+    VLExpression* expr = vlNewExpr(parser, VL_EXPR_MULTI, opener.pos);
+    VLExpression** children = vlArenaAlloc(&parser->arena, count * sizeof(VLExpression*));
+    if (!expr || (count && !children)) {
+        parser->status = VL_STATUS_OUT_OF_MEM;
+        return;
+    }
+    if (count) memcpy(children, parser->operands + opener.base, count * sizeof(VLExpression*));
+    if (opener.operation == VL_OP_ARR_INIT) vlFoldArrayInit(children, count);
+    expr->multiOp.operation = opener.operation;
+    expr->multiOp.children = children;
+    expr->multiOp.count = count;
+
+    parser->operandCount = opener.base;
+    vlPushOperand(parser, expr);
+}
+
+
+static VLTokenKind vlGroupCloser(VLOperation op) {
+    switch (op) {
+        case VL_OP_LIST:
+        case VL_OP_CALL:
+            return VL_SYM_R_PAREN;
+        case VL_OP_INDEX:
+        case VL_OP_ARR_INIT:
+            return VL_SYM_R_SQUARE;
+        default:
+            return VL_SYM_COLON;
+    }
+}
+
+
+static VLExpression* vlMakeLeaf(VLParser* parser, VLToken token) {
+    VLExpression* expr = vlNewExpr(parser, VL_EXPR_NAME, token.pos);
+    if (!expr) return NULL;
+
+    switch (token.kind) {
+        case VL_TOKEN_NAME:
+            expr->stringValue = token.stringValue;
+            expr->symbol = token.symbol;
+            break;
+        case VL_TOKEN_STR:
+            expr->kind = VL_EXPR_STR;
+            expr->stringValue = token.stringValue;
+            expr->hasEscapes = token.hasEscapes;
+            break;
+        case VL_TOKEN_CHAR:     expr->kind = VL_EXPR_CHAR; expr->charValue = token.charValue; break;
+        case VL_TOKEN_BYTE:     expr->kind = VL_EXPR_BYTE; expr->byteValue = token.byteValue; break;
+        case VL_TOKEN_SHORT:    expr->kind = VL_EXPR_SHORT; expr->shortValue = token.shortValue; break;
+        case VL_TOKEN_INT:      expr->kind = VL_EXPR_INT; expr->intValue = token.intValue; break;
+        case VL_TOKEN_LONG:     expr->kind = VL_EXPR_LONG; expr->longValue = token.longValue; break;
+        case VL_TOKEN_FLOAT:    expr->kind = VL_EXPR_FLOAT; expr->floatValue = token.floatValue; break;
+        case VL_TOKEN_DOUBLE:   expr->kind = VL_EXPR_DOUBLE; expr->doubleValue = token.doubleValue; break;
+        case VL_TOKEN_BOOL:     expr->kind = VL_EXPR_BOOL; expr->boolValue = token.boolValue; break;
+        default: break;
+    }
+    return expr;
+}
+
+
+// The lexer takes integer magnitudes up to 2^(bits - 1) so that negating one reaches the type's minimum,
+// which makes that magnitude the only literal it hands over with the sign bit set
+static const char* vlOverflowingType(VLToken token) {
+    switch (token.kind) {
+        case VL_TOKEN_BYTE:     return token.byteValue < 0 ? "byte" : NULL;
+        case VL_TOKEN_SHORT:    return token.shortValue < 0 ? "short" : NULL;
+        case VL_TOKEN_INT:      return token.intValue < 0 ? "int" : NULL;
+        case VL_TOKEN_LONG:     return token.longValue < 0 ? "long" : NULL;
+        default:                return NULL;
+    }
+}
+
+
+static bool vlIsPrefixSymbol(VLTokenKind kind) {
+    switch (kind) {
+        case VL_SYM_ADD:
+        case VL_SYM_SUB:
+        case VL_SYM_NOT:
+        case VL_SYM_LNOT:
+        case VL_SYM_INC:
+        case VL_SYM_DEC:
+            return true;
+        default:
+            return false;
+    }
+}
+
+
+static bool vlIsAssignable(const VLExpression* expr) {
+    if (expr->kind == VL_EXPR_NAME) return true;
+    if (expr->kind == VL_EXPR_BINARY) {
+        switch (expr->binaryOp.operation) {
+            case VL_OP_MEMBER:
+            case VL_OP_DECLARE:
+            case VL_OP_DECLARE_FINAL:
+                return true;
+            default:
+                return false;
+        }
+    }
+    return expr->kind == VL_EXPR_MULTI && expr->multiOp.operation == VL_OP_INDEX && expr->multiOp.count == 2;
+}
+
+
+// Whether expr can be the type in a declaration: a name, possibly qualified, or an array, generic or
+// variadic type built from one
+static bool vlIsTypeShaped(const VLExpression* expr) {
+    while (expr->kind != VL_EXPR_NAME) {
+        if (expr->kind == VL_EXPR_UNARY && expr->unaryOp.operation == VL_OP_EXTEND) {
+            expr = expr->unaryOp.child;
+        } else if (expr->kind == VL_EXPR_BINARY && expr->binaryOp.operation == VL_OP_MEMBER) {
+            if (expr->binaryOp.second->kind != VL_EXPR_NAME) return false;
+            expr = expr->binaryOp.first;
+        } else if (expr->kind == VL_EXPR_MULTI && ((expr->multiOp.operation == VL_OP_INDEX && expr->multiOp.count == 1)
+                || expr->multiOp.operation == VL_OP_GENERIC)) {
+            expr = expr->multiOp.children[0];
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+
 void vlMakeOperand(VLParser* parser) {
-    if (parser->operandCount < vlNumOperands(parser->operators[parser->operatorCount - 1])) {
+    VLPendingOp pending = parser->operators[parser->operatorCount - 1];
+    size_t count = vlNumOperands(pending.operation);
+    if (parser->operandCount < count) {
         parser->status = VL_STATUS_NOT_ENOUGH_OPERANDS;
-        // TODO: set parser->what to something meaningful
+        parser->what = vlOpSpelling(pending.operation);
+        return;
+    }
+    --parser->operatorCount;
+
+    VLExpression** args = parser->operands + parser->operandCount - count;
+    VLExpression* folded = vlFoldOperation(parser, pending.operation, args, pending.pos);
+    if (folded) {
+        parser->operandCount -= count;
+        vlPushOperand(parser, folded);
+        return;
+    }
+
+    VLExpression* expr = vlNewExpr(parser, VL_EXPR_UNARY, pending.pos);
+    if (!expr) return;
+
+    switch (count) {
+        case 1:
+            expr->unaryOp.operation = pending.operation;
+            expr->unaryOp.child = args[0];
+            break;
+        case 2:
+            expr->kind = VL_EXPR_BINARY;
+            expr->binaryOp.operation = pending.operation;
+            expr->binaryOp.first = args[0];
+            expr->binaryOp.second = args[1];
+            break;
+        default:
+            expr->kind = VL_EXPR_TERNARY;
+            expr->ternaryOp.operation = pending.operation;
+            expr->ternaryOp.first = args[0];
+            expr->ternaryOp.second = args[1];
+            expr->ternaryOp.third = args[2];
+            break;
+    }
+
+    parser->operandCount -= count;
+    vlPushOperand(parser, expr);
+}
+
+
+size_t vlExprChildCount(const VLExpression* expr) {
+    switch (expr->kind) {
+        case VL_EXPR_UNARY: return 1;
+        case VL_EXPR_BINARY: return 2;
+        case VL_EXPR_TERNARY: return 3;
+        case VL_EXPR_MULTI: return expr->multiOp.count;
+        default: return 0;
     }
 }
 
 
+VLExpression* vlExprChild(const VLExpression* expr, size_t index) {
+    switch (expr->kind) {
+        case VL_EXPR_UNARY: return expr->unaryOp.child;
+        case VL_EXPR_BINARY: return index == 0 ? expr->binaryOp.first : expr->binaryOp.second;
+        case VL_EXPR_TERNARY:
+            return index == 0 ? expr->ternaryOp.first : index == 1 ? expr->ternaryOp.second : expr->ternaryOp.third;
+        case VL_EXPR_MULTI: return expr->multiOp.children[index];
+        default: return NULL;
+    }
+}
+
+
+VLLiteral vlExprLiteral(const VLExpression* expr) {
+    VLLiteral literal = {0};
+    switch (expr->kind) {
+        case VL_EXPR_NAME:
+        case VL_EXPR_STR:
+            literal.stringValue = expr->stringValue;
+            literal.symbol = expr->symbol;
+            literal.hasEscapes = expr->hasEscapes;
+            break;
+        case VL_EXPR_CHAR:      literal.charValue = expr->charValue; break;
+        case VL_EXPR_BYTE:      literal.byteValue = expr->byteValue; break;
+        case VL_EXPR_SHORT:     literal.shortValue = expr->shortValue; break;
+        case VL_EXPR_INT:       literal.intValue = expr->intValue; break;
+        case VL_EXPR_LONG:      literal.longValue = expr->longValue; break;
+        case VL_EXPR_FLOAT:     literal.floatValue = expr->floatValue; break;
+        case VL_EXPR_DOUBLE:    literal.doubleValue = expr->doubleValue; break;
+        case VL_EXPR_BOOL:      literal.boolValue = expr->boolValue; break;
+        default: break;
+    }
+    return literal;
+}
+
+
 VLExpression* vlParseExpr(VLParser* parser, VLDataType type, bool lvalue, bool allowComma, bool allowEmpty) {
-    return NULL; // temporary
-}
\ No newline at end of file
+    // Operator-precedence parsing over the parser's own stacks. Brackets and the '?' of a conditional
+    // are pushed as open entries instead of recursing, so nesting depth is bounded only by memory.
+    size_t operatorBase = parser->operatorCount;
+    size_t operandBase = parser->operandCount;
+    size_t group = VL_NO_GROUP;
+    bool expectOperand = true;
+    bool declareFinal = false;
+
+    while (parser->status == VL_STATUS_OK) {
+        VLToken token = parser->token;
+        VLPendingOp* inner = group == VL_NO_GROUP ? NULL : &parser->operators[group];
+
+        if (expectOperand) {
+            if (token.kind >= VL_TOKEN_NAME && token.kind <= VL_TOKEN_BOOL) {
+                // 2^(bits - 1) only fits as the direct operand of a unary '-', which folds it to the minimum
+                const char* overflow = vlOverflowingType(token);
+                const VLPendingOp* top = parser->operatorCount > operatorBase
+                    ? &parser->operators[parser->operatorCount - 1] : NULL;
+                if (overflow && !(top && top->operation == VL_OP_NEG && !top->open)) {
+                    parser->status = VL_STATUS_OVERFLOW;
+                    parser->what = overflow;
+                    break;
+                }
+                vlPushOperand(parser, vlMakeLeaf(parser, token));
+                expectOperand = false;
+            } else if (token.kind == VL_KW_FINAL) {
+                declareFinal = true;
+            } else if (token.kind == VL_SYM_L_PAREN || token.kind == VL_SYM_L_SQUARE) {
+                VLOperation op = token.kind == VL_SYM_L_PAREN ? VL_OP_LIST : VL_OP_ARR_INIT;
+                if (vlPushOperator(parser, op, token.pos, parser->operandCount, group, true)) {
+                    group = parser->operatorCount - 1;
+                }
+            } else if (vlIsPrefixSymbol(token.kind)) {
+                vlPushOperator(parser, vlGetOp(token.kind, true), token.pos, parser->operandCount, group, false);
+            } else if (inner && inner->operation != VL_OP_LIST && parser->operatorCount == group + 1
+                    && parser->operandCount == inner->base + (inner->operation != VL_OP_ARR_INIT)
+                    && token.kind == vlGroupCloser(inner->operation)) {
+                // Empty brackets: f(), T[] and [] are all fine
+                group = inner->enclosing;
+                vlCloseGroup(parser);
+                expectOperand = false;
+            } else if (allowEmpty && !inner && parser->operatorCount == operatorBase
+                    && parser->operandCount == operandBase && vlEndsExpr(token.kind, allowComma)) {
+                return NULL;
+            } else {
+                parser->status = VL_STATUS_UNEXPECTED;
+                parser->what = vlTokenSpelling(token.kind);
+            }
+        } else if (inner && token.kind == vlGroupCloser(inner->operation)) {
+            vlReduceTo(parser, group);
+            if (inner->operation == VL_OP_COND) {
+                // The ':' of a conditional; from here on it's an ordinary pending operator
+                inner->open = false;
+                group = inner->enclosing;
+                expectOperand = true;
+            } else {
+                group = inner->enclosing;
+                vlCloseGroup(parser);
+            }
+        } else if (token.kind == VL_SYM_COMMA && (inner ? inner->operation != VL_OP_COND : allowComma)) {
+            // Separates items, either inside brackets or in a top-level list
+            if (inner) {
+                vlReduceTo(parser, group);
+            } else {
+                while (parser->status == VL_STATUS_OK && parser->operatorCount > operatorBase) vlMakeOperand(parser);
+            }
+            expectOperand = true;
+        } else if (!inner && vlEndsExpr(token.kind, allowComma)) {
+            break;
+        } else if (token.kind == VL_SYM_INC || token.kind == VL_SYM_DEC || token.kind == VL_SYM_ELLIPSIS) {
+            VLOperation op = vlGetOp(token.kind, false);
+            vlReduceBefore(parser, operatorBase, op);
+            if (vlPushOperator(parser, op, token.pos, parser->operandCount, group, false)) vlMakeOperand(parser);
+        } else if (token.kind == VL_SYM_L_PAREN || token.kind == VL_SYM_L_SQUARE || token.kind == VL_SYM_COND) {
+            VLOperation op = vlGetOp(token.kind, false);
+            vlReduceBefore(parser, operatorBase, op);
+            // Calls and indexing keep their callee or array as the first child
+            size_t base = op == VL_OP_COND ? parser->operandCount : parser->operandCount - 1;
+            if (vlPushOperator(parser, op, token.pos, base, group, true)) group = parser->operatorCount - 1;
+            expectOperand = true;
+        } else if (token.kind == VL_TOKEN_NAME) {
+            // A name right after a type declares it, as in `double total`; the name itself is read next time.
+            // After any other operand it's most likely a missing ';'.
+            VLOperation op = declareFinal ? VL_OP_DECLARE_FINAL : VL_OP_DECLARE;
+            declareFinal = false;
+            vlReduceBefore(parser, operatorBase, op);
+            if (parser->status != VL_STATUS_OK) break;
+            if (!vlIsTypeShaped(parser->operands[parser->operandCount - 1])) {
+                parser->status = VL_STATUS_SYNTAX;
+                parser->what = token.stringValue.first;
+                break;
+            }
+            vlPushOperator(parser, op, token.pos, parser->operandCount, group, false);
+            expectOperand = true;
+            continue;
+        } else if ((token.kind >= VL_SYM_ADD || token.kind == VL_KW_IS)
+                && vlNumOperands(vlGetOp(token.kind, false)) == 2) {
+            VLOperation op = vlGetOp(token.kind, false);
+            vlReduceBefore(parser, operatorBase, op);
+            vlPushOperator(parser, op, token.pos, parser->operandCount, group, false);
+            expectOperand = true;
+        } else if (inner) {
+            parser->status = inner->operation == VL_OP_COND ? VL_STATUS_EXPECTED : VL_STATUS_UNCLOSED;
+            parser->what = vlTokenSpelling(inner->operation == VL_OP_COND ? VL_SYM_COLON :
+                    vlGroupCloser(inner->operation) == VL_SYM_R_PAREN ? VL_SYM_L_PAREN : VL_SYM_L_SQUARE);
+        } else {
+            parser->status = VL_STATUS_UNEXPECTED;
+            parser->what = vlTokenSpelling(token.kind);
+        }
+
+        if (parser->status != VL_STATUS_OK) break;
+        vlGrabToken(parser);
+    }
+
+    while (parser->status == VL_STATUS_OK && parser->operatorCount > operatorBase) vlMakeOperand(parser);
+
+    VLExpression* result = NULL;
+    if (parser->status == VL_STATUS_OK) {
+        if (parser->operandCount - operandBase > 1) {
+            // Top-level commas produce a list of everything parsed
+            if (vlPushOperator(parser, VL_OP_LIST, parser->operands[operandBase]->pos, operandBase, group, true)) {
+                vlCloseGroup(parser);
+            }
+        }
+        if (parser->status == VL_STATUS_OK) {
+            result = parser->operands[operandBase];
+            if (lvalue && !vlIsAssignable(result)) {
+                parser->status = VL_STATUS_EXPECTED;
+                parser->what = "assignable expression";
+                result = NULL;
+            }
+        }
+    }
+
+    parser->operatorCount = operatorBase;
+    parser->operandCount = operandBase;
+    (void) type;
+    return result;
+}
@@ -0,0 +1,764 @@
+/* ================
+ * src/vm.c
+ * VALLEY LANGUAGE COMPILER
+ * Interpreter for register bytecode
+ * ================
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+
+#include "../include/vm.h"
+
+// Threaded dispatch jumps straight from one instruction's handler to the next through a table of
+// label addresses, which GCC and Clang support; anything else falls back to a switch in a loop
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(VL_NO_COMPUTED_GOTO)
+#define VL_COMPUTED_GOTO
+#endif
+
+
+// ---- HELPERS ---- //
+
+static bool vlConcat(VLMachine* machine, VLValue* args);
+
+const VLNative vlNatives[] = {
+    {"concat", "str(str[],str)", vlConcat},
+};
+
+const size_t vlNativeCount = sizeof(vlNatives) / sizeof(vlNatives[0]);
+
+
+static bool vlRuntimeError(VLMachine* machine, const char* format, ...) {
+    machine->status = VL_STATUS_RUNTIME;
+    machine->what = machine->detail;
+    va_list args;
+    va_start(args, format);
+    vsnprintf(machine->detail, sizeof(machine->detail), format, args);
+    va_end(args);
+    return false;
+}
+
+
+static VLObject* vlNewObject(VLMachine* machine, size_t header, size_t count, size_t size) {
+    if (count > (SIZE_MAX - header) / (size ? size : 1)) {
+        machine->status = VL_STATUS_OUT_OF_MEM;
+        return NULL;
+    }
+    VLObject* object = calloc(1, header + count * size);
+    if (!object) {
+        machine->status = VL_STATUS_OUT_OF_MEM;
+        return NULL;
+    }
+    object->next = machine->objects;
+    machine->objects = object;
+    return object;
+}
+
+
+static bool vlConcat(VLMachine* machine, VLValue* args) {
+    const VLArrayObject* strings = args[0].p;
+    const VLStringObject* sep = args[1].p;
+    if (!strings || !sep) return vlRuntimeError(machine, "null passed to 'concat'");
+    const VLStringObject** items = (const VLStringObject**) (void*) strings->data;
+
+    size_t length = strings->length ? (strings->length - 1) * sep->length : 0;
+    for (size_t i = 0; i < strings->length; ++i) {
+        if (!items[i]) return vlRuntimeError(machine, "null passed to 'concat'");
+        length += items[i]->length;
+    }
+    VLStringObject* result = vlNewString(machine, length);
+    if (!result) return false;
+    char* at = result->data;
+    for (size_t i = 0; i < strings->length; ++i) {
+        if (i) {
+            memcpy(at, sep->data, sep->length);
+            at += sep->length;
+        }
+        memcpy(at, items[i]->data, items[i]->length);
+        at += items[i]->length;
+    }
+    args[0].p = result;
+    return true;
+}
+
+
+static VLLong vlWrapInt(uint64_t value) {
+    return (VLInt) (uint32_t) value;
+}
+
+
+// Float to integer conversions saturate, and NaN becomes zero
+static VLLong vlTruncate(VLDouble value, VLLong min, VLLong max) {
+    if (isnan(value)) return 0;
+    if (value <= (VLDouble) min) return min;
+    if (value >= (VLDouble) max) return max;
+    return (VLLong) value;
+}
+
+
+// Wraps like repeated multiplication would. A negative power of anything but 1 and -1 rounds to 0.
+static bool vlIntPower(VLMachine* machine, VLLong x, VLLong y, VLLong* result) {
+    if (y < 0) {
+        if (x == 0) return vlRuntimeError(machine, "division by zero");
+        *result = x == 1 ? 1 : x == -1 ? (y & 1 ? -1 : 1) : 0;
+        return true;
+    }
+    uint64_t a = (uint64_t) x, b = (uint64_t) y, value = 1;
+    for (; b; b >>= 1, a *= a) {
+        if (b & 1) value *= a;
+    }
+    *result = (VLLong) value;
+    return true;
+}
+
+
+static bool vlStringsEqual(const VLStringObject* first, const VLStringObject* second) {
+    if (first == second) return true;
+    if (!first || !second || first->length != second->length) return false;
+    return !memcmp(first->data, second->data, first->length);
+}
+
+
+static bool vlCheckElement(VLMachine* machine, const VLArrayObject* array, VLLong index) {
+    if (!array) return vlRuntimeError(machine, "indexing a null array");
+    if (index < 0 || (uint64_t) index >= array->length) {
+        return vlRuntimeError(machine, "index %lld is out of bounds for length %zu", (long long) index, array->length);
+    }
+    return true;
+}
+
+
+// Moves an array's elements to a buffer of its own with room for capacity of them, which must be
+// at least its length. An array that has left its inline storage never goes back to it.
+static bool vlResizeArray(VLMachine* machine, VLArrayObject* array, size_t capacity) {
+    size_t size = vlElementSize(array->element);
+    char* data = capacity <= SIZE_MAX / size ? realloc(array->header.buffer, (capacity ? capacity : 1) * size) : NULL;
+    if (!data) {
+        machine->status = VL_STATUS_OUT_OF_MEM;
+        return false;
+    }
+    if (!array->header.buffer) memcpy(data, array->storage, array->length * size);
+    array->header.buffer = data;
+    array->data = data;
+    array->capacity = capacity;
+    return true;
+}
+
+
+// Makes room for an element at index, counting from the end when it is negative so that -1
+// appends, by moving those from index on up one. Capacity doubles whenever it runs out, so n
+// appends move O(n) elements in all.
+static bool vlOpenSlot(VLMachine* machine, VLArrayObject* array, VLLong index, VLLong* slot) {
+    if (!array) return vlRuntimeError(machine, "adding to a null array");
+    VLLong at = index < 0 ? index + (VLLong) array->length + 1 : index;
+    if (at < 0 || (uint64_t) at > array->length) {
+        return vlRuntimeError(machine, "index %lld is out of bounds for adding to length %zu", (long long) index,
+                              array->length);
+    }
+    size_t grown = array->capacity ? array->capacity * 2 : 1;
+    if (array->length == array->capacity && !vlResizeArray(machine, array, grown)) return false;
+    size_t size = vlElementSize(array->element);
+    char* from = array->data + (size_t) at * size;
+    memmove(from + size, from, (array->length - (size_t) at) * size);
+    ++array->length;
+    *slot = at;
+    return true;
+}
+
+
+// Setting the capacity below the length drops the elements past it. An array with a buffer of its
+// own has it reallocated to exactly the capacity asked for, while inline storage is only left to
+// grow.
+static bool vlSetCapacity(VLMachine* machine, VLArrayObject* array, VLLong capacity) {
+    if (!array) return vlRuntimeError(machine, "setting the capacity of null");
+    if (capacity < 0) return vlRuntimeError(machine, "negative array capacity %lld", (long long) capacity);
+    if ((uint64_t) capacity < array->length) array->length = (size_t) capacity;
+    if (!array->header.buffer && (uint64_t) capacity <= array->capacity) return true;
+    return vlResizeArray(machine, array, (size_t) capacity);
+}
+
+
+// A pack holds exactly its elements, with no header of its own in the object list, since it goes
+// away when the call it was made for returns. One too big for what's left of the pack stack is
+// made an ordinary array instead.
+static VLArrayObject* vlNewPack(VLMachine* machine, VLElementKind element, size_t length) {
+    size_t size = vlElementSize(element);
+    size_t align = alignof(max_align_t);
+    size_t room = VL_PACK_BYTES - machine->packTop;
+    if (room < sizeof(VLArrayObject) || length > (room - sizeof(VLArrayObject)) / size) {
+        return vlNewArray(machine, element, length);
+    }
+    VLArrayObject* array = (VLArrayObject*) (void*) (machine->packs + machine->packTop);
+    machine->packTop += (sizeof(VLArrayObject) + length * size + align - 1) & ~(align - 1);
+    *array = (VLArrayObject) {.length = length, .capacity = length, .element = element, .data = array->storage};
+    memset(array->storage, 0, length * size);
+    return array;
+}
+
+
+// Pops the pack stack back to where pack was taken from, unless it didn't come from there
+static void vlDropPack(VLMachine* machine, const VLArrayObject* pack) {
+    uintptr_t at = (uintptr_t) pack - (uintptr_t) machine->packs;
+    if (at < VL_PACK_BYTES) machine->packTop = (size_t) at;
+}
+
+
+#define VL_STEP_ADD(a, b) ((a) + (b))
+#define VL_STEP_MUL(a, b) ((a) * (b))
+#define VL_STEP_AND(a, b) ((a) & (b))
+#define VL_STEP_OR(a, b) ((a) | (b))
+#define VL_STEP_XOR(a, b) ((a) ^ (b))
+#define VL_STEP_MIN(a, b) ((b) < (a) ? (b) : (a))
+#define VL_STEP_MAX(a, b) ((b) > (a) ? (b) : (a))
+
+// The lanes are independent, so the compiler is free to keep them in vector registers. Counting
+// whole blocks and bounding the tail by the lane count lets it see every lanes[j] stays in range.
+#define VL_FOLD(type, lane, field, identity, step) do { \
+        const type* items = (const type*) (const void*) array->data; \
+        size_t blocks = array->length / VL_REDUCE_LANES, rest = array->length % VL_REDUCE_LANES; \
+        lane lanes[VL_REDUCE_LANES]; \
+        for (size_t j = 0; j < VL_REDUCE_LANES; ++j) lanes[j] = (identity); \
+        lanes[0] = (lane) acc.field; \
+        for (size_t b = 0; b < blocks; ++b, items += VL_REDUCE_LANES) { \
+            for (size_t j = 0; j < VL_REDUCE_LANES; ++j) lanes[j] = step(lanes[j], (lane) items[j]); \
+        } \
+        for (size_t j = 0; j < rest; ++j) lanes[j] = step(lanes[j], (lane) items[j]); \
+        for (size_t j = 1; j < VL_REDUCE_LANES; ++j) lanes[0] = step(lanes[0], lanes[j]); \
+        acc.field = lanes[0]; \
+    } while (0)
+#define VL_FOLD_STRICT(type, field, step) do { \
+        const type* items = (const type*) (const void*) array->data; \
+        for (size_t i = 0; i < array->length; ++i) acc.field = step(acc.field, items[i]); \
+    } while (0)
+
+#define VL_FOLD_INTS(type) \
+    switch (op) { \
+        case VL_REDUCE_ADD: VL_FOLD(type, uint64_t, i, 0, VL_STEP_ADD); break; \
+        case VL_REDUCE_MUL: VL_FOLD(type, uint64_t, i, 1, VL_STEP_MUL); break; \
+        case VL_REDUCE_AND: VL_FOLD(type, uint64_t, i, UINT64_MAX, VL_STEP_AND); break; \
+        case VL_REDUCE_OR: VL_FOLD(type, uint64_t, i, 0, VL_STEP_OR); break; \
+        case VL_REDUCE_XOR: VL_FOLD(type, uint64_t, i, 0, VL_STEP_XOR); break; \
+        case VL_REDUCE_MIN: VL_FOLD(type, int64_t, i, INT64_MAX, VL_STEP_MIN); break; \
+        case VL_REDUCE_MAX: VL_FOLD(type, int64_t, i, INT64_MIN, VL_STEP_MAX); break; \
+    }
+#define VL_FOLD_REALS(type, field) \
+    switch (op) { \
+        case VL_REDUCE_ADD: \
+            if (strict) VL_FOLD_STRICT(type, field, VL_STEP_ADD); \
+            else VL_FOLD(type, type, field, (type) -0.0, VL_STEP_ADD); \
+            break; \
+        case VL_REDUCE_MUL: \
+            if (strict) VL_FOLD_STRICT(type, field, VL_STEP_MUL); \
+            else VL_FOLD(type, type, field, 1, VL_STEP_MUL); \
+            break; \
+        case VL_REDUCE_MIN: \
+            if (strict) VL_FOLD_STRICT(type, field, VL_STEP_MIN); \
+            else VL_FOLD(type, type, field, INFINITY, VL_STEP_MIN); \
+            break; \
+        case VL_REDUCE_MAX: \
+            if (strict) VL_FOLD_STRICT(type, field, VL_STEP_MAX); \
+            else VL_FOLD(type, type, field, -INFINITY, VL_STEP_MAX); \
+            break; \
+        default: break; \
+    }
+
+// Folds every element of array into acc as the mode of a REDUCE asks. Integers go in as longs, so
+// wrapping to a narrower type once at the end gives what wrapping after each step would have.
+static VLValue vlReduce(const VLArrayObject* array, VLValue acc, uint32_t mode) {
+    VLReduceOp op = VL_REDUCE_OP(mode);
+    bool strict = mode & VL_REDUCE_STRICT;
+    switch (VL_REDUCE_ELEMENT(mode)) {
+        case VL_ELEM_I8: VL_FOLD_INTS(int8_t); break;
+        case VL_ELEM_U8: VL_FOLD_INTS(uint8_t); break;
+        case VL_ELEM_I16: VL_FOLD_INTS(int16_t); break;
+        case VL_ELEM_I32: VL_FOLD_INTS(int32_t); break;
+        case VL_ELEM_I64: VL_FOLD_INTS(int64_t); break;
+        case VL_ELEM_F32: VL_FOLD_REALS(float, f); break;
+        case VL_ELEM_F64: VL_FOLD_REALS(double, d); break;
+        default: break;
+    }
+    return acc;
+}
+
+
+static VLValue vlLoadElement(const VLArrayObject* array, size_t index) {
+    VLValue value;
+    const char* at = array->data + index * vlElementSize(array->element);
+    switch (array->element) {
+        case VL_ELEM_I8: value.i = *(const int8_t*) at; break;
+        case VL_ELEM_U8: value.i = *(const uint8_t*) at; break;
+        case VL_ELEM_I16: value.i = *(const int16_t*) at; break;
+        case VL_ELEM_I32: value.i = *(const int32_t*) at; break;
+        case VL_ELEM_I64: value.i = *(const int64_t*) at; break;
+        case VL_ELEM_F32: value.f = *(const float*) at; break;
+        case VL_ELEM_F64: value.d = *(const double*) at; break;
+        default: value.p = *(void* const*) at; break;
+    }
+    return value;
+}
+
+
+// ---- FUNCTIONS ---- //
+
+size_t vlFindNative(VLString name) {
+    for (size_t i = 0; i < vlNativeCount; ++i) {
+        if (strlen(vlNatives[i].name) == name.len && !memcmp(vlNatives[i].name, name.first, name.len)) return i;
+    }
+    return VL_NO_NATIVE;
+}
+
+
+bool vlInitMachine(VLMachine* machine, const VLProgram* program) {
+    memset(machine, 0, sizeof(VLMachine));
+    machine->program = program;
+    machine->status = VL_STATUS_OK;
+    machine->stack = calloc(VL_STACK_VALUES, sizeof(VLValue));
+    machine->frames = malloc(VL_MAX_FRAMES * sizeof(VLFrame));
+    machine->globals = calloc(program->globalCount ? program->globalCount : 1, sizeof(VLValue));
+    machine->packs = malloc(VL_PACK_BYTES);
+    if (!machine->stack || !machine->frames || !machine->globals || !machine->packs) {
+        vlFreeMachine(machine);
+        machine->status = VL_STATUS_OUT_OF_MEM;
+        return false;
+    }
+    return true;
+}
+
+
+void vlFreeMachine(VLMachine* machine) {
+    for (VLObject* object = machine->objects; object;) {
+        VLObject* next = object->next;
+        free(object->buffer);
+        free(object);
+        object = next;
+    }
+    machine->objects = NULL;
+    if (machine->jit) vlFreeJit(machine->jit);
+    free(machine->jit);
+    machine->jit = NULL;
+    free(machine->stack);
+    free(machine->frames);
+    free(machine->globals);
+    free(machine->packs);
+    machine->stack = NULL;
+    machine->frames = NULL;
+    machine->globals = NULL;
+    machine->packs = NULL;
+}
+
+
+bool vlEnableJit(VLMachine* machine) {
+    if (machine->jit) return true;
+    machine->jit = malloc(sizeof(VLJit));
+    if (!machine->jit || !vlInitJit(machine->jit, machine->program)) {
+        free(machine->jit);
+        machine->jit = NULL;
+        machine->status = VL_STATUS_OUT_OF_MEM;
+        return false;
+    }
+    return true;
+}
+
+
+VLStringObject* vlNewString(VLMachine* machine, size_t length) {
+    if (length == SIZE_MAX) {
+        machine->status = VL_STATUS_OUT_OF_MEM;
+        return NULL;
+    }
+    VLStringObject* string = (VLStringObject*) vlNewObject(machine, sizeof(VLStringObject), length + 1, 1);
+    if (string) string->length = length;
+    return string;
+}
+
+
+VLArrayObject* vlNewArray(VLMachine* machine, VLElementKind element, size_t length) {
+    size_t size = vlElementSize(element);
+    size_t capacity = length > VL_ARRAY_INLINE_BYTES / size ? length : VL_ARRAY_INLINE_BYTES / size;
+    VLArrayObject* array = (VLArrayObject*) vlNewObject(machine, sizeof(VLArrayObject), capacity, size);
+    if (array) {
+        array->length = length;
+        array->capacity = capacity;
+        array->element = element;
+        array->data = array->storage;
+    }
+    return array;
+}
+
+
+// For compiled code, which folds arrays exactly the way REDUCE does here
+VLValue vlReduceArray(const VLArrayObject* array, VLValue acc, uint32_t mode) {
+    return vlReduce(array, acc, mode);
+}
+
+
+bool vlRunProgram(VLMachine* machine) {
+    const VLProgram* program = machine->program;
+    const VLFunction* fn = &program->functions[program->functionCount - 1];
+    const VLValue* k = fn->constants;
+    const uint32_t* pc = fn->code;
+    VLValue* base = machine->stack;
+    VLValue* globals = machine->globals;
+    VLValue* stackEnd = machine->stack + VL_STACK_VALUES;
+    const VLJitEntry* compiled = machine->jit ? machine->jit->entries : NULL;
+    VLJitContext context = {.globals = globals, .stackEnd = stackEnd};
+    int jitError;
+    uint32_t ins;
+    machine->frames[0] = (VLFrame) {fn, pc, base};
+    machine->frameCount = 1;
+
+#define R(x) base[x]
+#define RA R(VL_INS_A(ins))
+#define RB R(VL_INS_B(ins))
+#define RC R(VL_INS_C(ins))
+#define VL_FAIL() goto fail
+#define VL_BINARY_I(name, expr) VL_CASE(name) { uint64_t a = (uint64_t) RB.i, b = (uint64_t) RC.i; \
+    RA.i = vlWrapInt(expr); VL_NEXT(); }
+#define VL_BINARY_L(name, expr) VL_CASE(name) { uint64_t a = (uint64_t) RB.i, b = (uint64_t) RC.i; \
+    RA.i = (VLLong) (expr); VL_NEXT(); }
+#define VL_BINARY(name, field, op) VL_CASE(name) RA.field = RB.field op RC.field; VL_NEXT();
+#define VL_COMPARE(name, field, op) VL_CASE(name) RA.i = RB.field op RC.field; VL_NEXT();
+#define VL_CONVERT(name, expr) VL_CASE(name) RA = (VLValue) {expr}; VL_NEXT();
+
+#ifdef VL_COMPUTED_GOTO
+    static const void* labels[] = {
+#define VL_BC_LABEL(name, format) &&vl_op_##name,
+        VL_OPCODES(VL_BC_LABEL)
+#undef VL_BC_LABEL
+    };
+#define VL_CASE(name) vl_op_##name:
+#define VL_NEXT() do { ins = *pc++; goto *labels[VL_INS_OP(ins)]; } while (0)
+#define VL_FALLTHROUGH()
+    VL_NEXT();
+#else
+#define VL_CASE(name) case VL_BC_##name:
+#define VL_NEXT() continue
+#define VL_FALLTHROUGH() [[fallthrough]]
+    for (;;) {
+        ins = *pc++;
+        switch ((VLOpcode) VL_INS_OP(ins)) {
+#endif
+
+    VL_CASE(MOVE) RA = RB; VL_NEXT();
+    VL_CASE(LOADK) RA = k[VL_INS_BX(ins)]; VL_NEXT();
+    VL_CASE(LOADI) RA.i = VL_INS_SBX(ins); VL_NEXT();
+    VL_CASE(LOADNULL) RA.p = NULL; VL_NEXT();
+
+    VL_CONVERT(I2F, .f = (VLFloat) RB.i)
+    VL_CONVERT(I2D, .d = (VLDouble) RB.i)
+    VL_CONVERT(L2I, .i = vlWrapInt((uint64_t) RB.i))
+    VL_CONVERT(L2F, .f = (VLFloat) RB.i)
+    VL_CONVERT(L2D, .d = (VLDouble) RB.i)
+    VL_CONVERT(F2I, .i = vlTruncate(RB.f, INT32_MIN, INT32_MAX))
+    VL_CONVERT(F2L, .i = vlTruncate(RB.f, INT64_MIN, INT64_MAX))
+    VL_CONVERT(F2D, .d = RB.f)
+    VL_CONVERT(D2I, .i = vlTruncate(RB.d, INT32_MIN, INT32_MAX))
+    VL_CONVERT(D2L, .i = vlTruncate(RB.d, INT64_MIN, INT64_MAX))
+    VL_CONVERT(D2F, .f = (VLFloat) RB.d)
+    VL_CONVERT(NARROWB, .i = (int8_t) RB.i)
+    VL_CONVERT(NARROWS, .i = (int16_t) RB.i)
+    VL_CONVERT(NARROWC, .i = (uint8_t) RB.i)
+
+    VL_BINARY_I(ADD_I, a + b)
+    VL_BINARY_L(ADD_L, a + b)
+    VL_BINARY(ADD_F, f, +)
+    VL_BINARY(ADD_D, d, +)
+    VL_BINARY_I(SUB_I, a - b)
+    VL_BINARY_L(SUB_L, a - b)
+    VL_BINARY(SUB_F, f, -)
+    VL_BINARY(SUB_D, d, -)
+    VL_BINARY_I(MUL_I, a * b)
+    VL_BINARY_L(MUL_L, a * b)
+    VL_BINARY(MUL_F, f, *)
+    VL_BINARY(MUL_D, d, *)
+
+    // Ints are held in 64 bits, so dividing the lowest int by -1 can't trap until it's wrapped
+    VL_CASE(DIV_I)
+        if (!RC.i) goto divide;
+        RA.i = vlWrapInt((uint64_t) (RB.i / RC.i));
+        VL_NEXT();
+    VL_CASE(DIV_L)
+        if (!RC.i) goto divide;
+        RA.i = RC.i == -1 ? (VLLong) (0 - (uint64_t) RB.i) : RB.i / RC.i;
+        VL_NEXT();
+    VL_BINARY(DIV_F, f, /)
+    VL_BINARY(DIV_D, d, /)
+    VL_CASE(MOD_I)
+        if (!RC.i) goto divide;
+        RA.i = RB.i % RC.i;
+        VL_NEXT();
+    VL_CASE(MOD_L)
+        if (!RC.i) goto divide;
+        RA.i = RC.i == -1 ? 0 : RB.i % RC.i;
+        VL_NEXT();
+    VL_CONVERT(MOD_F, .f = (VLFloat) fmod(RB.f, RC.f))
+    VL_CONVERT(MOD_D, .d = fmod(RB.d, RC.d))
+    VL_CASE(EXP_I) {
+        VLLong result;
+        if (!vlIntPower(machine, RB.i, RC.i, &result)) VL_FAIL();
+        RA.i = vlWrapInt((uint64_t) result);
+        VL_NEXT();
+    }
+    VL_CASE(EXP_L)
+        if (!vlIntPower(machine, RB.i, RC.i, &RA.i)) VL_FAIL();
+        VL_NEXT();
+    // Computed in double and rounded, so it matches what the constant folder works out
+    VL_CONVERT(EXP_F, .f = (VLFloat) pow(RB.f, RC.f))
+    VL_CONVERT(EXP_D, .d = pow(RB.d, RC.d))
+    VL_CASE(ADDI_I) RA.i = vlWrapInt((uint64_t) RB.i + (uint64_t) (VLLong) VL_INS_SC(ins)); VL_NEXT();
+    VL_CASE(ADDI_L) RA.i = (VLLong) ((uint64_t) RB.i + (uint64_t) (VLLong) VL_INS_SC(ins)); VL_NEXT();
+
+    VL_CONVERT(NEG_I, .i = vlWrapInt(0 - (uint64_t) RB.i))
+    VL_CONVERT(NEG_L, .i = (VLLong) (0 - (uint64_t) RB.i))
+    VL_CONVERT(NEG_F, .f = -RB.f)
+    VL_CONVERT(NEG_D, .d = -RB.d)
+    VL_CONVERT(NOT_I, .i = ~RB.i)
+    VL_CONVERT(NOT_L, .i = ~RB.i)
+    VL_CONVERT(LNOT, .i = !RB.i)
+    VL_BINARY(AND_I, i, &)
+    VL_BINARY(AND_L, i, &)
+    VL_BINARY(OR_I, i, |)
+    VL_BINARY(OR_L, i, |)
+    VL_BINARY(XOR_I, i, ^)
+    VL_BINARY(XOR_L, i, ^)
+    VL_BINARY_I(SHL_I, a << (b & 31))
+    VL_BINARY_L(SHL_L, a << (b & 63))
+    VL_CONVERT(SHR_I, .i = RB.i >> (RC.i & 31))
+    VL_CONVERT(SHR_L, .i = RB.i >> (RC.i & 63))
+
+    VL_COMPARE(EQ_I, i, ==)
+    VL_COMPARE(EQ_L, i, ==)
+    VL_COMPARE(EQ_F, f, ==)
+    VL_COMPARE(EQ_D, d, ==)
+    VL_CONVERT(EQ_S, .i = vlStringsEqual(RB.p, RC.p))
+    VL_COMPARE(EQ_P, p, ==)
+    VL_COMPARE(NE_I, i, !=)
+    VL_COMPARE(NE_L, i, !=)
+    VL_COMPARE(NE_F, f, !=)
+    VL_COMPARE(NE_D, d, !=)
+    VL_CONVERT(NE_S, .i = !vlStringsEqual(RB.p, RC.p))
+    VL_COMPARE(NE_P, p, !=)
+    VL_COMPARE(LT_I, i, <)
+    VL_COMPARE(LT_L, i, <)
+    VL_COMPARE(LT_F, f, <)
+    VL_COMPARE(LT_D, d, <)
+    VL_COMPARE(LE_I, i, <=)
+    VL_COMPARE(LE_L, i, <=)
+    VL_COMPARE(LE_F, f, <=)
+    VL_COMPARE(LE_D, d, <=)
+
+    VL_CASE(JMP) pc += VL_INS_SAX(ins); VL_NEXT();
+    VL_CASE(JT) if (RA.i) pc += VL_INS_SBX(ins); VL_NEXT();
+    VL_CASE(JF) if (!RA.i) pc += VL_INS_SBX(ins); VL_NEXT();
+
+    VL_CASE(NEWARR) {
+        if (RB.i < 0) {
+            vlRuntimeError(machine, "negative array length %lld", (long long) RB.i);
+            VL_FAIL();
+        }
+        VLArrayObject* array = vlNewArray(machine, (VLElementKind) VL_INS_C(ins), (size_t) RB.i);
+        if (!array) VL_FAIL();
+        RA.p = array;
+        VL_NEXT();
+    }
+    VL_CASE(NEWPACK) {
+        VLArrayObject* array = vlNewPack(machine, (VLElementKind) VL_INS_C(ins), (size_t) RB.i);
+        if (!array) VL_FAIL();
+        RA.p = array;
+        VL_NEXT();
+    }
+    VL_CASE(DROPPACK)
+        vlDropPack(machine, RA.p);
+        VL_NEXT();
+    // Strings keep their length in the same place arrays do
+    VL_CASE(REDUCE)
+        if (!RB.p) {
+            vlRuntimeError(machine, "taking the length of null");
+            VL_FAIL();
+        }
+        RA = vlReduce(RB.p, RA, VL_INS_C(ins));
+        VL_NEXT();
+    VL_CASE(LEN)
+        if (!RB.p) {
+            vlRuntimeError(machine, "taking the length of null");
+            VL_FAIL();
+        }
+        RA.i = (VLLong) ((const VLArrayObject*) RB.p)->length;
+        VL_NEXT();
+    VL_CASE(CAP)
+        if (!RB.p) {
+            vlRuntimeError(machine, "taking the capacity of null");
+            VL_FAIL();
+        }
+        RA.i = (VLLong) ((const VLArrayObject*) RB.p)->capacity;
+        VL_NEXT();
+    VL_CASE(SETCAP)
+        if (!vlSetCapacity(machine, RA.p, RB.i)) VL_FAIL();
+        VL_NEXT();
+
+#define VL_AGET(name, type, field) VL_CASE(name) { \
+        const VLArrayObject* array = RB.p; \
+        if (!vlCheckElement(machine, array, RC.i)) VL_FAIL(); \
+        RA.field = ((type const*) (const void*) array->data)[RC.i]; \
+        VL_NEXT(); }
+#define VL_ASET(name, type, field) VL_CASE(name) { \
+        VLArrayObject* array = RA.p; \
+        if (!vlCheckElement(machine, array, RB.i)) VL_FAIL(); \
+        ((type*) (void*) array->data)[RB.i] = (type) RC.field; \
+        VL_NEXT(); }
+
+    VL_AGET(AGET_I8, int8_t, i)
+    VL_AGET(AGET_U8, uint8_t, i)
+    VL_AGET(AGET_I16, int16_t, i)
+    VL_AGET(AGET_I32, int32_t, i)
+    VL_AGET(AGET_I64, int64_t, i)
+    VL_AGET(AGET_F32, float, f)
+    VL_AGET(AGET_F64, double, d)
+    VL_AGET(AGET_REF, void*, p)
+    VL_ASET(ASET_I8, uint8_t, i)
+    VL_ASET(ASET_I16, int16_t, i)
+    VL_ASET(ASET_I32, int32_t, i)
+    VL_ASET(ASET_I64, int64_t, i)
+    VL_ASET(ASET_F32, float, f)
+    VL_ASET(ASET_F64, double, d)
+    VL_ASET(ASET_REF, void*, p)
+    VL_CASE(AINS)
+        if (!vlOpenSlot(machine, RB.p, RC.i, &RA.i)) VL_FAIL();
+        VL_NEXT();
+
+    VL_CASE(GETG) RA = globals[VL_INS_BX(ins)]; VL_NEXT();
+    VL_CASE(SETG) globals[VL_INS_BX(ins)] = RA; VL_NEXT();
+
+    VL_CASE(CALL) {
+        const VLFunction* callee = &program->functions[VL_INS_BX(ins)];
+        VLValue* window = &RA;
+        if (machine->frameCount == VL_MAX_FRAMES || window + callee->registerCount > stackEnd) {
+            vlRuntimeError(machine, "stack overflow");
+            VL_FAIL();
+        }
+        // Compiled code takes the frames it needs from those left
+        if (compiled && compiled[VL_INS_BX(ins)]) {
+            context.depth = (int64_t) (VL_MAX_FRAMES - machine->frameCount - 1);
+            if ((jitError = compiled[VL_INS_BX(ins)](window, &context)) != VL_JIT_OK) goto jitFail;
+            VL_NEXT();
+        }
+        machine->frames[machine->frameCount - 1].pc = pc;
+        machine->frames[machine->frameCount++] = (VLFrame) {callee, callee->code, window};
+        fn = callee;
+        k = fn->constants;
+        pc = fn->code;
+        base = window;
+        VL_NEXT();
+    }
+    VL_CASE(CALLN)
+        if (!vlNatives[VL_INS_BX(ins)].call(machine, &RA)) VL_FAIL();
+        VL_NEXT();
+    VL_CASE(RET)
+        R(0) = RA;
+        VL_FALLTHROUGH();
+    VL_CASE(RETV)
+        if (--machine->frameCount == 0) return true;
+        {
+            const VLFrame* caller = &machine->frames[machine->frameCount - 1];
+            fn = caller->function;
+            k = fn->constants;
+            pc = caller->pc;
+            base = caller->base;
+        }
+        VL_NEXT();
+
+#ifndef VL_COMPUTED_GOTO
+        }
+    }
+#endif
+
+jitFail:
+    switch (jitError) {
+        case VL_JIT_DIVIDE: vlRuntimeError(machine, "division by zero"); break;
+        case VL_JIT_NULL_LENGTH: vlRuntimeError(machine, "taking the length of null"); break;
+        case VL_JIT_NULL_INDEX: vlRuntimeError(machine, "indexing a null array"); break;
+        case VL_JIT_BOUNDS:
+            vlRuntimeError(machine, "index %lld is out of bounds for length %zu", (long long) context.index,
+                           (size_t) context.length);
+            break;
+        default: vlRuntimeError(machine, "stack overflow"); break;
+    }
+    machine->pos = program->functions[context.function].positions[context.at];
+    return false;
+divide:
+    vlRuntimeError(machine, "division by zero");
+fail:
+    machine->pos = fn->positions[pc - fn->code - 1];
+    if (machine->status == VL_STATUS_OUT_OF_MEM) machine->what = "";
+    return false;
+
+#undef R
+#undef RA
+#undef RB
+#undef RC
+#undef VL_FAIL
+#undef VL_BINARY_I
+#undef VL_BINARY_L
+#undef VL_BINARY
+#undef VL_COMPARE
+#undef VL_CONVERT
+#undef VL_AGET
+#undef VL_ASET
+#undef VL_CASE
+#undef VL_NEXT
+#undef VL_FALLTHROUGH
+}
+
+
+void vlPrintValue(FILE* out, VLValue value, VLType type) {
+    if (type.rank) {
+        const VLArrayObject* array = value.p;
+        if (!array) {
+            fputs("null", out);
+            return;
+        }
+        VLType element = {type.base, (uint8_t) (type.rank - 1)};
+        fputc('[', out);
+        for (size_t i = 0; i < array->length; ++i) {
+            if (i) fputs(", ", out);
+            vlPrintValue(out, vlLoadElement(array, i), element);
+        }
+        fputc(']', out);
+        return;
+    }
+    switch (type.base) {
+        case VL_TYPE_STR: {
+            const VLStringObject* string = value.p;
+            if (!string) {
+                fputs("null", out);
+                break;
+            }
+            vlPrintQuoted(out, string);
+            break;
+        }
+        case VL_TYPE_CHAR: fprintf(out, "%u", (unsigned) value.i); break;
+        case VL_TYPE_BOOL: fputs(value.i ? "true" : "false", out); break;
+        case VL_TYPE_FLOAT: vlPrintReal(out, value.f, true); break;
+        case VL_TYPE_DOUBLE: vlPrintReal(out, value.d, false); break;
+        case VL_TYPE_BYTE:
+        case VL_TYPE_SHORT:
+        case VL_TYPE_INT:
+        case VL_TYPE_LONG: fprintf(out, "%lld", (long long) value.i); break;
+        default: fputs(value.p ? "<object>" : "null", out); break;
+    }
+}
+
+
+void vlPrintVariables(FILE* out, const VLMachine* machine) {
+    const VLProgram* program = machine->program;
+    char type[64];
+    for (size_t i = 0; i < program->variableCount; ++i) {
+        const VLVariable* variable = &program->variables[i];
+        VLValue value = variable->global ? machine->globals[variable->slot] : machine->stack[variable->slot];
+        fprintf(out, "%s %.*s = ", vlTypeName(variable->type, type, sizeof(type)), (int) variable->name.len,
+                variable->name.first);
+        vlPrintValue(out, value, variable->type);
+        fputc('\n', out);
+    }
+}
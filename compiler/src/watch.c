@@ -0,0 +1,326 @@
+/* ================
+ * src/watch.c
+ * VALLEY LANGUAGE COMPILER
+ * Incremental reparsing and the inotify watch loop
+ * ================
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#include "../include/watch.h"
+
+
+// ---- HELPERS ---- //
+
+static size_t vlCountLines(const char* p, const char* end) {
+    size_t count = 0;
+    while (p < end && (p = memchr(p, '\n', (size_t) (end - p)))) {
+        ++count;
+        ++p;
+    }
+    return count;
+}
+
+
+static size_t vlCommonPrefix(const char* a, const char* b, size_t limit) {
+    size_t n = 0;
+    while (n + 64 <= limit && !memcmp(a + n, b + n, 64)) n += 64;
+    while (n < limit && a[n] == b[n]) ++n;
+    return n;
+}
+
+
+// Like vlCommonPrefix, but comparing backwards from the ends of a and b
+static size_t vlCommonSuffix(const char* aEnd, const char* bEnd, size_t limit) {
+    size_t n = 0;
+    while (n + 64 <= limit && !memcmp(aEnd - n - 64, bEnd - n - 64, 64)) n += 64;
+    while (n < limit && aEnd[-(ptrdiff_t) n - 1] == bEnd[-(ptrdiff_t) n - 1]) ++n;
+    return n;
+}
+
+
+static bool vlAppendEntry(VLTopLevel** entries, size_t* count, size_t* capacity, VLTopLevel entry) {
+    if (*count == *capacity) {
+        size_t grown = *capacity ? *capacity * 2 : 64;
+        VLTopLevel* resized = realloc(*entries, grown * sizeof(VLTopLevel));
+        if (!resized) return false;
+        *entries = resized;
+        *capacity = grown;
+    }
+    (*entries)[(*count)++] = entry;
+    return true;
+}
+
+
+// The file's bytes as an owned copy; the file itself may well change again while we hold onto them
+static char* vlReadText(const char* path, size_t* size) {
+    VLSource source;
+    if (!vlLoadSource(&source, path)) return NULL;
+    char* text = malloc(source.size ? source.size : 1);
+    if (text) {
+        memcpy(text, source.data, source.size);
+        *size = source.size;
+    }
+    vlFreeSource(&source);
+    return text;
+}
+
+
+typedef struct {
+    VLIncrementalUnit state;
+    const char* path;
+    const char* name;
+    int wd;
+    bool pending;
+} VLWatchedFile;
+
+
+static void vlRefresh(VLWatchedFile* file, FILE* out) {
+    size_t size = 0;
+    char* text = vlReadText(file->path, &size);
+    if (!text) {
+        fprintf(out, VL_ANSI_RED "Error: Unable to load file '%s'." VL_ANSI_RESET "\n", file->path);
+        return;
+    }
+
+    struct timespec start, stop;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    VLReparseStats stats;
+    bool ok = vlUpdateIncremental(&file->state, text, size, file->path, out, &stats);
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+
+    double micros = (double) (stop.tv_sec - start.tv_sec) * 1e6 + (double) (stop.tv_nsec - start.tv_nsec) / 1e3;
+    if (ok) {
+        fprintf(out, "%s: reparsed %zu of %zu statements (%zu bytes relexed) in %.1f us\n", file->path,
+                stats.reparsed, stats.reparsed + stats.reused, stats.relexedBytes, micros);
+    } else {
+        fprintf(out, "%s: failed after relexing %zu bytes in %.1f us\n", file->path, stats.relexedBytes, micros);
+    }
+}
+
+
+// ---- FUNCTIONS ---- //
+
+void vlInitIncremental(VLIncrementalUnit* unit) {
+    VLIncrementalUnit init = {0};
+    *unit = init;
+    vlInitParser(&unit->parser, NULL, 0);
+
+    // Reused statements outlive the text they were parsed from, so their strings can't point into it
+    unit->parser.copyStrings = true;
+}
+
+
+void vlFreeIncremental(VLIncrementalUnit* unit) {
+    free(unit->text);
+    free(unit->entries);
+    vlFreeParser(&unit->parser);
+    unit->text = NULL;
+    unit->entries = NULL;
+    unit->size = unit->count = unit->capacity = 0;
+}
+
+
+bool vlUpdateIncremental(VLIncrementalUnit* unit, char* text, size_t size, const char* path, FILE* out,
+                         VLReparseStats* stats) {
+    VLReparseStats init = {0};
+    *stats = init;
+
+    // Replaced trees stay in the arena, so once they dominate it, start over with a fresh parse
+    if (unit->count && unit->parser.arena.stats.bytesUsed > VL_ARENA_WASTE_FACTOR * unit->liveBytes) {
+        vlFreeIncremental(unit);
+        vlInitIncremental(unit);
+    }
+
+    // inotify only says that a file changed, so find the changed range by trimming what's the same
+    const char* old = unit->text ? unit->text : "";
+    size_t oldSize = unit->size;
+    size_t limit = oldSize < size ? oldSize : size;
+    size_t prefix = vlCommonPrefix(old, text, limit);
+    if (prefix == size && size == oldSize) {
+        free(text);
+        stats->reused = unit->count;
+        unit->ok = true;
+        return true;
+    }
+    size_t suffix = vlCommonSuffix(old + oldSize, text + size, limit - prefix);
+    size_t changedEnd = size - suffix;
+    ptrdiff_t delta = (ptrdiff_t) size - (ptrdiff_t) oldSize;
+
+    // Restart from the last statement that starts before the edit rather than the one containing it,
+    // so that something like an `else` typed at the start of a statement still finds its `if`.
+    size_t low = 0, high = unit->count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (unit->entries[mid].start < prefix) low = mid + 1;
+        else high = mid;
+    }
+    size_t first = low ? low - 1 : 0;
+    size_t restart = first ? unit->entries[first].start : 0;
+    size_t line = first ? unit->entries[first].line : 1;
+
+    VLParser* parser = &unit->parser;
+    parser->source = text;
+    parser->cursor = text + restart;
+    parser->end = text + size;
+    parser->status = VL_STATUS_OK;
+    parser->errorPos = VL_NO_POS;
+
+    // The token left over from the last update points into the old text, so don't let an error read it
+    VLToken startToken = {.kind = VL_TOKEN_EOF, .pos = restart};
+    parser->token = startToken;
+    vlGrabToken(parser);
+
+    // Parse until a statement starts past the edit exactly where an old one did; from there on the
+    // text, and so every token and statement, is the same as before, just moved by delta.
+    VLTopLevel* fresh = NULL;
+    size_t freshCount = 0, freshCapacity = 0;
+    size_t synced = unit->count;
+    size_t search = first;
+    size_t linePos = restart;
+    while (parser->status == VL_STATUS_OK) {
+        size_t pos = parser->token.pos;
+        line += vlCountLines(text + linePos, text + pos);
+        linePos = pos;
+        if (parser->token.kind == VL_TOKEN_EOF) break;
+
+        if (pos >= changedEnd) {
+            size_t oldPos = (size_t) ((ptrdiff_t) pos - delta);
+            while (search < unit->count && unit->entries[search].start < oldPos) ++search;
+            if (search < unit->count && unit->entries[search].start == oldPos) {
+                synced = search;
+                break;
+            }
+        }
+
+        VLStatement* stmt = vlParseStatement(parser);
+        if (!stmt) break;
+        VLTopLevel entry = {.stmt = stmt, .start = pos, .end = parser->token.pos, .line = line};
+        if (!vlAppendEntry(&fresh, &freshCount, &freshCapacity, entry)) parser->status = VL_STATUS_OUT_OF_MEM;
+    }
+
+    stats->reparsed = freshCount;
+    if (parser->status != VL_STATUS_OK) {
+        size_t pos = vlErrorPos(parser) > linePos ? vlErrorPos(parser) : linePos;
+        if (pos > size) pos = size;
+        line += vlCountLines(text + linePos, text + pos);
+        size_t lineStart = pos;
+        while (lineStart > 0 && text[lineStart - 1] != '\n') --lineStart;
+        fprintf(out, "%s:%zu:%zu: ", path, line, pos - lineStart + 1);
+        vlReportStatus(out, parser);
+
+        stats->relexedBytes = pos - restart;
+        free(fresh);
+        free(text);
+        unit->ok = false;
+        return false;
+    }
+    stats->relexedBytes = linePos - restart;
+
+    // Splice: old entries before the restart, then the fresh ones, then the old tail moved into place
+    size_t tail = unit->count - synced;
+    size_t total = first + freshCount + tail;
+    if (total > unit->capacity) {
+        VLTopLevel* entries = realloc(unit->entries, total * sizeof(VLTopLevel));
+        if (!entries) {
+            free(fresh);
+            free(text);
+            parser->status = VL_STATUS_OUT_OF_MEM;
+            vlReportStatus(out, parser);
+            unit->ok = false;
+            return false;
+        }
+        unit->entries = entries;
+        unit->capacity = total;
+    }
+
+    ptrdiff_t lineDelta = tail ? (ptrdiff_t) line - (ptrdiff_t) unit->entries[synced].line : 0;
+    memmove(unit->entries + first + freshCount, unit->entries + synced, tail * sizeof(VLTopLevel));
+    for (size_t i = first + freshCount; i < total; ++i) {
+        VLTopLevel* entry = &unit->entries[i];
+        entry->start = (size_t) ((ptrdiff_t) entry->start + delta);
+        entry->end = (size_t) ((ptrdiff_t) entry->end + delta);
+        entry->line = (size_t) ((ptrdiff_t) entry->line + lineDelta);
+        entry->shift += delta;
+    }
+    if (freshCount) memcpy(unit->entries + first, fresh, freshCount * sizeof(VLTopLevel));
+    free(fresh);
+
+    unit->count = total;
+    free(unit->text);
+    unit->text = text;
+    unit->size = size;
+    unit->ok = true;
+    if (first == 0 && tail == 0) unit->liveBytes = parser->arena.stats.bytesUsed;
+    stats->reused = first + tail;
+    return true;
+}
+
+
+bool vlWatch(VLBuild* build, FILE* out) {
+    int fd = inotify_init1(IN_CLOEXEC);
+    if (fd < 0) {
+        fprintf(out, VL_ANSI_RED "Error: Unable to start watching files." VL_ANSI_RESET "\n");
+        return false;
+    }
+
+    VLWatchedFile* files = calloc(build->count ? build->count : 1, sizeof(VLWatchedFile));
+    if (!files) {
+        close(fd);
+        return false;
+    }
+
+    // Editors often save by renaming over the old file, so watch each file's directory, not the file
+    bool ok = true;
+    size_t watched = 0;
+    for (; watched < build->count && ok; ++watched) {
+        VLWatchedFile* file = &files[watched];
+        file->path = build->units[watched].path;
+        const char* slash = strrchr(file->path, '/');
+        file->name = slash ? slash + 1 : file->path;
+
+        char* dir = slash ? strndup(file->path, (size_t) (slash - file->path)) : strdup(".");
+        file->wd = dir ? inotify_add_watch(fd, *dir ? dir : "/", IN_CLOSE_WRITE | IN_MOVED_TO) : -1;
+        if (file->wd < 0) {
+            fprintf(out, VL_ANSI_RED "Error: Unable to watch '%s'." VL_ANSI_RESET "\n", file->path);
+            ok = false;
+        }
+        free(dir);
+
+        vlInitIncremental(&file->state);
+        if (ok) vlRefresh(file, out);
+    }
+    fflush(out);
+
+    alignas(struct inotify_event) char buffer[4096];
+    while (ok) {
+        ssize_t len = read(fd, buffer, sizeof(buffer));
+        if (len < 0 && errno == EINTR) continue;
+        if (len <= 0) break;
+
+        // Mark first and refresh after, so a burst of events on one file costs one reparse
+        for (char* p = buffer; p < buffer + len;) {
+            const struct inotify_event* event = (const struct inotify_event*) p;
+            for (size_t i = 0; event->len && i < watched; ++i) {
+                if (files[i].wd == event->wd && !strcmp(files[i].name, event->name)) files[i].pending = true;
+            }
+            p += sizeof(struct inotify_event) + event->len;
+        }
+        for (size_t i = 0; i < watched; ++i) {
+            if (!files[i].pending) continue;
+            files[i].pending = false;
+            vlRefresh(&files[i], out);
+        }
+        fflush(out);
+    }
+
+    for (size_t i = 0; i < watched; ++i) vlFreeIncremental(&files[i].state);
+    free(files);
+    close(fd);
+    return ok;
+}
@@ -0,0 +1,94 @@
+/* ================
+ * test/literals.c
+ * VALLEY LANGUAGE COMPILER
+ * Integer literals on both sides of each type's range
+ * ================
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/valley.h"
+
+
+typedef struct VLLiteralCase {
+    const char* source;
+    VLStatus status;
+    VLExprKind kind;
+    int64_t value;
+} VLLiteralCase;
+
+
+static bool vlIntegerOfExpr(const VLExpression* expr, int64_t* value) {
+    switch (expr->kind) {
+        case VL_EXPR_BYTE:  *value = expr->byteValue; return true;
+        case VL_EXPR_SHORT: *value = expr->shortValue; return true;
+        case VL_EXPR_INT:   *value = expr->intValue; return true;
+        case VL_EXPR_LONG:  *value = expr->longValue; return true;
+        default:            return false;
+    }
+}
+
+
+static bool vlRunCase(const VLLiteralCase* test) {
+    VLParser parser;
+    vlInitParser(&parser, test->source, strlen(test->source));
+    VLExpression* expr = NULL;
+    if (vlNextToken(&parser)) expr = vlParseExpr(&parser, VL_TYPE_VOID, false, true, false);
+
+    // Accepted literals have to fold all the way down to the value, including the negated minimums
+    int64_t value = 0;
+    bool ok = parser.status == test->status;
+    if (ok && test->status == VL_STATUS_OK) {
+        ok = expr && expr->kind == test->kind && vlIntegerOfExpr(expr, &value) && value == test->value;
+    }
+
+    if (!ok) {
+        printf("%-34s FAILED: status %d, expected %d", test->source, (int) parser.status, (int) test->status);
+        if (test->status == VL_STATUS_OK) {
+            printf(", value %lld, expected %lld", (long long) value, (long long) test->value);
+        }
+        printf("\n");
+    }
+    vlFreeParser(&parser);
+    return ok;
+}
+
+
+int main(void) {
+    static const VLLiteralCase cases[] = {
+        {"127b", VL_STATUS_OK, VL_EXPR_BYTE, INT8_MAX},
+        {"128b", VL_STATUS_OVERFLOW, 0, 0},
+        {"-128b", VL_STATUS_OK, VL_EXPR_BYTE, INT8_MIN},
+        {"-129b", VL_STATUS_OVERFLOW, 0, 0},
+        {"-(128b)", VL_STATUS_OVERFLOW, 0, 0},
+        {"1b - 128b", VL_STATUS_OVERFLOW, 0, 0},
+
+        {"32767s", VL_STATUS_OK, VL_EXPR_SHORT, INT16_MAX},
+        {"32768s", VL_STATUS_OVERFLOW, 0, 0},
+        {"-32768s", VL_STATUS_OK, VL_EXPR_SHORT, INT16_MIN},
+        {"-32769s", VL_STATUS_OVERFLOW, 0, 0},
+        {"-(32768s)", VL_STATUS_OVERFLOW, 0, 0},
+        {"1s - 32768s", VL_STATUS_OVERFLOW, 0, 0},
+
+        {"2147483647", VL_STATUS_OK, VL_EXPR_INT, INT32_MAX},
+        {"2147483648", VL_STATUS_OVERFLOW, 0, 0},
+        {"-2147483648", VL_STATUS_OK, VL_EXPR_INT, INT32_MIN},
+        {"-2147483649", VL_STATUS_OVERFLOW, 0, 0},
+        {"-(2147483648)", VL_STATUS_OVERFLOW, 0, 0},
+        {"1 - 2147483648", VL_STATUS_OVERFLOW, 0, 0},
+
+        {"9223372036854775807l", VL_STATUS_OK, VL_EXPR_LONG, INT64_MAX},
+        {"9223372036854775808l", VL_STATUS_OVERFLOW, 0, 0},
+        {"-9223372036854775808l", VL_STATUS_OK, VL_EXPR_LONG, INT64_MIN},
+        {"-9223372036854775809l", VL_STATUS_OVERFLOW, 0, 0},
+        {"-(9223372036854775808l)", VL_STATUS_OVERFLOW, 0, 0},
+        {"1l - 9223372036854775808l", VL_STATUS_OVERFLOW, 0, 0},
+    };
+
+    size_t failed = 0;
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) failed += !vlRunCase(&cases[i]);
+    printf("%zu of %zu literal cases passed\n", sizeof(cases) / sizeof(cases[0]) - failed,
+           sizeof(cases) / sizeof(cases[0]));
+    return failed ? 1 : 0;
+}
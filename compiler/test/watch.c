@@ -0,0 +1,115 @@
+/* ================
+ * test/watch.c
+ * VALLEY LANGUAGE COMPILER
+ * Incremental reparsing across edits that break and repair a file
+ * ================
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/watch.h"
+
+
+typedef struct VLWatchTest {
+    VLIncrementalUnit unit;
+    VLReparseStats stats;
+    char report[512];
+    bool ok;
+} VLWatchTest;
+
+
+// Hands a copy of source to the unit as the file's new contents, keeping whatever it printed
+static void vlTestUpdate(VLWatchTest* test, const char* source) {
+    size_t size = strlen(source);
+    char* text = malloc(size + 1);
+    if (!text) {
+        printf("Out of memory.\n");
+        exit(1);
+    }
+    memcpy(text, source, size + 1);
+
+    FILE* out = fmemopen(test->report, sizeof(test->report), "w");
+    if (!out) {
+        printf("Unable to capture output.\n");
+        exit(1);
+    }
+    memset(test->report, 0, sizeof(test->report));
+    test->ok = vlUpdateIncremental(&test->unit, text, size, "t.vl", out, &test->stats);
+    fclose(out);
+}
+
+
+static bool vlExpect(bool condition, const char* name, const char* what, const VLWatchTest* test) {
+    if (!condition) printf("%-28s FAILED: %s\n  output: %s\n", name, what, test->report);
+    return condition;
+}
+
+
+// ---- TESTS ---- //
+
+static const char* vlClean = "int first = 1;\nint second = 2;\nint third = 3;\nint fourth = 4;\n";
+
+
+static bool vlTestLexErrorAdded(void) {
+    static const char* name = "lex-error-added";
+    VLWatchTest test = {0};
+    vlInitIncremental(&test.unit);
+    vlTestUpdate(&test, vlClean);
+    bool ok = vlExpect(test.ok && test.unit.count == 4, name, "clean parse", &test);
+
+    // The edit is at the very start, so the first token of the restart is the one that fails
+    vlTestUpdate(&test, "$");
+    ok &= vlExpect(!test.ok, name, "error reported", &test);
+    ok &= vlExpect(strncmp(test.report, "t.vl:1:1: ", 10) == 0, name, "located at 1:1", &test);
+    ok &= vlExpect(strstr(test.report, "unexpected '$'") != NULL, name, "names the character", &test);
+    ok &= vlExpect(test.unit.count == 4, name, "last good parse kept", &test);
+
+    // Further into the file the error sits at the character, not at the token before it
+    vlTestUpdate(&test, "int first = 1;\nint second = 2 # 5;\nint third = 3;\nint fourth = 4;\n");
+    ok &= vlExpect(!test.ok, name, "error reported", &test);
+    ok &= vlExpect(strncmp(test.report, "t.vl:2:16: ", 11) == 0, name, "located at 2:16", &test);
+
+    vlFreeIncremental(&test.unit);
+    return ok;
+}
+
+
+static bool vlTestLexErrorRemoved(void) {
+    static const char* name = "lex-error-removed";
+    VLWatchTest test = {0};
+    vlInitIncremental(&test.unit);
+    vlTestUpdate(&test, vlClean);
+    vlTestUpdate(&test, "int first = 1;\nint second = \"2;\nint third = 3;\nint fourth = 4;\n");
+    bool ok = vlExpect(!test.ok, name, "error reported", &test);
+    ok &= vlExpect(strncmp(test.report, "t.vl:2:14: ", 11) == 0, name, "located at 2:14", &test);
+
+    // Repairing it only reparses around the edit and splices the rest back in
+    vlTestUpdate(&test, "int first = 1;\nint second = 22;\nint third = 3;\nint fourth = 4;\n");
+    ok &= vlExpect(test.ok && test.report[0] == '\0', name, "clean after repair", &test);
+    ok &= vlExpect(test.unit.count == 4, name, "all statements present", &test);
+    ok &= vlExpect(test.stats.reused > 0, name, "untouched statements reused", &test);
+    ok &= vlExpect(test.unit.entries[3].line == 4, name, "lines carried over", &test);
+
+    vlFreeIncremental(&test.unit);
+    return ok;
+}
+
+
+int main(void) {
+    static const struct {
+        const char* name;
+        bool (*run)(void);
+    } tests[] = {
+        {"lex-error-added", vlTestLexErrorAdded},
+        {"lex-error-removed", vlTestLexErrorRemoved},
+    };
+
+    bool ok = true;
+    for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); ++i) {
+        bool passed = tests[i].run();
+        printf("%-28s %s\n", tests[i].name, passed ? "ok" : "FAILED");
+        ok &= passed;
+    }
+    return ok ? 0 : 1;
+}